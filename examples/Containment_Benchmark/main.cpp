@@ -0,0 +1,125 @@
+#include "setup.h"
+#include <chrono>
+#include <iomanip>
+#include <random>
+// Compares Layer::getGeometryContainmentRelation, which looks the candidate
+// parents up from a grid of bounding boxes, with the pairwise scan it
+// replaced, on a layer of mixed circles, rectangles, ellipses and triangles
+// inside two large containers. The program fails if any parent differs.
+// usage: ./main [number of patterns]
+using namespace RCWA;
+
+// the center checked when the pattern is a child
+void getCenter(const Pattern& pattern, double center[2]){
+  center[0] = pattern.arg1_.first;
+  center[1] = pattern.type_ == CIRCLE_ ? pattern.arg2_.first : pattern.arg1_.second;
+}
+
+// whether the center of pattern2 lies in pattern1
+bool isContained(const Pattern& pattern1, const Pattern& pattern2){
+  double center1[2], center2[2];
+  getCenter(pattern1, center1);
+  getCenter(pattern2, center2);
+  switch (pattern1.type_) {
+    case RECTANGLE_:{
+      double width[2] = {pattern1.arg2_.first, pattern1.arg2_.second};
+      return isContainedInRectangle(center1, center2, width);
+    }
+    case CIRCLE_: return isContainedInCircle(center1, center2, pattern1.arg1_.second);
+    case ELLIPSE_: return isContainedInEllipse(center1, center2, pattern1.arg2_.first, pattern1.arg2_.second);
+    case POLYGON_: return isContainedInPolygon(center1, center2, pattern1.edgeList_);
+    default: return false;
+  }
+}
+
+// the pairwise scan, every pattern against every larger one
+std::vector<int> getParentsPairwise(const PatternVec& patterns){
+  std::vector< std::pair<int, double> > areaVec;
+  for(size_t i = 0; i < patterns.size(); i++){
+    areaVec.push_back(std::make_pair(i, patterns[i].area));
+  }
+  std::sort(
+    areaVec.begin(),
+    areaVec.end(),
+    [](const std::pair<int, double>& lhs, const std::pair<int, double>& rhs) {
+           return lhs.second < rhs.second; }
+  );
+  std::vector<int> parents(patterns.size(), -1);
+  for(size_t i = 0; i < areaVec.size(); i++){
+    for(size_t j = i + 1; j < areaVec.size(); j++){
+      if(isContained(patterns[areaVec[j].first], patterns[areaVec[i].first])){
+        parents[areaVec[i].first] = areaVec[j].first;
+        break;
+      }
+    }
+  }
+  return parents;
+}
+
+double seconds(const std::chrono::steady_clock::time_point& start){
+  return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+int main(int argc, char** argv){
+  int numOfPattern = 10000;
+  if(argc > 1) numOfPattern = atoi(argv[1]);
+  Ptr<Material> material = Material::instanceNew("Drude", DispersionModel());
+  Ptr<Layer> layer = Layer::instanceNew("slab", material, 1e-6);
+
+  // two containers splitting the unit cell, then one in five shapes is a
+  // medium one and the rest are small ones, many of them inside the others
+  double left[2] = {-0.25, 0}, right[2] = {0.25, 0}, leftWidth[2] = {0.49, 0.98};
+  double rightHalf[2] = {0.24, 0.485};
+  layer->addRectanglePattern(material, left, 0, leftWidth);
+  layer->addEllipsePattern(material, right, 0, rightHalf);
+  std::mt19937 generator(1);
+  std::uniform_real_distribution<double> position(-0.5, 0.5), scale(0.5, 1.5);
+  for(int i = 2; i < numOfPattern; i++){
+    double center[2] = {position(generator), position(generator)};
+    double size = (i % 5 == 0 ? 0.03 : 0.004) * scale(generator);
+    switch (i % 4) {
+      case 0: layer->addCirclePattern(material, center, size); break;
+      case 1:{
+        double width[2] = {2 * size, size * scale(generator)};
+        layer->addRectanglePattern(material, center, 0, width);
+        break;
+      }
+      case 2:{
+        double halfwidth[2] = {size, size * scale(generator)};
+        layer->addEllipsePattern(material, center, 0, halfwidth);
+        break;
+      }
+      case 3:{
+        double** edgePoints = new double*[3];
+        for(int k = 0; k < 3; k++){
+          double theta = 2 * datum::pi * k / 3 + scale(generator);
+          edgePoints[k] = new double[2];
+          edgePoints[k][0] = size * std::cos(theta);
+          edgePoints[k][1] = size * std::sin(theta);
+        }
+        layer->addPolygonPattern(material, center, 0, edgePoints, 3);
+        for(int k = 0; k < 3; k++) delete [] edgePoints[k];
+        delete [] edgePoints;
+        break;
+      }
+    }
+  }
+  PatternVec patterns(layer->getPatternsBegin(), layer->getPatternsEnd());
+
+  auto start = std::chrono::steady_clock::now();
+  std::vector<int> expected = getParentsPairwise(patterns);
+  double pairwiseTime = seconds(start);
+  start = std::chrono::steady_clock::now();
+  layer->getGeometryContainmentRelation();
+  double gridTime = seconds(start);
+
+  int numOfMismatch = 0, numOfChild = 0, count = 0;
+  for(const_PatternIter it = layer->getPatternsBegin(); it != layer->getPatternsEnd(); it++, count++){
+    if(it->parent != expected[count]) numOfMismatch++;
+    if(it->parent != -1) numOfChild++;
+  }
+  std::cout << "patterns: " << count << ", with a parent: " << numOfChild << std::endl;
+  std::cout << std::setw(12) << "pairwise (s)" << std::setw(12) << "grid (s)" << std::setw(12) << "mismatches" << std::endl;
+  std::cout << std::setw(12) << pairwiseTime << std::setw(12) << gridTime << std::setw(12) << numOfMismatch << std::endl;
+  return numOfMismatch == 0 ? 0 : 1;
+}
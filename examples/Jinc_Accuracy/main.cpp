@@ -0,0 +1,61 @@
+#include "setup.h"
+#include <iomanip>
+// Compares RCWA::jinc, the rational approximation used by the circle and
+// ellipse transforms, with J1(x) / x from bessjy01a it replaced. The sweep
+// covers (0, 200] on both sides of x = 5, where jinc switches to its
+// asymptotic form, and of x = 12, where bessjy01a does, and x = 0, where
+// jinc is 1/2. The program fails if any error exceeds the tolerance.
+// usage: ./main [number of points]
+double reference(const double x){
+  if(x == 0) return 0.5;
+  double j0, j1, y0, y1, j0p, j1p, y0p, y1p;
+  bessjy01a(x, j0, j1, y0, y1, j0p, j1p, y0p, y1p);
+  return j1 / x;
+}
+
+int main(int argc, char** argv){
+  int numOfPoint = 200000;
+  if(argc > 1) numOfPoint = atoi(argv[1]);
+  const double maxX = 200, tolerance = 1e-12;
+
+  // a uniform sweep, plus points packed around the switching arguments
+  std::vector<double> x(1, 0.0);
+  for(int i = 1; i <= numOfPoint; i++) x.push_back(maxX * i / numOfPoint);
+  const double edges[] = {5.0, 12.0};
+  for(int e = 0; e < 2; e++){
+    for(int k = -1000; k <= 1000; k++) x.push_back(edges[e] + k * 1e-6);
+    x.push_back(std::nextafter(edges[e], 0.0));
+    x.push_back(std::nextafter(edges[e], maxX));
+  }
+  std::vector<double> result(x.size());
+  jinc(x.data(), result.data(), x.size());
+
+  // the largest absolute error on each interval
+  const double bounds[] = {0, 5, 12, maxX};
+  const char* names[] = {"[0, 5]", "(5, 12]", "(12, 200]"};
+  double maxError[3] = {0, 0, 0}, worstX[3] = {0, 0, 0};
+  for(size_t i = 0; i < x.size(); i++){
+    double error = std::abs(result[i] - reference(x[i]));
+    int interval = x[i] <= bounds[1] ? 0 : (x[i] <= bounds[2] ? 1 : 2);
+    if(error > maxError[interval]){
+      maxError[interval] = error;
+      worstX[interval] = x[i];
+    }
+    if(jinc(x[i]) != result[i]){
+      std::cerr << "scalar and array jinc differ at x = " << x[i] << std::endl;
+      return 1;
+    }
+  }
+
+  std::cout << std::setw(12) << "interval" << std::setw(16) << "max error" << std::setw(16) << "at x" << std::endl;
+  bool passed = true;
+  for(int i = 0; i < 3; i++){
+    std::cout << std::setw(12) << names[i] << std::setw(16) << std::setprecision(4) << maxError[i]
+      << std::setw(16) << std::setprecision(10) << worstX[i] << std::endl;
+    passed = passed && maxError[i] < tolerance;
+  }
+  std::cout << "jinc(0) = " << std::setprecision(17) << result[0] << std::endl;
+  passed = passed && result[0] == 0.5;
+  std::cout << (passed ? "passed" : "failed") << " with tolerance " << std::setprecision(3) << tolerance << std::endl;
+  return passed ? 0 : 1;
+}
@@ -0,0 +1,98 @@
+#include "setup.h"
+#include "Profile.h"
+#include <chrono>
+#include <iomanip>
+// Compares the S matrix propogation of getSMatrices, which keeps the four 2N
+// blocks separately and applies the diagonal F matrices as scalings, with the
+// full 4N x 4N propogation it replaced. Both take the same interface matrices,
+// so only the work per interface is compared.
+// usage: ./main [number of layers]
+using namespace RCWA;
+
+// the full 4N x 4N propogation, as it was before the blocks were separated
+void getSMatricesFull(const int N, const int numOfLayer, const RCWAcMatrices& interfaceUp,
+  const RCWAcMatrices& FMatrices, RCWAcMatrices& SMatrices){
+  int r1 = 0, r2 = 2*N -1, r3 = 2*N, r4 = 4*N -1;
+  SMatrices.assign(numOfLayer, eye<RCWAcMatrix>(4*N, 4*N));
+  for(int i = 0; i < numOfLayer - 1; i++){
+    const RCWAcMatrix& I = interfaceUp[i];
+    RCWAcMatrix leftTop = I(span(r1, r2), span(r1, r2));
+    RCWAcMatrix rightTop = I(span(r1, r2), span(r3, r4));
+    RCWAcMatrix leftBottom = I(span(r3, r4), span(r1, r2));
+    RCWAcMatrix rightBottom = I(span(r3, r4), span(r3, r4));
+
+    SMatrices[i+1](span(r1, r2), span(r1, r2)) = solve(
+      leftTop - FMatrices[i] * SMatrices[i](span(r1, r2), span(r3, r4)) * leftBottom,
+      FMatrices[i],
+      solve_opts::fast
+    ) * SMatrices[i](span(r1, r2), span(r1,r2));
+
+    SMatrices[i+1](span(r1, r2), span(r3, r4)) = solve(
+      leftTop - FMatrices[i] * SMatrices[i](span(r1, r2), span(r3, r4)) * leftBottom,
+      FMatrices[i] * SMatrices[i](span(r1, r2), span(r3,r4)) * rightBottom - rightTop,
+      solve_opts::fast
+    ) * FMatrices[i+1];
+
+    SMatrices[i+1](span(r3,r4), span(r1,r2)) = SMatrices[i](span(r3,r4), span(r1,r2)) +
+      SMatrices[i](span(r3,r4), span(r3,r4)) * leftBottom * SMatrices[i+1](span(r1,r2), span(r1,r2));
+
+    SMatrices[i+1](span(r3,r4), span(r3,r4)) = SMatrices[i](span(r3,r4), span(r3,r4)) *
+      (leftBottom * SMatrices[i+1](span(r1,r2), span(r3,r4)) + rightBottom * FMatrices[i+1]);
+  }
+}
+
+double seconds(const std::chrono::steady_clock::time_point& start){
+  return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+int main(int argc, char** argv){
+  int numOfLayer = 20;
+  if(argc > 1) numOfLayer = atoi(argv[1]);
+  std::vector<int> Ns = {25, 50, 100, 200};
+  arma_rng::set_seed(1);
+
+  std::cout << "layers: " << numOfLayer << std::endl;
+  std::cout << std::setw(6) << "N" << std::setw(14) << "full (s)" << std::setw(14) << "blocks (s)"
+    << std::setw(16) << "full GFlop" << std::setw(16) << "blocks GFlop" << std::setw(14) << "difference" << std::endl;
+  for(size_t n = 0; n < Ns.size(); n++){
+    int N = Ns[n];
+    // M = [A, -A; V, V] as in poyntingFlux, and diagonal F with decaying phases
+    RCWAcMatrices MMatrices(numOfLayer), FMatrices(numOfLayer);
+    for(int i = 0; i < numOfLayer; i++){
+      RCWAcMatrix A = eye<RCWAcMatrix>(2*N, 2*N) + 0.1 * randu<RCWAcMatrix>(2*N, 2*N);
+      RCWAcMatrix V = eye<RCWAcMatrix>(2*N, 2*N) + 0.1 * randu<RCWAcMatrix>(2*N, 2*N);
+      MMatrices[i] = join_vert(join_horiz(A, -A), join_horiz(V, V));
+      FMatrices[i] = diagmat(exp(dcomplex(-0.1, 1) * randu<vec>(2*N)));
+    }
+    LUFactors factors;
+    Interfaces interfaces;
+    getInterfaceMatrices(MMatrices, FMatrices, numOfLayer, 0, 0, nullptr, factors, interfaces);
+    RCWAcMatrices interfaceUp(numOfLayer - 1);
+    for(int i = 0; i < numOfLayer - 1; i++) interfaceUp[i] = interfaces.up[interfaces.upIdx[i]];
+
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    RCWAcMatrices full;
+    getSMatricesFull(N, numOfLayer, interfaceUp, FMatrices, full);
+    double timeFull = seconds(start);
+
+    start = std::chrono::steady_clock::now();
+    SMatrixList blocks;
+    getSMatrices(0, N, numOfLayer, MMatrices, FMatrices, blocks, UP_, &interfaces);
+    double timeBlocks = seconds(start);
+
+    // per interface, the full propogation solves the same 2N system twice and takes
+    // 15 products with dense F, the blocks solve it once with both right hand sides
+    // and take 6 products
+    int numOfStep = numOfLayer - 1;
+    double flopsFull = numOfStep * (2 * PROFILE::solveFlops(2*N, 2*N) + 15 * PROFILE::gemmFlops(2*N, 2*N, 2*N));
+    double flopsBlocks = numOfStep * (PROFILE::solveFlops(2*N, 4*N) + 6 * PROFILE::gemmFlops(2*N, 2*N, 2*N));
+    const RCWAcMatrix& last = full[numOfLayer-1];
+    double difference = norm(last(span(2*N, 4*N-1), span(0, 2*N-1)) - blocks[numOfLayer-1].S21) /
+      norm(blocks[numOfLayer-1].S21);
+
+    std::cout << std::setw(6) << N << std::setw(14) << std::fixed << std::setprecision(3) << timeFull
+      << std::setw(14) << timeBlocks << std::setw(16) << flopsFull / 1e9 << std::setw(16) << flopsBlocks / 1e9
+      << std::setw(14) << std::scientific << std::setprecision(2) << difference << std::endl;
+  }
+  return 0;
+}
@@ -0,0 +1,69 @@
+#include "setup.h"
+#include <chrono>
+#include <iomanip>
+// Compares the thread policies of SetThread for a patterned silicon layer of
+// growing number of G, on a coarse and a fine k grid. Auto never threads
+// LAPACK, so the crossover to Split or InsideLAPACK as the matrices grow and
+// the number of k points per thread drops is measured here for a machine.
+// usage: ./main [number of threads]
+double run(const int nG, const int numOfK, const int thread, const std::string& policy){
+  Ptr<SimulationPattern> s = SimulationPattern::instanceNew();
+  s->setLattice(1e-6, 1e-6, 90);
+  s->setNumOfG(nG);
+
+  // two frequencies around the silicon plasma frequency
+  std::vector<double> omega = {1e14, 2e14};
+  std::vector< std::vector<double> > vacuum(omega.size(), std::vector<double>{1, 1e-10});
+  DispersionModel drude;
+  drude.epsInf = 11.7;
+  drude.omegaP = 3e14;
+  drude.gammaP = 1e13;
+  s->setOmega(omega);
+  s->addMaterial("Si", drude);
+  s->addMaterial("Vacuum", omega, vacuum);
+
+  s->addLayer("SiBottom", 0, "Si");
+  s->addLayer("VacGap", 1e-6, "Vacuum");
+  s->addLayer("SiGrating", 1e-6, "Vacuum");
+  s->setLayerPatternCircle("SiGrating", "Si", 5e-7, 5e-7, 3e-7);
+  s->addLayer("SiTop", 0, "Si");
+  s->setSourceLayer("SiBottom");
+  s->setProbeLayer("VacGap");
+
+  s->setKxIntegralSym(numOfK, 2);
+  s->setKyIntegralSym(numOfK, 2);
+  s->setThread(thread, policy);
+  s->initSimulation();
+
+  std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+  s->integrateKxKy();
+  return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+int main(int argc, char** argv){
+  int thread = 1;
+  #if defined(_OPENMP)
+    thread = omp_get_max_threads();
+  #endif
+  if(argc > 1) thread = atoi(argv[1]);
+  std::vector<int> nGs = {25, 50, 100, 200, 400};
+  std::vector<int> numOfKs = {2, 8};
+  std::vector<std::string> policies = {"OverK", "InsideLAPACK", "Split", "Auto"};
+
+  std::cout << "threads: " << thread << std::endl;
+  std::cout << std::setw(6) << "nG" << std::setw(10) << "k points";
+  for(size_t i = 0; i < policies.size(); i++){
+    std::cout << std::setw(14) << policies[i];
+  }
+  std::cout << std::endl;
+  for(size_t i = 0; i < nGs.size(); i++){
+    for(size_t j = 0; j < numOfKs.size(); j++){
+      std::cout << std::setw(6) << nGs[i] << std::setw(10) << numOfKs[j] * numOfKs[j];
+      for(size_t k = 0; k < policies.size(); k++){
+        std::cout << std::setw(14) << std::fixed << std::setprecision(3) << run(nGs[i], numOfKs[j], thread, policies[k]);
+      }
+      std::cout << std::endl;
+    }
+  }
+  return 0;
+}
@@ -32,8 +32,9 @@ using UTILITY::PtrInterface;
 using UTILITY::NamedInterface;
 
 enum DIMENSION { NO_, ONE_, TWO_ };
-enum PATTERN {GRATING_, RECTANGLE_, CIRCLE_, ELLIPSE_, POLYGON_};
+enum PATTERN {GRATING_, RECTANGLE_, CIRCLE_, ELLIPSE_, POLYGON_, RASTER_, CIRCLES_, RECTANGLES_};
 enum EPSTYPE {SCALAR_, DIAGONAL_, TENSOR_};
+enum DISPERSION {TABULATED_, ANALYTIC_, UNIAXIAL_};
 enum POLARIZATION {TE_, TM_, BOTH_};
 enum TRUNCATION {CIRCULAR_, PARALLELOGRAMIC_};
 
@@ -64,6 +65,22 @@ struct EPSILON
   EPSTYPE type_;
 };
 
+// a Lorentz oscillator strength * omega0^2 / (omega0^2 - omega^2 - i * gamma * omega)
+typedef struct OSCILLATOR{
+  double strength = 0;
+  double omega0 = 0;
+  double gamma = 0;
+} Oscillator;
+
+// epsInf - omegaP^2 / (omega^2 + i * gammaP * omega) + sum of the oscillators
+// Drude: no oscillators, Lorentz: omegaP = 0, Drude-Lorentz: both
+typedef struct DISPERSIONMODEL{
+  double epsInf = 1;
+  double omegaP = 0;
+  double gammaP = 0;
+  std::vector<Oscillator> oscillators;
+} DispersionModel;
+
 typedef struct LATTICE{
   double bx[2] = {0, 0};
   double by[2] = {0, 0};
@@ -72,6 +89,8 @@ typedef struct LATTICE{
 } Lattice;
 
 typedef std::vector<bool> SourceList;
+typedef std::pair<int, double> Probe;
+typedef std::vector<Probe> ProbeList;
 typedef std::pair<double, double> LayerPattern;
 typedef std::vector<LayerPattern> EdgeList;
 #endif
\ No newline at end of file
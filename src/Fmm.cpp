@@ -19,6 +19,10 @@
 
  #include "Fmm.h"
  #include "Common.h"
+ #include <map>
+
+ // the number of shapes of an array pattern transformed together
+ #define ARRAY_BLOCK 256
 
  namespace FMM{
    /*==============================================*/
@@ -77,6 +81,76 @@
      }
    }
 
+  /*==============================================*/
+  // This function builds the table of G differences
+  // @args:
+  // Gx_mat: the Gx matrix
+  // Gy_mat: the Gy matrix
+  // table: the table (output)
+  /*==============================================*/
+  void getGDifferenceTable(
+    const RCWArMatrix& Gx_mat,
+    const RCWArMatrix& Gy_mat,
+    GDifferenceTable& table
+  ){
+    RCWArMatrix Gx_r, Gx_l, Gy_r, Gy_l;
+    meshGrid(Gx_mat, Gx_mat, Gx_r, Gx_l);
+    meshGrid(Gy_mat, Gy_mat, Gy_r, Gy_l);
+    table.GxMat = Gx_l - Gx_r;
+    table.GyMat = Gy_l - Gy_r;
+
+    // the differences are lattice vectors, so after rounding on a grid much
+    // finer than the lattice the equal ones share the same key
+    double scale = std::max(abs(table.GxMat).max(), abs(table.GyMat).max());
+    double tolerance = scale > 0 ? scale * 1e-9 : 1.0;
+    std::map< std::pair<long long, long long>, uword > keyMap;
+    std::vector<double> uniqueGx, uniqueGy;
+    keyMap[std::make_pair(0LL, 0LL)] = 0;
+    uniqueGx.push_back(0);
+    uniqueGy.push_back(0);
+
+    table.index.set_size(table.GxMat.n_elem);
+    for(uword i = 0; i < table.GxMat.n_elem; i++){
+      std::pair<long long, long long> key = std::make_pair(
+        std::llround(table.GxMat(i) / tolerance),
+        std::llround(table.GyMat(i) / tolerance)
+      );
+      std::map< std::pair<long long, long long>, uword >::const_iterator it = keyMap.find(key);
+      if(it == keyMap.cend()){
+        keyMap[key] = uniqueGx.size();
+        table.index(i) = uniqueGx.size();
+        uniqueGx.push_back(table.GxMat(i));
+        uniqueGy.push_back(table.GyMat(i));
+      }
+      else{
+        table.index(i) = it->second;
+      }
+    }
+    table.uniqueGx = RCWArVector(uniqueGx);
+    table.uniqueGy = RCWArVector(uniqueGy);
+  }
+
+  /*==============================================*/
+  // This function expands values given on the distinct differences to the
+  // full N x N matrix
+  // @args:
+  // table: the table of G differences
+  // uniqueVal: the values on uniqueGx and uniqueGy
+  /*==============================================*/
+  RCWAcMatrix expandGDifference(
+    const GDifferenceTable& table,
+    const RCWAcMatrix& uniqueVal
+  ){
+    RCWAcMatrix result(table.GxMat.n_rows, table.GxMat.n_cols);
+    const dcomplex* val = uniqueVal.memptr();
+    const uword* index = table.index.memptr();
+    dcomplex* out = result.memptr();
+    for(uword i = 0; i < result.n_elem; i++){
+      out[i] = val[index[i]];
+    }
+    return result;
+  }
+
   /*==============================================*/
    // helper function to do fourier transform for one value
    // @args:
@@ -122,17 +196,9 @@
      const double radius
    ){
      RCWArMatrix rho = sqrt(square(GxMat) + square(GyMat)) * radius;
-     RCWArMatrix jincMat = zeros<RCWArMatrix>( size(rho) );
-
-     RCWArMatrix::iterator jincMat_it = jincMat.begin();
-     int count = 0;
-     for(mat::const_iterator it = rho.begin(); it != rho.end(); it++){
-       *(jincMat_it + count) = jinc(*it);
-       count++;
-     }
-
+     RCWArMatrix jincMat(size(rho));
+     jinc(rho.memptr(), jincMat.memptr(), rho.n_elem);
      return 2 * datum::pi * POW2(radius) * jincMat;
-
    }
    /*==============================================*/
    // helper function to do fourier transform for one value
@@ -149,15 +215,8 @@
      const double b
    ){
      RCWArMatrix rho = sqrt( square(a * GxMat) + square(b * GyMat) );
-     RCWArMatrix jincMat = zeros<RCWArMatrix>( size(rho) );
-
-     RCWArMatrix::iterator jincMat_it = jincMat.begin();
-     int count = 0;
-     for(RCWArMatrix::const_iterator it = rho.begin(); it != rho.end(); it++){
-       *(jincMat_it + count) = jinc(*it);
-       count++;
-     }
-
+     RCWArMatrix jincMat(size(rho));
+     jinc(rho.memptr(), jincMat.memptr(), rho.n_elem);
      return 2 * datum::pi * a * b * jincMat;
    }
    /*==============================================*/
@@ -212,6 +271,187 @@
      return result;
    }
    /*==============================================*/
+   // helper function computing the Fourier transform of the pixels of a
+   // raster covered by one material, normalized by the area of the unit cell.
+   // Pixel (i, j) is the cell spanned by lattice1 / nx and lattice2 / ny at
+   // i / nx * lattice1 + j / ny * lattice2. Each G is written as
+   // m * b1 + n * b2 on the reciprocal lattice and reads the entry
+   // (m mod nx, n mod ny) of the inverse FFT of the mask, a sum over the
+   // pixel corners. The phase exp(i pi (m / nx + n / ny)) moves the corners
+   // to the pixel centers, and sinc(pi m / nx) sinc(pi n / ny) integrates
+   // over the pixel, so the transform is exact for the piecewise constant
+   // raster at every G, also beyond the Nyquist range of the mask
+   // @args:
+   // GxMat: the x components of G
+   // GyMat: the y components of G
+   // mask: 1 on the pixels covered by the material, nx by ny
+   // lattice1: the first lattice vector, along the rows of mask
+   // lattice2: the second lattice vector, along the columns of mask
+   /*==============================================*/
+   static RCWAcMatrix transformRasterElement(
+     const RCWArMatrix& GxMat,
+     const RCWArMatrix& GyMat,
+     const RCWArMatrix& mask,
+     const double lattice1[2],
+     const double lattice2[2]
+   ){
+     int nx = mask.n_rows, ny = mask.n_cols;
+     // maskFT(p, q) = sum of mask(i, j) * exp(2 pi i (p * i / nx + q * j / ny)) / (nx * ny)
+     RCWAcMatrix maskFT = ifft2(conv_to<RCWAcMatrix>::from(mask));
+     RCWAcMatrix result(size(GxMat));
+     for(uword i = 0; i < GxMat.n_elem; i++){
+       // G = m * b1 + n * b2 with a_i * b_j = 2 pi delta_ij
+       long long m = std::llround((GxMat(i) * lattice1[0] + GyMat(i) * lattice1[1]) / (2 * datum::pi));
+       long long n = std::llround((GxMat(i) * lattice2[0] + GyMat(i) * lattice2[1]) / (2 * datum::pi));
+       long long p = ((m % nx) + nx) % nx, q = ((n % ny) + ny) % ny;
+       // shift to the pixel centers and integrate over the pixels, so the
+       // result is exact for the piecewise constant raster
+       double u = datum::pi * m / nx, v = datum::pi * n / ny;
+       result(i) = maskFT(p, q) * exp(IMAG_I * (u + v)) * RCWA::sinc(u) * RCWA::sinc(v);
+     }
+     return result;
+   }
+   /*==============================================*/
+   // helper function adding the contrast of a material to the background,
+   // for a transform given on the distinct G differences
+   // @args:
+   // eps_xx ... im_eps_zz: the Fourier transforms, see transformGrating
+   // epsilonBGTensor: the epsilon of bacground (transformed to tensor already)
+   // epsilon: the epsilon of the material
+   // epsilonType: the type of the epsilon of the material
+   // geoMat: the transform of the shape, normalized by the area
+   // hasTensor: whether this layer contains tensor
+   /*==============================================*/
+   static void addContrast(
+     RCWAcMatrix& eps_xx,
+     RCWAcMatrix& eps_xy,
+     RCWAcMatrix& eps_yx,
+     RCWAcMatrix& eps_yy,
+     RCWAcMatrix& eps_zz,
+     RCWAcMatrix& im_eps_xx,
+     RCWAcMatrix& im_eps_xy,
+     RCWAcMatrix& im_eps_yx,
+     RCWAcMatrix& im_eps_yy,
+     RCWAcMatrix& im_eps_zz,
+     const EpsilonVal& epsBGTensor,
+     const EpsilonVal& epsilon,
+     const EPSTYPE epsilonType,
+     const RCWAcMatrix& geoMat,
+     const bool hasTensor
+   ){
+     dcomplex eps_BG_xx = dcomplex(epsBGTensor.tensor[0], epsBGTensor.tensor[1]);
+     dcomplex eps_BG_xy = dcomplex(epsBGTensor.tensor[2], epsBGTensor.tensor[3]);
+     dcomplex eps_BG_yx = dcomplex(epsBGTensor.tensor[4], epsBGTensor.tensor[5]);
+     dcomplex eps_BG_yy = dcomplex(epsBGTensor.tensor[6], epsBGTensor.tensor[7]);
+     dcomplex eps_BG_zz = dcomplex(epsBGTensor.tensor[8], epsBGTensor.tensor[9]);
+     dcomplex im_eps_BG_xx = dcomplex(epsBGTensor.tensor[1], 0);
+     dcomplex im_eps_BG_xy = ( eps_BG_xy - std::conj(eps_BG_yx) ) / 2.0 / IMAG_I;
+     dcomplex im_eps_BG_yx = ( eps_BG_yx - std::conj(eps_BG_xy) ) / 2.0 / IMAG_I;
+     dcomplex im_eps_BG_yy = dcomplex(epsBGTensor.tensor[7], 0);
+     dcomplex im_eps_BG_zz = dcomplex(epsBGTensor.tensor[9], 0);
+
+     EpsilonVal epsTensor = toTensor(epsilon, epsilonType);
+
+     eps_xx += (dcomplex(epsTensor.tensor[0], epsTensor.tensor[1]) - eps_BG_xx) * geoMat;
+
+     im_eps_xx += (dcomplex(epsTensor.tensor[1], 0) - im_eps_BG_xx) * geoMat;
+
+     eps_yy += (dcomplex(epsTensor.tensor[6], epsTensor.tensor[7]) - eps_BG_yy) * geoMat;
+
+     im_eps_yy += (dcomplex(epsTensor.tensor[7], 0) - im_eps_BG_yy) * geoMat;
+
+     eps_zz += (dcomplex(epsTensor.tensor[8], epsTensor.tensor[9]) - eps_BG_zz) * geoMat;
+
+     im_eps_zz += (dcomplex(epsTensor.tensor[9], 0) - im_eps_BG_zz) * geoMat;
+
+     if(hasTensor){
+       eps_xy += (dcomplex(epsTensor.tensor[2], epsTensor.tensor[3]) - eps_BG_xy) * geoMat;
+
+       eps_yx += (dcomplex(epsTensor.tensor[4], epsTensor.tensor[5]) - eps_BG_yx) * geoMat;
+
+       im_eps_xy += ( (dcomplex(epsTensor.tensor[2], epsTensor.tensor[3]) - dcomplex(epsTensor.tensor[4], -epsTensor.tensor[5])) / 2.0 / IMAG_I - im_eps_BG_xy)
+        * geoMat;
+
+       im_eps_yx += ( (dcomplex(epsTensor.tensor[4], epsTensor.tensor[5]) - dcomplex(epsTensor.tensor[2], -epsTensor.tensor[3])) / 2.0 / IMAG_I - im_eps_BG_yx)
+        * geoMat;
+     }
+   }
+   /*==============================================*/
+   // helper function to do fourier transform for an array of circles, the
+   // shapes are handled in blocks, the phases of a block form a matrix and
+   // the sum over the shapes is a matrix-vector product
+   // @args:
+   // Gx_mat: the Gx_mat
+   // Gy_mat: the Gy_mat
+   // centerx, centery: the centers of the circles
+   // radius: the radii of the circles
+   /*==============================================*/
+   static RCWAcMatrix transformCircleArrayElement(
+     const RCWArMatrix& GxMat,
+     const RCWArMatrix& GyMat,
+     const RCWArVector& centerx,
+     const RCWArVector& centery,
+     const RCWArVector& radius
+   ){
+     RCWAcMatrix result(size(GxMat), fill::zeros);
+     RCWArVector G = sqrt(square(vectorise(GxMat)) + square(vectorise(GyMat)));
+     // with one radius the form factor is shared and factors out of the sum
+     bool sameRadius = all(radius == radius(0));
+     RCWArMatrix formFactor;
+     if(sameRadius) formFactor = transformCircleElement(GxMat, GyMat, radius(0));
+     for(uword start = 0; start < centerx.n_elem; start += ARRAY_BLOCK){
+       uword end = std::min<uword>(start + ARRAY_BLOCK, centerx.n_elem) - 1;
+       RCWAcMatrix phase = exp(IMAG_I * (vectorise(GxMat) * centerx.subvec(start, end).t() + vectorise(GyMat) * centery.subvec(start, end).t()));
+       if(sameRadius){
+         result += phase * ones<RCWAcMatrix>(end - start + 1, 1);
+       }
+       else{
+         RCWArMatrix rho = G * radius.subvec(start, end).t();
+         RCWArMatrix jincMat(size(rho));
+         jinc(rho.memptr(), jincMat.memptr(), rho.n_elem);
+         jincMat.each_row() %= 2 * datum::pi * square(radius.subvec(start, end)).t();
+         result += (phase % jincMat) * ones<RCWAcMatrix>(end - start + 1, 1);
+       }
+     }
+     if(sameRadius) result = result % formFactor;
+     return result;
+   }
+   /*==============================================*/
+   // helper function to do fourier transform for an array of rectangles,
+   // handled in blocks as transformCircleArrayElement
+   // @args:
+   // Gx_mat: the Gx_mat
+   // Gy_mat: the Gy_mat
+   // centerx, centery: the centers of the rectangles
+   // angle: the rotated angles with respect to x axis
+   // widthx, widthy: the widths of the rectangles
+   /*==============================================*/
+   static RCWAcMatrix transformRectangleArrayElement(
+     const RCWArMatrix& GxMat,
+     const RCWArMatrix& GyMat,
+     const RCWArVector& centerx,
+     const RCWArVector& centery,
+     const RCWArVector& angle,
+     const RCWArVector& widthx,
+     const RCWArVector& widthy
+   ){
+     RCWAcMatrix result(size(GxMat), fill::zeros);
+     RCWArVector Gx = vectorise(GxMat), Gy = vectorise(GyMat);
+     for(uword start = 0; start < centerx.n_elem; start += ARRAY_BLOCK){
+       uword end = std::min<uword>(start + ARRAY_BLOCK, centerx.n_elem) - 1;
+       RCWAcMatrix phase = exp(IMAG_I * (Gx * centerx.subvec(start, end).t() + Gy * centery.subvec(start, end).t()));
+       RCWArVector c = cos(angle.subvec(start, end)), s = sin(angle.subvec(start, end));
+       RCWArMatrix Gu = Gx * c.t() + Gy * s.t();
+       RCWArMatrix Gv = -Gx * s.t() + Gy * c.t();
+       Gu.each_row() %= widthx.subvec(start, end).t() / 2;
+       Gv.each_row() %= widthy.subvec(start, end).t() / 2;
+       RCWArMatrix geoMat = RCWA::sinc(Gu) % RCWA::sinc(Gv);
+       geoMat.each_row() %= (widthx.subvec(start, end) % widthy.subvec(start, end)).t();
+       result += (phase % geoMat) * ones<RCWAcMatrix>(end - start + 1, 1);
+     }
+     return result;
+   }
+   /*==============================================*/
    // This function computes the Fourier transform for grating geometry
    // @args:
    // eps_xx: the Fourier transform for eps_xx
@@ -225,7 +465,7 @@
    // im_eps_yy: the Fourier transform for imaginary part
    // im_eps_zz: the Fourier transform for imaginary part
    // epsilonBGTensor: the epsilon of bacground (transformed to tensor already)
-   // Gx_mat: the Gx matrix
+   // GTable: the table of G differences
    // center: the center of the grating
    // width: the width of the grating
    // area: the area of one periodicity
@@ -245,17 +485,14 @@
     const EpsilonVal& epsBGTensor,
     const EpsilonVal& epsilon,
     const EPSTYPE epsilonType,
-    const RCWArMatrix& Gx_Mat,
+    const GDifferenceTable& GTable,
     const double center,
     const double width,
     const double area,
     const bool hasTensor
    ){
 
-     RCWArMatrix Gx_r, Gx_l, Gy_r, Gy_l;
-     meshGrid(Gx_Mat, Gx_Mat, Gx_r, Gx_l);
-
-     RCWArMatrix G_mat = Gx_l - Gx_r;
+     const RCWArMatrix& G_mat = GTable.uniqueGx;
      RCWAcMatrix phase = exp(IMAG_I * G_mat * center);
 
      dcomplex eps_BG_xx = dcomplex(epsBGTensor.tensor[0], epsBGTensor.tensor[1]);
@@ -314,8 +551,7 @@
    // im_eps_yy: the Fourier transform for imaginary part
    // im_eps_zz: the Fourier transform for imaginary part
    // epsilonBGTensor: the epsilon of bacground (transformed to tensor already)
-   // Gx_mat: the Gx matrix
-   // Gy_mat: the Gy matrix
+   // GTable: the table of G differences
    // centers: the centers of the rectangle
    // angle: the rotated angle with respect to x axis
    // widths: the widths of the rectangle
@@ -336,8 +572,7 @@
     const EpsilonVal& epsBGTensor,
     const EpsilonVal& epsilon,
     const EPSTYPE epsilonType,
-    const RCWArMatrix& Gx_Mat,
-    const RCWArMatrix& Gy_Mat,
+    const GDifferenceTable& GTable,
     const double centers[2],
     const double angle,
     const double widths[2],
@@ -346,12 +581,8 @@
    ){
 
 
-     RCWArMatrix Gx_r, Gx_l, Gy_r, Gy_l;
-     meshGrid(Gx_Mat, Gx_Mat, Gx_r, Gx_l);
-     meshGrid(Gy_Mat, Gy_Mat, Gy_r, Gy_l);
-
-     RCWArMatrix GxMat = Gx_l - Gx_r;
-     RCWArMatrix GyMat = Gy_l - Gy_r;
+     RCWArMatrix GxMat = GTable.uniqueGx;
+     RCWArMatrix GyMat = GTable.uniqueGy;
 
      RCWAcMatrix phase = exp(IMAG_I * (GxMat * centers[0] + GyMat * centers[1]));
      RCWArMatrix G_temp = GxMat * cos(angle) + GyMat * sin(angle);
@@ -416,8 +647,7 @@
    // im_eps_yy: the Fourier transform for imaginary part
    // im_eps_zz: the Fourier transform for imaginary part
    // epsilonBGTensor: the epsilon of bacground (transformed to tensor already)
-   // Gx_mat: the Gx matrix
-   // Gy_mat: the Gy matrix
+   // GTable: the table of G differences
    // centers: the centers of the circle
    // angle: the rotated angle with respect to x axis
    // radius: the radius of the circle
@@ -438,21 +668,15 @@
     const EpsilonVal& epsBGTensor,
     const EpsilonVal& epsilon,
     const EPSTYPE epsilonType,
-    const RCWArMatrix& Gx_Mat,
-    const RCWArMatrix& Gy_Mat,
+    const GDifferenceTable& GTable,
     const double centers[2],
     const double radius,
     const double area,
     const bool hasTensor
    ){
 
-     // dcomplex IMAG_I = dcomplex(0, 1.0);
-     RCWArMatrix Gx_r, Gx_l, Gy_r, Gy_l;
-     meshGrid(Gx_Mat, Gx_Mat, Gx_r, Gx_l);
-     meshGrid(Gy_Mat, Gy_Mat, Gy_r, Gy_l);
-
-     RCWArMatrix GxMat = Gx_l - Gx_r;
-     RCWArMatrix GyMat = Gy_l - Gy_r;
+     RCWArMatrix GxMat = GTable.uniqueGx;
+     RCWArMatrix GyMat = GTable.uniqueGy;
      RCWAcMatrix phase = exp(IMAG_I * (GxMat * centers[0] + GyMat * centers[1]));
 
 
@@ -513,8 +737,7 @@
     // im_eps_yy: the Fourier transform for imaginary part
     // im_eps_zz: the Fourier transform for imaginary part
     // epsilonBGTensor: the epsilon of bacground (transformed to tensor already)
-    // Gx_mat: the Gx matrix
-    // Gy_mat: the Gy matrix
+    // GTable: the table of G differences
     // centers: the centers of the ellipse
     // angle: the rotated angle with respect to x axis
     // halfwidths: the halfwidths of the ellipse
@@ -535,21 +758,15 @@
      const EpsilonVal& epsBGTensor,
      const EpsilonVal& epsilon,
      const EPSTYPE epsilonType,
-     const RCWArMatrix& Gx_Mat,
-     const RCWArMatrix& Gy_Mat,
+     const GDifferenceTable& GTable,
      const double centers[2],
      const double angle,
      const double halfwidths[2],
      const double area,
      const bool hasTensor
     ){
-      // dcomplex IMAG_I = dcomplex(0, 1.0);
-      RCWArMatrix Gx_r, Gx_l, Gy_r, Gy_l;
-      meshGrid(Gx_Mat, Gx_Mat, Gx_r, Gx_l);
-      meshGrid(Gy_Mat, Gy_Mat, Gy_r, Gy_l);
-
-      RCWArMatrix GxMat = Gx_l - Gx_r;
-      RCWArMatrix GyMat = Gy_l - Gy_r;
+      RCWArMatrix GxMat = GTable.uniqueGx;
+      RCWArMatrix GyMat = GTable.uniqueGy;
       RCWAcMatrix phase = exp(IMAG_I * (GxMat * centers[0] + GyMat * centers[1]));
       RCWArMatrix G_temp = GxMat * cos(angle) + GyMat * sin(angle);
       GyMat = -GxMat * sin(angle) + GyMat * cos(angle);
@@ -611,8 +828,7 @@
      // im_eps_yy: the Fourier transform for imaginary part
      // im_eps_zz: the Fourier transform for imaginary part
      // epsilonBGTensor: the epsilon of bacground (transformed to tensor already)
-     // Gx_mat: the Gx matrix
-     // Gy_mat: the Gy matrix
+     // GTable: the table of G differences
      // centers: the centers of the polygon
      // angle: the rotated angle with respect to x axis
      // edgeList: the edges of the polygon
@@ -633,8 +849,7 @@
       const EpsilonVal& epsBGTensor,
       const EpsilonVal& epsilon,
       const EPSTYPE epsilonType,
-      const RCWArMatrix& Gx_Mat,
-      const RCWArMatrix& Gy_Mat,
+      const GDifferenceTable& GTable,
       const double centers[2],
       const double angle,
       const EdgeList& edgeList,
@@ -642,13 +857,8 @@
       const bool hasTensor
     ){
       double polygonArea = getPolygonArea(edgeList);
-      // dcomplex IMAG_I = dcomplex(0, 1.0);
-      RCWArMatrix Gx_r, Gx_l, Gy_r, Gy_l;
-      meshGrid(Gx_Mat, Gx_Mat, Gx_r, Gx_l);
-      meshGrid(Gy_Mat, Gy_Mat, Gy_r, Gy_l);
-
-      RCWArMatrix GxMat = Gx_l - Gx_r;
-      RCWArMatrix GyMat = Gy_l - Gy_r;
+      RCWArMatrix GxMat = GTable.uniqueGx;
+      RCWArMatrix GyMat = GTable.uniqueGy;
       RCWAcMatrix phase = exp(IMAG_I * (GxMat * centers[0] + GyMat * centers[1]));
       RCWArMatrix G_temp = GxMat * cos(angle) + GyMat * sin(angle);
       GyMat = -GxMat * sin(angle) + GyMat * cos(angle);
@@ -697,4 +907,131 @@
          / area * phase % geoMat;
       }
     }
+
+     /*==============================================*/
+     // This function computes the Fourier transform for the pixels of a
+     // raster covered by one material, with one FFT of the pixel mask
+     // @args:
+     // eps_xx: the Fourier transform for eps_xx
+     // eps_xy: the Fourier transform for eps_xy
+     // eps_zx: the Fourier transform for eps_yx
+     // eps_yy: the Fourier transform for eps_yy
+     // eps_zz: the Fourier transform for eps_zz
+     // im_eps_xx: the Fourier transform for imaginary part
+     // im_eps_xy: the Fourier transform for imaginary part
+     // im_eps_yx: the Fourier transform for imaginary part
+     // im_eps_yy: the Fourier transform for imaginary part
+     // im_eps_zz: the Fourier transform for imaginary part
+     // epsilonBGTensor: the epsilon of bacground (transformed to tensor already)
+     // GTable: the table of G differences
+     // mask: 1 for the pixels of the material and 0 otherwise, rows along
+     // the first lattice vector and columns along the second
+     // lattice1: the first lattice vector, the raster starts at the origin
+     // lattice2: the second lattice vector
+     // hasTensor: whether this layer contains tensor
+     /*==============================================*/
+     void transformRaster(
+      RCWAcMatrix& eps_xx,
+      RCWAcMatrix& eps_xy,
+      RCWAcMatrix& eps_yx,
+      RCWAcMatrix& eps_yy,
+      RCWAcMatrix& eps_zz,
+      RCWAcMatrix& im_eps_xx,
+      RCWAcMatrix& im_eps_xy,
+      RCWAcMatrix& im_eps_yx,
+      RCWAcMatrix& im_eps_yy,
+      RCWAcMatrix& im_eps_zz,
+      const EpsilonVal& epsBGTensor,
+      const EpsilonVal& epsilon,
+      const EPSTYPE epsilonType,
+      const GDifferenceTable& GTable,
+      const RCWArMatrix& mask,
+      const double lattice1[2],
+      const double lattice2[2],
+      const bool hasTensor
+    ){
+      // already normalized by the area of the unit cell
+      RCWAcMatrix geoMat = transformRasterElement(GTable.uniqueGx, GTable.uniqueGy, mask, lattice1, lattice2);
+      addContrast(eps_xx, eps_xy, eps_yx, eps_yy, eps_zz, im_eps_xx, im_eps_xy, im_eps_yx, im_eps_yy, im_eps_zz,
+        epsBGTensor, epsilon, epsilonType, geoMat, hasTensor);
+    }
+
+     /*==============================================*/
+     // This function computes the Fourier transform for an array of circles
+     // made of one material in one pass
+     // @args:
+     // eps_xx ... im_eps_zz: the Fourier transforms, see transformCircle
+     // epsilonBGTensor: the epsilon of bacground (transformed to tensor already)
+     // GTable: the table of G differences
+     // centerx, centery: the centers of the circles
+     // radius: the radii of the circles
+     // area: the area of one periodicity
+     // hasTensor: whether this layer contains tensor
+     /*==============================================*/
+     void transformCircleArray(
+      RCWAcMatrix& eps_xx,
+      RCWAcMatrix& eps_xy,
+      RCWAcMatrix& eps_yx,
+      RCWAcMatrix& eps_yy,
+      RCWAcMatrix& eps_zz,
+      RCWAcMatrix& im_eps_xx,
+      RCWAcMatrix& im_eps_xy,
+      RCWAcMatrix& im_eps_yx,
+      RCWAcMatrix& im_eps_yy,
+      RCWAcMatrix& im_eps_zz,
+      const EpsilonVal& epsBGTensor,
+      const EpsilonVal& epsilon,
+      const EPSTYPE epsilonType,
+      const GDifferenceTable& GTable,
+      const RCWArVector& centerx,
+      const RCWArVector& centery,
+      const RCWArVector& radius,
+      const double area,
+      const bool hasTensor
+    ){
+      RCWAcMatrix geoMat = transformCircleArrayElement(GTable.uniqueGx, GTable.uniqueGy, centerx, centery, radius) / area;
+      addContrast(eps_xx, eps_xy, eps_yx, eps_yy, eps_zz, im_eps_xx, im_eps_xy, im_eps_yx, im_eps_yy, im_eps_zz,
+        epsBGTensor, epsilon, epsilonType, geoMat, hasTensor);
+    }
+
+     /*==============================================*/
+     // This function computes the Fourier transform for an array of
+     // rectangles made of one material in one pass
+     // @args:
+     // eps_xx ... im_eps_zz: the Fourier transforms, see transformRectangle
+     // epsilonBGTensor: the epsilon of bacground (transformed to tensor already)
+     // GTable: the table of G differences
+     // centerx, centery: the centers of the rectangles
+     // angle: the rotated angles with respect to x axis
+     // widthx, widthy: the widths of the rectangles
+     // area: the area of one periodicity
+     // hasTensor: whether this layer contains tensor
+     /*==============================================*/
+     void transformRectangleArray(
+      RCWAcMatrix& eps_xx,
+      RCWAcMatrix& eps_xy,
+      RCWAcMatrix& eps_yx,
+      RCWAcMatrix& eps_yy,
+      RCWAcMatrix& eps_zz,
+      RCWAcMatrix& im_eps_xx,
+      RCWAcMatrix& im_eps_xy,
+      RCWAcMatrix& im_eps_yx,
+      RCWAcMatrix& im_eps_yy,
+      RCWAcMatrix& im_eps_zz,
+      const EpsilonVal& epsBGTensor,
+      const EpsilonVal& epsilon,
+      const EPSTYPE epsilonType,
+      const GDifferenceTable& GTable,
+      const RCWArVector& centerx,
+      const RCWArVector& centery,
+      const RCWArVector& angle,
+      const RCWArVector& widthx,
+      const RCWArVector& widthy,
+      const double area,
+      const bool hasTensor
+    ){
+      RCWAcMatrix geoMat = transformRectangleArrayElement(GTable.uniqueGx, GTable.uniqueGy, centerx, centery, angle, widthx, widthy) / area;
+      addContrast(eps_xx, eps_xy, eps_yx, eps_yy, eps_zz, im_eps_xx, im_eps_xy, im_eps_yx, im_eps_yy, im_eps_zz,
+        epsBGTensor, epsilon, epsilonType, geoMat, hasTensor);
+    }
  }
\ No newline at end of file
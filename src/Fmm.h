@@ -39,6 +39,50 @@ namespace FMM{
   /*==============================================*/
   EpsilonVal toTensor(const EpsilonVal epsilon, const EPSTYPE type);
 
+  /*==============================================*/
+  // The differences G_i - G_j of the G vectors. It only depends on the
+  // G vectors, so it is built once per simulation and shared by the Fourier
+  // transforms of all the patterns in all the layers. The transforms are
+  // evaluated on the distinct differences only and expanded to the N x N
+  // matrices by expandGDifference.
+  // GxMat, GyMat: the differences, (i, j) is G_i - G_j
+  // index: for each (i, j) in column major, the position of its difference
+  // in uniqueGx and uniqueGy
+  // uniqueGx, uniqueGy: the distinct differences, the first one is zero
+  /*==============================================*/
+  typedef struct GDIFFERENCETABLE{
+    RCWArMatrix GxMat;
+    RCWArMatrix GyMat;
+    uvec index;
+    RCWArVector uniqueGx;
+    RCWArVector uniqueGy;
+  } GDifferenceTable;
+
+  /*==============================================*/
+  // This function builds the table of G differences
+  // @args:
+  // Gx_mat: the Gx matrix
+  // Gy_mat: the Gy matrix
+  // table: the table (output)
+  /*==============================================*/
+  void getGDifferenceTable(
+    const RCWArMatrix& Gx_mat,
+    const RCWArMatrix& Gy_mat,
+    GDifferenceTable& table
+  );
+
+  /*==============================================*/
+  // This function expands values given on the distinct differences to the
+  // full N x N matrix
+  // @args:
+  // table: the table of G differences
+  // uniqueVal: the values on uniqueGx and uniqueGy
+  /*==============================================*/
+  RCWAcMatrix expandGDifference(
+    const GDifferenceTable& table,
+    const RCWAcMatrix& uniqueVal
+  );
+
   /*==============================================*/
   // This function computes the Fourier transform for grating geometry
   // @args:
@@ -53,8 +97,7 @@ namespace FMM{
   // im_eps_yy: the Fourier transform for imaginary part
   // im_eps_zz: the Fourier transform for imaginary part
   // epsilonBGTensor: the epsilon of bacground (transformed to tensor already)
-  // Gx_mat: the Gx matrix
-  // Gy_mat: the Gy matrix
+  // GTable: the table of G differences
   // center: the center of the grating
   // width: the width of the grating
   // area: the area of one periodicity
@@ -74,7 +117,7 @@ namespace FMM{
     const EpsilonVal& epsilonBGTensor,
     const EpsilonVal& epsilon,
     const EPSTYPE epsilonType,
-    const RCWArMatrix& Gx_Mat,
+    const GDifferenceTable& GTable,
     const double center,
     const double width,
     const double area,
@@ -95,8 +138,7 @@ namespace FMM{
   // im_eps_yy: the Fourier transform for imaginary part
   // im_eps_zz: the Fourier transform for imaginary part
   // epsilonBGTensor: the epsilon of bacground (transformed to tensor already)
-  // Gx_mat: the Gx matrix
-  // Gy_mat: the Gy matrix
+  // GTable: the table of G differences
   // centers: the centers of the rectangle
   // widths: the widths of the rectangle
   // area: the area of one periodicity
@@ -116,8 +158,7 @@ namespace FMM{
     const EpsilonVal& epsBGTensor,
     const EpsilonVal& epsilon,
     const EPSTYPE epsilonType,
-    const RCWArMatrix& Gx_Mat,
-    const RCWArMatrix& Gy_Mat,
+    const GDifferenceTable& GTable,
     const double centers[2],
     const double angle,
     const double widths[2],
@@ -139,8 +180,7 @@ namespace FMM{
   // im_eps_yy: the Fourier transform for imaginary part
   // im_eps_zz: the Fourier transform for imaginary part
   // epsilonBGTensor: the epsilon of bacground (transformed to tensor already)
-  // Gx_mat: the Gx matrix
-  // Gy_mat: the Gy matrix
+  // GTable: the table of G differences
   // centers: the centers of the circle
   // radius: the radius of the circle
   // area: the area of one periodicity
@@ -160,8 +200,7 @@ namespace FMM{
     const EpsilonVal& epsBGTensor,
     const EpsilonVal& epsilon,
     const EPSTYPE epsilonType,
-    const RCWArMatrix& Gx_Mat,
-    const RCWArMatrix& Gy_Mat,
+    const GDifferenceTable& GTable,
     const double centers[2],
     const double radius,
     const double area,
@@ -182,8 +221,7 @@ namespace FMM{
   // im_eps_yy: the Fourier transform for imaginary part
   // im_eps_zz: the Fourier transform for imaginary part
   // epsilonBGTensor: the epsilon of bacground (transformed to tensor already)
-  // Gx_mat: the Gx matrix
-  // Gy_mat: the Gy matrix
+  // GTable: the table of G differences
   // area: the area of one periodicity
   // angle: the rotated angle of the ellipse
   // halfwidths: the halfwidths of the ellipse
@@ -204,8 +242,7 @@ namespace FMM{
    const EpsilonVal& epsBGTensor,
    const EpsilonVal& epsilon,
    const EPSTYPE epsilonType,
-   const RCWArMatrix& Gx_Mat,
-   const RCWArMatrix& Gy_Mat,
+   const GDifferenceTable& GTable,
    const double centers[2],
    const double angle,
    const double halfwidths[2],
@@ -226,8 +263,7 @@ namespace FMM{
  // im_eps_yy: the Fourier transform for imaginary part
  // im_eps_zz: the Fourier transform for imaginary part
  // epsilonBGTensor: the epsilon of bacground (transformed to tensor already)
- // Gx_mat: the Gx matrix
- // Gy_mat: the Gy matrix
+ // GTable: the table of G differences
  // centers: the centers of the polygon
  // edgeList: the edges of the polygon
  // area: the area of one periodicity
@@ -247,14 +283,127 @@ namespace FMM{
   const EpsilonVal& epsBGTensor,
   const EpsilonVal& epsilon,
   const EPSTYPE epsilonType,
-  const RCWArMatrix& Gx_Mat,
-  const RCWArMatrix& Gy_Mat,
+  const GDifferenceTable& GTable,
   const double centers[2],
   const double angle,
   const EdgeList& edgeList,
   const double area,
   const bool hasTensor
 );
+
+  /*==============================================*/
+  // This function computes the Fourier transform for the pixels of a raster
+  // covered by one material, with one FFT of the pixel mask
+  // @args:
+  // eps_xx: the Fourier transform for eps_xx
+  // eps_xy: the Fourier transform for eps_xy
+  // eps_zx: the Fourier transform for eps_yx
+  // eps_yy: the Fourier transform for eps_yy
+  // eps_zz: the Fourier transform for eps_zz
+  // im_eps_xx: the Fourier transform for imaginary part
+  // im_eps_xy: the Fourier transform for imaginary part
+  // im_eps_yx: the Fourier transform for imaginary part
+  // im_eps_yy: the Fourier transform for imaginary part
+  // im_eps_zz: the Fourier transform for imaginary part
+  // epsilonBGTensor: the epsilon of bacground (transformed to tensor already)
+  // GTable: the table of G differences
+  // mask: 1 for the pixels of the material and 0 otherwise, rows along the
+  // first lattice vector and columns along the second
+  // lattice1: the first lattice vector, the raster starts at the origin
+  // lattice2: the second lattice vector
+  // hasTensor: whether this layer contains tensor
+  /*==============================================*/
+  void transformRaster(
+    RCWAcMatrix& eps_xx,
+    RCWAcMatrix& eps_xy,
+    RCWAcMatrix& eps_yx,
+    RCWAcMatrix& eps_yy,
+    RCWAcMatrix& eps_zz,
+    RCWAcMatrix& im_eps_xx,
+    RCWAcMatrix& im_eps_xy,
+    RCWAcMatrix& im_eps_yx,
+    RCWAcMatrix& im_eps_yy,
+    RCWAcMatrix& im_eps_zz,
+    const EpsilonVal& epsBGTensor,
+    const EpsilonVal& epsilon,
+    const EPSTYPE epsilonType,
+    const GDifferenceTable& GTable,
+    const RCWArMatrix& mask,
+    const double lattice1[2],
+    const double lattice2[2],
+    const bool hasTensor
+  );
+
+  /*==============================================*/
+  // This function computes the Fourier transform for an array of circles
+  // made of one material in one pass
+  // @args:
+  // eps_xx ... im_eps_zz: the Fourier transforms, see transformCircle
+  // epsilonBGTensor: the epsilon of bacground (transformed to tensor already)
+  // GTable: the table of G differences
+  // centerx, centery: the centers of the circles
+  // radius: the radii of the circles
+  // area: the area of one periodicity
+  // hasTensor: whether this layer contains tensor
+  /*==============================================*/
+  void transformCircleArray(
+    RCWAcMatrix& eps_xx,
+    RCWAcMatrix& eps_xy,
+    RCWAcMatrix& eps_yx,
+    RCWAcMatrix& eps_yy,
+    RCWAcMatrix& eps_zz,
+    RCWAcMatrix& im_eps_xx,
+    RCWAcMatrix& im_eps_xy,
+    RCWAcMatrix& im_eps_yx,
+    RCWAcMatrix& im_eps_yy,
+    RCWAcMatrix& im_eps_zz,
+    const EpsilonVal& epsBGTensor,
+    const EpsilonVal& epsilon,
+    const EPSTYPE epsilonType,
+    const GDifferenceTable& GTable,
+    const RCWArVector& centerx,
+    const RCWArVector& centery,
+    const RCWArVector& radius,
+    const double area,
+    const bool hasTensor
+  );
+
+  /*==============================================*/
+  // This function computes the Fourier transform for an array of rectangles
+  // made of one material in one pass
+  // @args:
+  // eps_xx ... im_eps_zz: the Fourier transforms, see transformRectangle
+  // epsilonBGTensor: the epsilon of bacground (transformed to tensor already)
+  // GTable: the table of G differences
+  // centerx, centery: the centers of the rectangles
+  // angle: the rotated angles with respect to x axis
+  // widthx, widthy: the widths of the rectangles
+  // area: the area of one periodicity
+  // hasTensor: whether this layer contains tensor
+  /*==============================================*/
+  void transformRectangleArray(
+    RCWAcMatrix& eps_xx,
+    RCWAcMatrix& eps_xy,
+    RCWAcMatrix& eps_yx,
+    RCWAcMatrix& eps_yy,
+    RCWAcMatrix& eps_zz,
+    RCWAcMatrix& im_eps_xx,
+    RCWAcMatrix& im_eps_xy,
+    RCWAcMatrix& im_eps_yx,
+    RCWAcMatrix& im_eps_yy,
+    RCWAcMatrix& im_eps_zz,
+    const EpsilonVal& epsBGTensor,
+    const EpsilonVal& epsilon,
+    const EPSTYPE epsilonType,
+    const GDifferenceTable& GTable,
+    const RCWArVector& centerx,
+    const RCWArVector& centery,
+    const RCWArVector& angle,
+    const RCWArVector& widthx,
+    const RCWArVector& widthy,
+    const double area,
+    const bool hasTensor
+  );
 }
 
 #endif
\ No newline at end of file
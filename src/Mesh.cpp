@@ -18,8 +18,105 @@
  */
 
 #include "Mesh.h"
+#include "Profile.h"
+#include <cstring>
+#include <cstdio>
+#include <chrono>
+#include <mutex>
+#include <set>
+#include <sys/types.h>
+#include <sys/stat.h>
+#if !defined(_WIN32)
+  #include <fcntl.h>
+  #include <unistd.h>
+  #include <dlfcn.h>
+#endif
 
 namespace MESH{
+  /*==============================================*/
+  // The thread controls of MKL and OpenBLAS, looked up at run time so that
+  // the library works with any LAPACK and only the one loaded is called
+  /*==============================================*/
+  typedef void (*SetNumThreadsFunc)(int);
+  typedef int (*GetNumThreadsFunc)();
+  typedef struct LAPACKTHREADCONTROL{
+    SetNumThreadsFunc mklSetNumThreads = nullptr;
+    SetNumThreadsFunc mklSetDynamic = nullptr;
+    SetNumThreadsFunc openblasSetNumThreads = nullptr;
+    GetNumThreadsFunc mklGetMaxThreads = nullptr;
+    GetNumThreadsFunc mklGetDynamic = nullptr;
+    GetNumThreadsFunc openblasGetNumThreads = nullptr;
+  } LapackThreadControl;
+  static const LapackThreadControl& lapackThreadControl(){
+    static LapackThreadControl control = [](){
+      LapackThreadControl c;
+      #if !defined(_WIN32)
+        c.mklSetNumThreads = (SetNumThreadsFunc) dlsym(RTLD_DEFAULT, "mkl_set_num_threads");
+        c.mklSetDynamic = (SetNumThreadsFunc) dlsym(RTLD_DEFAULT, "mkl_set_dynamic");
+        c.openblasSetNumThreads = (SetNumThreadsFunc) dlsym(RTLD_DEFAULT, "openblas_set_num_threads");
+        c.mklGetMaxThreads = (GetNumThreadsFunc) dlsym(RTLD_DEFAULT, "mkl_get_max_threads");
+        c.mklGetDynamic = (GetNumThreadsFunc) dlsym(RTLD_DEFAULT, "mkl_get_dynamic");
+        c.openblasGetNumThreads = (GetNumThreadsFunc) dlsym(RTLD_DEFAULT, "openblas_get_num_threads");
+      #endif
+      return c;
+    }();
+    return control;
+  }
+  /*==============================================*/
+  // Class setting the number of threads inside every LAPACK call and the
+  // OpenMP nesting for its lifetime. The LAPACK threads and the nesting are
+  // process wide, so the values found by the first of the live scopes are
+  // saved, and restored when the last one ends, also for scopes of different
+  // simulations running concurrently
+  // @args:
+  // numOfLapackThread: the number of threads inside LAPACK
+  // nested: whether the regions of a k point run inside the k point threads
+  /*==============================================*/
+  class ThreadScope{
+  public:
+    ThreadScope(const int numOfLapackThread, const bool nested){
+      const LapackThreadControl& c = lapackThreadControl();
+      std::lock_guard<std::mutex> lock(mutex_);
+      if(count_++ == 0){
+        if(c.mklGetMaxThreads != nullptr) mklThread_ = c.mklGetMaxThreads();
+        if(c.mklGetDynamic != nullptr) mklDynamic_ = c.mklGetDynamic();
+        if(c.openblasGetNumThreads != nullptr) openblasThread_ = c.openblasGetNumThreads();
+        #if defined(_OPENMP)
+          levels_ = omp_get_max_active_levels();
+        #endif
+      }
+      if(c.mklSetNumThreads != nullptr) c.mklSetNumThreads(numOfLapackThread);
+      // otherwise MKL runs single threaded inside a parallel region
+      if(c.mklSetDynamic != nullptr) c.mklSetDynamic(numOfLapackThread == 1);
+      if(c.openblasSetNumThreads != nullptr) c.openblasSetNumThreads(numOfLapackThread);
+      #if defined(_OPENMP)
+        // the k points, the layers of a k point and LAPACK are nested regions
+        omp_set_max_active_levels(nested ? 3 : 1);
+      #endif
+    }
+    ~ThreadScope(){
+      const LapackThreadControl& c = lapackThreadControl();
+      std::lock_guard<std::mutex> lock(mutex_);
+      if(--count_ > 0) return;
+      if(c.mklSetNumThreads != nullptr && mklThread_ > 0) c.mklSetNumThreads(mklThread_);
+      if(c.mklSetDynamic != nullptr && mklDynamic_ >= 0) c.mklSetDynamic(mklDynamic_);
+      if(c.openblasSetNumThreads != nullptr && openblasThread_ > 0) c.openblasSetNumThreads(openblasThread_);
+      #if defined(_OPENMP)
+        omp_set_max_active_levels(levels_);
+      #endif
+    }
+    ThreadScope(const ThreadScope&) = delete;
+  private:
+    static std::mutex mutex_;
+    static int count_;
+    static int mklThread_, mklDynamic_, openblasThread_, levels_;
+  };
+  std::mutex ThreadScope::mutex_;
+  int ThreadScope::count_ = 0;
+  int ThreadScope::mklThread_ = -1;
+  int ThreadScope::mklDynamic_ = -1;
+  int ThreadScope::openblasThread_ = -1;
+  int ThreadScope::levels_ = 1;
   /*==============================================*/
   // Constructor of the FileLoader class
   /*==============================================*/
@@ -35,93 +132,263 @@ namespace MESH{
   }
 
   /*==============================================*/
-  // Function checking a line contains more than 3 spaces
+  // Magic string and version of the binary material file
+  /*==============================================*/
+  static const char MATERIAL_MAGIC[8] = {'M', 'E', 'S', 'H', 'M', 'A', 'T', '\0'};
+  static const int32_t MATERIAL_VERSION = 2;
   /*==============================================*/
-  EPSTYPE checkType(std::string line){
-    int numOfSpace = 0;
-    UTILITY::preprocessString(line);
-    for(size_t i = 0; i < line.length(); i++){
-      if(isspace(line.at(i))) numOfSpace++;
+  // Function returning number of doubles stored for each omega
+  /*==============================================*/
+  static int epsilonWidth(const EPSTYPE type){
+    switch (type) {
+      case SCALAR_: return 2;
+      case DIAGONAL_: return 6;
+      case TENSOR_: return 10;
+      default: return 0;
     }
-    switch (numOfSpace) {
-      case 2: return SCALAR_;
-      case 6: return DIAGONAL_;
-      case 10: return TENSOR_;
-      default:{
-        std::cerr << "Input type wrong: should be of 2, 6 or 10 tabs (spaces)!" << std::endl;
-        throw UTILITY::UnknownTypeException("Input type wrong: should be of 2, 6 or 10 tabs (spaces)!");
+  }
+  /*==============================================*/
+  // Function getting the modification time and size of a file
+  // @args
+  // fileName: the name of the file
+  // mtime: the modification time in nanoseconds (output)
+  // size: the size of the file in bytes (output)
+  /*==============================================*/
+  static bool fileStamp(const std::string fileName, int64_t& mtime, int64_t& size){
+    struct stat st;
+    if(stat(fileName.c_str(), &st) != 0) return false;
+#if defined(__APPLE__)
+    mtime = static_cast<int64_t>(st.st_mtimespec.tv_sec) * 1000000000 + st.st_mtimespec.tv_nsec;
+#elif defined(_WIN32)
+    mtime = static_cast<int64_t>(st.st_mtime) * 1000000000;
+#else
+    mtime = static_cast<int64_t>(st.st_mtim.tv_sec) * 1000000000 + st.st_mtim.tv_nsec;
+#endif
+    size = static_cast<int64_t>(st.st_size);
+    return true;
+  }
+  /*==============================================*/
+  // Function computing the 64 bit FNV-1a hash of the content of a file
+  // @args
+  // fileName: the name of the file
+  // hash: the hash (output)
+  /*==============================================*/
+  static bool fileHash(const std::string fileName, uint64_t& hash){
+    std::ifstream inputFile(fileName, std::ios::binary);
+    if(!inputFile.good()) return false;
+    hash = 14695981039346656037ULL;
+    std::vector<char> buffer(1 << 16);
+    while(inputFile.read(buffer.data(), buffer.size()) || inputFile.gcount() > 0){
+      std::streamsize count = inputFile.gcount();
+      for(std::streamsize i = 0; i < count; i++){
+        hash = (hash ^ static_cast<unsigned char>(buffer[i])) * 1099511628211ULL;
       }
     }
-    return SCALAR_;
+    return true;
   }
   /*==============================================*/
-  // Function reads a file from disk
+  // Function reads a file from disk. A binary material file is read
+  // directly. For a text file, a side-car binary cache <fileName>.meshbin
+  // is used when it matches the modification time, size and content hash
+  // of the text file, otherwise the text file is parsed and the cache
+  // is rewritten
   // @args
   // fileName: the name of the file
   /*==============================================*/
   void FileLoader::load(const std::string fileName){
-    std::ifstream inputFile(fileName);
-    if(!inputFile.good()){
+    MaterialHeader source;
+    if(!fileStamp(fileName, source.sourceMTime, source.sourceSize)){
       std::cerr << fileName + " not exists!" << std::endl;
       throw UTILITY::FileNotExistException(fileName + " not exists!");
     }
-    std::string line;
-    int count = 0;
-    EPSTYPE type = SCALAR_;
-    while(std::getline(inputFile, line)){
-      count++;
-      type = checkType(line);
+    if(this->loadBinary(fileName)) return;
+
+    // the hash catches the edits that keep the time stamp and the size,
+    // without it the cache can not be checked and the text is parsed
+    if(!fileHash(fileName, source.sourceHash)){
+      this->loadText(fileName);
+      return;
+    }
+    const std::string cacheName = fileName + ".meshbin";
+    if(this->loadBinary(cacheName, &source)) return;
+
+    this->loadText(fileName);
+    MaterialHeader header = source;
+    std::memcpy(header.magic, MATERIAL_MAGIC, sizeof(MATERIAL_MAGIC));
+    header.version = MATERIAL_VERSION;
+    header.type = static_cast<int32_t>(epsilonList_.type_);
+    header.numOfOmega = numOfOmega_;
+    // failing to write the cache (e.g. read-only directory) is not an error
+    this->writeBinary(cacheName, header);
+  }
+  /*==============================================*/
+  // Function converting the loaded material to a binary material file
+  // @args
+  // fileName: the name of the binary file
+  /*==============================================*/
+  void FileLoader::save(const std::string fileName){
+    if(omegaList_ == nullptr){
+      std::cerr << "No material loaded!" << std::endl;
+      throw UTILITY::MemoryException("No material loaded!");
+    }
+    MaterialHeader header;
+    std::memcpy(header.magic, MATERIAL_MAGIC, sizeof(MATERIAL_MAGIC));
+    header.version = MATERIAL_VERSION;
+    header.type = static_cast<int32_t>(epsilonList_.type_);
+    header.numOfOmega = numOfOmega_;
+    header.sourceMTime = 0;
+    header.sourceSize = 0;
+    header.sourceHash = 0;
+    if(!this->writeBinary(fileName, header)){
+      std::cerr << "Cannot write " + fileName + "!" << std::endl;
+      throw UTILITY::StorageException("Cannot write " + fileName + "!");
     }
+  }
+  /*==============================================*/
+  // Function parsing a text material file in a single pass
+  // @args
+  // fileName: the name of the file
+  /*==============================================*/
+  void FileLoader::loadText(const std::string fileName){
+    std::ifstream inputFile(fileName, std::ios::binary);
+    if(!inputFile.good()){
+      std::cerr << fileName + " not exists!" << std::endl;
+      throw UTILITY::FileNotExistException(fileName + " not exists!");
+    }
+    std::string content((std::istreambuf_iterator<char>(inputFile)), std::istreambuf_iterator<char>());
     inputFile.close();
 
-    if(!preSet_){
-      numOfOmega_ = count;
+    std::vector<double> omega, epsilon;
+    int width = -1;
+    double fields[12];
+    const char* p = content.c_str();
+    const char* end = p + content.size();
+    while(p < end){
+      const char* lineEnd = static_cast<const char*>(std::memchr(p, '\n', end - p));
+      if(lineEnd == nullptr) lineEnd = end;
+      int numOfField = 0;
+      const char* q = p;
+      while(q < lineEnd){
+        while(q < lineEnd && isspace(*q)) q++;
+        if(q >= lineEnd) break;
+        char* next;
+        double val = std::strtod(q, &next);
+        if(next == q || numOfField == 11){
+          numOfField = -1;
+          break;
+        }
+        fields[numOfField++] = val;
+        q = next;
+      }
+      p = lineEnd + 1;
+      if(numOfField == 0) continue;
+      if((numOfField != 3 && numOfField != 7 && numOfField != 11) || (width != -1 && numOfField - 1 != width)){
+        std::cerr << "Input type wrong: should be of 2, 6 or 10 tabs (spaces)!" << std::endl;
+        throw UTILITY::UnknownTypeException("Input type wrong: should be of 2, 6 or 10 tabs (spaces)!");
+      }
+      width = numOfField - 1;
+      omega.push_back(fields[0]);
+      for(int i = 0; i < width; i += 2){
+        epsilon.push_back(fields[i + 1]);
+        epsilon.push_back(-fields[i + 2]);
+      }
+    }
+
+    EPSTYPE type = width == 6 ? DIAGONAL_ : (width == 10 ? TENSOR_ : SCALAR_);
+    this->setValues(static_cast<int>(omega.size()), type, omega.data(), epsilon.data());
+  }
+  /*==============================================*/
+  // Function reading a binary material file
+  // @args
+  // fileName: the name of the binary file
+  // source: if not null, the file is only accepted when it was generated
+  // from a text file with the same modification time, size and hash
+  // @return
+  // whether the file is a valid binary material file and has been loaded
+  /*==============================================*/
+  bool FileLoader::loadBinary(const std::string fileName, const MaterialHeader* source){
+    std::ifstream inputFile(fileName, std::ios::binary | std::ios::ate);
+    if(!inputFile.good()) return false;
+    size_t size = static_cast<size_t>(inputFile.tellg());
+    inputFile.seekg(0);
+    MaterialHeader header;
+    if(size < sizeof(MaterialHeader) || !inputFile.read(reinterpret_cast<char*>(&header), sizeof(MaterialHeader))){
+      return false;
+    }
+    int width = epsilonWidth(static_cast<EPSTYPE>(header.type));
+    bool valid = std::memcmp(header.magic, MATERIAL_MAGIC, sizeof(MATERIAL_MAGIC)) == 0
+      && header.version == MATERIAL_VERSION
+      && width != 0
+      && header.numOfOmega > 0
+      && size == sizeof(MaterialHeader) + sizeof(double) * static_cast<size_t>(header.numOfOmega) * (1 + width);
+    if(valid && source != nullptr){
+      valid = header.sourceMTime == source->sourceMTime && header.sourceSize == source->sourceSize
+        && header.sourceHash == source->sourceHash;
+    }
+    if(!valid) return false;
+    std::vector<double> values(static_cast<size_t>(header.numOfOmega) * (1 + width));
+    if(!inputFile.read(reinterpret_cast<char*>(values.data()), sizeof(double) * values.size())){
+      return false;
+    }
+    this->setValues(static_cast<int>(header.numOfOmega), static_cast<EPSTYPE>(header.type), values.data(), values.data() + header.numOfOmega);
+    return true;
+  }
+  /*==============================================*/
+  // Function writing the loaded material to a binary material file.
+  // The file is written to a temporary name first and then renamed, so
+  // that other processes never see a partially written file
+  // @args
+  // fileName: the name of the binary file
+  // header: the header of the file
+  // @return
+  // whether the file has been written
+  /*==============================================*/
+  bool FileLoader::writeBinary(const std::string fileName, const MaterialHeader& header){
+    int width = epsilonWidth(epsilonList_.type_);
+#if defined(_WIN32)
+    const std::string tmpName = fileName + ".tmp";
+#else
+    const std::string tmpName = fileName + ".tmp" + std::to_string(getpid());
+#endif
+    std::ofstream outputFile(tmpName, std::ios::binary | std::ios::trunc);
+    if(!outputFile.good()) return false;
+    outputFile.write(reinterpret_cast<const char*>(&header), sizeof(MaterialHeader));
+    outputFile.write(reinterpret_cast<const char*>(omegaList_), sizeof(double) * numOfOmega_);
+    for(int i = 0; i < numOfOmega_; i++){
+      outputFile.write(reinterpret_cast<const char*>(epsilonList_.epsilonVals[i].tensor), sizeof(double) * width);
+    }
+    outputFile.close();
+    if(!outputFile.good() || std::rename(tmpName.c_str(), fileName.c_str()) != 0){
+      std::remove(tmpName.c_str());
+      return false;
+    }
+    return true;
+  }
+  /*==============================================*/
+  // Function copying the parsed values into the loader
+  // @args
+  // numOfOmega: number of omega points
+  // type: the type of epsilon
+  // omega: the omega values
+  // epsilon: the epsilon values, (2, 6 or 10) * numOfOmega doubles
+  /*==============================================*/
+  void FileLoader::setValues(const int numOfOmega, const EPSTYPE type, const double* omega, const double* epsilon){
+    // materials on different omega grids are resampled in initSimulation
+    if(!preSet_ || numOfOmega_ != numOfOmega){
+      delete [] omegaList_;
+      delete [] epsilonList_.epsilonVals;
+      numOfOmega_ = numOfOmega;
       preSet_ = true;
       omegaList_ = new double[numOfOmega_];
       epsilonList_.epsilonVals = new EpsilonVal[numOfOmega_];
     }
-    else{
-      if(numOfOmega_ != count){
-        std::cerr << "wrong omega points!" << std::endl;
-        throw UTILITY::RangeException("wrong omega points!");
-      }
-    }
 
     epsilonList_.type_ = type;
-    std::ifstream inputFile2(fileName);
+    int width = epsilonWidth(type);
+    std::memcpy(omegaList_, omega, sizeof(double) * numOfOmega_);
     for(int i = 0; i < numOfOmega_; i++){
-      inputFile2 >> omegaList_[i];
-      if(epsilonList_.type_ == SCALAR_){
-        double imag;
-        inputFile2 >> epsilonList_.epsilonVals[i].scalar[0] >> imag;
-        epsilonList_.epsilonVals[i].scalar[1] = -imag;
-      }
-      else if(epsilonList_.type_ == DIAGONAL_){
-        double real1, imag1, real2, imag2, real3, imag3;
-        inputFile2 >> real1 >> imag1 >> real2 >> imag2 >> real3 >> imag3;
-        epsilonList_.epsilonVals[i].diagonal[0] = real1;
-        epsilonList_.epsilonVals[i].diagonal[1] = -imag1;
-        epsilonList_.epsilonVals[i].diagonal[2] = real2;
-        epsilonList_.epsilonVals[i].diagonal[3] = -imag2;
-        epsilonList_.epsilonVals[i].diagonal[4] = real3;
-        epsilonList_.epsilonVals[i].diagonal[5] = -imag3;
-      }
-      else{
-        double real1, imag1, real2, imag2, real3, imag3, real4, imag4, real5, imag5;
-        inputFile2 >> real1 >> imag1 >> real2 >> imag2 >> real3 >> imag3 >> real4 >> imag4 >> real5 >> imag5;
-        epsilonList_.epsilonVals[i].tensor[0] = real1;
-        epsilonList_.epsilonVals[i].tensor[1] = -imag1;
-        epsilonList_.epsilonVals[i].tensor[2] = real2;
-        epsilonList_.epsilonVals[i].tensor[3] = -imag2;
-        epsilonList_.epsilonVals[i].tensor[4] = real3;
-        epsilonList_.epsilonVals[i].tensor[5] = -imag3;
-        epsilonList_.epsilonVals[i].tensor[6] = real4;
-        epsilonList_.epsilonVals[i].tensor[7] = -imag4;
-        epsilonList_.epsilonVals[i].tensor[8] = real5;
-        epsilonList_.epsilonVals[i].tensor[9] = -imag5;
-      }
+      std::memcpy(epsilonList_.epsilonVals[i].tensor, epsilon + i * width, sizeof(double) * width);
     }
-    inputFile2.close();
   }
 
   /*==============================================*/
@@ -156,10 +423,320 @@ namespace MESH{
     }
   }
   /*==============================================*/
+  // Magic string, version and chunk size of the binary intermediate file
+  /*==============================================*/
+  static const char INTERMEDIATE_MAGIC[8] = {'M', 'E', 'S', 'H', 'K', 'P', 'T', '\0'};
+  static const int32_t INTERMEDIATE_VERSION = 1;
+  static const size_t INTERMEDIATE_CHUNK = 1 << 16;
+  /*==============================================*/
+  // Constructor of the IntermediateWriter class
+  // @args
+  // fileName: the name of the output file
+  // numOfProbe: number of phi values per record
+  // numOfBuffer: number of buffers, one per thread
+  // singlePrecision: whether kx, ky and phi are stored as float
+  /*==============================================*/
+  IntermediateWriter::IntermediateWriter(const std::string fileName, const int numOfProbe, const int numOfBuffer, const bool singlePrecision) :
+    outputFile_(fileName, std::ios::binary | std::ios::trunc), buffers_(numOfBuffer),
+    numOfProbe_(numOfProbe), singlePrecision_(singlePrecision){
+    if(!outputFile_.good()){
+      std::cerr << "Cannot write " + fileName + "!" << std::endl;
+      throw UTILITY::StorageException("Cannot write " + fileName + "!");
+    }
+    for(size_t i = 0; i < buffers_.size(); i++){
+      buffers_[i].phi.resize(numOfProbe_);
+    }
+    IntermediateHeader header;
+    std::memcpy(header.magic, INTERMEDIATE_MAGIC, sizeof(INTERMEDIATE_MAGIC));
+    header.version = INTERMEDIATE_VERSION;
+    header.numOfProbe = numOfProbe_;
+    header.precision = singlePrecision_ ? sizeof(float) : sizeof(double);
+    header.reserved = 0;
+    outputFile_.write(reinterpret_cast<const char*>(&header), sizeof(IntermediateHeader));
+  }
+  /*==============================================*/
+  // This is a thin wrapper for the usage of smart pointer
+  /*==============================================*/
+  Ptr<IntermediateWriter> IntermediateWriter::instanceNew(
+    const std::string fileName,
+    const int numOfProbe,
+    const int numOfBuffer,
+    const bool singlePrecision
+  ){
+    return new IntermediateWriter(fileName, numOfProbe, numOfBuffer, singlePrecision);
+  }
+  /*==============================================*/
+  // Function adding a record to a buffer, the buffer is written out
+  // when it is full or omega changes
+  // @args
+  // buffer: the index of the buffer, normally the thread number
+  // omega, kx, ky: the coordinate of the record
+  // phi: numOfProbe values
+  /*==============================================*/
+  void IntermediateWriter::append(const int buffer, const double omega, const double kx, const double ky, const double* phi){
+    RecordBuffer& records = buffers_[buffer];
+    if(!records.kx.empty() && (records.omega != omega || records.kx.size() >= INTERMEDIATE_CHUNK)){
+      this->flush(buffer);
+    }
+    records.omega = omega;
+    records.kx.push_back(kx);
+    records.ky.push_back(ky);
+    for(int p = 0; p < numOfProbe_; p++){
+      records.phi[p].push_back(phi[p]);
+    }
+  }
+  /*==============================================*/
+  // Function copying a column into the chunk with the given precision
+  /*==============================================*/
+  static char* packColumn(const std::vector<double>& column, const bool singlePrecision, char* dest){
+    if(singlePrecision){
+      for(size_t i = 0; i < column.size(); i++){
+        float val = static_cast<float>(column[i]);
+        std::memcpy(dest, &val, sizeof(float));
+        dest += sizeof(float);
+      }
+    }
+    else{
+      std::memcpy(dest, column.data(), sizeof(double) * column.size());
+      dest += sizeof(double) * column.size();
+    }
+    return dest;
+  }
+  /*==============================================*/
+  // Function writing a buffer to the file as one chunk. The chunk is
+  // assembled without the lock, only the write itself is serialized
+  // @args
+  // buffer: the index of the buffer
+  /*==============================================*/
+  void IntermediateWriter::flush(const int buffer){
+    RecordBuffer& records = buffers_[buffer];
+    int64_t numOfRecord = records.kx.size();
+    if(numOfRecord == 0) return;
+    size_t width = singlePrecision_ ? sizeof(float) : sizeof(double);
+    std::vector<char> chunk(sizeof(double) + sizeof(int64_t) + numOfRecord * (2 + numOfProbe_) * width);
+    char* dest = chunk.data();
+    std::memcpy(dest, &records.omega, sizeof(double));
+    dest += sizeof(double);
+    std::memcpy(dest, &numOfRecord, sizeof(int64_t));
+    dest += sizeof(int64_t);
+    dest = packColumn(records.kx, singlePrecision_, dest);
+    dest = packColumn(records.ky, singlePrecision_, dest);
+    for(int p = 0; p < numOfProbe_; p++){
+      dest = packColumn(records.phi[p], singlePrecision_, dest);
+      records.phi[p].clear();
+    }
+    records.kx.clear();
+    records.ky.clear();
+    #if defined(_OPENMP)
+      #pragma omp critical(MESH_INTERMEDIATE)
+    #endif
+    outputFile_.write(chunk.data(), chunk.size());
+  }
+  /*==============================================*/
+  // Function writing out all the buffers and closing the file
+  /*==============================================*/
+  void IntermediateWriter::close(){
+    if(!outputFile_.is_open()) return;
+    for(size_t i = 0; i < buffers_.size(); i++){
+      this->flush(i);
+    }
+    outputFile_.close();
+  }
+  /*==============================================*/
+  // Function reading a binary intermediate file
+  // @args
+  // fileName: the name of the file
+  // omega, kx, ky: the coordinates of all the records (output)
+  // phi: one column per probe (output)
+  /*==============================================*/
+  void IntermediateWriter::read(
+    const std::string fileName,
+    std::vector<double>& omega,
+    std::vector<double>& kx,
+    std::vector<double>& ky,
+    std::vector< std::vector<double> >& phi
+  ){
+    std::ifstream inputFile(fileName, std::ios::binary);
+    if(!inputFile.good()){
+      std::cerr << fileName + " not exists!" << std::endl;
+      throw UTILITY::FileNotExistException(fileName + " not exists!");
+    }
+    IntermediateHeader header;
+    inputFile.read(reinterpret_cast<char*>(&header), sizeof(IntermediateHeader));
+    if(!inputFile.good() || std::memcmp(header.magic, INTERMEDIATE_MAGIC, sizeof(INTERMEDIATE_MAGIC)) != 0
+      || header.version != INTERMEDIATE_VERSION || header.numOfProbe < 0
+      || (header.precision != sizeof(float) && header.precision != sizeof(double))){
+      std::cerr << fileName + ": not an intermediate file!" << std::endl;
+      throw UTILITY::UnknownTypeException(fileName + ": not an intermediate file!");
+    }
+    omega.clear();
+    kx.clear();
+    ky.clear();
+    phi.assign(header.numOfProbe, std::vector<double>());
+
+    double chunkOmega;
+    int64_t numOfRecord;
+    std::vector<char> column;
+    while(inputFile.read(reinterpret_cast<char*>(&chunkOmega), sizeof(double))){
+      inputFile.read(reinterpret_cast<char*>(&numOfRecord), sizeof(int64_t));
+      column.resize(numOfRecord * header.precision);
+      omega.insert(omega.end(), numOfRecord, chunkOmega);
+      for(int c = 0; c < 2 + header.numOfProbe; c++){
+        if(!inputFile.read(column.data(), column.size())){
+          std::cerr << fileName + ": file truncated!" << std::endl;
+          throw UTILITY::RangeException(fileName + ": file truncated!");
+        }
+        std::vector<double>& dest = c == 0 ? kx : (c == 1 ? ky : phi[c - 2]);
+        for(int64_t i = 0; i < numOfRecord; i++){
+          if(header.precision == sizeof(float)){
+            float val;
+            std::memcpy(&val, &column[i * sizeof(float)], sizeof(float));
+            dest.push_back(val);
+          }
+          else{
+            double val;
+            std::memcpy(&val, &column[i * sizeof(double)], sizeof(double));
+            dest.push_back(val);
+          }
+        }
+      }
+    }
+  }
+  /*==============================================*/
+  // Class destructor
+  /*==============================================*/
+  IntermediateWriter::~IntermediateWriter(){
+    this->close();
+  }
+  /*==============================================*/
+  // Magic string and version of the checkpoint file
+  /*==============================================*/
+  static const char CHECKPOINT_MAGIC[8] = {'M', 'E', 'S', 'H', 'C', 'K', 'P', '\0'};
+  static const int32_t CHECKPOINT_VERSION = 1;
+  /*==============================================*/
+  // Function returning the wall time in seconds
+  /*==============================================*/
+  static double wallTime(){
+    return std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+  }
+  /*==============================================*/
+  // Constructor of the CheckpointFile class
+  // @args
+  // fileName: the name of the checkpoint file
+  // header: describes the integration, an existing file is only resumed
+  // when its header is identical
+  // interval: the minimum time in seconds between two flushes
+  /*==============================================*/
+  CheckpointFile::CheckpointFile(const std::string fileName, const CheckpointHeader& header, const double interval) :
+    numOfEntry_(header.numOfEntry), interval_(interval), lastFlush_(wallTime()){
+    std::ifstream inputFile(fileName, std::ios::binary);
+    bool exist = inputFile.good();
+    int64_t validSize = sizeof(CheckpointHeader), fileSize = 0;
+    if(exist){
+      CheckpointHeader oldHeader;
+      inputFile.read(reinterpret_cast<char*>(&oldHeader), sizeof(CheckpointHeader));
+      if(!inputFile.good() || std::memcmp(&oldHeader, &header, sizeof(CheckpointHeader)) != 0){
+        std::cerr << fileName + ": checkpoint belongs to a different simulation, please remove it!" << std::endl;
+        throw UTILITY::ValueException(fileName + ": checkpoint belongs to a different simulation, please remove it!");
+      }
+      int64_t block;
+      std::vector<double> vals(numOfEntry_);
+      // a record cut by a crash is ignored
+      while(inputFile.read(reinterpret_cast<char*>(&block), sizeof(int64_t))
+        && inputFile.read(reinterpret_cast<char*>(vals.data()), sizeof(double) * numOfEntry_)){
+        records_[block] = vals;
+        validSize += sizeof(int64_t) + sizeof(double) * numOfEntry_;
+      }
+      inputFile.close();
+      int64_t mtime;
+      fileStamp(fileName, mtime, fileSize);
+    }
+    if(exist && fileSize != validSize){
+      // the complete records are written to a temporary file that replaces the
+      // checkpoint only once it is on disk, so that a kill during the rewrite
+      // keeps the saved progress
+      const std::string tmpName = fileName + ".tmp";
+      std::ofstream tmpFile(tmpName, std::ios::binary | std::ios::trunc);
+      tmpFile.write(reinterpret_cast<const char*>(&header), sizeof(CheckpointHeader));
+      for(RecordMap::const_iterator it = records_.cbegin(); it != records_.cend(); it++){
+        tmpFile.write(reinterpret_cast<const char*>(&it->first), sizeof(int64_t));
+        tmpFile.write(reinterpret_cast<const char*>(it->second.data()), sizeof(double) * numOfEntry_);
+      }
+      tmpFile.close();
+      bool written = !tmpFile.fail();
+      #if !defined(_WIN32)
+        int fd = ::open(tmpName.c_str(), O_RDONLY);
+        written = written && fd >= 0 && ::fsync(fd) == 0;
+        if(fd >= 0) ::close(fd);
+      #else
+        written = written && std::remove(fileName.c_str()) == 0;
+      #endif
+      if(!written || std::rename(tmpName.c_str(), fileName.c_str()) != 0){
+        std::remove(tmpName.c_str());
+        std::cerr << "Cannot write " + fileName + "!" << std::endl;
+        throw UTILITY::StorageException("Cannot write " + fileName + "!");
+      }
+    }
+    // the records of the run are appended to the complete records
+    outputFile_.open(fileName, std::ios::binary | std::ios::app);
+    if(!outputFile_.good()){
+      std::cerr << "Cannot write " + fileName + "!" << std::endl;
+      throw UTILITY::StorageException("Cannot write " + fileName + "!");
+    }
+    if(!exist){
+      outputFile_.write(reinterpret_cast<const char*>(&header), sizeof(CheckpointHeader));
+    }
+    outputFile_.flush();
+  }
+  /*==============================================*/
+  // This is a thin wrapper for the usage of smart pointer
+  /*==============================================*/
+  Ptr<CheckpointFile> CheckpointFile::instanceNew(
+    const std::string fileName,
+    const CheckpointHeader& header,
+    const double interval
+  ){
+    return new CheckpointFile(fileName, header, interval);
+  }
+  /*==============================================*/
+  // Function returning the records loaded from an existing file
+  /*==============================================*/
+  const CheckpointFile::RecordMap& CheckpointFile::getRecords(){
+    return records_;
+  }
+  /*==============================================*/
+  // Function appending the record of a finished block
+  // @args
+  // block: the index of the block
+  // vals: numOfEntry values
+  /*==============================================*/
+  void CheckpointFile::write(const int64_t block, const double* vals){
+    outputFile_.write(reinterpret_cast<const char*>(&block), sizeof(int64_t));
+    outputFile_.write(reinterpret_cast<const char*>(vals), sizeof(double) * numOfEntry_);
+    if(wallTime() - lastFlush_ >= interval_){
+      outputFile_.flush();
+      lastFlush_ = wallTime();
+    }
+  }
+  /*==============================================*/
+  // Function flushing and closing the file
+  /*==============================================*/
+  void CheckpointFile::close(){
+    if(outputFile_.is_open()) outputFile_.close();
+  }
+  /*==============================================*/
+  // Class destructor
+  /*==============================================*/
+  CheckpointFile::~CheckpointFile(){
+    this->close();
+  }
+  /*==============================================*/
   // This function wraps the data for quad_gaussian_kronrod
   // @args:
   // kx: the kx value (normalized)
-  // wrapper: wrapper for all the arguments wrapped in wrapper
+  // data: wrapper for all the arguments wrapped in wrapper
+  // fdim: the number of probes times (1 + 3 * number of layers)
+  // fval: the integrand at each probe, followed by that from each source
   /*==============================================*/
   static void wrapperFunQuadgk(unsigned ndim,
     const double *kx,
@@ -167,8 +744,9 @@ namespace MESH{
     unsigned fdim,
     double *fval
     ){
-    ArgWrapper wrapper = *(ArgWrapper*)data;
-    fval[0] = kx[0] * poyntingFlux(
+    const ArgWrapper& wrapper = *(ArgWrapper*)data;
+    int numOfProbe = wrapper.probeList.size();
+    poyntingFlux(
       wrapper.omega / MICRON,
       wrapper.thicknessList,
       kx[0],
@@ -179,41 +757,72 @@ namespace MESH{
       wrapper.Gx_mat,
       wrapper.Gy_mat,
       wrapper.sourceList,
-      wrapper.targetLayer,
+      wrapper.probeList,
       1,
       wrapper.polar,
-      wrapper.target_z
+      fval,
+      fval + numOfProbe,
+      nullptr,
+      1,
+      &wrapper.repeatList
     );
+    for(unsigned i = 0; i < fdim; i++){
+      fval[i] *= kx[0];
+    }
   }
   /*==============================================*/
-  // This function wraps the data for quad_legendre
+  // This function integrates a vector integrand by gauss_legendre
   // @args:
-  // kx: the kx value (normalized)
+  // n: the degree of the integral
+  // f: the integrand, in the same form as that of adapt_integrate
   // data: wrapper for all the arguments wrapped in wrapper
-  /*==============================================*/
-  static double wrapperFunQuadgl(const double kx, void* data){
-    ArgWrapper wrapper = *(ArgWrapper*) data;
-    return kx * poyntingFlux(
-      wrapper.omega / MICRON,
-      wrapper.thicknessList,
-      kx,
-      0,
-      wrapper.EMatrices,
-      wrapper.grandImaginaryMatrices,
-      wrapper.eps_zz_Inv,
-      wrapper.Gx_mat,
-      wrapper.Gy_mat,
-      wrapper.sourceList,
-      wrapper.targetLayer,
-      1,
-      wrapper.polar,
-      wrapper.target_z
-    );
+  // fdim: the dimension of the integrand
+  // a, b: the range of the integral
+  // val: the value of the integral
+  /*==============================================*/
+  static void gaussLegendreVec(const int n, integrand f, void* data, const unsigned fdim,
+    const double a, const double b, double* val){
+    double* x = nullptr;
+    double* w = nullptr;
+    int m = (n + 1) >> 1;
+    bool newTable = true;
+    for(int i = 0; i < GLAWSIZE; i++){
+      if(n == glaw[i].n){
+        x = glaw[i].x;
+        w = glaw[i].w;
+        newTable = false;
+        break;
+      }
+    }
+    if(newTable){
+      x = new double[m];
+      w = new double[m];
+      gauss_legendre_tbl(n, x, w, 1e-10);
+    }
+
+    double A = 0.5 * (b - a), B = 0.5 * (b + a);
+    std::vector<double> fval(fdim);
+    for(unsigned j = 0; j < fdim; j++) val[j] = 0;
+    for(int i = 0; i < m; i++){
+      // for odd n the first abscissa is the center point and is counted once
+      bool center = (n & 1) && i == 0;
+      double points[2] = {B + A * x[i], B - A * x[i]};
+      for(int k = 0; k < (center ? 1 : 2); k++){
+        f(1, &points[k], data, fdim, fval.data());
+        for(unsigned j = 0; j < fdim; j++) val[j] += w[i] * fval[j];
+      }
+    }
+    for(unsigned j = 0; j < fdim; j++) val[j] *= A;
+
+    if(newTable){
+      delete[] x;
+      delete[] w;
+    }
   }
   /*======================================================*/
   // Implementaion of the parent simulation super class
   /*=======================================================*/
-  Simulation::Simulation() : nG_(0), numOfOmega_(0), Phi_(nullptr), omegaList_(nullptr),
+  Simulation::Simulation() : nG_(0), numOfOmega_(0), Phi_(nullptr), PhiBySource_(nullptr), omegaList_(nullptr),
    kxStart_(0), kxEnd_(0), kyStart_(0), kyEnd_(0), numOfKx_(0), numOfKy_(0)
   {
     targetLayer_ = -1;
@@ -230,6 +839,14 @@ namespace MESH{
       delete[] Phi_;
       Phi_ = nullptr;
     }
+    if(PhiBySource_ != nullptr){
+      delete[] PhiBySource_;
+      PhiBySource_ = nullptr;
+    }
+    if(PhiKGrid_ != nullptr){
+      delete[] PhiKGrid_;
+      PhiKGrid_ = nullptr;
+    }
   }
 
 
@@ -244,6 +861,108 @@ namespace MESH{
     }
     return Phi_;
   }
+  /*==============================================*/
+  // This function return the Phi value at all probes
+  // @note
+  // Phi at probe p and omega index i is stored at p * numOfOmega + i,
+  // where probe 0 is the probe layer and the rest come from addProbeLayer
+  /*==============================================*/
+  double* Simulation::getPhiAtProbes(){
+    return this->getPhi();
+  }
+  /*==============================================*/
+  // This function return the Phi value contributed by one source layer
+  // @args:
+  // name: the name of the source layer
+  // polar: BOTH_ for the total, TE_ or TM_ for the contribution of that polarization
+  // probeIndex: the index of the probe, 0 for the probe layer
+  // @note
+  // TE and TM do not add up to the total for sources with in-plane anisotropy
+  /*==============================================*/
+  double* Simulation::getPhiBySource(const std::string name, const POLARIZATION polar, const int probeIndex){
+    if(PhiBySource_ == nullptr){
+      std::cerr << "Please do integration first!" << std::endl;
+      throw UTILITY::MemoryException("Please do integration first!");
+    }
+    if(layerInstanceMap_.find(name) == layerInstanceMap_.cend()){
+      std::cerr << name + ": Layer does not exist!" << std::endl;
+      throw UTILITY::IllegalNameException(name + ": Layer does not exist!");
+    }
+    if(probeIndex < 0 || probeIndex >= this->getNumOfProbe()){
+      std::cerr << std::to_string(probeIndex) + ": out of range!" << std::endl;
+      throw UTILITY::RangeException(std::to_string(probeIndex) + ": out of range!");
+    }
+    Ptr<Layer> layer = layerInstanceMap_.find(name)->second;
+    if(!layer->checkIsSource()){
+      std::cerr << name + ": Layer is not a source!" << std::endl;
+      throw UTILITY::ValueException(name + ": Layer is not a source!");
+    }
+    int numOfLayer = structure_->getNumOfLayer();
+    int layerIdx = 0;
+    for(int i = 0; i < numOfLayer; i++){
+      if(structure_->getLayerByIndex(i) == layer) layerIdx = i;
+    }
+    int component = 0;
+    switch (polar) {
+      case TE_: component = 1; break;
+      case TM_: component = 2; break;
+      default: component = 0; break;
+    }
+    return &PhiBySource_[((probeIndex * numOfLayer + layerIdx) * 3 + component) * numOfOmega_];
+  }
+  /*==============================================*/
+  // This function return the names of the source layers, from bottom to top
+  /*==============================================*/
+  std::vector<std::string> Simulation::getSourceLayerNames(){
+    std::vector<std::string> names;
+    for(int i = 0; i < structure_->getNumOfLayer(); i++){
+      Ptr<Layer> layer = structure_->getLayerByIndex(i);
+      if(layer->checkIsSource()) names.push_back(layer->getName());
+    }
+    return names;
+  }
+  /*==============================================*/
+  // This function return the number of probes
+  /*==============================================*/
+  int Simulation::getNumOfProbe(){
+    return 1 + probeLayerList_.size();
+  }
+
+  /*==============================================*/
+  // This function returns the integrand on the full (omega, kx, ky) grid,
+  // stored as [((omegaIdx * numOfKx + kxIdx) * numOfKy + kyIdx) * numOfProbe + probe]
+  // @note
+  // only available with optRetainKGrid. In the MPI version each rank only
+  // fills its own part of the grid
+  /*==============================================*/
+  double* Simulation::getPhiOnKGrid(){
+    if(PhiKGrid_ == nullptr){
+      std::cerr << "Please call OptRetainKGrid before the integration!" << std::endl;
+      throw UTILITY::ValueException("Please call OptRetainKGrid before the integration!");
+    }
+    return PhiKGrid_;
+  }
+  /*==============================================*/
+  // This function returns the number of kx points of integrateKxKy
+  /*==============================================*/
+  int Simulation::getNumOfKx(){
+    return numOfKx_;
+  }
+  /*==============================================*/
+  // This function returns the number of ky points of integrateKxKy
+  /*==============================================*/
+  int Simulation::getNumOfKy(){
+    return numOfKy_;
+  }
+  /*==============================================*/
+  // function returns the fraction of the k points done by the running or
+  // the last integration, it can be called from another thread
+  /*==============================================*/
+  double Simulation::getProgress(){
+    int total = numOfPointTotal_.load();
+    if(total == 0) return 0;
+    return static_cast<double>(numOfPointDone_.load()) / total;
+  }
 
   /*==============================================*/
   // This function return the omega value
@@ -283,21 +1002,25 @@ namespace MESH{
     }
     if(layerIdx == 0 && positions[2] > offset) layerIdx = structure_->getNumOfLayer() - 1;
 
-    RCWArMatrix Gx_r, Gx_l, Gy_r, Gy_l;
-    meshGrid(Gx_mat_, Gx_mat_, Gx_r, Gx_l);
-    meshGrid(Gy_mat_, Gy_mat_, Gy_r, Gy_l);
-
-    RCWArMatrix GxMat = Gx_l - Gx_r;
-    RCWArMatrix GyMat = Gy_l - Gy_r;
+    const RCWArMatrix& GxMat = GTable_.GxMat;
+    const RCWArMatrix& GyMat = GTable_.GyMat;
     int r1 = 0, r2 = nG_-1, r3 = nG_, r4 = 2*nG_-1;
     int pos = (nG_-1)/2;
     if(options_.truncation_ == CIRCULAR_ && dim_ == TWO_) pos = 0;
     arma::cx_rowvec phase = exp(-IMAG_I * (GxMat.row(pos) * positions[0] + GyMat.row(pos) * positions[1]));
-    dcomplex eps_xx = accu(EMatrices_[layerIdx](span(r3, r4), span(r3, r4)).row(pos) % phase);
-    dcomplex eps_xy = -accu(EMatrices_[layerIdx](span(r3, r4), span(r1, r2)).row(pos) % phase);
-    dcomplex eps_yx = -accu(EMatrices_[layerIdx](span(r1, r2), span(r3, r4)).row(pos) % phase);
-    dcomplex eps_yy = accu(EMatrices_[layerIdx](span(r1, r2), span(r1, r2)).row(pos) % phase);
-    RCWAcMatrix eps_zz_mat =inv(eps_zz_Inv_Matrices_[layerIdx]);
+    const RCWAcMatrix& EMatrix = EMatrices_[layerMap_[layerIdx]];
+    dcomplex eps_xx, eps_xy = 0, eps_yx = 0, eps_yy;
+    if(isBlockDiagonal(EMatrix, nG_)){
+      eps_xx = accu(EMatrix.rows(r3, r4).row(pos) % phase);
+      eps_yy = accu(EMatrix.rows(r1, r2).row(pos) % phase);
+    }
+    else{
+      eps_xx = accu(EMatrix(span(r3, r4), span(r3, r4)).row(pos) % phase);
+      eps_xy = -accu(EMatrix(span(r3, r4), span(r1, r2)).row(pos) % phase);
+      eps_yx = -accu(EMatrix(span(r1, r2), span(r3, r4)).row(pos) % phase);
+      eps_yy = accu(EMatrix(span(r1, r2), span(r1, r2)).row(pos) % phase);
+    }
+    RCWAcMatrix eps_zz_mat =inv(eps_zz_Inv_Matrices_[layerMap_[layerIdx]]);
     dcomplex eps_zz = accu(eps_zz_mat.row(pos) % phase);
 
     epsilon[0] = real(eps_xx);
@@ -489,6 +1212,68 @@ namespace MESH{
     epsilonList.epsilonVals = nullptr;
   }
 
+  /*==============================================*/
+  // This function adds an analytic material (Drude, Lorentz or Drude-Lorentz)
+  // to the system. It is evaluated on the omega grid of the simulation
+  // @args:
+  // name: the name of the material
+  // model: the parameters of the dispersion model
+  /*==============================================*/
+  void Simulation::addMaterial(const std::string name, const DispersionModel& model){
+    if(materialInstanceMap_.find(name) != materialInstanceMap_.cend()){
+      std::cerr << name + ": Material already exist!" << std::endl;
+      throw UTILITY::NameInUseException(name + ": Material already exist!");
+      return;
+    }
+    Ptr<Material> material = Material::instanceNew(name, model);
+    materialInstanceMap_.insert(MaterialMap::value_type(name, material));
+    structure_->addMaterial(material);
+  }
+
+  /*==============================================*/
+  // This function adds a uniaxial material to the system
+  // @args:
+  // name: the name of the material
+  // ordinary: the name of the scalar material for epsilon_xx and epsilon_yy
+  // extraordinary: the name of the scalar material for epsilon_zz
+  /*==============================================*/
+  void Simulation::addMaterialUniaxial(const std::string name, const std::string ordinary, const std::string extraordinary){
+    if(materialInstanceMap_.find(name) != materialInstanceMap_.cend()){
+      std::cerr << name + ": Material already exist!" << std::endl;
+      throw UTILITY::NameInUseException(name + ": Material already exist!");
+      return;
+    }
+    if(materialInstanceMap_.find(ordinary) == materialInstanceMap_.cend()){
+      std::cerr << ordinary + ": Material does not exist!" << std::endl;
+      throw UTILITY::IllegalNameException(ordinary + ": Material does not exist!");
+    }
+    if(materialInstanceMap_.find(extraordinary) == materialInstanceMap_.cend()){
+      std::cerr << extraordinary + ": Material does not exist!" << std::endl;
+      throw UTILITY::IllegalNameException(extraordinary + ": Material does not exist!");
+    }
+    Ptr<Material> material = Material::instanceNew(name,
+      materialInstanceMap_.find(ordinary)->second,
+      materialInstanceMap_.find(extraordinary)->second
+    );
+    materialInstanceMap_.insert(MaterialMap::value_type(name, material));
+    structure_->addMaterial(material);
+  }
+
+  /*==============================================*/
+  // This function sets the omega grid of the simulation. All the materials
+  // are evaluated (analytic) or interpolated (tabulated) on this grid.
+  // If not set, the grid of the background material of the first layer is used
+  // @args:
+  // omega: the omega values, in ascending order
+  /*==============================================*/
+  void Simulation::setOmega(const std::vector<double>& omega){
+    if(omega.empty() || !std::is_sorted(omega.begin(), omega.end())){
+      std::cerr << "omega should be non-empty and in ascending order!" << std::endl;
+      throw UTILITY::ValueException("omega should be non-empty and in ascending order!");
+    }
+    omegaGrid_ = omega;
+  }
+
   /*==============================================*/
   // This function reset the dielectric of a material
   // @args:
@@ -509,6 +1294,10 @@ namespace MESH{
     Ptr<Material> material = materialInstanceMap_.find(name)->second;
     EPSTYPE originalType = material->getType();
     int numOfOmega = material->getNumOfOmega();
+    if(numOfOmega == 0){
+      std::cerr << name + ": Material has no omega grid yet, please call it after initialization!" << std::endl;
+      throw UTILITY::ValueException(name + ": Material has no omega grid yet, please call it after initialization!");
+    }
     EPSILON newEpsilon;
     newEpsilon.epsilonVals = new EpsilonVal[numOfOmega];
     // if a scalar
@@ -652,6 +1441,33 @@ namespace MESH{
     structure_->addLayer(newLayer);
   }
   /*==============================================*/
+  // This function repeats existing layers periodically on top of the structure.
+  // The repetitions are the same layers, so changing a layer changes all of them,
+  // and a stack of many periods costs about as much as a few of them
+  // @args:
+  // names: the names of the layers in one period, from bottom to top
+  // count: the number of periods added
+  // @note
+  // a repeated layer cannot be a source or a probe
+  /*==============================================*/
+  void Simulation::addLayerRepeat(const std::vector<std::string>& names, const int count){
+    if(names.empty() || count < 1){
+      std::cerr << "Repeat should have at least one layer and one period!" << std::endl;
+      throw UTILITY::ValueException("Repeat should have at least one layer and one period!");
+    }
+    for(size_t i = 0; i < names.size(); i++){
+      if(layerInstanceMap_.find(names[i]) == layerInstanceMap_.cend()){
+        std::cerr << names[i] + ": Layer does not exist!" << std::endl;
+        throw UTILITY::IllegalNameException(names[i] + ": Layer does not exist!");
+      }
+    }
+    for(int c = 0; c < count; c++){
+      for(size_t i = 0; i < names.size(); i++){
+        structure_->addLayer(layerInstanceMap_.find(names[i])->second);
+      }
+    }
+  }
+  /*==============================================*/
   // This function deletes an existing layer
   // @args:
   // name: the name of the layer
@@ -662,8 +1478,16 @@ namespace MESH{
       throw UTILITY::NameInUseException(name + ": Layer does not exist!");
       return;
     }
+    Ptr<Layer> layer = layerInstanceMap_.find(name)->second;
     layerInstanceMap_.erase(name);
-    structure_->deleteLayerByName(name);
+    // a repeated layer is removed from every period
+    int numOfLayer = structure_->getNumOfLayer(), count = 0;
+    for(int i = 0; i < numOfLayer; i++){
+      if(structure_->getLayerByIndex(i) == layer) count++;
+    }
+    for(int i = 0; i < count; i++){
+      structure_->deleteLayerByName(name);
+    }
   }
   /*==============================================*/
   // This function sets a layer as the source
@@ -717,6 +1541,27 @@ namespace MESH{
     }
     target_z_ = target_z * MICRON;
   }
+  /*==============================================*/
+  // This function adds an additional probe, computed in the same pass
+  // @args:
+  // name: the name of the probe layer
+  // target_z: the z-th coordinate, negative value for the default position
+  /*==============================================*/
+  void Simulation::addProbeLayer(const std::string name, const double target_z){
+    if(layerInstanceMap_.find(name) == layerInstanceMap_.cend()){
+      std::cerr << name + ": Layer does not exist!" << std::endl;
+      throw UTILITY::IllegalNameException(name + ": Layer does not exist!");
+    }
+    Ptr<Layer> layer = layerInstanceMap_.find(name)->second;
+    bool isBoundary = structure_->getLayerByIndex(0) == layer ||
+      structure_->getLayerByIndex(structure_->getNumOfLayer() - 1) == layer;
+    if(target_z >= 0 && !isBoundary && target_z > layer->getThickness()){
+      std::cerr << "Value of " + std::to_string(target_z) + " shouldn't exceed the thickness of the layer" << std::endl;
+      throw UTILITY::RangeException("Value of " + std::to_string(target_z) + " shouldn't exceed the thickness of the layer");
+    }
+    probeLayerList_.push_back(layer);
+    probeZList_.push_back(target_z < 0 ? -1 : target_z * MICRON);
+  }
   
 
   /*==============================================*/
@@ -772,30 +1617,63 @@ namespace MESH{
   // N: the number of total G
   /*==============================================*/
   double Simulation::getPhiAtKxKy(const int omegaIdx, const double kx, const double ky){
+    double phi;
+    ThreadScope threadScope(numOfLapackThread_, numOfPointThread_ > 1 || numOfLapackThread_ > 1);
+    this->getPhiAtKxKyInternal(omegaIdx, kx, ky, ProbeList(1, Probe(targetLayer_, target_z_)), &phi);
+    return phi;
+  }
+  /*==============================================*/
+  // This function gets the Phi at given kx and ky for a list of probes
+  // @args:
+  // omegaIndex: the index of omega
+  // kx: the kx value, normalized
+  // ky: the ky value, normalized
+  // probeList: the list of probes
+  // phi: the Phi at each probe (output)
+  // phiBySource: the Phi at each probe from each layer (output), see poyntingFlux
+  // eigenCache: eigenvectors from the previous k point, nullptr to disable
+  // bundle: the matrices at omegaIdx, nullptr to use (and build) the ones of the simulation
+  /*==============================================*/
+  void Simulation::getPhiAtKxKyInternal(const int omegaIdx, const double kx, const double ky,
+    const ProbeList& probeList, double* phi, double* phiBySource, EigenCache* eigenCache,
+    const RCWAMatricesBundle* bundle){
     if(omegaIdx >= numOfOmega_){
       std::cerr << std::to_string(omegaIdx) + ": out of range!" << std::endl;
       throw UTILITY::RangeException(std::to_string(omegaIdx) + ": out of range!");
     }
-    if(curOmegaIndex_ != omegaIdx){
+    if(bundle == nullptr && curOmegaIndex_ != omegaIdx){
       curOmegaIndex_ = omegaIdx;
       this->buildRCWAMatrices();
     }
-    return omegaList_[omegaIdx] / datum::c_0 / POW3(datum::pi) / 2.0 *
-      poyntingFlux(omegaList_[omegaIdx] / datum::c_0 / MICRON,
-        thicknessListVec_,
-        kx,
-        ky,
-        EMatrices_,
-        grandImaginaryMatrices_,
-        eps_zz_Inv_Matrices_,
-        Gx_mat_,
-        Gy_mat_,
-        sourceList_,
-        targetLayer_,
-        nG_,
-        options_.polarization,
-        target_z_
-      );
+    PROFILE::Timer timer(PROFILE::KPOINT_, 0, nG_);
+    poyntingFlux(omegaList_[omegaIdx] / datum::c_0 / MICRON,
+      thicknessListVec_,
+      kx,
+      ky,
+      bundle == nullptr ? EMatrices_ : bundle->EMatrices,
+      bundle == nullptr ? grandImaginaryMatrices_ : bundle->grandImaginaryMatrices,
+      bundle == nullptr ? eps_zz_Inv_Matrices_ : bundle->eps_zz_Inv_Matrices,
+      Gx_mat_,
+      Gy_mat_,
+      sourceList_,
+      probeList,
+      nG_,
+      options_.polarization,
+      phi,
+      phiBySource,
+      eigenCache,
+      numOfPointThread_,
+      &repeatList_
+    );
+    double scale = omegaList_[omegaIdx] / datum::c_0 / POW3(datum::pi) / 2.0;
+    for(size_t i = 0; i < probeList.size(); i++){
+      phi[i] *= scale;
+    }
+    if(phiBySource != nullptr){
+      for(size_t i = 0; i < probeList.size() * thicknessListVec_.n_elem * 3; i++){
+        phiBySource[i] *= scale;
+      }
+    }
   }
   /*==============================================*/
   // function return the number of G values
@@ -825,9 +1703,32 @@ namespace MESH{
       rescaledLattice.area = reciprocalLattice_.area / POW2(MICRON);
     }
     GSEL::getGMatrices(nG_, rescaledLattice, Gx_mat_, Gy_mat_, dim_, options_.truncation_);
+    FMM::getGDifferenceTable(Gx_mat_, Gy_mat_, GTable_);
     // get constants
     Ptr<Layer> firstLayer = structure_->getLayerByIndex(0);
     Ptr<Material> backGround = firstLayer->getBackGround();
+    // bring all the materials onto the same omega grid
+    std::vector<double> omegaGrid = omegaGrid_;
+    if(omegaGrid.empty()){
+      if(backGround->getNumOfOmega() == 0){
+        std::cerr << "Please set omega for analytic materials!" << std::endl;
+        throw UTILITY::ValueException("Please set omega for analytic materials!");
+      }
+      omegaGrid.assign(backGround->getOmegaList(), backGround->getOmegaList() + backGround->getNumOfOmega());
+    }
+    // only the materials of the layers and their patterns, a material that is
+    // not used may be tabulated on a narrower range
+    std::set<Material*> usedMaterials;
+    for(int i = 0; i < structure_->getNumOfLayer(); i++){
+      Ptr<Layer> layer = structure_->getLayerByIndex(i);
+      usedMaterials.insert(layer->getBackGround().ptr());
+      for(const_MaterialIter m_it = layer->getMaterialsBegin(); m_it != layer->getMaterialsEnd(); m_it++){
+        usedMaterials.insert(m_it->ptr());
+      }
+    }
+    for(std::set<Material*>::const_iterator it = usedMaterials.cbegin(); it != usedMaterials.cend(); it++){
+      (*it)->resample(omegaGrid.data(), omegaGrid.size());
+    }
     numOfOmega_ = backGround->getNumOfOmega();
     omegaList_ = backGround->getOmegaList();
     int numOfLayer = structure_->getNumOfLayer();
@@ -836,20 +1737,73 @@ namespace MESH{
     grandImaginaryMatrices_.resize(numOfLayer);
     eps_zz_Inv_Matrices_.resize(numOfLayer);
 
+    // the probe layer comes first, followed by the additional probes
+    probeList_.clear();
+    probeList_.push_back(Probe(targetLayer_, target_z_));
+    for(size_t p = 0; p < probeLayerList_.size(); p++){
+      int probeLayer = -1;
+      for(int i = 0; i < numOfLayer; i++){
+        if(structure_->getLayerByIndex(i) == probeLayerList_[p]) probeLayer = i;
+      }
+      if(probeLayer == -1){
+        std::cerr << probeLayerList_[p]->getName() + ": Layer does not exist!" << std::endl;
+        throw UTILITY::IllegalNameException(probeLayerList_[p]->getName() + ": Layer does not exist!");
+      }
+      probeList_.push_back(Probe(probeLayer, probeZList_[p]));
+    }
+    int numOfProbe = probeList_.size();
+
     thicknessListVec_ = zeros<RCWArVector>(numOfLayer);
     sourceList_.resize(numOfLayer);
     for(int i = 0; i < numOfLayer; i++){
       thicknessListVec_(i) = (structure_->getLayerByIndex(i))->getThickness() * MICRON;
       sourceList_[i] = (structure_->getLayerByIndex(i))->checkIsSource();
-      if(sourceList_[i] && i >= targetLayer_){
-        std::cerr << "Probe layer should be higher than source layer!" << std::endl;
-        throw UTILITY::RangeException("Probe layer should be higher than source layer!");
+      for(int p = 0; p < numOfProbe; p++){
+        if(sourceList_[i] && i >= probeList_[p].first){
+          std::cerr << "Probe layer should be higher than source layer!" << std::endl;
+          throw UTILITY::RangeException("Probe layer should be higher than source layer!");
+        }
       }
     }
     // set the first and last layer to have 0 thickness
     thicknessListVec_(0) = 0;
     thicknessListVec_(numOfLayer - 1) = 0;
 
+    // find the periodic runs of the same layers between the first and the last layer,
+    // the period is the distance from a layer to its next appearance
+    repeatList_.clear();
+    for(int i = 1; i < numOfLayer - 1;){
+      Ptr<Layer> layer = structure_->getLayerByIndex(i);
+      int period = 0, count = 1;
+      for(int j = i + 1; j < numOfLayer - 1 && period == 0; j++){
+        if(structure_->getLayerByIndex(j) == layer) period = j - i;
+      }
+      while(period > 0 && i + (count + 1) * period <= numOfLayer - 1){
+        bool same = true;
+        for(int t = 0; t < period && same; t++){
+          same = structure_->getLayerByIndex(i + count * period + t) == structure_->getLayerByIndex(i + t);
+        }
+        if(!same) break;
+        count++;
+      }
+      if(count < 2){
+        i++;
+        continue;
+      }
+      for(int t = i; t < i + period * count; t++){
+        Ptr<Layer> repeated = structure_->getLayerByIndex(t);
+        bool isProbe = false;
+        for(int p = 0; p < numOfProbe; p++) isProbe = isProbe || probeList_[p].first == t;
+        if(repeated->checkIsSource() || isProbe){
+          std::cerr << repeated->getName() + ": a repeated layer cannot be a source or a probe!" << std::endl;
+          throw UTILITY::ValueException(repeated->getName() + ": a repeated layer cannot be a source or a probe!");
+        }
+      }
+      repeatList_.push_back(RepeatGroup{i, period, count});
+      i += period * count;
+    }
+    getLayerMap(repeatList_, numOfLayer, layerMap_);
+
     if(dim_ != NO_ && reciprocalLattice_.bx[0] == 0.0){
       std::cerr << "Lattice not set!" << std::endl;
       throw UTILITY::ValueException("Lattice not set!");
@@ -860,25 +1814,64 @@ namespace MESH{
     }
 
     // initializing for the output
-    Phi_ = new double[numOfOmega_];
-    for(int i = 0; i < numOfOmega_; i++){
+    if(Phi_ != nullptr){
+      delete[] Phi_;
+    }
+    Phi_ = new double[numOfOmega_ * numOfProbe];
+    for(int i = 0; i < numOfOmega_ * numOfProbe; i++){
       Phi_[i] = 0;
     }
+    if(PhiBySource_ != nullptr){
+      delete[] PhiBySource_;
+    }
+    PhiBySource_ = new double[numOfOmega_ * numOfProbe * numOfLayer * 3];
+    for(int i = 0; i < numOfOmega_ * numOfProbe * numOfLayer * 3; i++){
+      PhiBySource_[i] = 0;
+    }
+    if(PhiKGrid_ != nullptr){
+      delete[] PhiKGrid_;
+      PhiKGrid_ = nullptr;
+    }
     // initialize layers
     for(int i = 0; i < numOfLayer; i++){
       Ptr<Layer> layer = structure_->getLayerByIndex(i);
       layer->getGeometryContainmentRelation();
     }
+    // the threads of a single k point, now that nG and the layers are known
+    this->setThreadSplit(1);
   }
   /*==============================================*/
-  // This function builds up the matrices
+  // This function builds up the matrices at curOmegaIndex_
   /*==============================================*/
   void Simulation::buildRCWAMatrices(){
-    RCWAcMatrices eps_xx_Matrices, eps_xy_Matrices, eps_yx_Matrices, eps_yy_Matrices;
-    RCWAcMatrices im_eps_xx_Matrices, im_eps_xy_Matrices, im_eps_yx_Matrices, im_eps_yy_Matrices, im_eps_zz_Matrices;
+    RCWAMatricesBundle bundle;
+    this->buildRCWAMatrices(curOmegaIndex_, bundle);
+    std::swap(EMatrices_, bundle.EMatrices);
+    std::swap(grandImaginaryMatrices_, bundle.grandImaginaryMatrices);
+    std::swap(eps_zz_Inv_Matrices_, bundle.eps_zz_Inv_Matrices);
+  }
+  /*==============================================*/
+  // This function builds up the matrices at one frequency. It only reads
+  // the simulation, so it can run concurrently with the k point work
+  // @args:
+  // omegaIdx: the index of omega
+  // bundle: the matrices of all the layers (output)
+  // layerMask: the layers to be rebuilt, nullptr for all. The matrices of the
+  // other layers in the bundle are kept, so they should be at omegaIdx
+  /*==============================================*/
+  void Simulation::buildRCWAMatrices(const int omegaIdx, RCWAMatricesBundle& bundle, const std::vector<char>* layerMask){
+    int numOfLayer = structure_->getNumOfLayer();
+    RCWAcMatrices eps_xx_Matrices(numOfLayer), eps_xy_Matrices(numOfLayer), eps_yx_Matrices(numOfLayer), eps_yy_Matrices(numOfLayer);
+    RCWAcMatrices im_eps_xx_Matrices(numOfLayer), im_eps_xy_Matrices(numOfLayer), im_eps_yx_Matrices(numOfLayer),
+      im_eps_yy_Matrices(numOfLayer), im_eps_zz_Matrices(numOfLayer);
 
+    PROFILE::Timer timer(PROFILE::BUILD_MATRICES_, 0, nG_);
     RCWAcMatrix onePadding1N = eye<RCWAcMatrix>(nG_, nG_);
-    int numOfLayer = structure_->getNumOfLayer();
+    int nGDiff = GTable_.uniqueGx.n_elem;
+    bundle.omegaIdx = omegaIdx;
+    bundle.EMatrices.resize(numOfLayer);
+    bundle.grandImaginaryMatrices.resize(numOfLayer);
+    bundle.eps_zz_Inv_Matrices.resize(numOfLayer);
     double area;
     if(dim_ == ONE_){
       area = lattice_.area * MICRON;
@@ -887,20 +1880,24 @@ namespace MESH{
       area = lattice_.area * POW2(MICRON);
     }
     for(int i = 0; i < numOfLayer; i++){
+      if(layerMask != nullptr && !(*layerMask)[i]) continue;
+      // repeated layers use the matrices of the first period
+      if(layerMap_[i] != i) continue;
       Ptr<Layer> layer = structure_->getLayerByIndex(i);
       Ptr<Material> backGround = layer->getBackGround();
 
-      RCWAcMatrix eps_xx(nG_, nG_, fill::zeros), eps_xy(nG_, nG_, fill::zeros), eps_yx(nG_, nG_, fill::zeros), eps_yy(nG_, nG_, fill::zeros), eps_zz(nG_, nG_, fill::zeros), eps_zz_Inv(nG_, nG_, fill::zeros);
-      RCWAcMatrix im_eps_xx(nG_, nG_, fill::zeros), im_eps_xy(nG_, nG_, fill::zeros), im_eps_yx(nG_, nG_, fill::zeros), im_eps_yy(nG_, nG_, fill::zeros), im_eps_zz(nG_, nG_, fill::zeros);
+      // the patterns are accumulated on the distinct G differences
+      RCWAcMatrix eps_xx(nGDiff, 1, fill::zeros), eps_xy(nGDiff, 1, fill::zeros), eps_yx(nGDiff, 1, fill::zeros), eps_yy(nGDiff, 1, fill::zeros), eps_zz(nGDiff, 1, fill::zeros), eps_zz_Inv;
+      RCWAcMatrix im_eps_xx(nGDiff, 1, fill::zeros), im_eps_xy(nGDiff, 1, fill::zeros), im_eps_yx(nGDiff, 1, fill::zeros), im_eps_yy(nGDiff, 1, fill::zeros), im_eps_zz(nGDiff, 1, fill::zeros);
 
-      EpsilonVal epsBG = backGround->getEpsilonAtIndex(curOmegaIndex_);
+      EpsilonVal epsBG = backGround->getEpsilonAtIndex(omegaIdx);
       EpsilonVal epsBGTensor = FMM::toTensor(epsBG, backGround->getType());
       const_MaterialIter m_it = layer->getMaterialsBegin();
       int count = 0;
       for(const_PatternIter it = layer->getPatternsBegin(); it != layer->getPatternsEnd(); it++){
         Pattern pattern = *it;
         Ptr<Material> material = *(m_it + count);
-        EpsilonVal epsilon = material->getEpsilonAtIndex(curOmegaIndex_);
+        EpsilonVal epsilon = material->getEpsilonAtIndex(omegaIdx);
         count++;
         EpsilonVal epsParentTensor;
         if(pattern.parent == -1){
@@ -908,7 +1905,7 @@ namespace MESH{
         }
         else{
           Ptr<Material> materialParent = *(m_it + pattern.parent);
-          EpsilonVal epsParent = materialParent->getEpsilonAtIndex(curOmegaIndex_);
+          EpsilonVal epsParent = materialParent->getEpsilonAtIndex(omegaIdx);
           epsParentTensor = FMM::toTensor(epsParent, materialParent->getType());
         }
         switch(pattern.type_){
@@ -932,7 +1929,7 @@ namespace MESH{
               epsParentTensor,
               epsilon,
               material->getType(),
-              Gx_mat_,
+              GTable_,
               center,
               width,
               area,
@@ -962,8 +1959,7 @@ namespace MESH{
               epsParentTensor,
               epsilon,
               material->getType(),
-              Gx_mat_,
-              Gy_mat_,
+              GTable_,
               centers,
               angle,
               widths,
@@ -992,8 +1988,7 @@ namespace MESH{
               epsParentTensor,
               epsilon,
               material->getType(),
-              Gx_mat_,
-              Gy_mat_,
+              GTable_,
               centers,
               radius,
               area,
@@ -1022,8 +2017,7 @@ namespace MESH{
               epsParentTensor,
               epsilon,
               material->getType(),
-              Gx_mat_,
-              Gy_mat_,
+              GTable_,
               centers,
               angle,
               halfwidths,
@@ -1056,8 +2050,7 @@ namespace MESH{
              epsParentTensor,
              epsilon,
              material->getType(),
-             Gx_mat_,
-             Gy_mat_,
+             GTable_,
              centers,
              angle,
              edgeList,
@@ -1066,9 +2059,112 @@ namespace MESH{
            );
             break;
           }
+          /*************************************/
+          // if the pattern is an array of circles (2D)
+          /************************************/
+          case CIRCLES_:{
+            const PatternArray& array = *pattern.array_;
+            FMM::transformCircleArray(
+              eps_xx,
+              eps_xy,
+              eps_yx,
+              eps_yy,
+              eps_zz,
+              im_eps_xx,
+              im_eps_xy,
+              im_eps_yx,
+              im_eps_yy,
+              im_eps_zz,
+              epsParentTensor,
+              epsilon,
+              material->getType(),
+              GTable_,
+              RCWArVector(array.centerx) * MICRON,
+              RCWArVector(array.centery) * MICRON,
+              RCWArVector(array.width1) * MICRON,
+              area,
+              layer->hasTensor()
+            );
+            break;
+          }
+          /*************************************/
+          // if the pattern is an array of rectangles (2D)
+          /************************************/
+          case RECTANGLES_:{
+            const PatternArray& array = *pattern.array_;
+            FMM::transformRectangleArray(
+              eps_xx,
+              eps_xy,
+              eps_yx,
+              eps_yy,
+              eps_zz,
+              im_eps_xx,
+              im_eps_xy,
+              im_eps_yx,
+              im_eps_yy,
+              im_eps_zz,
+              epsParentTensor,
+              epsilon,
+              material->getType(),
+              GTable_,
+              RCWArVector(array.centerx) * MICRON,
+              RCWArVector(array.centery) * MICRON,
+              RCWArVector(array.angle) * datum::pi / 180,
+              RCWArVector(array.width1) * MICRON,
+              RCWArVector(array.width2) * MICRON,
+              area,
+              layer->hasTensor()
+            );
+            break;
+          }
+          /*************************************/
+          // if the pattern is a part of a raster (2D)
+          /************************************/
+          case RASTER_:{
+            RCWArMatrix mask(pattern.rasterSize_[0], pattern.rasterSize_[1]);
+            const std::vector<int>& raster = *pattern.raster_;
+            for(size_t j = 0; j < raster.size(); j++){
+              mask(j) = raster[j] == pattern.rasterValue_ ? 1 : 0;
+            }
+            double lattice1[2] = {lattice_.bx[0] * MICRON, lattice_.bx[1] * MICRON};
+            double lattice2[2] = {lattice_.by[0] * MICRON, lattice_.by[1] * MICRON};
+            FMM::transformRaster(
+              eps_xx,
+              eps_xy,
+              eps_yx,
+              eps_yy,
+              eps_zz,
+              im_eps_xx,
+              im_eps_xy,
+              im_eps_yx,
+              im_eps_yy,
+              im_eps_zz,
+              epsParentTensor,
+              epsilon,
+              material->getType(),
+              GTable_,
+              mask,
+              lattice1,
+              lattice2,
+              layer->hasTensor()
+            );
+            break;
+          }
           default: break;
         }
       }
+      eps_xx = FMM::expandGDifference(GTable_, eps_xx);
+      eps_yy = FMM::expandGDifference(GTable_, eps_yy);
+      eps_zz = FMM::expandGDifference(GTable_, eps_zz);
+      im_eps_xx = FMM::expandGDifference(GTable_, im_eps_xx);
+      im_eps_yy = FMM::expandGDifference(GTable_, im_eps_yy);
+      im_eps_zz = FMM::expandGDifference(GTable_, im_eps_zz);
+      if(layer->hasTensor()){
+        eps_xy = FMM::expandGDifference(GTable_, eps_xy);
+        eps_yx = FMM::expandGDifference(GTable_, eps_yx);
+        im_eps_xy = FMM::expandGDifference(GTable_, im_eps_xy);
+        im_eps_yx = FMM::expandGDifference(GTable_, im_eps_yx);
+      }
       /*************************************/
       // collection information from the background
       /************************************/
@@ -1079,7 +2175,9 @@ namespace MESH{
       im_eps_yy += epsBGTensor.tensor[7] * onePadding1N;
 
       eps_zz += dcomplex(epsBGTensor.tensor[8], epsBGTensor.tensor[9]) * onePadding1N;
-      eps_zz_Inv = eps_zz.i();
+      // eps_zz of a uniform layer is diagonal, and needs no factorization
+      if(layer->getNumOfPattern() == 0) eps_zz_Inv = diagmat(1.0 / eps_zz.diag());
+      else eps_zz_Inv = eps_zz.i();
 
       im_eps_zz += epsBGTensor.tensor[9] * onePadding1N;
 
@@ -1094,20 +2192,23 @@ namespace MESH{
             / 2.0 / IMAG_I * onePadding1N;
       }
 
-      eps_xx_Matrices.push_back(eps_xx);
-      eps_xy_Matrices.push_back(eps_xy);
-      eps_yx_Matrices.push_back(eps_yx);
-      eps_yy_Matrices.push_back(eps_yy);
-      eps_zz_Inv_Matrices_[i] = eps_zz_Inv;
-      im_eps_xx_Matrices.push_back(im_eps_xx);
-      im_eps_xy_Matrices.push_back(im_eps_xy);
-      im_eps_yx_Matrices.push_back(im_eps_yx);
-      im_eps_yy_Matrices.push_back(im_eps_yy);
-      im_eps_zz_Matrices.push_back(im_eps_zz);
+      eps_xx_Matrices[i] = eps_xx;
+      eps_yy_Matrices[i] = eps_yy;
+      bundle.eps_zz_Inv_Matrices[i] = eps_zz_Inv;
+      im_eps_xx_Matrices[i] = im_eps_xx;
+      im_eps_yy_Matrices[i] = im_eps_yy;
+      im_eps_zz_Matrices[i] = im_eps_zz;
+      // the off-diagonal blocks are left empty for a block diagonal layer
+      if(layer->hasTensor()){
+        eps_xy_Matrices[i] = eps_xy;
+        eps_yx_Matrices[i] = eps_yx;
+        im_eps_xy_Matrices[i] = im_eps_xy;
+        im_eps_yx_Matrices[i] = im_eps_yx;
+      }
     }
 
     getEMatrices(
-      EMatrices_,
+      bundle.EMatrices,
       eps_xx_Matrices,
       eps_xy_Matrices,
       eps_yx_Matrices,
@@ -1117,7 +2218,7 @@ namespace MESH{
     );
 
     getGrandImaginaryMatrices(
-      grandImaginaryMatrices_,
+      bundle.grandImaginaryMatrices,
       im_eps_xx_Matrices,
       im_eps_xy_Matrices,
       im_eps_yx_Matrices,
@@ -1201,6 +2302,20 @@ namespace MESH{
               }
               break;
             }
+            case CIRCLES_:{
+              std::cout << "array of " << (*it).array_->centerx.size() << " circles" << std::endl;
+              break;
+            }
+            case RECTANGLES_:{
+              std::cout << "array of " << (*it).array_->centerx.size() << " rectangles" << std::endl;
+              break;
+            }
+            case RASTER_:{
+              std::cout << "raster, ";
+              std::cout << "(n_x, n_y) = (" << (*it).rasterSize_[0] << ", " << (*it).rasterSize_[1] << "), ";
+              std::cout << "pixels with index " << (*it).rasterValue_ << std::endl;
+              break;
+            }
             default: break;
           }
           if(it->parent != -1){
@@ -1214,10 +2329,20 @@ namespace MESH{
   }
   /*==============================================*/
   // function print intermediate results
+  // @args:
+  // output_flag: appended to the name of the output files
+  // format: one of Text, Binary (double) or Binary32 (float). The binary
+  // formats write a single file that can be read by IntermediateWriter::read,
+  // of about 0.6 (Binary) and 0.3 (Binary32) times the size of the text output
   /*==============================================*/
-  void Simulation::optPrintIntermediate(const std::string& output_flag){
+  void Simulation::optPrintIntermediate(const std::string& output_flag, const std::string& format){
+    if(format != "Text" && format != "Binary" && format != "Binary32"){
+      std::cerr << "format should be one of Text, Binary or Binary32!" << std::endl;
+      throw UTILITY::ValueException("format should be one of Text, Binary or Binary32!");
+    }
     options_.PrintIntermediate = true;
     options_.output_flag = output_flag;
+    options_.output_format = format;
   }
   /*==============================================*/
   // function sets that only TE mode is computed
@@ -1248,18 +2373,154 @@ namespace MESH{
       UTILITY::ValueException("truncation should be one of Circular or Parallelogramic!");
     }
   }
-
+
+  /*==============================================*/
+  // function sets the eigen solver to continue from the previous k point
+  // @note
+  // each thread then walks a contiguous ky strip at fixed kx and refines the
+  // eigenvectors of its previous point, falling back to a full solve
+  /*==============================================*/
+  void Simulation::optUseEigenContinuation(){
+    options_.eigenContinuation = true;
+  }
+
+  /*==============================================*/
+  // function keeps the integrand at every (omega, kx, ky) point of
+  // integrateKxKy, instead of only the running sums
+  /*==============================================*/
+  void Simulation::optRetainKGrid(){
+    options_.retainKGrid = true;
+  }
+
+  /*==============================================*/
+  // function sets the checkpoint file of integrateKxKy. Finished k blocks
+  // are appended to the file, and if the file already exists for the same
+  // simulation, these blocks are loaded and skipped
+  // @args:
+  // fileName: the name of the checkpoint file, the MPI version appends _rank_<rank>
+  // interval: the minimum time in seconds between two flushes to disk
+  /*==============================================*/
+  void Simulation::optCheckpoint(const std::string& fileName, const double interval){
+    if(fileName == ""){
+      std::cerr << "Checkpoint file name cannot be empty!" << std::endl;
+      throw UTILITY::ValueException("Checkpoint file name cannot be empty!");
+    }
+    options_.checkpointFile = fileName;
+    options_.checkpointInterval = interval;
+  }
+
+  /*==============================================*/
+  // function turns on the timers of the phases of the simulation, the report
+  // is written at the end of every integration or sweep
+  // @args:
+  // fileName: the name of the report, the MPI version appends _rank_<rank>
+  // format: JSON or CSV
+  /*==============================================*/
+  void Simulation::optProfile(const std::string& fileName, const std::string& format){
+    if(format != "JSON" && format != "CSV"){
+      std::cerr << "Wrong profile format: use JSON or CSV!" << std::endl;
+      throw UTILITY::ValueException("Wrong profile format: use JSON or CSV!");
+    }
+    options_.profile = true;
+    options_.profileFormat = format;
+    if(fileName == ""){
+      options_.profileFile = format == "JSON" ? "mesh_profile.json" : "mesh_profile.csv";
+    }
+    else{
+      options_.profileFile = fileName;
+    }
+  }
+  /*==============================================*/
+  // function writes the report of the profiler
+  // @args:
+  // numOfPoint: the number of points computed
+  // rank: the rank of the MPI run, -1 if not MPI
+  /*==============================================*/
+  void Simulation::writeProfile(const int numOfPoint, const int rank){
+    profiler_.stop();
+    std::vector< std::pair<std::string, double> > info;
+    info.push_back(std::make_pair("numOfG", nG_));
+    info.push_back(std::make_pair("numOfLayer", structure_->getNumOfLayer()));
+    info.push_back(std::make_pair("numOfOmega", numOfOmega_));
+    info.push_back(std::make_pair("numOfPoint", numOfPoint));
+    info.push_back(std::make_pair("numOfThread", numOfThread_));
+    info.push_back(std::make_pair("rank", rank));
+    std::string fileName = options_.profileFile;
+    if(rank >= 0) fileName += "_rank_" + std::to_string(rank);
+    profiler_.writeReport(fileName, options_.profileFormat, info);
+  }
   /*==============================================*/
   // function print intermediate results
   /*==============================================*/
-  void Simulation::setThread(const int thread){
+  void Simulation::setThread(const int thread, const std::string& policy){
     if(thread <= 0){
       std::cerr << "Number of thread should >= 1!" << std::endl;
       throw UTILITY::RangeException("Number of thread should >= 1!");
     }
+    if(policy.compare("Auto") == 0){
+      options_.threadPolicy = AUTO_;
+    }
+    else if(policy.compare("OverK") == 0){
+      options_.threadPolicy = OVERK_;
+    }
+    else if(policy.compare("InsideLAPACK") == 0){
+      options_.threadPolicy = INSIDELAPACK_;
+    }
+    else if(policy.compare("Split") == 0){
+      options_.threadPolicy = SPLIT_;
+    }
+    else{
+      std::cerr << "policy should be one of Auto, OverK, InsideLAPACK or Split!" << std::endl;
+      throw UTILITY::ValueException("policy should be one of Auto, OverK, InsideLAPACK or Split!");
+    }
     #if defined(_OPENMP)
       numOfThread_ = std::min(thread, omp_get_max_threads());
     #endif
+    this->setThreadSplit(1);
+  }
+  /*==============================================*/
+  // function divides the threads between the k points, the layers and
+  // sources of every k point, and the LAPACK calls
+  // @args:
+  // numOfTask: the number of k points that can run concurrently
+  // @return:
+  // the number of threads over the k points
+  // @note
+  // OverK: all threads over k points, LAPACK single threaded
+  // InsideLAPACK: one k point at a time, all threads inside LAPACK
+  // Split: threads over the k points, the remaining ones inside LAPACK
+  // Auto: threads over the k points, the remaining ones over the layers
+  // and sources of every k point. It only looks at the number of tasks and
+  // of layers, not at nG, since no crossover to Split or InsideLAPACK has
+  // been measured, see examples/Thread_Policy
+  // The threads are only set on the process by a ThreadScope
+  /*==============================================*/
+  int Simulation::setThreadSplit(const int numOfTask){
+    int numOfKThread = std::max(1, std::min(numOfThread_, numOfTask));
+    int numOfLapackThread = 1;
+    numOfPointThread_ = 1;
+    switch(options_.threadPolicy){
+      case OVERK_:{
+        break;
+      }
+      case INSIDELAPACK_:{
+        numOfKThread = 1;
+        numOfLapackThread = numOfThread_;
+        break;
+      }
+      case SPLIT_:{
+        numOfLapackThread = numOfThread_ / numOfKThread;
+        break;
+      }
+      case AUTO_:{
+        int numOfLayer = structure_->getNumOfLayer();
+        numOfPointThread_ = std::max(1, std::min(numOfThread_ / numOfKThread, numOfLayer));
+        break;
+      }
+      default: break;
+    }
+    numOfLapackThread_ = numOfLapackThread;
+    return numOfKThread;
   }
   /*==============================================*/
   // Function setting the integral over kx
@@ -1386,15 +2647,35 @@ namespace MESH{
     prefactor_ *= 2;
   }
   /*==============================================*/
-  // This function computes the flux for internal usage
-  // @args:
-  // start: the starting index
-  // end: the end index
+  // Compensated (Neumaier) summation of a set of values, so that summing
+  // up millions of k points on the fly does not lose accuracy
   /*==============================================*/
-  void Simulation::integrateKxKyInternal(const int start, const int end, const bool parallel, const int rank){
-
-    double* scalex = new double[numOfOmega_];
-    double* scaley = new double[numOfOmega_];
+  typedef struct COMPENSATEDSUM{
+    std::vector<double> sum;
+    std::vector<double> comp;
+    explicit COMPENSATEDSUM(const size_t n = 0) : sum(n, 0), comp(n, 0){}
+    void add(const size_t i, const double val){
+      double t = sum[i] + val;
+      if(std::abs(sum[i]) >= std::abs(val)) comp[i] += (sum[i] - t) + val;
+      else comp[i] += (val - t) + sum[i];
+      sum[i] = t;
+    }
+    double get(const size_t i) const{
+      return sum[i] + comp[i];
+    }
+  } CompensatedSum;
+  /*==============================================*/
+  // This function computes the scaling of the k grid and the weight of
+  // each k point in the integral at every omega
+  // @args:
+  // scalex: the scaling of kx (output)
+  // scaley: the scaling of ky (output)
+  // weight: the weight of each k point (output)
+  /*==============================================*/
+  void Simulation::getKGridWeights(std::vector<double>& scalex, std::vector<double>& scaley, std::vector<double>& weight){
+    scalex.assign(numOfOmega_, 1);
+    scaley.assign(numOfOmega_, 1);
+    weight.assign(numOfOmega_, 0);
     // here dkx is not normalized
     double dkx = (kxEnd_ - kxStart_) / (numOfKx_ - 1);
     // here kyEnd_ is normalized for 1D case
@@ -1424,139 +2705,336 @@ namespace MESH{
       }
     }
 
-    double* resultArray = new double[numOfKx_ * numOfKy_ * numOfOmega_];
-    for(int i = 0; i < numOfKx_ * numOfKy_ * numOfOmega_; i++){
-      resultArray[i] = 0;
+    for(int i = 0; i < numOfOmega_; i++){
+      weight[i] = prefactor_ * dkx / scalex[i] * dky / scaley[i]
+        * POW2(omegaList_[i] / datum::c_0) * std::abs(sin(reciprocalLattice_.angle * datum::pi/180));
+    }
+  }
+  /*==============================================*/
+  // This function computes the flux for internal usage
+  // @args:
+  // start: the starting index
+  // end: the end index
+  /*==============================================*/
+  void Simulation::integrateKxKyInternal(const int start, const int end, const bool parallel, const int rank){
+    if(options_.profile) profiler_.start();
+    PROFILE::Profiler* profiler = options_.profile ? &profiler_ : nullptr;
+    PROFILE::Scope profileScope(profiler);
+
+    std::vector<double> scalex, scaley, weight;
+    this->getKGridWeights(scalex, scaley, weight);
+    // here dkx is not normalized
+    double dkx = (kxEnd_ - kxStart_) / (numOfKx_ - 1);
+    // here kyEnd_ is normalized for 1D case
+    double dky = (kyEnd_ - kyStart_) / (numOfKy_ - 1);
+    double cosAngle = cos((reciprocalLattice_.angle - 90) * datum::pi/180);
+    double sinAngle = sin((reciprocalLattice_.angle - 90) * datum::pi/180);
+
+    int numOfProbe = probeList_.size();
+    int numOfSourceEntry = numOfProbe * thicknessListVec_.n_elem * 3;
+    // every point is summed up directly, one accumulator per thread
+    int numOfAccumulator = numOfThread_;
+    std::vector<CompensatedSum> sumPhi(numOfAccumulator, CompensatedSum(numOfProbe * numOfOmega_));
+    std::vector<CompensatedSum> sumBySource(numOfAccumulator, CompensatedSum(numOfSourceEntry * numOfOmega_));
+    // the integrand on the full grid is only kept on request
+    if(options_.retainKGrid && PhiKGrid_ == nullptr){
+      size_t gridSize = static_cast<size_t>(numOfOmega_) * numOfKx_ * numOfKy_ * numOfProbe;
+      PhiKGrid_ = new double[gridSize];
+      std::fill(PhiKGrid_, PhiKGrid_ + gridSize, 0.0);
+    }
+
+    // finished k blocks are written to the checkpoint file and skipped when resuming
+    int numOfEntry = numOfProbe + numOfSourceEntry;
+    Ptr<CheckpointFile> checkpoint;
+    std::vector<char> finished(numOfOmega_ * numOfKx_, 0);
+    if(options_.checkpointFile != ""){
+      CheckpointHeader header;
+      std::memset(&header, 0, sizeof(CheckpointHeader));
+      std::memcpy(header.magic, CHECKPOINT_MAGIC, sizeof(CHECKPOINT_MAGIC));
+      header.version = CHECKPOINT_VERSION;
+      header.numOfEntry = numOfEntry;
+      header.numOfOmega = numOfOmega_;
+      header.numOfKx = numOfKx_;
+      header.numOfKy = numOfKy_;
+      header.start = start;
+      header.end = end;
+      header.kRange[0] = kxStart_;
+      header.kRange[1] = kxEnd_;
+      header.kRange[2] = kyStart_;
+      header.kRange[3] = kyEnd_;
+      for(int i = 0; i < numOfOmega_; i++){
+        header.omegaSum += omegaList_[i];
+      }
+      header.nG = nG_;
+      std::string fileName = options_.checkpointFile;
+      if(!parallel) fileName += "_rank_" + std::to_string(rank);
+      checkpoint = CheckpointFile::instanceNew(fileName, header, options_.checkpointInterval);
+      const CheckpointFile::RecordMap& records = checkpoint->getRecords();
+      for(CheckpointFile::RecordMap::const_iterator it = records.cbegin(); it != records.cend(); it++){
+        if(it->first < 0 || it->first >= numOfOmega_ * numOfKx_) continue;
+        int omegaIdx = it->first / numOfKx_;
+        finished[it->first] = 1;
+        for(int p = 0; p < numOfProbe; p++){
+          sumPhi[0].add(p * numOfOmega_ + omegaIdx, it->second[p]);
+        }
+        for(int e = 0; e < numOfSourceEntry; e++){
+          sumBySource[0].add(e * numOfOmega_ + omegaIdx, it->second[numOfProbe + e]);
+        }
+      }
     }
 
-    //  this part is for the vanilla/openmp version of mesh
-    if(parallel){
-      double** kxList = new double*[numOfKx_];
-      double** kyList = new double*[numOfKx_];
-      for(int i = 0; i < numOfKx_; i++){
-        kxList[i] = new double[numOfKy_];
-        kyList[i] = new double[numOfKy_];
+    // the OpenMP version writes per thread files, the MPI version per rank files
+    // and both use numOfThread_ threads over the points in [start, end)
+    bool binaryOutput = options_.PrintIntermediate && options_.output_format != "Text";
+    std::vector< std::unique_ptr<std::ofstream> > outfiles;
+    Ptr<IntermediateWriter> writer;
+    if(binaryOutput){
+      std::ostringstream fileName;
+      if(parallel){
+        if(options_.output_flag == ""){
+          fileName << "omega_kx_ky_phi.bin";
+        }
+        else{
+          fileName << "omega_kx_ky_phi_" << options_.output_flag << ".bin";
+        }
+      }
+      else{
+        if(options_.output_flag == ""){
+          fileName << "omega_kx_ky_phi_rank_" << rank << ".bin";
+        }
+        else{
+          fileName << "omega_kx_ky_phi_rank_" << options_.output_flag << "_" << rank << ".bin";
+        }
       }
-      std::vector< std::unique_ptr<std::ofstream> > outfiles;
-      if(options_.PrintIntermediate){
-        for (int i = 0; i < numOfThread_; i++){
-          std::ostringstream fileName;
+      writer = IntermediateWriter::instanceNew(fileName.str(), numOfProbe, numOfThread_, options_.output_format == "Binary32");
+    }
+    else if(options_.PrintIntermediate){
+      for (int i = 0; i < (parallel ? numOfThread_ : 1); i++){
+        std::ostringstream fileName;
+        if(parallel){
           if(options_.output_flag == ""){
             fileName << "omega_kx_ky_phi_thread_" << i << ".txt";
           }
           else{
             fileName << "omega_kx_ky_phi_thread_" << options_.output_flag << "_" << i << ".txt";
           }
-          std::unique_ptr<std::ofstream> file( new std::ofstream(fileName.str()) );
-          outfiles.push_back(std::move(file));
         }
+        else{
+          if(options_.output_flag == ""){
+            fileName << "omega_kx_ky_phi_rank_" << rank << ".txt";
+          }
+          else{
+            fileName << "omega_kx_ky_phi_rank_" << options_.output_flag << "_" << rank << ".txt";
+          }
+        }
+        std::unique_ptr<std::ofstream> file( new std::ofstream(fileName.str()) );
+        outfiles.push_back(std::move(file));
       }
-
-      for(int omegaIdx = 0; omegaIdx < numOfOmega_; omegaIdx++){
-        if(curOmegaIndex_ != omegaIdx){
-          curOmegaIndex_ = omegaIdx;
-          this->buildRCWAMatrices();
+    }
+    std::vector<EigenCache> eigenCaches(numOfThread_);
+    // the last point of every thread, a cache is only reused for the next ky
+    std::vector<int> lastPoint(numOfThread_, -1);
+
+    int numOfKPoint = numOfKx_ * numOfKy_;
+    int omegaBegin = start / numOfKPoint;
+    int omegaEnd = end > start ? (end - 1) / numOfKPoint + 1 : omegaBegin;
+    // the omegas with unfinished k points within [start, end)
+    std::vector<int> omegaTodo;
+    numOfPointDone_ = 0;
+    numOfPointTotal_ = std::max(end - start, 0);
+    for(int omegaIdx = omegaBegin; omegaIdx < omegaEnd; omegaIdx++){
+      int lo = std::max(start, omegaIdx * numOfKPoint) - omegaIdx * numOfKPoint;
+      int hi = std::min(end, (omegaIdx + 1) * numOfKPoint) - omegaIdx * numOfKPoint;
+      bool todo = false;
+      for(int kxIdx = lo / numOfKy_; kxIdx * numOfKy_ < hi; kxIdx++){
+        if(!finished[omegaIdx * numOfKx_ + kxIdx]){
+          todo = true;
         }
-        #if defined(_OPENMP)
-          #pragma omp parallel for schedule(dynamic) num_threads(numOfThread_), collapse(2)
-        #endif
-        for(int i = 0; i < numOfKx_; i++){
-          for(int j = 0; j < numOfKy_; j++){
-            double kx = kxStart_ + dkx * i;
-            double ky = kyStart_ + dky * j;
-            kxList[i][j] = (kx * cos((reciprocalLattice_.angle - 90) * datum::pi/180)) / scalex[omegaIdx];
-            kyList[i][j] = (ky - kx * sin((reciprocalLattice_.angle - 90) * datum::pi/180)) / scaley[omegaIdx];
-          }
+        else{
+          numOfPointDone_ += std::min(numOfKy_, hi - kxIdx * numOfKy_) - std::max(0, lo - kxIdx * numOfKy_);
+        }
+      }
+      if(todo) omegaTodo.push_back(omegaIdx);
+    }
+    // the matrices of the next omega are built by one of the threads while
+    // the others work on the current omega, so at most two are in memory
+    RCWAMatricesBundle bundles[2];
+    for(size_t w = 0; w < omegaTodo.size(); w++){
+      int omegaIdx = omegaTodo[w];
+      RCWAMatricesBundle& bundle = bundles[w % 2];
+      RCWAMatricesBundle& nextBundle = bundles[(w + 1) % 2];
+      if(bundle.omegaIdx != omegaIdx){
+        this->buildRCWAMatrices(omegaIdx, bundle);
+      }
+      // the unfinished parts of the ky strips of this omega within [start, end)
+      int lo = std::max(start, omegaIdx * numOfKPoint) - omegaIdx * numOfKPoint;
+      int hi = std::min(end, (omegaIdx + 1) * numOfKPoint) - omegaIdx * numOfKPoint;
+      std::vector<int> segKx, segKyBegin, segOffset;
+      int numOfPoint = 0;
+      for(int kxIdx = lo / numOfKy_; kxIdx * numOfKy_ < hi; kxIdx++){
+        if(finished[omegaIdx * numOfKx_ + kxIdx]) continue;
+        int kyBegin = std::max(0, lo - kxIdx * numOfKy_);
+        int kyEnd = std::min(numOfKy_, hi - kxIdx * numOfKy_);
+        segKx.push_back(kxIdx);
+        segKyBegin.push_back(kyBegin);
+        segOffset.push_back(numOfPoint);
+        numOfPoint += kyEnd - kyBegin;
+      }
+      int numOfSeg = segKx.size();
+      segOffset.push_back(numOfPoint);
+      // with a checkpoint the strips are computed in slabs of a few points
+      // per thread, and every finished slab is written out
+      int segBegin = 0;
+      while(segBegin < numOfSeg){
+        int segEnd = numOfSeg;
+        if(checkpoint != nullptr){
+          segEnd = segBegin + 1;
+          while(segEnd < numOfSeg && segOffset[segEnd] - segOffset[segBegin] < 32 * numOfThread_) segEnd++;
         }
+        int numOfBlock = segEnd - segBegin;
+        std::vector<CompensatedSum> sumBlock(checkpoint == nullptr ? 0 : numOfThread_, CompensatedSum(numOfBlock * numOfEntry));
+        // with eigen continuation every chunk is one ky strip at fixed kx
+        int chunkSize = options_.eigenContinuation ? numOfKy_ : 1;
+        int numOfKThread = this->setThreadSplit(segOffset[segEnd] - segOffset[segBegin]);
+        ThreadScope threadScope(numOfLapackThread_, numOfPointThread_ > 1 || numOfLapackThread_ > 1);
+        bool buildNext = numOfKThread > 1 && w + 1 < omegaTodo.size() && segBegin == 0;
         #if defined(_OPENMP)
-          #pragma omp parallel for schedule(dynamic) num_threads(numOfThread_)
+          #pragma omp parallel num_threads(numOfKThread)
         #endif
-        for(int i = 0; i < numOfKx_ * numOfKy_; i++){
-          int kxIdx = i / numOfKy_;
-          int kyIdx = i % numOfKy_;
-          resultArray[omegaIdx * numOfKx_ * numOfKy_ + i] = this->getPhiAtKxKy(omegaIdx, kxList[kxIdx][kyIdx], kyList[kxIdx][kyIdx]);
-          if(options_.PrintIntermediate){
-            std::stringstream msg;
-            msg << omegaList_[omegaIdx] << "\t" << kxList[kxIdx][kyIdx] << "\t" << kyList[kxIdx][kyIdx] << "\t" << resultArray[omegaIdx * numOfKx_ * numOfKy_ + i] << std::endl;
-            // std::cout << msg.str();
+        {
+          PROFILE::Scope threadProfileScope(profiler);
+          if(buildNext){
+            #if defined(_OPENMP)
+              #pragma omp single nowait
+            #endif
+            this->buildRCWAMatrices(omegaTodo[w + 1], nextBundle);
+          }
+          #if defined(_OPENMP)
+            #pragma omp for schedule(dynamic, chunkSize)
+          #endif
+          for(int i = segOffset[segBegin]; i < segOffset[segEnd]; i++){
+            int seg = std::upper_bound(segOffset.begin() + segBegin, segOffset.begin() + segEnd, i) - segOffset.begin() - 1;
+            int block = seg - segBegin;
+            int kxIdx = segKx[seg];
+            int kyIdx = segKyBegin[seg] + i - segOffset[seg];
             int thread_num = 0;
             #if defined(_OPENMP)
               thread_num = omp_get_thread_num();
             #endif
-            (outfiles[thread_num])->write(msg.str().c_str(), sizeof(char) * msg.str().size());
-            //(outfiles[thread_num])->flush();
+            EigenCache* eigenCache = nullptr;
+            if(options_.eigenContinuation){
+              eigenCache = &eigenCaches[thread_num];
+              if(kyIdx == segKyBegin[seg] || lastPoint[thread_num] != i - 1) eigenCache->eigVecs.clear();
+              lastPoint[thread_num] = i;
+            }
+            double kx = kxStart_ + dkx * kxIdx;
+            double ky = kyStart_ + dky * kyIdx;
+            ky = (ky - kx * sinAngle) / scaley[omegaIdx];
+            kx = (kx * cosAngle) / scalex[omegaIdx];
+            std::vector<double> phi(numOfProbe);
+            std::vector<double> phiBySource(numOfSourceEntry);
+            this->getPhiAtKxKyInternal(omegaIdx, kx, ky, probeList_, phi.data(), phiBySource.data(), eigenCache, &bundle);
+            for(int p = 0; p < numOfProbe; p++){
+              sumPhi[thread_num].add(p * numOfOmega_ + omegaIdx, weight[omegaIdx] * phi[p]);
+            }
+            for(int e = 0; e < numOfSourceEntry; e++){
+              sumBySource[thread_num].add(e * numOfOmega_ + omegaIdx, weight[omegaIdx] * phiBySource[e]);
+            }
+            if(checkpoint != nullptr){
+              for(int p = 0; p < numOfProbe; p++){
+                sumBlock[thread_num].add(block * numOfEntry + p, weight[omegaIdx] * phi[p]);
+              }
+              for(int e = 0; e < numOfSourceEntry; e++){
+                sumBlock[thread_num].add(block * numOfEntry + numOfProbe + e, weight[omegaIdx] * phiBySource[e]);
+              }
+            }
+            if(PhiKGrid_ != nullptr){
+              std::copy(phi.begin(), phi.end(),
+                &PhiKGrid_[((static_cast<size_t>(omegaIdx) * numOfKx_ + kxIdx) * numOfKy_ + kyIdx) * numOfProbe]);
+            }
+            if(binaryOutput){
+              PROFILE::Timer outputTimer(PROFILE::OUTPUT_);
+              writer->append(thread_num, omegaList_[omegaIdx], kx, ky, phi.data());
+            }
+            else if(options_.PrintIntermediate){
+              PROFILE::Timer outputTimer(PROFILE::OUTPUT_);
+              std::stringstream msg;
+              msg << omegaList_[omegaIdx] << "\t" << kx << "\t" << ky;
+              for(int p = 0; p < numOfProbe; p++){
+                msg << "\t" << phi[p];
+              }
+              msg << std::endl;
+              // std::cout << msg.str();
+              if(parallel){
+                (outfiles[thread_num])->write(msg.str().c_str(), sizeof(char) * msg.str().size());
+              }
+              else{
+                #if defined(_OPENMP)
+                  #pragma omp critical(MESH_INTERMEDIATE_TEXT)
+                #endif
+                (outfiles[0])->write(msg.str().c_str(), sizeof(char) * msg.str().size());
+              }
+              //(outfiles[thread_num])->flush();
+            }
+            numOfPointDone_++;
           }
         }
-      }
-      for(int i = 0; i < numOfKx_; i++){
-        delete [] kxList[i];
-        delete [] kyList[i];
-      }
-      delete[] kxList;
-      kxList = nullptr;
-      delete[] kyList;
-      kyList = nullptr;
-
-      if(options_.PrintIntermediate){
-        for(int i = 0; i < numOfThread_; i++){
-          (outfiles[i])->close();
+        if(checkpoint != nullptr){
+          PROFILE::Timer outputTimer(PROFILE::OUTPUT_);
+          std::vector<double> vals(numOfEntry);
+          for(int block = 0; block < numOfBlock; block++){
+            for(int k = 0; k < numOfEntry; k++){
+              vals[k] = 0;
+              for(int t = 0; t < numOfThread_; t++){
+                vals[k] += sumBlock[t].get(block * numOfEntry + k);
+              }
+            }
+            checkpoint->write(omegaIdx * numOfKx_ + segKx[segBegin + block], vals.data());
+          }
         }
+        segBegin = segEnd;
       }
+      std::fill(lastPoint.begin(), lastPoint.end(), -1);
     }
-    // this part is for the MPI version of mesh
-    else{
-      std::ofstream outfile;
-      if(options_.PrintIntermediate){
-        std::ostringstream fileName;
-        if(options_.output_flag == ""){
-          fileName << "omega_kx_ky_phi_rank_" << rank << ".txt";
-        }
-        else{
-          fileName << "omega_kx_ky_phi_rank_" << options_.output_flag << "_" << rank << ".txt";
-        }
-        outfile.open(fileName.str());
+    this->setThreadSplit(1);
+    // the matrices of the last omega are kept for the following calls
+    if(!omegaTodo.empty()){
+      RCWAMatricesBundle& bundle = bundles[(omegaTodo.size() - 1) % 2];
+      curOmegaIndex_ = bundle.omegaIdx;
+      std::swap(EMatrices_, bundle.EMatrices);
+      std::swap(grandImaginaryMatrices_, bundle.grandImaginaryMatrices);
+      std::swap(eps_zz_Inv_Matrices_, bundle.eps_zz_Inv_Matrices);
+    }
+
+    if(binaryOutput){
+      writer->close();
+    }
+    else if(options_.PrintIntermediate){
+      for(size_t i = 0; i < outfiles.size(); i++){
+        (outfiles[i])->close();
       }
-      for(int i = start; i < end; i++){
-        int omegaIdx = i / (numOfKx_ * numOfKy_);
-        if(curOmegaIndex_ != omegaIdx){
-          curOmegaIndex_ = omegaIdx;
-          this->buildRCWAMatrices();
-        }
-        int residue = i % (numOfKx_ * numOfKy_);
-        int kxIdx = residue / numOfKy_;
-        int kyIdx = residue % numOfKy_;
-
-        double kx = kxStart_ + dkx * kxIdx;
-        double ky = kyStart_ + dky * kyIdx;
-
-        ky = (ky - kx * sin((reciprocalLattice_.angle - 90) * datum::pi/180)) / scaley[omegaIdx];
-        kx = (kx * cos((reciprocalLattice_.angle - 90) * datum::pi/180)) / scalex[omegaIdx];
-        resultArray[i] = this->getPhiAtKxKy(omegaIdx, kx, ky);
-        if(options_.PrintIntermediate){
-          std::stringstream msg;
-          msg << omegaList_[omegaIdx] << "\t" << kx << "\t" << ky << "\t" << resultArray[i] << std::endl;
-          //std::cout << msg.str();
-          outfile << msg.str();
-          //outfile.flush();
-        }
+    }
+
+    // reduce the accumulators of all the threads
+    CompensatedSum totalPhi(numOfProbe * numOfOmega_);
+    CompensatedSum totalBySource(numOfSourceEntry * numOfOmega_);
+    for(int t = 0; t < numOfAccumulator; t++){
+      for(int i = 0; i < numOfProbe * numOfOmega_; i++){
+        totalPhi.add(i, sumPhi[t].sum[i]);
+        totalPhi.add(i, sumPhi[t].comp[i]);
       }
-      if(options_.PrintIntermediate){
-        outfile.close();
+      for(int i = 0; i < numOfSourceEntry * numOfOmega_; i++){
+        totalBySource.add(i, sumBySource[t].sum[i]);
+        totalBySource.add(i, sumBySource[t].comp[i]);
       }
     }
-
-    for(int i = start; i < end; i++){
-      int omegaIdx = i / (numOfKx_ * numOfKy_);
-      Phi_[omegaIdx] += prefactor_ * resultArray[i] * dkx / scalex[omegaIdx] * dky / scaley[omegaIdx]
-        * POW2(omegaList_[omegaIdx] / datum::c_0) * std::abs(sin(reciprocalLattice_.angle * datum::pi/180));
+    for(int i = 0; i < numOfProbe * numOfOmega_; i++){
+      Phi_[i] += totalPhi.get(i);
     }
-
-    delete[] scalex;
-    scalex = nullptr;
-    delete[] scaley;
-    scaley = nullptr;
-    delete[] resultArray;
-    resultArray = nullptr;
+    for(int i = 0; i < numOfSourceEntry * numOfOmega_; i++){
+      PhiBySource_[i] += totalBySource.get(i);
+    }
+    if(options_.profile) this->writeProfile(end - start, parallel ? -1 : rank);
   }
 
   /*==============================================*/
@@ -1586,6 +3064,235 @@ namespace MESH{
 
   }
   /*==============================================*/
+  // This function adds a parameter to the structure sweep, every variant
+  // added by addSweepVariant gives one value for each parameter
+  // @args:
+  // layerName: the name of the layer
+  // parameter: Thickness, or a parameter of a pattern of the layer (CenterX,
+  // CenterY, Width, WidthX, WidthY, HalfwidthX, HalfwidthY, Radius, Angle)
+  // patternIndex: the index of the pattern in the order they are added
+  /*==============================================*/
+  void Simulation::addSweepParameter(const std::string layerName, const std::string parameter, const int patternIndex){
+    if(layerInstanceMap_.find(layerName) == layerInstanceMap_.cend()){
+      std::cerr << layerName + ": Layer does not exist!" << std::endl;
+      throw UTILITY::IllegalNameException(layerName + ": Layer does not exist!");
+    }
+    if(!sweepVariants_.empty()){
+      std::cerr << "Sweep parameters should be added before the variants!" << std::endl;
+      throw UTILITY::ValueException("Sweep parameters should be added before the variants!");
+    }
+    SweepParameter sweepParameter;
+    sweepParameter.layerName = layerName;
+    sweepParameter.parameter = parameter;
+    sweepParameter.patternIndex = patternIndex;
+    // checks that the pattern has the parameter
+    this->getSweepParameter(sweepParameter);
+    sweepParameters_.push_back(sweepParameter);
+  }
+  /*==============================================*/
+  // This function adds a variant of the structure to the sweep
+  // @args:
+  // values: the value of every sweep parameter, in the order they are added
+  /*==============================================*/
+  void Simulation::addSweepVariant(const std::vector<double>& values){
+    if(values.size() != sweepParameters_.size()){
+      std::cerr << "The number of values does not match the sweep parameters!" << std::endl;
+      throw UTILITY::ValueException("The number of values does not match the sweep parameters!");
+    }
+    sweepVariants_.push_back(values);
+  }
+  /*==============================================*/
+  // This function returns the current value of a sweep parameter
+  /*==============================================*/
+  double Simulation::getSweepParameter(const SweepParameter& sweepParameter){
+    Ptr<Layer> layer = layerInstanceMap_.find(sweepParameter.layerName)->second;
+    if(sweepParameter.parameter == "Thickness"){
+      return layer->getThickness();
+    }
+    return layer->getPatternParameter(sweepParameter.patternIndex, sweepParameter.parameter);
+  }
+  /*==============================================*/
+  // This function sets a sweep parameter of the initialized simulation
+  // @args:
+  // sweepParameter: the parameter
+  // value: the new value
+  // changed: the layers whose Fourier matrices should be rebuilt (output)
+  /*==============================================*/
+  void Simulation::setSweepParameter(const SweepParameter& sweepParameter, const double value, std::vector<char>& changed){
+    if(this->getSweepParameter(sweepParameter) == value) return;
+    Ptr<Layer> layer = layerInstanceMap_.find(sweepParameter.layerName)->second;
+    int numOfLayer = structure_->getNumOfLayer();
+    int layerIdx = 0;
+    while(layerIdx < numOfLayer && structure_->getLayerByIndex(layerIdx) != layer) layerIdx++;
+    if(sweepParameter.parameter == "Thickness"){
+      // only the propagation changes, the Fourier matrices are kept
+      layer->setThickness(value);
+      // a repeated layer appears several times in the structure
+      for(int i = 1; i < numOfLayer - 1; i++){
+        if(structure_->getLayerByIndex(i) == layer) thicknessListVec_(i) = value * MICRON;
+      }
+    }
+    else{
+      layer->setPatternParameter(sweepParameter.patternIndex, sweepParameter.parameter, value);
+      changed[layerIdx] = 1;
+    }
+  }
+  /*==============================================*/
+  // This function computes the flux of all the sweep variants for
+  // the (omega, variant, kx, ky) points in [start, end). The materials, the G
+  // vectors and the Fourier matrices of the layers that do not change between
+  // two variants are shared, and the k points of every variant run in parallel
+  // @args:
+  // start: the starting index
+  // end: the end index
+  // rank: the rank of the MPI run, -1 if not MPI
+  /*==============================================*/
+  void Simulation::runSweepInternal(const int start, const int end, const int rank){
+    if(sweepVariants_.empty()){
+      std::cerr << "No sweep variant!" << std::endl;
+      throw UTILITY::ValueException("No sweep variant!");
+    }
+    int numOfLayer = structure_->getNumOfLayer();
+    if((int)thicknessListVec_.n_elem != numOfLayer){
+      std::cerr << "Simulation should be initialized before the sweep!" << std::endl;
+      throw UTILITY::InternalException("Simulation should be initialized before the sweep!");
+    }
+    std::vector<double> scalex, scaley, weight;
+    this->getKGridWeights(scalex, scaley, weight);
+    // here dkx is not normalized
+    double dkx = (kxEnd_ - kxStart_) / (numOfKx_ - 1);
+    // here kyEnd_ is normalized for 1D case
+    double dky = (kyEnd_ - kyStart_) / (numOfKy_ - 1);
+    double cosAngle = cos((reciprocalLattice_.angle - 90) * datum::pi/180);
+    double sinAngle = sin((reciprocalLattice_.angle - 90) * datum::pi/180);
+
+    int numOfProbe = probeList_.size();
+    int numOfVariant = sweepVariants_.size();
+    int numOfParameter = sweepParameters_.size();
+    int numOfKPoint = numOfKx_ * numOfKy_;
+    sweepPhi_.assign(numOfVariant * numOfProbe * numOfOmega_, 0);
+
+    // the structure is restored after the sweep
+    std::vector<double> original(numOfParameter);
+    for(int i = 0; i < numOfParameter; i++){
+      original[i] = this->getSweepParameter(sweepParameters_[i]);
+    }
+    if(options_.profile) profiler_.start();
+    PROFILE::Profiler* profiler = options_.profile ? &profiler_ : nullptr;
+    PROFILE::Scope profileScope(profiler);
+    RCWAMatricesBundle bundle;
+    std::vector<char> changed(numOfLayer, 0);
+    numOfPointDone_ = 0;
+    numOfPointTotal_ = std::max(end - start, 0);
+    int numOfPointPerOmega = numOfVariant * numOfKPoint;
+    int omegaBegin = start / numOfPointPerOmega;
+    int omegaEnd = end > start ? (end - 1) / numOfPointPerOmega + 1 : omegaBegin;
+    for(int omegaIdx = omegaBegin; omegaIdx < omegaEnd; omegaIdx++){
+      for(int variantIdx = 0; variantIdx < numOfVariant; variantIdx++){
+        int base = (omegaIdx * numOfVariant + variantIdx) * numOfKPoint;
+        int kBegin = std::max(start - base, 0);
+        int kEnd = std::min(end - base, numOfKPoint);
+        if(kBegin >= kEnd) continue;
+        for(int i = 0; i < numOfParameter; i++){
+          this->setSweepParameter(sweepParameters_[i], sweepVariants_[variantIdx][i], changed);
+        }
+        if(bundle.omegaIdx != omegaIdx){
+          this->buildRCWAMatrices(omegaIdx, bundle);
+        }
+        else if(std::find(changed.begin(), changed.end(), 1) != changed.end()){
+          this->buildRCWAMatrices(omegaIdx, bundle, &changed);
+        }
+        std::fill(changed.begin(), changed.end(), 0);
+
+        int numOfKThread = this->setThreadSplit(kEnd - kBegin);
+        ThreadScope threadScope(numOfLapackThread_, numOfPointThread_ > 1 || numOfLapackThread_ > 1);
+        std::vector<CompensatedSum> sumPhi(numOfKThread, CompensatedSum(numOfProbe));
+        #if defined(_OPENMP)
+          #pragma omp parallel for schedule(dynamic) num_threads(numOfKThread)
+        #endif
+        for(int i = kBegin; i < kEnd; i++){
+          PROFILE::Scope threadProfileScope(profiler);
+          int thread_num = 0;
+          #if defined(_OPENMP)
+            thread_num = omp_get_thread_num();
+          #endif
+          double kx = kxStart_ + dkx * (i / numOfKy_);
+          double ky = kyStart_ + dky * (i % numOfKy_);
+          ky = (ky - kx * sinAngle) / scaley[omegaIdx];
+          kx = (kx * cosAngle) / scalex[omegaIdx];
+          std::vector<double> phi(numOfProbe);
+          this->getPhiAtKxKyInternal(omegaIdx, kx, ky, probeList_, phi.data(), nullptr, nullptr, &bundle);
+          for(int p = 0; p < numOfProbe; p++){
+            sumPhi[thread_num].add(p, weight[omegaIdx] * phi[p]);
+          }
+          numOfPointDone_++;
+        }
+        for(int p = 0; p < numOfProbe; p++){
+          CompensatedSum total(1);
+          for(int t = 0; t < numOfKThread; t++){
+            total.add(0, sumPhi[t].sum[p]);
+            total.add(0, sumPhi[t].comp[p]);
+          }
+          sweepPhi_[(variantIdx * numOfProbe + p) * numOfOmega_ + omegaIdx] += total.get(0);
+        }
+      }
+    }
+    for(int i = 0; i < numOfParameter; i++){
+      this->setSweepParameter(sweepParameters_[i], original[i], changed);
+    }
+    this->setThreadSplit(1);
+    if(options_.profile) this->writeProfile(end - start, rank);
+  }
+  /*==============================================*/
+  // This function computes the flux of all the sweep variants
+  /*==============================================*/
+  void Simulation::runSweep(){
+    this->runSweepInternal(0, numOfOmega_ * (int)sweepVariants_.size() * numOfKx_ * numOfKy_);
+  }
+  /*==============================================*/
+  // This function computes the flux of all the sweep variants for MPI only,
+  // the (omega, variant, k) points are divided evenly among the ranks
+  /*==============================================*/
+  void Simulation::runSweepMPI(const int rank, const int size){
+    int totalNum = numOfOmega_ * (int)sweepVariants_.size() * numOfKx_ * numOfKy_;
+    int chunksize = totalNum / size;
+    int left = totalNum % size;
+    int start, end;
+    if(rank >= left){
+      start = left * (chunksize + 1) + (rank - left) * chunksize;
+      end = start + chunksize;
+    }
+    else{
+      start = rank * (chunksize + 1);
+      end = start + chunksize + 1;
+    }
+    if(end > totalNum) end = totalNum;
+    this->runSweepInternal(start, end, rank);
+  }
+  /*==============================================*/
+  // function returns the number of sweep variants
+  /*==============================================*/
+  int Simulation::getNumOfSweepVariant(){
+    return sweepVariants_.size();
+  }
+  /*==============================================*/
+  // function returns Phi of one sweep variant at one probe
+  // @args:
+  // variantIndex: the index of the variant
+  // probeIndex: the index of the probe
+  // @return:
+  // Phi at every omega
+  /*==============================================*/
+  double* Simulation::getSweepPhi(const int variantIndex, const int probeIndex){
+    int numOfProbe = probeList_.size();
+    if(variantIndex < 0 || variantIndex >= (int)sweepVariants_.size() || probeIndex < 0 || probeIndex >= numOfProbe
+      || sweepPhi_.size() != sweepVariants_.size() * numOfProbe * numOfOmega_){
+      std::cerr << "Sweep result out of range!" << std::endl;
+      throw UTILITY::RangeException("Sweep result out of range!");
+    }
+    return &sweepPhi_[(variantIndex * numOfProbe + probeIndex) * numOfOmega_];
+  }
+  /*==============================================*/
   // Implementaion of the class on planar simulation
   /*==============================================*/
   SimulationPlanar::SimulationPlanar() : Simulation(){
@@ -1654,7 +3361,7 @@ namespace MESH{
     return POW2(omegaList_[omegaIdx] / datum::c_0) / POW2(datum::pi) * KParallel *
       poyntingFlux(omegaList_[omegaIdx] / datum::c_0 / MICRON, thicknessListVec_, KParallel, 0, EMatrices_,
       grandImaginaryMatrices_, eps_zz_Inv_Matrices_, Gx_mat_, Gy_mat_,
-      sourceList_, targetLayer_,1, options_.polarization, target_z_);
+      sourceList_, targetLayer_,1, options_.polarization, target_z_, nullptr, &repeatList_);
   }
 
 
@@ -1688,29 +3395,38 @@ namespace MESH{
       wrapper.Gx_mat = Gx_mat_;
       wrapper.Gy_mat = Gy_mat_;
       wrapper.sourceList = sourceList_;
-      wrapper.targetLayer = targetLayer_;
+      wrapper.probeList = probeList_;
       wrapper.omega = omegaList_[i] / datum::c_0;
       wrapper.EMatrices = EMatricesVec[i];
 
       wrapper.grandImaginaryMatrices = grandImaginaryMatricesVec[i];
       wrapper.eps_zz_Inv = eps_zz_Inv_MatricesVec[i];
       wrapper.polar = options_.polarization;
-      wrapper.target_z = target_z_;
+      wrapper.repeatList = repeatList_;
+      int numOfProbe = probeList_.size();
+      int numOfSourceEntry = numOfProbe * thicknessListVec_.n_elem * 3;
+      int fdim = numOfProbe + numOfSourceEntry;
+      std::vector<double> val(fdim, 0), err(fdim, 0);
       switch (options_.IntegralMethod) {
         case GAUSSLEGENDRE_:{
-          Phi_[i] = gauss_legendre(degree_, wrapperFunQuadgl, &wrapper, kxStart_, kxEnd_);
+          gaussLegendreVec(degree_, wrapperFunQuadgk, &wrapper, fdim, kxStart_, kxEnd_, val.data());
           break;
         }
         case GAUSSKRONROD_:{
-          double err;
-          adapt_integrate(1, wrapperFunQuadgk, &wrapper, 1, &kxStart_, &kxEnd_, 0, ABSERROR, RELERROR, &Phi_[i], &err);
+          adapt_integrate(fdim, wrapperFunQuadgk, &wrapper, 1, &kxStart_, &kxEnd_, 0, ABSERROR, RELERROR, val.data(), err.data());
           break;
         }
         default:{
           break;
         }
       }
-      Phi_[i] *= POW3(omegaList_[i] / datum::c_0) / POW2(datum::pi);
+      double scale = POW3(omegaList_[i] / datum::c_0) / POW2(datum::pi);
+      for(int p = 0; p < numOfProbe; p++){
+        Phi_[p * numOfOmega_ + i] = val[p] * scale;
+      }
+      for(int e = 0; e < numOfSourceEntry; e++){
+        PhiBySource_[e * numOfOmega_ + i] = val[numOfProbe + e] * scale;
+      }
     }
   }
 
@@ -1923,6 +3639,141 @@ namespace MESH{
     layer->addPolygonPattern(material, arg1, angle, edgePoints,numOfPoint);
   }
   /*==============================================*/
+  // This function adds an array of circles made of one material to a layer.
+  // The circles are stored together and transformed in one pass
+  // @args:
+  // layerName: the name of the layer
+  // materialName: the name of the material
+  // centerx: the centers of the circles in x direction
+  // centery: the centers of the circles in y direction
+  // radius: the radii of the circles
+  /*==============================================*/
+  void SimulationPattern::setLayerPatternCircles(
+    const std::string layerName,
+    const std::string materialName,
+    const std::vector<double>& centerx,
+    const std::vector<double>& centery,
+    const std::vector<double>& radius
+  ){
+    std::vector<double> angle(radius.size(), 0);
+    this->addLayerPatternArray(layerName, materialName, CIRCLES_, centerx, centery, angle, radius, radius);
+  }
+  /*==============================================*/
+  // This function adds an array of rectangles made of one material to a
+  // layer. The rectangles are stored together and transformed in one pass
+  // @args:
+  // layerName: the name of the layer
+  // materialName: the name of the material
+  // centerx: the centers of the rectangles in x direction
+  // centery: the centers of the rectangles in y direction
+  // angle: the rotated angles with respect to x axis
+  // widthx: the widths of the rectangles in x direction
+  // widthy: the widths of the rectangles in y direction
+  /*==============================================*/
+  void SimulationPattern::setLayerPatternRectangles(
+    const std::string layerName,
+    const std::string materialName,
+    const std::vector<double>& centerx,
+    const std::vector<double>& centery,
+    const std::vector<double>& angle,
+    const std::vector<double>& widthx,
+    const std::vector<double>& widthy
+  ){
+    this->addLayerPatternArray(layerName, materialName, RECTANGLES_, centerx, centery, angle, widthx, widthy);
+  }
+  /*==============================================*/
+  // helper function adding an array pattern to a layer
+  // @args:
+  // layerName: the name of the layer
+  // materialName: the name of the material
+  // type: CIRCLES_ or RECTANGLES_
+  // centerx, centery, angle, width1, width2: see PatternArray
+  /*==============================================*/
+  void SimulationPattern::addLayerPatternArray(
+    const std::string layerName,
+    const std::string materialName,
+    const PATTERN type,
+    const std::vector<double>& centerx,
+    const std::vector<double>& centery,
+    const std::vector<double>& angle,
+    const std::vector<double>& width1,
+    const std::vector<double>& width2
+  ){
+    if(materialInstanceMap_.find(materialName) == materialInstanceMap_.cend()){
+      std::cerr << materialName + ": Material does not exist!" << std::endl;
+      throw UTILITY::IllegalNameException(materialName + ": Material does not exist!");
+    }
+    if(layerInstanceMap_.find(layerName) == layerInstanceMap_.cend()){
+      std::cerr << layerName + ": Layer does not exist!" << std::endl;
+      throw UTILITY::IllegalNameException(layerName + ": Layer does not exist!");
+    }
+    size_t num = centerx.size();
+    if(num == 0 || centery.size() != num || angle.size() != num || width1.size() != num || width2.size() != num){
+      std::cerr << "The arrays of the shapes should have the same nonzero length!" << std::endl;
+      throw UTILITY::RangeException("The arrays of the shapes should have the same nonzero length!");
+    }
+    std::shared_ptr<PatternArray> array = std::make_shared<PatternArray>();
+    array->centerx = centerx;
+    array->centery = centery;
+    array->angle = angle;
+    array->width1 = width1;
+    array->width2 = width2;
+    Ptr<Material> material = materialInstanceMap_.find(materialName)->second;
+    Ptr<Layer> layer = layerInstanceMap_.find(layerName)->second;
+    layer->addArrayPattern(material, type, array);
+  }
+  /*==============================================*/
+  // This function adds a raster pattern to a layer. The pixels tile the unit
+  // cell spanned by the two lattice vectors from the origin, and the Fourier
+  // transform of each material is computed with one FFT
+  // @args:
+  // layerName: the name of the layer
+  // materialNames: the materials used by the pixels
+  // grid: the index in materialNames of each pixel, grid[i + nx * j] is the
+  // i-th pixel along the first lattice vector and the j-th along the second
+  // nx: the number of pixels along the first lattice vector
+  // ny: the number of pixels along the second lattice vector
+  /*==============================================*/
+  void SimulationPattern::setLayerPatternRaster(
+    const std::string layerName,
+    const std::vector<std::string>& materialNames,
+    const std::vector<int>& grid,
+    const int nx,
+    const int ny
+  ){
+    if(layerInstanceMap_.find(layerName) == layerInstanceMap_.cend()){
+      std::cerr << layerName + ": Layer does not exist!" << std::endl;
+      throw UTILITY::IllegalNameException(layerName + ": Layer does not exist!");
+    }
+    for(size_t i = 0; i < materialNames.size(); i++){
+      if(materialInstanceMap_.find(materialNames[i]) == materialInstanceMap_.cend()){
+        std::cerr << materialNames[i] + ": Material does not exist!" << std::endl;
+        throw UTILITY::IllegalNameException(materialNames[i] + ": Material does not exist!");
+      }
+    }
+    if(nx <= 0 || ny <= 0 || grid.size() != static_cast<size_t>(nx) * ny){
+      std::cerr << "The raster should have nx * ny pixels!" << std::endl;
+      throw UTILITY::RangeException("The raster should have nx * ny pixels!");
+    }
+    std::vector<bool> used(materialNames.size(), false);
+    for(size_t i = 0; i < grid.size(); i++){
+      if(grid[i] < 0 || grid[i] >= static_cast<int>(materialNames.size())){
+        std::cerr << std::to_string(grid[i]) + ": material index out of range!" << std::endl;
+        throw UTILITY::RangeException(std::to_string(grid[i]) + ": material index out of range!");
+      }
+      used[grid[i]] = true;
+    }
+    Ptr<Layer> layer = layerInstanceMap_.find(layerName)->second;
+    std::shared_ptr< const std::vector<int> > raster = std::make_shared< const std::vector<int> >(grid);
+    const int size[2] = {nx, ny};
+    // one pattern for each material that appears in the raster
+    for(size_t i = 0; i < materialNames.size(); i++){
+      if(!used[i]) continue;
+      Ptr<Material> material = materialInstanceMap_.find(materialNames[i])->second;
+      layer->addRasterPattern(material, raster, size, i);
+    }
+  }
+  /*==============================================*/
   // function setting the lattice
   // xLen: the length of coordinate in x direction
   // yLen: the length of coordinate in y direction
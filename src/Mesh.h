@@ -28,9 +28,12 @@
 #include "Common.h"
 #include "config.h"
 #include "Gsel.h"
+#include "Profile.h"
 #include <fstream>
 #include <cmath>
 #include <memory>
+#include <cstdint>
+#include <atomic>
 #if defined(_OPENMP)
   #include <omp.h>
 #endif
@@ -43,6 +46,7 @@ using namespace RCWA;
 
 enum INTEGRAL {GAUSSLEGENDRE_, GAUSSKRONROD_};
 enum METHOD {NAIVEFMM_, SPATIALADAPTIVE_};
+enum THREADPOLICY {AUTO_, OVERK_, INSIDELAPACK_, SPLIT_};
 
 typedef struct OPTIONS{
   int FMMRule = NAIVEFMM_;
@@ -50,10 +54,19 @@ typedef struct OPTIONS{
   POLARIZATION polarization = BOTH_;
   bool PrintIntermediate = false;
   std::string output_flag = "";
+  std::string output_format = "Text";
   bool IntegrateKParallel = true;
   bool kxIntegralPreset = false;
   bool kyIntegralPreset = false;
   TRUNCATION truncation_ = CIRCULAR_;
+  bool eigenContinuation = false;
+  bool retainKGrid = false;
+  std::string checkpointFile = "";
+  double checkpointInterval = 600;
+  bool profile = false;
+  std::string profileFile = "";
+  std::string profileFormat = "JSON";
+  THREADPOLICY threadPolicy = AUTO_;
 } Options;
 
 
@@ -66,11 +79,26 @@ typedef struct ARGWEAPPER{
   RCWArMatrix Gx_mat;
   RCWArMatrix Gy_mat;
   SourceList sourceList;
-  int targetLayer;
+  ProbeList probeList;
   POLARIZATION polar;
-  double target_z;
+  RepeatList repeatList;
 } ArgWrapper;
 
+/*======================================================*/
+//  Header of the binary material file
+//  followed by numOfOmega omega values and numOfOmega * (2, 6 or 10)
+//  epsilon values, stored in the same way as EpsilonVal
+/*=======================================================*/
+typedef struct MATERIALHEADER{
+  char magic[8];
+  int32_t version;
+  int32_t type;
+  int64_t numOfOmega;
+  int64_t sourceMTime;
+  int64_t sourceSize;
+  uint64_t sourceHash;
+} MaterialHeader;
+
 /*======================================================*/
 //  Implementaion of the FileLoader class
 /*=======================================================*/
@@ -78,6 +106,7 @@ class FileLoader : public PtrInterface{
 public:
   static Ptr<FileLoader> instanceNew();
   void load(const std::string fileName);
+  void save(const std::string fileName);
   double* getOmegaList();
   EPSILON getEpsilonList();
   int getNumOfOmega();
@@ -86,11 +115,134 @@ protected:
   ~FileLoader();
 private:
   FileLoader();
+  void loadText(const std::string fileName);
+  bool loadBinary(const std::string fileName, const MaterialHeader* source = nullptr);
+  bool writeBinary(const std::string fileName, const MaterialHeader& header);
+  void setValues(const int numOfOmega, const EPSTYPE type, const double* omega, const double* epsilon);
   double* omegaList_;
   EPSILON epsilonList_;
   int numOfOmega_;
   bool preSet_ = false;
 };
+
+/*======================================================*/
+//  Header of the binary intermediate file, followed by chunks of
+//  [omega (double), numOfRecord (int64), kx column, ky column,
+//  one phi column per probe], the columns stored with the given precision
+/*=======================================================*/
+typedef struct INTERMEDIATEHEADER{
+  char magic[8];
+  int32_t version;
+  int32_t numOfProbe;
+  int32_t precision;
+  int32_t reserved;
+} IntermediateHeader;
+
+/*======================================================*/
+//  Implementaion of the IntermediateWriter class, writing the
+//  (omega, kx, ky, phi) records to a single binary file. Each thread
+//  fills its own buffer and only takes a lock to append a full chunk
+/*=======================================================*/
+class IntermediateWriter : public PtrInterface{
+public:
+  static Ptr<IntermediateWriter> instanceNew(
+    const std::string fileName,
+    const int numOfProbe,
+    const int numOfBuffer,
+    const bool singlePrecision
+  );
+  void append(const int buffer, const double omega, const double kx, const double ky, const double* phi);
+  void close();
+  static void read(
+    const std::string fileName,
+    std::vector<double>& omega,
+    std::vector<double>& kx,
+    std::vector<double>& ky,
+    std::vector< std::vector<double> >& phi
+  );
+  IntermediateWriter(const IntermediateWriter&) = delete;
+protected:
+  ~IntermediateWriter();
+private:
+  IntermediateWriter(const std::string fileName, const int numOfProbe, const int numOfBuffer, const bool singlePrecision);
+  void flush(const int buffer);
+  typedef struct RECORDBUFFER{
+    double omega = 0;
+    std::vector<double> kx;
+    std::vector<double> ky;
+    std::vector< std::vector<double> > phi;
+  } RecordBuffer;
+  std::ofstream outputFile_;
+  std::vector<RecordBuffer> buffers_;
+  int numOfProbe_;
+  bool singlePrecision_;
+};
+/*======================================================*/
+//  Header of the checkpoint file, followed by one record per finished
+//  k block: [block index (int64), numOfEntry doubles]. A block is the
+//  ky strip at one (omega, kx), restricted to [start, end) for MPI
+/*=======================================================*/
+typedef struct CHECKPOINTHEADER{
+  char magic[8];
+  int32_t version;
+  int32_t numOfEntry;
+  int64_t numOfOmega;
+  int64_t numOfKx;
+  int64_t numOfKy;
+  int64_t start;
+  int64_t end;
+  double kRange[4];
+  double omegaSum;
+  int64_t nG;
+} CheckpointHeader;
+
+/*======================================================*/
+//  Implementaion of the CheckpointFile class. Records of an existing
+//  file with the same header are loaded for resuming, new records are
+//  appended and flushed to disk every interval seconds
+/*=======================================================*/
+class CheckpointFile : public PtrInterface{
+public:
+  typedef std::map< int64_t, std::vector<double> > RecordMap;
+  static Ptr<CheckpointFile> instanceNew(
+    const std::string fileName,
+    const CheckpointHeader& header,
+    const double interval
+  );
+  const RecordMap& getRecords();
+  void write(const int64_t block, const double* vals);
+  void close();
+  CheckpointFile(const CheckpointFile&) = delete;
+protected:
+  ~CheckpointFile();
+private:
+  CheckpointFile(const std::string fileName, const CheckpointHeader& header, const double interval);
+  std::ofstream outputFile_;
+  RecordMap records_;
+  int numOfEntry_;
+  double interval_;
+  double lastFlush_;
+};
+/*======================================================*/
+//  The Fourier matrices of all the layers at one frequency, so that the
+//  matrices of the next frequency can be built while the current ones
+//  are in use
+/*=======================================================*/
+typedef struct RCWAMATRICESBUNDLE{
+  int omegaIdx = -1;
+  RCWAcMatrices EMatrices;
+  RCWAcMatrices grandImaginaryMatrices;
+  RCWAcMatrices eps_zz_Inv_Matrices;
+} RCWAMatricesBundle;
+/*======================================================*/
+//  A parameter of a structure sweep: the thickness of a layer, or a
+//  geometric parameter of one of its patterns (see Layer::setPatternParameter)
+/*=======================================================*/
+typedef struct SWEEPPARAMETER{
+  std::string layerName;
+  std::string parameter;
+  int patternIndex = 0;
+} SweepParameter;
 /*======================================================*/
 //  definition of maps used in the simulation
 /*=======================================================*/
@@ -107,21 +259,34 @@ public:
 
   void addMaterial(const std::string name, const std::string infile);
   void addMaterial(const std::string name, const std::vector<double>& omega, const std::vector< std::vector<double> >& epsilon);
+  void addMaterial(const std::string name, const DispersionModel& model);
+  void addMaterialUniaxial(const std::string name, const std::string ordinary, const std::string extraordinary);
   void setMaterial(const std::string name, double** &epsilon, const std::string type);
+  void setOmega(const std::vector<double>& omega);
 
   void addLayer(const std::string name, const double thick, const std::string materialName);
   void setLayer(const std::string name, const double thick, const std::string materialName);
   void setLayerThickness(const std::string name, const double thick);
   void addLayerCopy(const std::string name, const std::string originalName);
+  void addLayerRepeat(const std::vector<std::string>& names, const int count);
   void deleteLayer(const std::string name);
 
 
   void setSourceLayer(const std::string name);
   void setProbeLayer(const std::string name);
   void setProbeLayerZCoordinate(const double target_z);
+  void addProbeLayer(const std::string name, const double target_z = -1);
 
   void setNumOfG(const int nG);
   double* getPhi();
+  double* getPhiAtProbes();
+  double* getPhiBySource(const std::string name, const POLARIZATION polar = BOTH_, const int probeIndex = 0);
+  std::vector<std::string> getSourceLayerNames();
+  int getNumOfProbe();
+  double* getPhiOnKGrid();
+  int getNumOfKx();
+  int getNumOfKy();
+  double getProgress();
   double* getOmega();
   void getEpsilon(const int omegaIndex, const double position[3], double* &epsilon);
   void outputLayerPatternRealization(
@@ -138,11 +303,15 @@ public:
 
   void outputSysInfo();
 
-  void optPrintIntermediate(const std::string& output_flag = "");
+  void optPrintIntermediate(const std::string& output_flag = "", const std::string& format = "Text");
   void optOnlyComputeTE();
   void optOnlyComputeTM();
   void optSetLatticeTruncation(const std::string& truncation);
-  void setThread(const int numThread);
+  void optUseEigenContinuation();
+  void optRetainKGrid();
+  void optCheckpoint(const std::string& fileName, const double interval = 600);
+  void optProfile(const std::string& fileName = "", const std::string& format = "JSON");
+  void setThread(const int numThread, const std::string& policy = "Auto");
 
   void setKxIntegral(const int points, const double end = 0);
   void setKxIntegralSym(const int points, const double end = 0);
@@ -152,13 +321,30 @@ public:
   void integrateKxKy();
   void integrateKxKyMPI(const int rank, const int size);
 
+  void addSweepParameter(const std::string layerName, const std::string parameter, const int patternIndex = 0);
+  void addSweepVariant(const std::vector<double>& values);
+  void runSweep();
+  void runSweepMPI(const int rank, const int size);
+  int getNumOfSweepVariant();
+  double* getSweepPhi(const int variantIndex, const int probeIndex = 0);
+
   ~Simulation();
 protected:
   void integrateKxKyInternal(const int start, const int end, const bool parallel, const int rank = 0);
+  void runSweepInternal(const int start, const int end, const int rank = -1);
+  void writeProfile(const int numOfPoint, const int rank);
+  double getSweepParameter(const SweepParameter& sweepParameter);
+  void setSweepParameter(const SweepParameter& sweepParameter, const double value, std::vector<char>& changed);
+  void getPhiAtKxKyInternal(const int omegaIndex, const double kx, const double ky, const ProbeList& probeList,
+    double* phi, double* phiBySource = nullptr, EigenCache* eigenCache = nullptr,
+    const RCWAMatricesBundle* bundle = nullptr);
   Simulation();
   Simulation(const Simulation&) = delete;
 
   void buildRCWAMatrices();
+  void buildRCWAMatrices(const int omegaIdx, RCWAMatricesBundle& bundle, const std::vector<char>* layerMask = nullptr);
+  int setThreadSplit(const int numOfTask);
+  void getKGridWeights(std::vector<double>& scalex, std::vector<double>& scaley, std::vector<double>& weight);
   void resetSimulation();
   void setTargetLayerByLayer(const Ptr<Layer>& layer);
   Ptr<Structure> getStructure();
@@ -169,7 +355,10 @@ protected:
   double target_z_ = -1;
 
   double* Phi_;
+  double* PhiBySource_;
+  double* PhiKGrid_ = nullptr;
   double* omegaList_;
+  std::vector<double> omegaGrid_;
   double kxStart_;
   double kxEnd_;
   double kyStart_;
@@ -192,9 +381,13 @@ protected:
 
 
   int targetLayer_;
+  std::vector< Ptr<Layer> > probeLayerList_;
+  std::vector<double> probeZList_;
+  ProbeList probeList_;
 
   RCWArMatrix Gx_mat_;
   RCWArMatrix Gy_mat_;
+  FMM::GDifferenceTable GTable_;
 
   RCWAcMatrices EMatrices_;
   RCWAcMatrices grandImaginaryMatrices_;
@@ -202,11 +395,26 @@ protected:
 
   SourceList sourceList_;
   RCWArVector thicknessListVec_;
+  // the layers repeated periodically, found at initialization
+  RepeatList repeatList_;
+  std::vector<int> layerMap_;
+
+  std::vector<SweepParameter> sweepParameters_;
+  std::vector< std::vector<double> > sweepVariants_;
+  std::vector<double> sweepPhi_;
   DIMENSION dim_;
   Options options_;
 
   int numOfThread_ = 1;
+  int numOfPointThread_ = 1;
+  int numOfLapackThread_ = 1;
   int curOmegaIndex_ = -1;
+  // the counters of OptProfile, only the threads working for this
+  // simulation record into them
+  PROFILE::Profiler profiler_;
+  // the points done by the running integration, read from other threads
+  std::atomic<int> numOfPointDone_{0};
+  std::atomic<int> numOfPointTotal_{0};
 };
 
 
@@ -305,12 +513,48 @@ public:
     const int numOfPoint
   );
 
+  void setLayerPatternCircles(
+    const std::string layerName,
+    const std::string materialName,
+    const std::vector<double>& centerx,
+    const std::vector<double>& centery,
+    const std::vector<double>& radius
+  );
+
+  void setLayerPatternRectangles(
+    const std::string layerName,
+    const std::string materialName,
+    const std::vector<double>& centerx,
+    const std::vector<double>& centery,
+    const std::vector<double>& angle,
+    const std::vector<double>& widthx,
+    const std::vector<double>& widthy
+  );
+
+  void setLayerPatternRaster(
+    const std::string layerName,
+    const std::vector<std::string>& materialNames,
+    const std::vector<int>& grid,
+    const int nx,
+    const int ny
+  );
+
   void getReciprocalLattice(double lattice[4]);
   void setLattice(const double xLen, const double yLen, const double angle);
   SimulationPattern();
   SimulationPattern(const SimulationPattern&) = delete;
 
 protected:
+  void addLayerPatternArray(
+    const std::string layerName,
+    const std::string materialName,
+    const PATTERN type,
+    const std::vector<double>& centerx,
+    const std::vector<double>& centery,
+    const std::vector<double>& angle,
+    const std::vector<double>& width1,
+    const std::vector<double>& width2
+  );
 
 private:
 };
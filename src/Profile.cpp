@@ -0,0 +1,200 @@
+/* Copyright (C) 2016-2018, Stanford University
+ * This file is part of MESH
+ * Written by Kaifeng Chen (kfchen@stanford.edu)
+ *
+ * MESH is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * MESH is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#include "Profile.h"
+#include <atomic>
+#include <chrono>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include "Common.h"
+
+namespace PROFILE{
+  static const char* PHASE_NAMES[NUM_OF_PHASE_] = {
+    "BuildMatrices", "Eigen", "SMatrix", "Source", "Probe", "Output", "KPoint"
+  };
+  // the profiler the calling thread records into, and its slot there
+  static thread_local Profiler* current_ = nullptr;
+  static thread_local Slot* currentSlot_ = nullptr;
+
+  static double wallTime(){
+    return std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+  }
+
+  Profiler::Profiler() : enabled_(false), startTime_(0){}
+
+  Slot* Profiler::getSlot(){
+    std::lock_guard<std::mutex> lock(slotMutex_);
+    Slot*& slot = slotOfThread_[std::this_thread::get_id()];
+    if(slot == nullptr){
+      slots_.push_back(std::unique_ptr<Slot>(new Slot()));
+      slot = slots_.back().get();
+    }
+    return slot;
+  }
+
+  void Profiler::start(){
+    std::lock_guard<std::mutex> lock(slotMutex_);
+    for(size_t i = 0; i < slots_.size(); i++){
+      *slots_[i] = Slot();
+    }
+    startTime_ = wallTime();
+    enabled_ = true;
+  }
+
+  void Profiler::stop(){
+    enabled_ = false;
+  }
+
+  bool Profiler::isEnabled(){
+    return enabled_.load(std::memory_order_relaxed);
+  }
+
+  Profiler* current(){
+    return current_;
+  }
+
+  bool isEnabled(){
+    return current_ != nullptr && current_->isEnabled();
+  }
+
+  Scope::Scope(Profiler* profiler) : previous_(current_), previousSlot_(currentSlot_){
+    current_ = profiler;
+    currentSlot_ = profiler == nullptr ? nullptr : profiler->getSlot();
+  }
+
+  Scope::~Scope(){
+    current_ = previous_;
+    currentSlot_ = previousSlot_;
+  }
+
+  void record(const PHASE phase, const double seconds, const double flops, const int size){
+    Slot* slot = currentSlot_;
+    if(slot == nullptr) return;
+    slot->seconds[phase] += seconds;
+    slot->flops[phase] += flops;
+    slot->calls[phase]++;
+    if(size > slot->maxSize[phase]) slot->maxSize[phase] = size;
+  }
+
+  double gemmFlops(const double n, const double k, const double m){
+    return 8 * n * k * m;
+  }
+
+  double solveFlops(const double n, const double m){
+    // LU factorization and the triangular solves, complex arithmetic
+    return 8.0 / 3 * n * n * n + 8 * n * n * m;
+  }
+
+  double eigFlops(const double n){
+    // Hessenberg reduction, QR iterations and the eigenvectors, complex arithmetic
+    return 100 * n * n * n;
+  }
+
+  void Profiler::writeReport(
+    const std::string& fileName,
+    const std::string& format,
+    const std::vector< std::pair<std::string, double> >& info
+  ){
+    if(format != "JSON" && format != "CSV"){
+      std::cerr << "Wrong profile format: use JSON or CSV!" << std::endl;
+      throw UTILITY::ValueException("Wrong profile format: use JSON or CSV!");
+    }
+    std::ofstream outFile(fileName);
+    if(!outFile.good()){
+      std::cerr << fileName + ": cannot open the profile report!" << std::endl;
+      throw UTILITY::StorageException(fileName + ": cannot open the profile report!");
+    }
+    std::lock_guard<std::mutex> lock(slotMutex_);
+    double wall = wallTime() - startTime_;
+    // threads that did not record anything are left out
+    std::vector<Slot*> active;
+    Slot total;
+    for(size_t i = 0; i < slots_.size(); i++){
+      bool used = false;
+      for(int j = 0; j < NUM_OF_PHASE_; j++){
+        if(slots_[i]->calls[j] == 0) continue;
+        used = true;
+        total.seconds[j] += slots_[i]->seconds[j];
+        total.flops[j] += slots_[i]->flops[j];
+        total.calls[j] += slots_[i]->calls[j];
+        total.maxSize[j] = std::max(total.maxSize[j], slots_[i]->maxSize[j]);
+      }
+      if(used) active.push_back(slots_[i].get());
+    }
+    outFile << std::setprecision(10);
+    if(format == "CSV"){
+      for(size_t i = 0; i < info.size(); i++){
+        outFile << "# " << info[i].first << "," << info[i].second << std::endl;
+      }
+      outFile << "# wallTime," << wall << std::endl;
+      outFile << "thread,phase,calls,seconds,flops,gflops_per_second,max_size" << std::endl;
+      for(size_t t = 0; t <= active.size(); t++){
+        const Slot* slot = t < active.size() ? active[t] : &total;
+        for(int j = 0; j < NUM_OF_PHASE_; j++){
+          if(t < active.size()) outFile << t;
+          else outFile << "total";
+          outFile << "," << PHASE_NAMES[j] << "," << slot->calls[j] << "," << slot->seconds[j] << "," << slot->flops[j]
+            << "," << (slot->seconds[j] > 0 ? slot->flops[j] / slot->seconds[j] / 1e9 : 0) << "," << slot->maxSize[j] << std::endl;
+        }
+      }
+      return;
+    }
+    outFile << "{" << std::endl;
+    for(size_t i = 0; i < info.size(); i++){
+      outFile << "  \"" << info[i].first << "\": " << info[i].second << "," << std::endl;
+    }
+    outFile << "  \"wallTime\": " << wall << "," << std::endl;
+    outFile << "  \"phases\": {" << std::endl;
+    for(int j = 0; j < NUM_OF_PHASE_; j++){
+      outFile << "    \"" << PHASE_NAMES[j] << "\": {\"calls\": " << total.calls[j] << ", \"seconds\": " << total.seconds[j]
+        << ", \"flops\": " << total.flops[j] << ", \"gflopsPerSecond\": " << (total.seconds[j] > 0 ? total.flops[j] / total.seconds[j] / 1e9 : 0)
+        << ", \"maxSize\": " << total.maxSize[j] << "}" << (j + 1 < NUM_OF_PHASE_ ? "," : "") << std::endl;
+    }
+    outFile << "  }," << std::endl;
+    outFile << "  \"threads\": [" << std::endl;
+    for(size_t t = 0; t < active.size(); t++){
+      outFile << "    {";
+      for(int j = 0; j < NUM_OF_PHASE_; j++){
+        outFile << "\"" << PHASE_NAMES[j] << "\": [" << active[t]->calls[j] << ", " << active[t]->seconds[j] << "]"
+          << (j + 1 < NUM_OF_PHASE_ ? ", " : "");
+      }
+      outFile << "}" << (t + 1 < active.size() ? "," : "") << std::endl;
+    }
+    outFile << "  ]" << std::endl;
+    outFile << "}" << std::endl;
+  }
+
+  Timer::Timer(const PHASE phase, const double flops, const int size) :
+    phase_(phase), flops_(flops), size_(size), start_(0), active_(isEnabled()){
+    if(active_) start_ = wallTime();
+  }
+
+  Timer::~Timer(){
+    this->stop();
+  }
+
+  void Timer::stop(){
+    if(!active_) return;
+    record(phase_, wallTime() - start_, flops_, size_);
+    active_ = false;
+  }
+}
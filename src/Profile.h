@@ -0,0 +1,149 @@
+/* Copyright (C) 2016-2018, Stanford University
+ * This file is part of MESH
+ * Written by Kaifeng Chen (kfchen@stanford.edu)
+ *
+ * MESH is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * MESH is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#ifndef _PROFILE_H
+#define _PROFILE_H
+#include <string>
+#include <vector>
+#include <utility>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <atomic>
+
+namespace PROFILE{
+  // the phases of a simulation that are timed
+  enum PHASE {BUILD_MATRICES_, EIGEN_, SMATRIX_, SOURCE_, PROBE_, OUTPUT_, KPOINT_, NUM_OF_PHASE_};
+
+  /*============================================================
+  * Function telling whether the calling thread records into a profiler
+  * that is on
+  ==============================================================*/
+  bool isEnabled();
+
+  /*============================================================
+  * Function adding one call of a phase to the counters of the calling thread
+  @arg:
+   phase: the phase
+   seconds: the wall time of the call
+   flops: the estimated number of real floating point operations
+   size: the size of the largest matrix of the call
+  ==============================================================*/
+  void record(const PHASE phase, const double seconds, const double flops = 0, const int size = 0);
+
+  /*============================================================
+  * Functions estimating the real floating point operations of
+  * complex dense linear algebra
+  @arg:
+   n, m, k: the dimensions, an (n x k) times (k x m) product, or a
+   linear system of size n with m right hand sides
+  ==============================================================*/
+  double gemmFlops(const double n, const double k, const double m);
+  double solveFlops(const double n, const double m);
+  double eigFlops(const double n);
+
+  // the counters of one thread
+  typedef struct SLOT{
+    double seconds[NUM_OF_PHASE_] = {0};
+    double flops[NUM_OF_PHASE_] = {0};
+    long calls[NUM_OF_PHASE_] = {0};
+    int maxSize[NUM_OF_PHASE_] = {0};
+  } Slot;
+
+  /*============================================================
+  * Class keeping the counters of one simulation, for every thread that has
+  * worked for it. A thread only records inside a Scope of the profiler, so
+  * simulations running at the same time never share counters
+  ==============================================================*/
+  class Profiler{
+  public:
+    Profiler();
+    Profiler(const Profiler&) = delete;
+    /*============================================================
+    * Functions turning the profiler on and off, start also clears the counters
+    ==============================================================*/
+    void start();
+    void stop();
+    bool isEnabled();
+    /*============================================================
+    * Function writing the report of all the counters
+    @arg:
+     fileName: the name of the report
+     format: "JSON" or "CSV"
+     info: (name, value) pairs describing the run, written at the top of the report
+    ==============================================================*/
+    void writeReport(
+      const std::string& fileName,
+      const std::string& format,
+      const std::vector< std::pair<std::string, double> >& info
+    );
+  private:
+    friend class Scope;
+    Slot* getSlot();
+    std::atomic<bool> enabled_;
+    std::mutex slotMutex_;
+    // the slots live as long as the profiler, so a thread that has finished
+    // can still be reported
+    std::vector< std::unique_ptr<Slot> > slots_;
+    std::map< std::thread::id, Slot* > slotOfThread_;
+    double startTime_;
+  };
+
+  /*============================================================
+  * Function returning the profiler the calling thread records into,
+  * nullptr if none
+  ==============================================================*/
+  Profiler* current();
+
+  /*============================================================
+  * Class making the calling thread record into a profiler until its
+  * destruction, the previous profiler of the thread is restored then. The
+  * threads of a parallel region each need their own scope
+  @arg:
+   profiler: the profiler, nullptr records nothing
+  ==============================================================*/
+  class Scope{
+  public:
+    explicit Scope(Profiler* profiler);
+    ~Scope();
+    Scope(const Scope&) = delete;
+  private:
+    Profiler* previous_;
+    Slot* previousSlot_;
+  };
+
+  /*============================================================
+  * Class timing a phase from its construction to stop() or its destruction,
+  * it does nothing when the profiler is off
+  ==============================================================*/
+  class Timer{
+  public:
+    Timer(const PHASE phase, const double flops = 0, const int size = 0);
+    ~Timer();
+    void stop();
+  private:
+    PHASE phase_;
+    double flops_;
+    int size_;
+    double start_;
+    bool active_;
+  };
+}
+#endif
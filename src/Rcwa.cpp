@@ -17,6 +17,8 @@
  * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
  */
 #include "Rcwa.h"
+#include "Profile.h"
+#include <map>
 
 /*============================================================
 * Function similar to meshgrid in matlab for real numbers
@@ -56,6 +58,166 @@ void RCWA::meshGrid(
   qL = repmat(vL.st(), vR.n_rows, 1);
   qR = repmat(vR, 1, vL.n_rows);
 }
+/*============================================================
+* Function propogating the S matrix through one interface
+@arg:
+ S: the S matrix of the current layer
+ f: the diagonal of the F matrix of the current layer
+ fNext: the diagonal of the F matrix of the next layer
+ leftTop, rightTop, leftBottom, rightBottom: the blocks of the interface matrix
+ SNext: the S matrix of the next layer (output)
+@note:
+  F is diagonal, so the products with F are row or column scalings, and the
+  two blocks sharing the same denominator are solved together
+==============================================================*/
+static void propogateSMatrix(
+  const RCWA::SMatrix& S,
+  const arma::cx_vec& f,
+  const arma::cx_vec& fNext,
+  const RCWA::RCWAcMatrix& leftTop,
+  const RCWA::RCWAcMatrix& rightTop,
+  const RCWA::RCWAcMatrix& leftBottom,
+  const RCWA::RCWAcMatrix& rightBottom,
+  RCWA::SMatrix& SNext
+){
+  int n = f.n_elem;
+  RCWA::RCWAcMatrix FS12 = S.S12;
+  FS12.each_col() %= f;
+  RCWA::RCWAcMatrix FS11 = S.S11;
+  FS11.each_col() %= f;
+  RCWA::RCWAcMatrix X = arma::solve(leftTop - FS12 * leftBottom, arma::join_horiz(FS11, FS12 * rightBottom - rightTop),
+    arma::solve_opts::fast);
+
+  SNext.S11 = X.cols(0, n-1);
+  SNext.S12 = X.cols(n, 2*n-1);
+  SNext.S12.each_row() %= fNext.st();
+
+  RCWA::RCWAcMatrix rightBottomF = rightBottom;
+  rightBottomF.each_row() %= fNext.st();
+  SNext.S21 = S.S21 + (S.S22 * leftBottom) * SNext.S11;
+  SNext.S22 = S.S22 * (leftBottom * SNext.S12 + rightBottomF);
+}
+
+/*============================================================
+* Function splitting an interface matrix into the blocks used by the propogation
+@arg:
+ I: the interface matrix
+ direction: UP_ or DOWN_
+ leftTop, rightTop, leftBottom, rightBottom: the blocks (output)
+==============================================================*/
+static void splitInterface(
+  const RCWA::RCWAcMatrix& I,
+  const RCWA::DIRECTION direction,
+  RCWA::RCWAcMatrix& leftTop,
+  RCWA::RCWAcMatrix& rightTop,
+  RCWA::RCWAcMatrix& leftBottom,
+  RCWA::RCWAcMatrix& rightBottom
+){
+  int n = I.n_rows / 2;
+  int up = direction == RCWA::UP_ ? 0 : n, down = direction == RCWA::UP_ ? n : 0;
+  leftTop = I.submat(up, up, up+n-1, up+n-1);
+  rightTop = I.submat(up, down, up+n-1, down+n-1);
+  leftBottom = I.submat(down, up, down+n-1, up+n-1);
+  rightBottom = I.submat(down, down, down+n-1, down+n-1);
+}
+
+/*============================================================
+* Function computing the S matrix of one interface step, so that
+* propogateSMatrix(S) is the star product of S and this S matrix
+@arg:
+ f: the diagonal of the F matrix of the current layer
+ fNext: the diagonal of the F matrix of the next layer
+ leftTop, rightTop, leftBottom, rightBottom: the blocks of the interface matrix
+ T: the S matrix of the step (output)
+==============================================================*/
+static void getStepSMatrix(
+  const arma::cx_vec& f,
+  const arma::cx_vec& fNext,
+  const RCWA::RCWAcMatrix& leftTop,
+  const RCWA::RCWAcMatrix& rightTop,
+  const RCWA::RCWAcMatrix& leftBottom,
+  const RCWA::RCWAcMatrix& rightBottom,
+  RCWA::SMatrix& T
+){
+  int n = f.n_elem;
+  RCWA::RCWAcMatrix Y = arma::solve(leftTop, arma::join_horiz(arma::eye<RCWA::RCWAcMatrix>(n, n), rightTop),
+    arma::solve_opts::fast);
+  T.S11 = Y.cols(0, n-1);
+  T.S11.each_row() %= f.st();
+  T.S21 = leftBottom * T.S11;
+  T.S12 = -Y.cols(n, 2*n-1);
+  T.S12.each_row() %= fNext.st();
+  T.S22 = rightBottom - leftBottom * Y.cols(n, 2*n-1);
+  T.S22.each_row() %= fNext.st();
+}
+
+/*============================================================
+* Function checking whether a layer is uniform and isotropic
+@arg:
+ E: the E matrix of the layer
+ eps_zz_inv: the inverse of the eps_zz matrix of the layer
+ N: the number of G
+@note:
+  the E matrix of such a layer is epsilon times the identity, and eps_zz_inv
+  its inverse up to rounding, so that the eigen matrix of the layer is
+  diagonal in the plane wave basis
+==============================================================*/
+static bool isUniformIsotropic(
+  const RCWA::RCWAcMatrix& E,
+  const RCWA::RCWAcMatrix& eps_zz_inv,
+  const int N
+){
+  if(!RCWA::isBlockDiagonal(E, N)) return false;
+  const dcomplex epsilon = E(0, 0);
+  for(int j = 0; j < N; j++){
+    for(int i = 0; i < 2*N; i++){
+      if(E(i, j) != (i % N == j ? epsilon : dcomplex(0))) return false;
+    }
+    for(int i = 0; i < N; i++){
+      if(i != j && eps_zz_inv(i, j) != 0.0) return false;
+    }
+    if(std::abs(eps_zz_inv(j, j) * epsilon - 1.0) > 1e-13) return false;
+  }
+  return true;
+}
+
+/*============================================================
+* Function computing the Redheffer star product of two S matrices,
+* the S matrix of A followed by B
+@arg:
+ A, B: the S matrices
+ C: A * B (output), should not be A or B
+==============================================================*/
+void RCWA::starProduct(const SMatrix& A, const SMatrix& B, SMatrix& C){
+  int n = A.S11.n_rows;
+  RCWAcMatrix one = eye<RCWAcMatrix>(n, n);
+  RCWAcMatrix Y = solve(one - A.S12 * B.S21, join_horiz(A.S11, A.S12 * B.S22), solve_opts::fast);
+  RCWAcMatrix Z = solve(one - B.S21 * A.S12, join_horiz(B.S21 * A.S11, B.S22), solve_opts::fast);
+  C.S11 = B.S11 * Y.cols(0, n-1);
+  C.S12 = B.S12 + B.S11 * Y.cols(n, 2*n-1);
+  C.S21 = A.S21 + A.S22 * Z.cols(0, n-1);
+  C.S22 = A.S22 * Z.cols(n, 2*n-1);
+}
+
+/*============================================================
+* Function mapping every layer to the layer whose matrices it uses
+@arg:
+ repeatList: the repeated layers of the stack
+ numOfLayer: the number of layers
+ layerMap: the layer of the first period for repeated layers,
+   the layer itself otherwise (output)
+==============================================================*/
+void RCWA::getLayerMap(const RepeatList& repeatList, const int numOfLayer, std::vector<int>& layerMap){
+  layerMap.resize(numOfLayer);
+  for(int i = 0; i < numOfLayer; i++) layerMap[i] = i;
+  for(size_t g = 0; g < repeatList.size(); g++){
+    const RepeatGroup& group = repeatList[g];
+    for(int i = group.first + group.period; i < group.first + group.period * group.count; i++){
+      layerMap[i] = group.first + (i - group.first) % group.period;
+    }
+  }
+}
+
 /*============================================================
 * Function computing S matrix for each layers
 @arg:
@@ -64,8 +226,16 @@ void RCWA::meshGrid(
  numOfLayer: the number of layers
  MMatrices: matrix corresponding to the propogation in each layer
  FMatrices: matrix corresponding to the phase in each layer
- SMatrices: the S matrix for each layer
+ SMatrices: the S matrix for each layer (output)
  DIRECTION: the direction of propogation
+ interfaces: the interface matrices from getInterfaceMatrices, nullptr to
+   solve them here
+ keepLayers: the layers whose S matrices are kept, nullptr for all
+@note:
+  FMatrices should be diagonal. The S matrix of startLayer and those at
+  the ends of the propogation are always kept. With interfaces, the
+  repeated periods crossed by the propogation are skipped by their
+  S matrices, and the S matrices of the skipped layers are not computed
 ==============================================================*/
 void RCWA::getSMatrices(
   const int startLayer,
@@ -73,72 +243,250 @@ void RCWA::getSMatrices(
   const int numOfLayer,
   const RCWAcMatrices& MMatrices,
   const RCWAcMatrices& FMatrices,
-  RCWAcMatrices& SMatrices,
-  const DIRECTION direction
+  SMatrixList& SMatrices,
+  const DIRECTION direction,
+  const Interfaces* interfaces,
+  const std::vector<char>* keepLayers
 ){
 
-  int r1 = 0, r2 = 2*N -1, r3 = 2*N, r4 = 4*N -1;
-// propogating down
-  if(direction == ALL_ || direction == DOWN_){
-    // propogating down
-    for(int i = startLayer; i >=1; i--){
-      RCWAcMatrix I = solve(MMatrices[i], MMatrices[i-1], solve_opts::fast);
-
-      RCWAcMatrix leftTop = I(span(r3, r4), span(r3, r4));
-      RCWAcMatrix rightTop = I(span(r3, r4), span(r1, r2));
-      RCWAcMatrix leftBottom = I(span(r1, r2), span(r3, r4));
-      RCWAcMatrix rightBottom = I(span(r1, r2), span(r1, r2));
+  int numOfStep = 0;
+  if(direction == ALL_ || direction == DOWN_) numOfStep += startLayer;
+  if(direction == ALL_ || direction == UP_) numOfStep += std::max(numOfLayer - 1 - startLayer, 0);
+  // every interface solves one 2N system with 4N right hand sides and takes six 2N products,
+  // plus one 4N system if the interface matrix is not given. Skipped periods are not counted
+  PROFILE::Timer timer(PROFILE::SMATRIX_, numOfStep * ((interfaces == nullptr ? PROFILE::solveFlops(4*N, 4*N) : 0) +
+    PROFILE::solveFlops(2*N, 4*N) + 6 * PROFILE::gemmFlops(2*N, 2*N, 2*N)), 4*N);
 
-      SMatrices[i-1](span(r1, r2), span(r1, r2)) = solve(
-        leftTop - FMatrices[i] * SMatrices[i](span(r1, r2), span(r3, r4)) * leftBottom,
-        FMatrices[i],
-        solve_opts::fast
-      ) * SMatrices[i](span(r1, r2), span(r1,r2));
-
-      RCWAcMatrix test = leftTop - FMatrices[i] * SMatrices[i](span(r1, r2), span(r3, r4)) * leftBottom;
-
-      SMatrices[i-1](span(r1, r2), span(r3, r4)) = solve(
-        leftTop - FMatrices[i] * SMatrices[i](span(r1, r2), span(r3, r4)) * leftBottom,
-        FMatrices[i] * SMatrices[i](span(r1, r2), span(r3,r4)) * rightBottom - rightTop,
-        solve_opts::fast
-      ) * FMatrices[i-1];
+  SMatrices.resize(numOfLayer);
+  SMatrices[startLayer].S11.eye(2*N, 2*N);
+  SMatrices[startLayer].S12.zeros(2*N, 2*N);
+  SMatrices[startLayer].S21.zeros(2*N, 2*N);
+  SMatrices[startLayer].S22.eye(2*N, 2*N);
+  // releases the S matrix of a layer once the next one is computed
+  auto release = [&](const int i){
+    if(i == startLayer || keepLayers == nullptr || (*keepLayers)[i]) return;
+    SMatrices[i] = SMatrix();
+  };
+  // the layer whose M and F matrices are used
+  auto layer = [&](const int i){
+    return interfaces == nullptr ? i : interfaces->layerMap[i];
+  };
 
-      SMatrices[i-1](span(r3,r4), span(r1,r2)) = SMatrices[i](span(r3,r4), span(r1,r2)) +
-        SMatrices[i](span(r3,r4), span(r3,r4)) * leftBottom * SMatrices[i-1](span(r1,r2), span(r1,r2));
-
-      SMatrices[i-1](span(r3,r4), span(r3,r4)) = SMatrices[i](span(r3,r4), span(r3,r4)) *
-        (leftBottom * SMatrices[i-1](span(r1,r2), span(r3,r4)) + rightBottom * FMatrices[i-1]);
+  RCWAcMatrix solved, leftTop, rightTop, leftBottom, rightBottom;
+  if(direction == ALL_ || direction == DOWN_){
+    // propogating down
+    for(int i = startLayer; i >= 1; i--){
+      if(interfaces != nullptr){
+        // skip to the first period of a repeat group ending here
+        for(size_t g = 0; g < interfaces->repeatList.size(); g++){
+          const RepeatGroup& group = interfaces->repeatList[g];
+          if(interfaces->repeatDown[g].S11.is_empty() || group.first + group.period * group.count - 1 != i) continue;
+          int next = i - group.period * (group.count - 1);
+          starProduct(SMatrices[i], interfaces->repeatDown[g], SMatrices[next]);
+          release(i);
+          i = next;
+          break;
+        }
+      }
+      if(interfaces == nullptr) solved = solve(MMatrices[i], MMatrices[i-1], solve_opts::fast);
+      const RCWAcMatrix& I = interfaces == nullptr ? solved : interfaces->down[interfaces->downIdx[i]];
+      splitInterface(I, DOWN_, leftTop, rightTop, leftBottom, rightBottom);
+      propogateSMatrix(SMatrices[i], FMatrices[layer(i)].diag(), FMatrices[layer(i-1)].diag(),
+        leftTop, rightTop, leftBottom, rightBottom, SMatrices[i-1]);
+      release(i);
     }
   }
   if(direction == ALL_ || direction == UP_){
     // propogating up
     for(int i = startLayer; i < numOfLayer - 1; i++){
-      RCWAcMatrix I = solve(MMatrices[i], MMatrices[i+1], solve_opts::fast);
-      RCWAcMatrix leftTop = I(span(r1, r2), span(r1, r2));
-      RCWAcMatrix rightTop = I(span(r1, r2), span(r3, r4));
-      RCWAcMatrix leftBottom = I(span(r3, r4), span(r1, r2));
-      RCWAcMatrix rightBottom = I(span(r3, r4), span(r3, r4));
-
-      SMatrices[i+1](span(r1, r2), span(r1, r2)) = solve(
-        leftTop - FMatrices[i] * SMatrices[i](span(r1, r2), span(r3, r4)) * leftBottom,
-        FMatrices[i],
-        solve_opts::fast
-      ) * SMatrices[i](span(r1, r2), span(r1,r2));
+      if(interfaces != nullptr){
+        // skip to the last period of a repeat group starting here
+        for(size_t g = 0; g < interfaces->repeatList.size(); g++){
+          const RepeatGroup& group = interfaces->repeatList[g];
+          if(interfaces->repeatUp[g].S11.is_empty() || group.first != i) continue;
+          int next = i + group.period * (group.count - 1);
+          starProduct(SMatrices[i], interfaces->repeatUp[g], SMatrices[next]);
+          release(i);
+          i = next;
+          break;
+        }
+      }
+      if(interfaces == nullptr) solved = solve(MMatrices[i], MMatrices[i+1], solve_opts::fast);
+      const RCWAcMatrix& I = interfaces == nullptr ? solved : interfaces->up[interfaces->upIdx[i]];
+      splitInterface(I, UP_, leftTop, rightTop, leftBottom, rightBottom);
+      propogateSMatrix(SMatrices[i], FMatrices[layer(i)].diag(), FMatrices[layer(i+1)].diag(),
+        leftTop, rightTop, leftBottom, rightBottom, SMatrices[i+1]);
+      release(i);
+    }
+  }
 
-      SMatrices[i+1](span(r1, r2), span(r3, r4)) = solve(
-        leftTop - FMatrices[i] * SMatrices[i](span(r1, r2), span(r3, r4)) * leftBottom,
-        FMatrices[i] * SMatrices[i](span(r1, r2), span(r3,r4)) * rightBottom - rightTop,
-        solve_opts::fast
-      ) * FMatrices[i+1];
+}
+
+/*============================================================
+* Function computing the LU factorization of a square matrix
+@arg:
+ A: the matrix
+ factor: the factorization (output)
+@note:
+  throws std::runtime_error if A is singular, the same as solve
+==============================================================*/
+void RCWA::luFactorize(const RCWAcMatrix& A, LUFactor& factor){
+  factor.LU = A;
+  blas_int n = A.n_rows;
+  blas_int info = 0;
+  factor.pivot.resize(A.n_rows);
+  arma::lapack::getrf(&n, &n, factor.LU.memptr(), &n, factor.pivot.data(), &info);
+  if(info != 0){
+    factor.LU.reset();
+    throw std::runtime_error("solve(): solution not found");
+  }
+}
 
-      SMatrices[i+1](span(r3,r4), span(r1,r2)) = SMatrices[i](span(r3,r4), span(r1,r2)) +
-        SMatrices[i](span(r3,r4), span(r3,r4)) * leftBottom * SMatrices[i+1](span(r1,r2), span(r1,r2));
+/*============================================================
+* Function solving A * X = B from the LU factorization of A
+@arg:
+ factor: the factorization of A from luFactorize
+ B: the right hand side
+==============================================================*/
+RCWA::RCWAcMatrix RCWA::luSolve(const LUFactor& factor, const RCWAcMatrix& B){
+  RCWAcMatrix X = B;
+  char trans = 'N';
+  blas_int n = factor.LU.n_rows;
+  blas_int nrhs = B.n_cols;
+  blas_int info = 0;
+  // getrs does not modify the factorization
+  arma::lapack::getrs(&trans, &n, &nrhs, const_cast<dcomplex*>(factor.LU.memptr()), &n,
+    const_cast<blas_int*>(factor.pivot.data()), X.memptr(), &n, &info);
+  return X;
+}
 
-      SMatrices[i+1](span(r3,r4), span(r3,r4)) = SMatrices[i](span(r3,r4), span(r3,r4)) *
-        (leftBottom * SMatrices[i+1](span(r1,r2), span(r3,r4)) + rightBottom * FMatrices[i+1]);
-    }
+/*============================================================
+* Function computing the interface matrices between neighboring layers
+@arg:
+ MMatrices: matrix corresponding to the propogation in each layer
+ FMatrices: matrix corresponding to the phase in each layer
+ numOfLayer: the number of layers
+ firstUp: the up interfaces are computed for layers firstUp to numOfLayer - 2
+ lastDown: the down interfaces are computed for layers 1 to lastDown
+ repeatList: the repeated layers, nullptr if none
+ factors: the LU factorization of each M matrix, factorized when
+   needed and kept for other solves with the same M matrix
+ interfaces: the interface matrices (output)
+ numOfThread: the number of threads over the layers
+@note:
+  MMatrices and FMatrices are only read at the layers of layerMap
+==============================================================*/
+void RCWA::getInterfaceMatrices(
+  const RCWAcMatrices& MMatrices,
+  const RCWAcMatrices& FMatrices,
+  const int numOfLayer,
+  const int firstUp,
+  const int lastDown,
+  const RepeatList* repeatList,
+  LUFactors& factors,
+  Interfaces& interfaces,
+  const int numOfThread
+){
+  interfaces.repeatList = repeatList == nullptr ? RepeatList() : *repeatList;
+  getLayerMap(interfaces.repeatList, numOfLayer, interfaces.layerMap);
+  const std::vector<int>& layerMap = interfaces.layerMap;
+  factors.resize(numOfLayer);
+  interfaces.up.assign(numOfLayer, RCWAcMatrix());
+  interfaces.down.assign(numOfLayer, RCWAcMatrix());
+  interfaces.upIdx.assign(numOfLayer, -1);
+  interfaces.downIdx.assign(numOfLayer, -1);
+
+  // an interface is solved at the first layer with the same pair of M matrices
+  std::map<std::pair<int, int>, int> upIdx, downIdx;
+  std::vector<char> solveUp(numOfLayer, 0), solveDown(numOfLayer, 0), factorize(numOfLayer, 0);
+  for(int i = std::max(firstUp, 0); i < numOfLayer - 1; i++){
+    auto it = upIdx.insert(std::make_pair(std::make_pair(layerMap[i], layerMap[i+1]), i)).first;
+    interfaces.upIdx[i] = it->second;
+    if(it->second == i) solveUp[i] = factorize[layerMap[i]] = 1;
+  }
+  for(int i = 1; i <= lastDown && i < numOfLayer; i++){
+    auto it = downIdx.insert(std::make_pair(std::make_pair(layerMap[i], layerMap[i-1]), i)).first;
+    interfaces.downIdx[i] = it->second;
+    if(it->second == i) solveDown[i] = factorize[layerMap[i]] = 1;
+  }
+
+  // the threads of the loops record into the profiler of the caller
+  PROFILE::Profiler* profiler = PROFILE::current();
+  #if defined(_OPENMP)
+    #pragma omp parallel for schedule(dynamic) num_threads(numOfThread) if(numOfThread > 1)
+  #endif
+  for(int i = 0; i < numOfLayer; i++){
+    if(!factorize[i] || !factors[i].LU.is_empty()) continue;
+    PROFILE::Scope profileScope(profiler);
+    int n = MMatrices[i].n_rows;
+    PROFILE::Timer timer(PROFILE::SMATRIX_, PROFILE::solveFlops(n, 0), n);
+    luFactorize(MMatrices[i], factors[i]);
+  }
+  #if defined(_OPENMP)
+    #pragma omp parallel for schedule(dynamic) num_threads(numOfThread) if(numOfThread > 1)
+  #endif
+  for(int i = 0; i < numOfLayer; i++){
+    if(!solveUp[i] && !solveDown[i]) continue;
+    PROFILE::Scope profileScope(profiler);
+    int n = MMatrices[layerMap[i]].n_rows;
+    PROFILE::Timer timer(PROFILE::SMATRIX_, (solveUp[i] + solveDown[i]) * PROFILE::gemmFlops(n, n, n), n);
+    if(solveUp[i]) interfaces.up[i] = luSolve(factors[layerMap[i]], MMatrices[layerMap[i+1]]);
+    if(solveDown[i]) interfaces.down[i] = luSolve(factors[layerMap[i]], MMatrices[layerMap[i-1]]);
   }
 
+  // the S matrices of count - 1 periods, by repeated squaring of one period
+  int numOfGroup = interfaces.repeatList.size();
+  interfaces.repeatUp.assign(numOfGroup, SMatrix());
+  interfaces.repeatDown.assign(numOfGroup, SMatrix());
+  for(int g = 0; g < numOfGroup; g++){
+    const RepeatGroup& group = interfaces.repeatList[g];
+    int last = group.first + group.period * group.count - 1;
+    if(group.count < 2) continue;
+    for(int d = 0; d < 2; d++){
+      DIRECTION direction = d == 0 ? UP_ : DOWN_;
+      // an up propogation crosses the group if it starts below, a down one if it starts above
+      if(direction == UP_ && firstUp > group.first) continue;
+      if(direction == DOWN_ && lastDown <= last) continue;
+      int n = MMatrices[group.first].n_rows / 2;
+      PROFILE::Timer timer(PROFILE::SMATRIX_, (group.period + 2 * std::log2(group.count)) *
+        (2 * PROFILE::solveFlops(n, 2*n) + 6 * PROFILE::gemmFlops(n, n, n)), 2*n);
+      SMatrix period, step, product;
+      RCWAcMatrix leftTop, rightTop, leftBottom, rightBottom;
+      for(int k = 0; k < group.period; k++){
+        int i = direction == UP_ ? group.first + k : last - k;
+        int next = direction == UP_ ? i + 1 : i - 1;
+        const RCWAcMatrix& I = direction == UP_ ? interfaces.up[interfaces.upIdx[i]] :
+          interfaces.down[interfaces.downIdx[i]];
+        splitInterface(I, direction, leftTop, rightTop, leftBottom, rightBottom);
+        getStepSMatrix(FMatrices[layerMap[i]].diag(), FMatrices[layerMap[next]].diag(),
+          leftTop, rightTop, leftBottom, rightBottom, step);
+        if(k == 0){
+          period = step;
+        }
+        else{
+          starProduct(period, step, product);
+          std::swap(period, product);
+        }
+      }
+      // the periods commute, so the powers can be multiplied in any order
+      SMatrix& power = direction == UP_ ? interfaces.repeatUp[g] : interfaces.repeatDown[g];
+      for(int count = group.count - 1; count > 0; count >>= 1){
+        if(count & 1){
+          if(power.S11.is_empty()){
+            power = period;
+          }
+          else{
+            starProduct(power, period, product);
+            std::swap(power, product);
+          }
+        }
+        if(count > 1){
+          starProduct(period, period, product);
+          std::swap(period, product);
+        }
+      }
+    }
+  }
 }
 
 /*============================================================
@@ -166,11 +514,73 @@ double RCWA::sinc(const double x){
  x: the input argument
 ==============================================================*/
 double RCWA::jinc(const double x){
-  if(x == 0.0) return 0.5;
-  double j1 = 0;
-  double j0, y0, y1, j0p, j1p, y0p, y1p;
-  bessjy01a(x, j0, j1, y0, y1, j0p, j1p, y0p, y1p);
-  return j1 / x;
+  double result;
+  jinc(&x, &result, 1);
+  return result;
+}
+/*============================================================
+* Coefficients of the rational approximations of J1 (Cephes), for x <= 5
+* J1(x) / x = (x^2 - Z1) (x^2 - Z2) RP(x^2) / RQ(x^2), and for x > 5
+* J1(x) = sqrt(2 / (pi x)) (P(25 / x^2) cos(xn) - 5 / x Q(25 / x^2) sin(xn))
+* with xn = x - 3 pi / 4, the absolute error is below 1e-13
+==============================================================*/
+static const double J1_RP[4] = {
+  -8.99971225705559398224E8, 4.52228297998194034323E11, -7.27494245221818276015E13, 3.68295732863852883286E15
+};
+static const double J1_RQ[8] = {
+  6.20836478118054335476E2, 2.56987256757748830383E5, 8.35146791431949253037E7, 2.21511595479792499675E10,
+  4.74914122079991414898E12, 7.84369607876235854894E14, 8.95222336184627338078E16, 5.32278620332680085395E18
+};
+static const double J1_PP[7] = {
+  7.62125616208173112003E-4, 7.31397056940917570436E-2, 1.12719608129684925192E0, 5.11207951146807644818E0,
+  8.42404590141772420927E0, 5.21451598682361504063E0, 1.00000000000000000254E0
+};
+static const double J1_PQ[7] = {
+  5.71323128072548699714E-4, 6.88455908754495404082E-2, 1.10514232634061696926E0, 5.07386386128601488557E0,
+  8.39985554327604159757E0, 5.20982848682361821619E0, 9.99999999999999997461E-1
+};
+static const double J1_QP[8] = {
+  5.10862594750176621635E-2, 4.98213872951233449420E0, 7.58238284132545283818E1, 3.66779609360150777800E2,
+  7.10856304998926107277E2, 5.97489612400613639965E2, 2.11688757100572135698E2, 2.52070205858023719784E1
+};
+static const double J1_QQ[7] = {
+  7.42373277035675149943E1, 1.05644886038262816351E3, 4.98641058337653607651E3, 9.56231892404756170795E3,
+  7.99704160447350683650E3, 2.82619278517639096600E3, 3.36093607810698293419E2
+};
+static const double J1_Z1 = 1.46819706421238932572E1;
+static const double J1_Z2 = 4.92184563216946036703E1;
+static const double J1_SQ2OPI = 7.9788456080286535587989E-1;
+static const double J1_THPIO4 = 2.35619449019234492885;
+
+void RCWA::jinc(const double* x, double* result, const int n){
+  // the small argument form for every x, it has no branches
+  #if defined(_OPENMP)
+    #pragma omp simd
+  #endif
+  for(int i = 0; i < n; i++){
+    double z = x[i] * x[i];
+    double p = ((J1_RP[0] * z + J1_RP[1]) * z + J1_RP[2]) * z + J1_RP[3];
+    double q = z + J1_RQ[0];
+    for(int k = 1; k < 8; k++) q = q * z + J1_RQ[k];
+    result[i] = p / q * (z - J1_Z1) * (z - J1_Z2);
+  }
+  // the large arguments are replaced by the asymptotic form
+  for(int i = 0; i < n; i++){
+    double xi = x[i];
+    if(xi <= 5.0) continue;
+    double w = 5.0 / xi;
+    double z = w * w;
+    double pp = J1_PP[0], pq = J1_PQ[0], qp = J1_QP[0], qq = z + J1_QQ[0];
+    for(int k = 1; k < 7; k++){
+      pp = pp * z + J1_PP[k];
+      pq = pq * z + J1_PQ[k];
+      qq = qq * z + J1_QQ[k];
+    }
+    for(int k = 1; k < 8; k++) qp = qp * z + J1_QP[k];
+    double xn = xi - J1_THPIO4;
+    double j1 = (pp / pq * cos(xn) - w * qp / qq * sin(xn)) * J1_SQ2OPI / sqrt(xi);
+    result[i] = j1 / xi;
+  }
 }
 /*============================================================
 * Function computing G matrix for the system
@@ -236,6 +646,8 @@ im_eps_yy: the imaginary part of eps_yy
 im_eps_zz: the imaginary part of eps_zz
 numOfLayer: the number of layer in the system
 N: the number of G
+@note:
+  an empty im_eps_xy means a block diagonal matrix, stored as [xx; yy; zz]
 ==============================================================*/
 // IMPORTANT: this functoin need to be changed to be compatible with tensor interface
 void RCWA::getGrandImaginaryMatrices(
@@ -250,6 +662,16 @@ void RCWA::getGrandImaginaryMatrices(
 )
 {
   for(int i = 0; i < numOfLayer; i++){
+    // layers that are not rebuilt are left unchanged
+    if(im_eps_xx[i].is_empty()) continue;
+    if(im_eps_xy[i].is_empty()){
+      RCWAcMatrix grandImaginaryMatrix(3*N, N);
+      grandImaginaryMatrix.rows(0, N-1) = im_eps_xx[i];
+      grandImaginaryMatrix.rows(N, 2*N-1) = im_eps_yy[i];
+      grandImaginaryMatrix.rows(2*N, 3*N-1) = im_eps_zz[i];
+      grandImaginaryMatrices[i] = grandImaginaryMatrix;
+      continue;
+    }
     RCWAcMatrix grandImaginaryMatrix = zeros<RCWAcMatrix>(3*N, 3*N);
     grandImaginaryMatrix(span(0, N-1), span(0, N-1)) = im_eps_xx[i];
     grandImaginaryMatrix(span(0, N-1), span(N, 2*N-1)) = im_eps_xy[i];
@@ -270,6 +692,8 @@ eps_yx: the epsilon in yx direction
 eps_yy: the epsilon in yy direction
 numOfLayer: the number of layer in the system
 N: the number of G
+@note:
+  an empty eps_xy means a block diagonal matrix, stored as [yy; xx]
 ==============================================================*/
 // IMPORTANT: this functoin need to be changed to be compatible with tensor interface
 void RCWA::getEMatrices(
@@ -283,6 +707,12 @@ void RCWA::getEMatrices(
 ){
 
   for(int i = 0; i < numOfLayer; i++){
+    // layers that are not rebuilt are left unchanged
+    if(eps_xx[i].is_empty()) continue;
+    if(eps_xy[i].is_empty()){
+      EMatrices[i] = join_vert(eps_yy[i], eps_xx[i]);
+      continue;
+    }
     RCWAcMatrix EMatrix = join_vert(
       join_horiz(eps_yy[i], -eps_yx[i]),
       join_horiz(-eps_xy[i], eps_xx[i])
@@ -292,6 +722,110 @@ void RCWA::getEMatrices(
 }
 
 
+/*============================================================
+* Function refining the eigen system of A from eigenvectors of a nearby matrix
+@arg:
+ A: the matrix to be diagonalized
+ eigVal: the eigenvalues of A (output)
+ eigVec: on input the eigenvectors of the nearby matrix, on output those of A
+ maxIter: maximum number of perturbation sweeps
+ tol: relative tolerance of the off-diagonal coupling
+@note:
+ B = V^-1 A V is nearly diagonal when A is close to the previous matrix.
+ Each sweep removes the coupling between well separated eigenvalues with
+ the first order update V <- V (1 + Z), Z_ij = B_ij / (B_jj - B_ii).
+ Eigenvalues that are (nearly) degenerate are grouped into clusters, and
+ each cluster is diagonalized by a small eig_gen at the end.
+==============================================================*/
+bool RCWA::refineEigenSystem(
+  const RCWAcMatrix& A,
+  cx_vec& eigVal,
+  RCWAcMatrix& eigVec,
+  const int maxIter,
+  const double tol
+){
+  const int n = A.n_rows;
+  if(eigVec.n_rows != A.n_rows || eigVec.n_cols != A.n_cols) return false;
+
+  RCWAcMatrix V = eigVec, B;
+  if(!solve(B, V, A * V, solve_opts::fast)) return false;
+
+  std::vector<int> cluster(n);
+  for(int iter = 0; iter <= maxIter; iter++){
+    cx_vec d = B.diag();
+    double scale = max(abs(d));
+    if(scale == 0) scale = 1;
+
+    // group eigenvalues that are too close for a perturbative update
+    for(int i = 0; i < n; i++) cluster[i] = i;
+    for(int j = 0; j < n; j++){
+      for(int i = 0; i < n; i++){
+        if(i == j) continue;
+        double coupling = std::abs(B(i, j));
+        if(coupling <= tol * scale) continue;
+        if(std::abs(d(j) - d(i)) >= 2 * coupling) continue;
+        int ri = i, rj = j;
+        while(cluster[ri] != ri) ri = cluster[ri];
+        while(cluster[rj] != rj) rj = cluster[rj];
+        if(ri != rj) cluster[std::max(ri, rj)] = std::min(ri, rj);
+      }
+    }
+    // parents always have smaller indices, so one pass flattens the tree
+    for(int i = 0; i < n; i++) cluster[i] = cluster[cluster[i]];
+
+    RCWAcMatrix Z(n, n, fill::zeros);
+    double offMax = 0, zMax = 0;
+    for(int j = 0; j < n; j++){
+      for(int i = 0; i < n; i++){
+        if(cluster[i] == cluster[j]) continue;
+        double coupling = std::abs(B(i, j));
+        if(coupling <= tol * scale) continue;
+        offMax = std::max(offMax, coupling);
+        Z(i, j) = B(i, j) / (d(j) - d(i));
+        zMax = std::max(zMax, std::abs(Z(i, j)));
+      }
+    }
+
+    // the update is quadratically convergent, so the coupling left after
+    // this sweep is of order offMax * zMax
+    bool converged = offMax * zMax <= tol * scale;
+    if(offMax != 0){
+      if(iter == maxIter && !converged) break;
+      RCWAcMatrix X = Z;
+      X.diag() += 1;
+      V = V * X;
+      if(!solve(B, X, B * X, solve_opts::fast)) return false;
+    }
+    if(!converged) continue;
+
+    // diagonalize the remaining clusters
+    eigVal = B.diag();
+    for(int i = 0; i < n; i++){
+      if(cluster[i] != i) continue;
+      std::vector<uword> memberList;
+      for(int j = i; j < n; j++){
+        if(cluster[j] == i) memberList.push_back(j);
+      }
+      if(memberList.size() == 1) continue;
+      uvec members(memberList);
+      // a large cluster means the previous solution is of little use
+      if(2 * members.n_elem > (uword)n) return false;
+      cx_vec clusterVal;
+      RCWAcMatrix clusterVec;
+      RCWAcMatrix subB = B(members, members);
+      if(!eig_gen(clusterVal, clusterVec, subB)) return false;
+      V.cols(members) = V.cols(members) * clusterVec;
+      eigVal(members) = clusterVal;
+    }
+    V = normalise(V);
+    // final residual check before accepting the refined solution
+    if(norm(A * V - V * diagmat(eigVal), "fro") > 1e3 * tol * norm(A, "fro")) return false;
+    eigVec = V;
+    return true;
+  }
+  return false;
+}
+
 /*============================================================
 * Function computing the poynting vector at given (kx, ky)
 @arg:
@@ -309,8 +843,8 @@ targetLayer: the targetLayer for the flux measurement
 N: total number of G
 polar: the polarization of the light
 target_z: the relative z coordinate in the target layer, in micron
+eigenCache: eigenvectors from the previous k point, nullptr to disable
 ==============================================================*/
-// IMPORTANT: there is no change in this function even for a tensor
 double RCWA::poyntingFlux(
   const double omega,
   const RCWArVector& thicknessList,
@@ -325,7 +859,67 @@ double RCWA::poyntingFlux(
   const int targetLayer,
   const int N,
   const POLARIZATION polar,
-  const double target_z
+  const double target_z,
+  EigenCache* eigenCache,
+  const RepeatList* repeatList
+){
+  ProbeList probeList(1, Probe(targetLayer, target_z));
+  double flux = 0;
+  poyntingFlux(omega, thicknessList, kx, ky, EMatrices, grandImaginaryMatrices,
+    eps_zz_inv, Gx_mat, Gy_mat, sourceList, probeList, N, polar, &flux, nullptr, eigenCache, 1, repeatList);
+  return flux;
+}
+
+/*============================================================
+* Function computing the poynting vector at given (kx, ky) for several probes
+@arg:
+omega: the angular frequency (normalized to c)
+thicknessList: the thickness for each layer
+kx: the k vector at x direction (normalized value)
+ky: the y vector at x direction (normalized value)
+EMatrices:  the E matrices for all layers
+grandImaginaryMatrices: collection of all imaginary matrices in all layers
+eps_zz_inv: the inverse of eps_zz
+Gx_mat: the Gx matrix
+Gy_mat: the Gy matrix
+sourceList: list of 0 or 1 with the same size of thicknessList
+probeList: list of (target layer, relative z coordinate in micron)
+N: total number of G
+polar: the polarization of the light
+flux: the flux at each probe (output), should have the size of probeList
+fluxBySource: the flux at each probe from each layer (output), nullptr to disable.
+  For probe p and layer i, entries (p * numOfLayer + i) * 3 + {0, 1, 2} are the
+  total, the TE and the TM part. Non-source layers are left as zero
+eigenCache: eigenvectors from the previous k point, nullptr to disable
+numOfThread: the number of threads over the layers and the sources
+@note:
+the eigen problem, the S matrices of the sources and the source fields are
+shared by all probes, only the propagation to each probe is repeated.
+The eigen problems of the layers and the contributions of the sources are
+independent, and run in parallel with numOfThread > 1. The contributions
+are summed up in the order of the layers, so the result does not depend
+on the number of threads
+==============================================================*/
+// IMPORTANT: there is no change in this function even for a tensor
+void RCWA::poyntingFlux(
+  const double omega,
+  const RCWArVector& thicknessList,
+  double kx,
+  double ky,
+  const RCWAcMatrices& EMatrices,
+  const RCWAcMatrices& grandImaginaryMatrices,
+  const RCWAcMatrices& eps_zz_inv,
+  const RCWArMatrix& Gx_mat,
+  const RCWArMatrix& Gy_mat,
+  const SourceList& sourceList,
+  const ProbeList& probeList,
+  const int N,
+  const POLARIZATION polar,
+  double* flux,
+  double* fluxBySource,
+  EigenCache* eigenCache,
+  const int numOfThread,
+  const RepeatList* repeatList
 ){
 
   /*======================================================
@@ -341,6 +935,7 @@ double RCWA::poyntingFlux(
   RCWAcMatrix zeroPadding2N(2*N, 2*N, fill::zeros);
   RCWAcMatrix zeroPadding4N(4*N, 4*N, fill::zeros);
   int numOfLayer = thicknessList.n_elem;
+  int numOfProbe = probeList.size();
 
   // populate Gx and Gy matrices
   RCWArMatrix kxMat = diagmat(kx + Gx_mat);
@@ -350,7 +945,6 @@ double RCWA::poyntingFlux(
   =======================================================*/
   RCWAcMatrices TMatrices(numOfLayer), MMatrices(numOfLayer);
   RCWAcMatrices EigenValMatrices(numOfLayer), EigenVecMatrices(numOfLayer), FMatrices(numOfLayer);
-  RCWAcMatrix CoeffOfA = onePadding2N, CoeffOfB = onePadding2N;
 
   // initialize K matrix
   RCWArMatrix KMatrix = join_vert(
@@ -361,7 +955,28 @@ double RCWA::poyntingFlux(
   This part solves RCWA
   e.g initialize M and F matrices, and compute the Eigen value problem
   =======================================================*/
+  // continue from the previous k point only if all the layers are cached
+  bool useCache = eigenCache != nullptr && (int)eigenCache->eigVecs.size() == numOfLayer;
+  // the layers after the first period of a repeat group share its eigen system
+  std::vector<int> layerMap;
+  getLayerMap(repeatList == nullptr ? RepeatList() : *repeatList, numOfLayer, layerMap);
+  if(eigenCache != nullptr){
+    eigenCache->eigVecs.resize(numOfLayer);
+  }
+  // the threads of the loops record into the profiler of the caller
+  PROFILE::Profiler* profiler = PROFILE::current();
+  #if defined(_OPENMP)
+    #pragma omp parallel for schedule(dynamic) num_threads(numOfThread) if(numOfThread > 1)
+  #endif
   for(int i = 0; i < numOfLayer; i++){
+    if(layerMap[i] != i) continue;
+    PROFILE::Scope profileScope(profiler);
+    // the eigen matrix of a uniform isotropic layer is diagonal, and its
+    // eigenvectors are the plane waves
+    bool uniform = isUniformIsotropic(EMatrices[i], eps_zz_inv[i], N);
+    // the estimate assumes a full eigen decomposition
+    PROFILE::Timer timer(PROFILE::EIGEN_, uniform ? 2 * PROFILE::gemmFlops(2*N, N, 2*N) :
+      PROFILE::eigFlops(2*N) + PROFILE::solveFlops(2*N, 2*N) + 3 * PROFILE::gemmFlops(2*N, 2*N, 2*N), 2*N);
 
     RCWArMatrix verticalAlign = join_vert(kyMat, -kxMat);
     RCWArMatrix horizontalAlign = join_horiz(kyMat, -kxMat);
@@ -372,14 +987,46 @@ double RCWA::poyntingFlux(
       join_horiz(-kxMat * eps_zz_inv[i] * kyMat, kxMat * eps_zz_inv[i] * kxMat)
     );
     */
-    RCWAcMatrix eigMatrix = EMatrices[i] * (POW2(omega) * onePadding2N - TMatrices[i]) - KMatrix;
+    RCWAcMatrix eigMatrix;
     cx_vec eigVal;
-    // here is the problem
-    eig_gen(eigVal, EigenVecMatrices[i], eigMatrix);
+    if(uniform){
+      // eps * (omega^2 - T) - K, whose off-diagonal blocks cancel up to rounding
+      cx_vec T_diag = TMatrices[i].diag();
+      eigVal = EMatrices[i](0, 0) * (POW2(omega) - T_diag) - KMatrix.diag();
+      EigenVecMatrices[i] = onePadding2N;
+    }
+    else if(isBlockDiagonal(EMatrices[i], N)){
+      // only the diagonal blocks of E are nonzero
+      RCWAcMatrix rhs = POW2(omega) * onePadding2N - TMatrices[i];
+      eigMatrix.set_size(2*N, 2*N);
+      eigMatrix.rows(0, N-1) = EMatrices[i].rows(0, N-1) * rhs.rows(0, N-1);
+      eigMatrix.rows(N, 2*N-1) = EMatrices[i].rows(N, 2*N-1) * rhs.rows(N, 2*N-1);
+      eigMatrix = eigMatrix - KMatrix;
+    }
+    else{
+      eigMatrix = EMatrices[i] * (POW2(omega) * onePadding2N - TMatrices[i]) - KMatrix;
+    }
+    // continue from the previous k point if possible, otherwise solve from scratch
+    bool refined = uniform;
+    if(useCache && !uniform){
+      EigenVecMatrices[i] = eigenCache->eigVecs[i];
+      refined = refineEigenSystem(eigMatrix, eigVal, EigenVecMatrices[i]);
+    }
+    if(!refined){
+      // here is the problem
+      eig_gen(eigVal, EigenVecMatrices[i], eigMatrix);
+    }
+    if(eigenCache != nullptr){
+      eigenCache->eigVecs[i] = EigenVecMatrices[i];
+    }
 
     eigVal = sqrt(eigVal);
 
-    eigVal = -eigVal % sign(imag(eigVal));
+    // the decaying branch, a real root of a lossless layer is taken as
+    // the limit of a vanishing loss
+    for(uword j = 0; j < eigVal.n_elem; j++){
+      if(!(eigVal(j).imag() < 0)) eigVal(j) = -eigVal(j);
+    }
     EigenValMatrices[i] = diagmat(eigVal);
     if(i == 0 || i == numOfLayer - 1){
       FMatrices[i] = onePadding2N;
@@ -388,21 +1035,17 @@ double RCWA::poyntingFlux(
       FMatrices[i] = diagmat(exp(-IMAG_I * dcomplex(thicknessList(i),0) * eigVal));
     }
 
-    if(i == targetLayer){
-      if(target_z < 0) {
-        CoeffOfA = FMatrices[i];
-      }
-      else{
-        CoeffOfA = diagmat(exp(-IMAG_I * dcomplex(target_z,0) * eigVal));
-        if(i != 0 && i != numOfLayer - 1){
-          CoeffOfB = diagmat(exp(-IMAG_I * dcomplex(thicknessList(i)-target_z,0) * eigVal));
-        }
-      }
-    }
-
     MMatrices[i] = zeroPadding4N;
-    MMatrices[i](span(r1, r2), span(r1, r2)) = (omega * onePadding2N - TMatrices[i] / omega) *
-      EigenVecMatrices[i] * (EigenValMatrices[i]).i();
+    if(uniform){
+      // the eigenvectors are the identity, so only the columns are scaled
+      RCWAcMatrix A = omega * onePadding2N - TMatrices[i] / omega;
+      A.each_row() /= eigVal.st();
+      MMatrices[i](span(r1, r2), span(r1, r2)) = A;
+    }
+    else{
+      MMatrices[i](span(r1, r2), span(r1, r2)) = (omega * onePadding2N - TMatrices[i] / omega) *
+        EigenVecMatrices[i] * (EigenValMatrices[i]).i();
+    }
 
     MMatrices[i](span(r1, r2), span(r3, r4)) = -MMatrices[i](span(r1, r2), span(r1, r2));
     MMatrices[i](span(r3, r4), span(r1, r2)) = EigenVecMatrices[i];
@@ -416,29 +1059,87 @@ double RCWA::poyntingFlux(
   This part initialize matrix for flux computation
   =======================================================*/
 
-  double flux = 0;
-  RCWAcMatrices S_matrices_target;
+  RCWAcMatrices CoeffOfA(numOfProbe, onePadding2N), CoeffOfB(numOfProbe, onePadding2N);
+  RCWAcMatrices S_target(numOfProbe);
+  // only the S matrices at the ends and at the probes are needed
+  std::vector<char> noLayers(numOfLayer, 0), probeLayers(numOfLayer, 0);
+  for(int p = 0; p < numOfProbe; p++) probeLayers[probeList[p].first] = 1;
+  int maxTargetLayer = 0, minTargetLayer = numOfLayer - 1;
+  for(int p = 0; p < numOfProbe; p++){
+    maxTargetLayer = std::max(maxTargetLayer, probeList[p].first);
+    minTargetLayer = std::min(minTargetLayer, probeList[p].first);
+  }
+  std::vector<int> sourceLayers;
+  for(int layerIdx = 0; layerIdx < maxTargetLayer; layerIdx++){
+    if(sourceList[layerIdx]) sourceLayers.push_back(layerIdx);
+  }
+  int numOfSource = sourceLayers.size();
 
+  // every sweep crosses the same interfaces, so they are solved once for all of them,
+  // and the factorizations of the M matrices are kept for the source solves
+  int firstUp = numOfSource > 0 ? std::min(sourceLayers[0], minTargetLayer) : minTargetLayer;
+  int lastDown = numOfSource > 0 ? sourceLayers[numOfSource - 1] : 0;
+  LUFactors MFactors;
+  Interfaces interfaces;
+  getInterfaceMatrices(MMatrices, FMatrices, numOfLayer, firstUp, lastDown, repeatList,
+    MFactors, interfaces, numOfThread);
 
-  for(int i = 0; i < numOfLayer; i++){
-    S_matrices_target.push_back(onePadding4N);
+  for(int p = 0; p < numOfProbe; p++){
+    int targetLayer = probeList[p].first;
+    double target_z = probeList[p].second;
+    flux[p] = 0;
+    if(fluxBySource != nullptr){
+      for(int i = 0; i < 3 * numOfLayer; i++) fluxBySource[p * 3 * numOfLayer + i] = 0;
+    }
+
+    cx_vec eigVal = diagvec(EigenValMatrices[targetLayer]);
+    if(target_z < 0) {
+      CoeffOfA[p] = FMatrices[targetLayer];
+    }
+    else{
+      CoeffOfA[p] = diagmat(exp(-IMAG_I * dcomplex(target_z,0) * eigVal));
+      if(targetLayer != 0 && targetLayer != numOfLayer - 1){
+        CoeffOfB[p] = diagmat(exp(-IMAG_I * dcomplex(thicknessList(targetLayer)-target_z,0) * eigVal));
+      }
+    }
+
+    // the S matrix from the probe to the top, shared by probes in the same layer
+    bool found = false;
+    for(int q = 0; q < p; q++){
+      if(probeList[q].first == targetLayer){
+        S_target[p] = S_target[q];
+        found = true;
+        break;
+      }
+    }
+    if(found) continue;
+    SMatrixList S_matrices_target;
+    getSMatrices(targetLayer, N, numOfLayer,
+        MMatrices, FMatrices, S_matrices_target, UP_, &interfaces, &noLayers);
+    S_target[p] = S_matrices_target[numOfLayer-1].S21;
   }
 
-  getSMatrices(targetLayer, N, numOfLayer,
-      MMatrices, FMatrices, S_matrices_target, UP_);
-  RCWAcMatrix q_R, q_L, targetFields, P1, P2, Q1, Q2, R;
-  RCWAcMatrix integralSelf, integralMutual, integral, poyntingMat;
-  RCWAcMatrices S_matrices(numOfLayer), NewFMatrices(numOfLayer);
+  // columns of the source driving the TE and TM part
+  uvec colTE = regspace<uvec>(N, 2*N-1);
+  uvec colTM = join_vert(regspace<uvec>(0, N-1), regspace<uvec>(2*N, 3*N-1));
 
-  RCWAcMatrix source = zeros<RCWAcMatrix>(4*N, 3*N);
   /*======================================================
   This part compute flux by collecting emission from source layers
   =======================================================*/
+  // the flux of every (source, probe) pair, summed up in order afterwards
+  std::vector<double> fluxOfLayer(numOfSource * numOfProbe, 0);
 
-  for(int layerIdx = 0; layerIdx < targetLayer; layerIdx++){
-
-    // if is not source layer, then continue
-    if(sourceList[layerIdx] == false) continue;
+  #if defined(_OPENMP)
+    #pragma omp parallel for schedule(dynamic) num_threads(numOfThread) if(numOfThread > 1)
+  #endif
+  for(int sourceIdx = 0; sourceIdx < numOfSource; sourceIdx++){
+    PROFILE::Scope profileScope(profiler);
+    int layerIdx = sourceLayers[sourceIdx];
+    RCWAcMatrix q_R, q_L, targetFields, P1, P2, Q1, Q2, W, R;
+    RCWAcMatrix integralSelf, integralMutual, integral, poyntingMat, poyntingMatTE, poyntingMatTM;
+    SMatrixList S_matrices;
+    RCWAcMatrices NewFMatrices(numOfLayer);
+    RCWAcMatrix source = zeros<RCWAcMatrix>(4*N, 3*N);
 
     // initial steps, propogate S matrix
     RCWAcMatrix q(diagvec(EigenValMatrices[layerIdx]));
@@ -458,35 +1159,28 @@ double RCWA::poyntingFlux(
     NewFMatrices = FMatrices;
     NewFMatrices[layerIdx] = onePadding2N;
 
-    for(int i = 0; i < numOfLayer; i++){
-      S_matrices[i] = onePadding4N;
-    }
-
     getSMatrices(layerIdx, N, numOfLayer,
-        MMatrices, NewFMatrices, S_matrices, ALL_);
+        MMatrices, NewFMatrices, S_matrices, ALL_, &interfaces, &probeLayers);
 
 
     // solve the source
-    targetFields = solve(MMatrices[layerIdx], source, solve_opts::fast);
-
-    // calculating the P1 and P2
-    P1 = solve(
-      onePadding2N - S_matrices[targetLayer](span(r1, r2), span(r3, r4)) * S_matrices_target[numOfLayer-1](span(r3, r4), span(r1, r2)),
-      S_matrices[targetLayer](span(r1, r2), span(r1, r2)),
-      solve_opts::fast
-    );
-
-    P2 = S_matrices_target[numOfLayer-1](span(r3, r4), span(r1, r2)) * P1;
+    bool blockDiagonal = isBlockDiagonal(grandImaginaryMatrices[layerIdx], N);
+    // M is already factorized, so the source only takes the triangular solves
+    PROFILE::Timer sourceTimer(PROFILE::SOURCE_, PROFILE::gemmFlops(4*N, 4*N, 3*N) + PROFILE::solveFlops(2*N, 4*N) +
+      (blockDiagonal ? 3 * PROFILE::gemmFlops(4*N, N, N) : PROFILE::gemmFlops(4*N, 3*N, 3*N)) +
+      PROFILE::gemmFlops(4*N, 3*N, 4*N), 4*N);
+    targetFields = luSolve(MFactors[layerIdx], source);
 
     // calculating the Q1 and Q2
-    Q1 = onePadding2N - FMatrices[layerIdx] * S_matrices[0](span(r3, r4), span(r1, r2)) *
-      FMatrices[layerIdx] * S_matrices[numOfLayer-1](span(r3, r4), span(r1, r2));
-
-    Q2 = -FMatrices[layerIdx] * S_matrices[0](span(r3, r4), span(r1, r2));
+    // F is diagonal, so F * S is a row scaling of S
+    cx_vec f = FMatrices[layerIdx].diag();
+    Q2 = -S_matrices[0].S21;
+    Q2.each_col() %= f;
+    RCWAcMatrix FS21 = S_matrices[numOfLayer-1].S21;
+    FS21.each_col() %= f;
+    Q1 = onePadding2N + Q2 * FS21;
 
-    // calculating R
-    R = MMatrices[targetLayer] * join_vert(CoeffOfA * P1, CoeffOfB * P2) *
-      Q1.i() * join_horiz(onePadding2N, Q2);
+    W = solve(Q1, join_horiz(onePadding2N, Q2), solve_opts::fast);
 
     // calculating integrands
     if(layerIdx == 0 || layerIdx == numOfLayer - 1){
@@ -506,11 +1200,63 @@ double RCWA::poyntingFlux(
     );
 
     // calculating kernel
-    poyntingMat = (targetFields * grandImaginaryMatrices[layerIdx] * targetFields.t()) % integral;
+    if(blockDiagonal){
+      // multiply the columns of each block by its own diagonal block, skipping the zero blocks
+      RCWAcMatrix weightedFields(4*N, 3*N);
+      for(int b = 0; b < 3; b++){
+        weightedFields.cols(b*N, (b+1)*N-1) = targetFields.cols(b*N, (b+1)*N-1) *
+          grandImaginaryMatrices[layerIdx].rows(b*N, (b+1)*N-1);
+      }
+      poyntingMat = (weightedFields * targetFields.t()) % integral;
+      if(fluxBySource != nullptr){
+        poyntingMatTE = (weightedFields.cols(colTE) * targetFields.cols(colTE).t()) % integral;
+        poyntingMatTM = (weightedFields.cols(colTM) * targetFields.cols(colTM).t()) % integral;
+      }
+    }
+    else{
+      poyntingMat = (targetFields * grandImaginaryMatrices[layerIdx] * targetFields.t()) % integral;
+      if(fluxBySource != nullptr){
+        // the rest of poyntingMat is the TE-TM cross term of in-plane anisotropic sources
+        poyntingMatTE = (targetFields.cols(colTE) * grandImaginaryMatrices[layerIdx](colTE, colTE) *
+          targetFields.cols(colTE).t()) % integral;
+        poyntingMatTM = (targetFields.cols(colTM) * grandImaginaryMatrices[layerIdx](colTM, colTM) *
+          targetFields.cols(colTM).t()) % integral;
+      }
+    }
+    sourceTimer.stop();
 
-    poyntingMat = -R * poyntingMat * R.t();
-    flux += real(trace(poyntingMat(span(r1, r2), span(r3, r4)))) / MICRON;
-  }
-  return flux;
+    for(int p = 0; p < numOfProbe; p++){
+      int targetLayer = probeList[p].first;
+      if(layerIdx >= targetLayer) continue;
+      PROFILE::Timer probeTimer(PROFILE::PROBE_, PROFILE::solveFlops(2*N, 2*N) + PROFILE::gemmFlops(4*N, 2*N, 4*N) +
+        PROFILE::gemmFlops(2*N, 4*N, 4*N), 4*N);
+
+      // calculating the P1 and P2
+      P1 = solve(
+        onePadding2N - S_matrices[targetLayer].S12 * S_target[p],
+        S_matrices[targetLayer].S11,
+        solve_opts::fast
+      );
 
+      P2 = S_target[p] * P1;
+
+      // calculating R
+      R = MMatrices[targetLayer] * join_vert(CoeffOfA[p] * P1, CoeffOfB[p] * P2) * W;
+
+      // only the trace of the upper right block of -R * poyntingMat * R^H is needed
+      double fluxOfSource = -real(accu((R.rows(r1, r2) * poyntingMat) % conj(R.rows(r3, r4)))) / MICRON;
+      fluxOfLayer[sourceIdx * numOfProbe + p] = fluxOfSource;
+      if(fluxBySource != nullptr){
+        double* entry = &fluxBySource[(p * numOfLayer + layerIdx) * 3];
+        entry[0] = fluxOfSource;
+        entry[1] = -real(accu((R.rows(r1, r2) * poyntingMatTE) % conj(R.rows(r3, r4)))) / MICRON;
+        entry[2] = -real(accu((R.rows(r1, r2) * poyntingMatTM) % conj(R.rows(r3, r4)))) / MICRON;
+      }
+    }
+  }
+  for(int p = 0; p < numOfProbe; p++){
+    for(int sourceIdx = 0; sourceIdx < numOfSource; sourceIdx++){
+      flux[p] += fluxOfLayer[sourceIdx * numOfProbe + p];
+    }
+  }
 }
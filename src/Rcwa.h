@@ -24,6 +24,9 @@
 #include <vector>
 #include <cmath>
 #include "Common.h"
+#if defined(_OPENMP)
+  #include <omp.h>
+#endif
 
 namespace RCWA{
   enum DIRECTION {UP_, DOWN_, ALL_};
@@ -34,6 +37,69 @@ namespace RCWA{
   typedef std::vector< RCWAcMatrices > RCWAcMatricesVec;
   typedef vec RCWArVector;
 
+  /*============================================================
+  * Structure holding the eigenvectors of every layer at the previous
+  * k point, used to continue the eigen solution along a k path
+  @note:
+    an empty eigVecs (or an empty entry) means no previous solution
+  ==============================================================*/
+  typedef struct EIGENCACHE{
+    RCWAcMatrices eigVecs;
+  } EigenCache;
+
+  /*============================================================
+  * Structure holding the LU factorization of a square matrix, so that
+  * several right hand sides can be solved without factorizing it again
+  @note:
+    an empty LU means the matrix is not factorized yet
+  ==============================================================*/
+  typedef struct LUFACTOR{
+    RCWAcMatrix LU;
+    std::vector<blas_int> pivot;
+  } LUFactor;
+  typedef std::vector< LUFactor > LUFactors;
+
+  /*============================================================
+  * Structure holding the S matrix of a layer by its four 2N blocks
+  @note:
+    the full matrix is [S11, S12; S21, S22], an empty S11 means the S
+    matrix of the layer is not kept
+  ==============================================================*/
+  typedef struct SMATRIX{
+    RCWAcMatrix S11, S12, S21, S22;
+  } SMatrix;
+  typedef std::vector< SMatrix > SMatrixList;
+
+  /*============================================================
+  * Structure describing layers repeated periodically in the stack: layers
+  * first to first + period - 1 appear count times in a row
+  @note:
+    the layers of the later periods use the matrices of the first period
+  ==============================================================*/
+  typedef struct REPEATGROUP{
+    int first;
+    int period;
+    int count;
+  } RepeatGroup;
+  typedef std::vector< RepeatGroup > RepeatList;
+
+  /*============================================================
+  * Structure holding the interface matrices of a stack at one k point,
+  * with the S matrices of the repeated periods
+  @note:
+    up[upIdx[i]] is M_i^-1 * M_{i+1} and down[downIdx[i]] is M_i^-1 * M_{i-1},
+    the interfaces of repeated layers are stored once. repeatUp[g] and
+    repeatDown[g] are the S matrices of count - 1 periods of the g-th
+    repeat group, empty if no sweep crosses the group in that direction
+  ==============================================================*/
+  typedef struct INTERFACES{
+    std::vector<int> layerMap;
+    std::vector<int> upIdx, downIdx;
+    RCWAcMatrices up, down;
+    RepeatList repeatList;
+    SMatrixList repeatUp, repeatDown;
+  } Interfaces;
+
   /*============================================================
   * Function similar to meshgrid in matlab for real numbers
   @arg:
@@ -72,7 +138,16 @@ namespace RCWA{
    numOfLayer: the number of layers
    MMatrices: matrix corresponding to the propogation in each layer
    FMatrices: matrix corresponding to the phase in each layer
-   SMatrices: the S matrix for each layer
+   SMatrices: the S matrix for each layer (output)
+   DIRECTION: the direction of propogation
+   interfaces: the interface matrices from getInterfaceMatrices, nullptr to
+     solve them here
+   keepLayers: the layers whose S matrices are kept, nullptr for all
+  @note:
+    FMatrices should be diagonal. The S matrix of startLayer and those at
+    the ends of the propogation are always kept. With interfaces, the
+    repeated periods crossed by the propogation are skipped by their
+    S matrices, and the S matrices of the skipped layers are not computed
   ==============================================================*/
   void getSMatrices(
     const int startLayer,
@@ -80,8 +155,75 @@ namespace RCWA{
     const int numOfLayer,
     const RCWAcMatrices& MMatrices,
     const RCWAcMatrices& FMatrices,
-    RCWAcMatrices& SMatrices,
-    const DIRECTION direction
+    SMatrixList& SMatrices,
+    const DIRECTION direction,
+    const Interfaces* interfaces = nullptr,
+    const std::vector<char>* keepLayers = nullptr
+  );
+
+  /*============================================================
+  * Function computing the Redheffer star product of two S matrices,
+  * the S matrix of A followed by B
+  @arg:
+   A, B: the S matrices
+   C: A * B (output), should not be A or B
+  ==============================================================*/
+  void starProduct(const SMatrix& A, const SMatrix& B, SMatrix& C);
+
+  /*============================================================
+  * Function mapping every layer to the layer whose matrices it uses
+  @arg:
+   repeatList: the repeated layers of the stack
+   numOfLayer: the number of layers
+   layerMap: the layer of the first period for repeated layers,
+     the layer itself otherwise (output)
+  ==============================================================*/
+  void getLayerMap(const RepeatList& repeatList, const int numOfLayer, std::vector<int>& layerMap);
+
+  /*============================================================
+  * Function computing the LU factorization of a square matrix
+  @arg:
+   A: the matrix
+   factor: the factorization (output)
+  @note:
+    throws std::runtime_error if A is singular, the same as solve
+  ==============================================================*/
+  void luFactorize(const RCWAcMatrix& A, LUFactor& factor);
+
+  /*============================================================
+  * Function solving A * X = B from the LU factorization of A
+  @arg:
+   factor: the factorization of A from luFactorize
+   B: the right hand side
+  ==============================================================*/
+  RCWAcMatrix luSolve(const LUFactor& factor, const RCWAcMatrix& B);
+
+  /*============================================================
+  * Function computing the interface matrices between neighboring layers
+  @arg:
+   MMatrices: matrix corresponding to the propogation in each layer
+   FMatrices: matrix corresponding to the phase in each layer
+   numOfLayer: the number of layers
+   firstUp: the up interfaces are computed for layers firstUp to numOfLayer - 2
+   lastDown: the down interfaces are computed for layers 1 to lastDown
+   repeatList: the repeated layers, nullptr if none
+   factors: the LU factorization of each M matrix, factorized when
+     needed and kept for other solves with the same M matrix
+   interfaces: the interface matrices (output)
+   numOfThread: the number of threads over the layers
+  @note:
+    MMatrices and FMatrices are only read at the layers of layerMap
+  ==============================================================*/
+  void getInterfaceMatrices(
+    const RCWAcMatrices& MMatrices,
+    const RCWAcMatrices& FMatrices,
+    const int numOfLayer,
+    const int firstUp,
+    const int lastDown,
+    const RepeatList* repeatList,
+    LUFactors& factors,
+    Interfaces& interfaces,
+    const int numOfThread = 1
   );
 
 
@@ -103,6 +245,29 @@ namespace RCWA{
   x: the input argument
  ==============================================================*/
  double jinc(const double x);
+ /*============================================================
+ * Function computing the jinc function (J1(x) / x) for an array of x >= 0,
+ * the loops have no branches below x = 5 so that they vectorize
+ @arg:
+  x: the input arguments
+  result: the values (output)
+  n: the number of arguments
+ ==============================================================*/
+ void jinc(const double* x, double* result, const int n);
+
+  /*============================================================
+  * Function checking whether a E matrix or an imaginary dielectric matrix
+  * is stored by its diagonal blocks only
+  @arg:
+  M: the E matrix or the imaginary dielectric matrix of a layer
+  N: the number of G
+  @note:
+    the diagonal blocks are stacked vertically, i.e. M is 2N x N (E matrix)
+    or 3N x N (imaginary dielectric matrix) instead of 2N x 2N or 3N x 3N
+  ==============================================================*/
+  inline bool isBlockDiagonal(const RCWAcMatrix& M, const int N){
+    return (int)M.n_cols == N && (int)M.n_rows > N;
+  }
 
   /*============================================================
   * Function computing imaginary dielectric matrix for the system
@@ -115,6 +280,9 @@ namespace RCWA{
   im_eps_zz: the imaginary part of eps_zz
   numOfLayer: the number of layer in the system
   N: the number of G
+  @note:
+    an empty im_eps_xy (and im_eps_yx) means the off-diagonal blocks are zero,
+    and only the xx, yy and zz blocks are stored (see isBlockDiagonal)
   ==============================================================*/
   void getGrandImaginaryMatrices(
     RCWAcMatrices& grandImaginaryMatrices,
@@ -137,6 +305,9 @@ namespace RCWA{
   eps_yy: the epsilon in yy direction
   numOfLayer: the number of layer in the system
   N: the number of G
+  @note:
+    an empty eps_xy (and eps_yx) means the off-diagonal blocks are zero,
+    and only the yy and xx blocks are stored (see isBlockDiagonal)
   ==============================================================*/
   void getEMatrices(
     RCWAcMatrices& EMatrices,
@@ -148,6 +319,26 @@ namespace RCWA{
     const int N
   );
 
+  /*============================================================
+  * Function refining the eigen system of A from eigenvectors of a nearby matrix
+  @arg:
+   A: the matrix to be diagonalized
+   eigVal: the eigenvalues of A (output)
+   eigVec: on input the eigenvectors of the nearby matrix, on output those of A
+   maxIter: maximum number of perturbation sweeps
+   tol: relative tolerance of the off-diagonal coupling
+  @note:
+    returns false if the update does not converge, in which case the caller
+    should fall back to eig_gen
+  ==============================================================*/
+  bool refineEigenSystem(
+    const RCWAcMatrix& A,
+    cx_vec& eigVal,
+    RCWAcMatrix& eigVec,
+    const int maxIter = 4,
+    const double tol = 1e-11
+  );
+
   /*============================================================
   * Function computing the poynting vector at given (kx, ky)
   @arg:
@@ -163,6 +354,10 @@ namespace RCWA{
    sourceList: list of 0 or 1 with the same size of thicknessList
    targetLayer: the targetLayer for the flux measurement
    N: total number of G
+   polar: the polarization of the light
+   z: the relative z coordinate in the target layer, in micron
+   eigenCache: eigenvectors from the previous k point, nullptr to disable
+   repeatList: the repeated layers, nullptr if none
   ==============================================================*/
   double poyntingFlux(
     const double omega,
@@ -178,7 +373,56 @@ namespace RCWA{
     const int targetLayer,
     const int N,
     const POLARIZATION polar,
-    const double z
+    const double z,
+    EigenCache* eigenCache = nullptr,
+    const RepeatList* repeatList = nullptr
+  );
+
+  /*============================================================
+  * Function computing the poynting vector at given (kx, ky) for several probes
+  @arg:
+   omega: the angular frequency (normalized to c)
+   thicknessList: the thickness for each layer
+   kx: the k vector at x direction (normalized value)
+   ky: the y vector at x direction (normalized value)
+   EMatrices:  the E matrices for all layers
+   grandImaginaryMatrices: collection of all imaginary matrices in all layers
+   eps_zz_inv: the inverse of eps_zz
+   Gx_mat: the Gx matrix
+   Gy_mat: the Gy matrix
+   sourceList: list of 0 or 1 with the same size of thicknessList
+   probeList: list of (target layer, relative z coordinate in micron)
+   N: total number of G
+   polar: the polarization of the light
+   flux: the flux at each probe (output), should have the size of probeList
+   fluxBySource: the flux at each probe from each layer (output), nullptr to disable.
+     For probe p and layer i, entries (p * numOfLayer + i) * 3 + {0, 1, 2} are the
+     total, the TE and the TM part. Non-source layers are left as zero
+   eigenCache: eigenvectors from the previous k point, nullptr to disable
+   numOfThread: the number of threads over the layers and the sources
+   repeatList: the repeated layers, nullptr if none. The matrices of the
+     layers after the first period are not used, and may be empty. The
+     repeated layers should not be sources or probes
+  ==============================================================*/
+  void poyntingFlux(
+    const double omega,
+    const RCWArVector& thicknessList,
+    double kx,
+    double ky,
+    const RCWAcMatrices& EMatrices,
+    const RCWAcMatrices& grandImaginaryMatrices,
+    const RCWAcMatrices& eps_zz_inv,
+    const RCWArMatrix& Gx_mat,
+    const RCWArMatrix& Gy_mat,
+    const SourceList& sourceList,
+    const ProbeList& probeList,
+    const int N,
+    const POLARIZATION polar,
+    double* flux,
+    double* fluxBySource = nullptr,
+    EigenCache* eigenCache = nullptr,
+    const int numOfThread = 1,
+    const RepeatList* repeatList = nullptr
   );
 
 }
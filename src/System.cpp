@@ -18,6 +18,9 @@
  */
 #include "System.h"
 #include <iostream>
+#include <limits>
+#include <array>
+#include <cmath>
 namespace SYSTEM{
   /*==============================================*/
   // Implementaion of the Material class
@@ -67,6 +70,63 @@ namespace SYSTEM{
     return new Material(name, omegaList, epsilonList, numOfOmega);
   }
 
+  /*==============================================*/
+  // Constructor of an analytic (Drude, Lorentz or Drude-Lorentz) material
+  // @args:
+  // name: the name of the material
+  // model: the parameters of the dispersion model
+  /*==============================================*/
+  Material::Material(
+    const std::string name,
+    const DispersionModel& model): NamedInterface(name)
+    , omegaList_(nullptr), numOfOmega_(0), dispersion_(ANALYTIC_), model_(model){
+    epsilonList_.epsilonVals = nullptr;
+    epsilonList_.type_ = SCALAR_;
+  }
+
+  /*==============================================*/
+  // Constructor of a uniaxial material, with epsilon_xx = epsilon_yy
+  // given by ordinary and epsilon_zz given by extraordinary
+  // @args:
+  // name: the name of the material
+  // ordinary: the material for the ordinary axes, should be scalar
+  // extraordinary: the material for the extraordinary axis, should be scalar
+  /*==============================================*/
+  Material::Material(
+    const std::string name,
+    const Ptr<Material>& ordinary,
+    const Ptr<Material>& extraordinary): NamedInterface(name)
+    , omegaList_(nullptr), numOfOmega_(0), dispersion_(UNIAXIAL_)
+    , ordinary_(ordinary), extraordinary_(extraordinary){
+    if(ordinary->getType() != SCALAR_ || extraordinary->getType() != SCALAR_){
+      std::cerr << name + ": components of a uniaxial material should be scalar!" << std::endl;
+      throw UTILITY::UnknownTypeException(name + ": components of a uniaxial material should be scalar!");
+    }
+    epsilonList_.epsilonVals = nullptr;
+    epsilonList_.type_ = DIAGONAL_;
+  }
+
+  /*==============================================*/
+  // This is a thin wrapper for the usage of smart pointer
+  /*==============================================*/
+  Ptr<Material> Material::instanceNew(
+    const std::string name,
+    const DispersionModel& model
+  ){
+    return new Material(name, model);
+  }
+
+  /*==============================================*/
+  // This is a thin wrapper for the usage of smart pointer
+  /*==============================================*/
+  Ptr<Material> Material::instanceNew(
+    const std::string name,
+    const Ptr<Material>& ordinary,
+    const Ptr<Material>& extraordinary
+  ){
+    return new Material(name, ordinary, extraordinary);
+  }
+
   /*==============================================*/
   // destructor
   /*==============================================*/
@@ -100,6 +160,68 @@ namespace SYSTEM{
     return epsilonList_.epsilonVals[index];
   }
 
+  /*==============================================*/
+  // function return how the epsilon of the material is given
+  /*==============================================*/
+  DISPERSION Material::getDispersion(){
+    return dispersion_;
+  }
+
+  /*==============================================*/
+  // function return the epsilon at an arbitrary omega. Analytic materials
+  // are evaluated directly, tabulated ones are linearly interpolated
+  // @args:
+  // omega: the angular frequency
+  /*==============================================*/
+  EpsilonVal Material::getEpsilonAtOmega(const double omega){
+    EpsilonVal result;
+    if(dispersion_ == ANALYTIC_){
+      dcomplex epsilon = model_.epsInf;
+      if(model_.omegaP != 0){
+        epsilon -= POW2(model_.omegaP) / (omega * (omega + IMAG_I * model_.gammaP));
+      }
+      for(size_t i = 0; i < model_.oscillators.size(); i++){
+        const Oscillator& osc = model_.oscillators[i];
+        epsilon += osc.strength * POW2(osc.omega0) / (POW2(osc.omega0) - POW2(omega) - IMAG_I * osc.gamma * omega);
+      }
+      result.scalar[0] = epsilon.real();
+      result.scalar[1] = -epsilon.imag();
+      return result;
+    }
+    if(dispersion_ == UNIAXIAL_){
+      EpsilonVal o = ordinary_->getEpsilonAtOmega(omega);
+      EpsilonVal e = extraordinary_->getEpsilonAtOmega(omega);
+      result.diagonal[0] = o.scalar[0];
+      result.diagonal[1] = o.scalar[1];
+      result.diagonal[2] = o.scalar[0];
+      result.diagonal[3] = o.scalar[1];
+      result.diagonal[4] = e.scalar[0];
+      result.diagonal[5] = e.scalar[1];
+      return result;
+    }
+
+    const double* omegaList = omegaList_;
+    const EpsilonVal* epsilonList = epsilonList_.epsilonVals;
+    int numOfOmega = numOfOmega_;
+    if(!tableOmega_.empty()){
+      omegaList = tableOmega_.data();
+      epsilonList = tableEpsilon_.data();
+      numOfOmega = tableOmega_.size();
+    }
+    if(numOfOmega == 0 || omega < omegaList[0] || omega > omegaList[numOfOmega - 1]){
+      std::cerr << this->getName() + ": omega out of the tabulated range!" << std::endl;
+      throw UTILITY::RangeException(this->getName() + ": omega out of the tabulated range!");
+    }
+    int upper = std::lower_bound(omegaList, omegaList + numOfOmega, omega) - omegaList;
+    if(omegaList[upper] == omega) return epsilonList[upper];
+    double ratio = (omega - omegaList[upper - 1]) / (omegaList[upper] - omegaList[upper - 1]);
+    int width = epsilonList_.type_ == SCALAR_ ? 2 : (epsilonList_.type_ == DIAGONAL_ ? 6 : 10);
+    for(int j = 0; j < width; j++){
+      result.tensor[j] = ratio * epsilonList[upper].tensor[j] + (1 - ratio) * epsilonList[upper - 1].tensor[j];
+    }
+    return result;
+  }
+
   /*==============================================*/
   // function return the omega list
   /*==============================================*/
@@ -131,7 +253,12 @@ namespace SYSTEM{
   /*==============================================*/
   void Material::setEpsilon(const EPSILON& epsilonList, const int numOfOmega){
     numOfOmega_ = numOfOmega;
+    delete [] epsilonList_.epsilonVals;
     epsilonList_.epsilonVals = new EpsilonVal[numOfOmega_];
+    // the new values are a table on the current omega grid
+    dispersion_ = TABULATED_;
+    tableOmega_.clear();
+    tableEpsilon_.clear();
     if(epsilonList.type_ == SCALAR_){
       for(int i = 0; i < numOfOmega_; i++){
         epsilonList_.epsilonVals[i].scalar[0] = epsilonList.epsilonVals[i].scalar[0];
@@ -155,6 +282,35 @@ namespace SYSTEM{
     }
   }
 
+  /*==============================================*/
+  // function evaluating the material on a new omega grid. The values
+  // originally given for a tabulated material are kept, so resampling
+  // several times does not lose accuracy
+  // @args:
+  // omegaList: the new omega grid, in ascending order
+  // numOfOmega: the number of omega points
+  /*==============================================*/
+  void Material::resample(const double* omegaList, const int numOfOmega){
+    if(numOfOmega_ == numOfOmega && omegaList_ != nullptr
+      && std::equal(omegaList, omegaList + numOfOmega, omegaList_)){
+      return;
+    }
+    if(dispersion_ == TABULATED_ && tableOmega_.empty()){
+      tableOmega_.assign(omegaList_, omegaList_ + numOfOmega_);
+      tableEpsilon_.assign(epsilonList_.epsilonVals, epsilonList_.epsilonVals + numOfOmega_);
+    }
+    EpsilonVal* epsilonVals = new EpsilonVal[numOfOmega];
+    for(int i = 0; i < numOfOmega; i++){
+      epsilonVals[i] = this->getEpsilonAtOmega(omegaList[i]);
+    }
+    delete [] epsilonList_.epsilonVals;
+    epsilonList_.epsilonVals = epsilonVals;
+    delete [] omegaList_;
+    numOfOmega_ = numOfOmega;
+    omegaList_ = new double[numOfOmega_];
+    std::copy(omegaList, omegaList + numOfOmega_, omegaList_);
+  }
+
   /*==============================================*/
   // Implementaion of the Layer class
   /*==============================================*/
@@ -247,6 +403,15 @@ namespace SYSTEM{
           delete [] edgePoints;
           break;
         }
+        case RASTER_:{
+          newLayer->addRasterPattern(*(itMat + count), pattern.raster_, pattern.rasterSize_, pattern.rasterValue_);
+          break;
+        }
+        case CIRCLES_:
+        case RECTANGLES_:{
+          newLayer->addArrayPattern(*(itMat + count), pattern.type_, pattern.array_);
+          break;
+        }
         default: break;
       }
     }
@@ -490,40 +655,97 @@ namespace SYSTEM{
     patternVec_.push_back(pattern);
   }
   /*==============================================*/
-  // helper function checking whether pattern2 is contained in pattern1
+  // add the part of a raster pattern made of one material
   // @args:
-  // pattern1: the parent pattern to be checked
-  // pattern2: the child pattern to be checked
+  // material: the material used for this part of the pattern
+  // raster: the material indices of the pixels, shared by all the parts
+  // size: the number of pixels along the two lattice vectors
+  // value: the index in raster covered by this part
   /*==============================================*/
-  static bool isContainedInGeometry(const Pattern& pattern1, const Pattern& pattern2){
-    double center2[2] = {0, 0};
-    switch (pattern2.type_) {
+  void Layer::addRasterPattern(
+    const Ptr<Material>& material,
+    const std::shared_ptr< const std::vector<int> >& raster,
+    const int size[2],
+    const int value
+  ){
+    materialVec_.push_back(material);
+    if(material->getType() == TENSOR_) hasTensor_++;
+    Pattern pattern;
+    pattern.arg1_ = std::make_pair(0, 0);
+    pattern.arg2_ = std::make_pair(0, 0);
+    pattern.type_ = RASTER_;
+    pattern.raster_ = raster;
+    pattern.rasterSize_[0] = size[0];
+    pattern.rasterSize_[1] = size[1];
+    pattern.rasterValue_ = value;
+    // the raster covers the whole unit cell, so it never has a parent and
+    // is never the parent of another pattern
+    pattern.area = std::numeric_limits<double>::max();
+    patternVec_.push_back(pattern);
+  }
+  /*==============================================*/
+  // add an array of circles or rectangles made of one material
+  // @args:
+  // material: the material used for this part of the pattern
+  // type: CIRCLES_ or RECTANGLES_
+  // array: the shapes, shared by the copies of the pattern
+  /*==============================================*/
+  void Layer::addArrayPattern(
+    const Ptr<Material>& material,
+    const PATTERN type,
+    const std::shared_ptr< const PatternArray >& array
+  ){
+    materialVec_.push_back(material);
+    if(material->getType() == TENSOR_) hasTensor_++;
+    Pattern pattern;
+    pattern.arg1_ = std::make_pair(0, 0);
+    pattern.arg2_ = std::make_pair(0, 0);
+    pattern.type_ = type;
+    pattern.array_ = array;
+    // the shapes are embedded in the background, so like a raster the array
+    // stays out of the containment relation
+    pattern.area = std::numeric_limits<double>::max();
+    patternVec_.push_back(pattern);
+  }
+  /*==============================================*/
+  // helper function returning the center of a pattern, the point checked
+  // when the pattern is a child
+  // @args:
+  // pattern: the pattern
+  // center: the center (output)
+  /*==============================================*/
+  static void getPatternCenter(const Pattern& pattern, double center[2]){
+    center[0] = 0;
+    center[1] = 0;
+    switch (pattern.type_) {
       case GRATING_:{
-        center2[0] = pattern2.arg1_.first;
-        break;
-      }
-      case RECTANGLE_:{
-        center2[0] = pattern2.arg1_.first;
-        center2[1] = pattern2.arg1_.second;
+        center[0] = pattern.arg1_.first;
         break;
       }
       case CIRCLE_:{
-        center2[0] = pattern2.arg1_.first;
-        center2[1] = pattern2.arg2_.first;
-        break;
-      }
-      case ELLIPSE_:{
-        center2[0] = pattern2.arg1_.first;
-        center2[1] = pattern2.arg1_.second;
+        center[0] = pattern.arg1_.first;
+        center[1] = pattern.arg2_.first;
         break;
       }
+      case RECTANGLE_:
+      case ELLIPSE_:
       case POLYGON_:{
-        center2[0] = pattern2.arg1_.first;
-        center2[1] = pattern2.arg1_.second;
+        center[0] = pattern.arg1_.first;
+        center[1] = pattern.arg1_.second;
         break;
       }
       default: break;
     }
+  }
+  /*==============================================*/
+  // helper function checking whether pattern2 is contained in pattern1
+  // @args:
+  // pattern1: the parent pattern to be checked
+  // pattern2: the child pattern to be checked
+  /*==============================================*/
+  static bool isContainedInGeometry(const Pattern& pattern1, const Pattern& pattern2){
+    double center2[2];
+    getPatternCenter(pattern2, center2);
 
     switch (pattern1.type_) {
       case GRATING_:{
@@ -562,7 +784,70 @@ namespace SYSTEM{
   }
 
   /*==============================================*/
-  // function generating the containment relation between patterns
+  // helper function returning a bounding box of the region checked by
+  // isContainedInGeometry when the pattern is a parent, slightly padded so
+  // that it stays a superset under rounding
+  // @args:
+  // pattern: the pattern
+  // box: {xmin, xmax, ymin, ymax} (output)
+  // @return:
+  // false if the pattern can not be a parent
+  /*==============================================*/
+  static bool getContainmentBox(const Pattern& pattern, double box[4]){
+    double halfwidth[2] = {0, 0};
+    double center[2];
+    getPatternCenter(pattern, center);
+    switch (pattern.type_) {
+      case GRATING_:{
+        // a grating only checks x, its children are gratings at y = 0
+        halfwidth[0] = pattern.arg1_.second / 2;
+        break;
+      }
+      case RECTANGLE_:{
+        halfwidth[0] = pattern.arg2_.first / 2;
+        halfwidth[1] = pattern.arg2_.second / 2;
+        break;
+      }
+      case CIRCLE_:{
+        halfwidth[0] = pattern.arg1_.second;
+        halfwidth[1] = pattern.arg1_.second;
+        break;
+      }
+      case ELLIPSE_:{
+        halfwidth[0] = pattern.arg2_.first;
+        halfwidth[1] = pattern.arg2_.second;
+        break;
+      }
+      case POLYGON_:{
+        double range[4] = {0, 0, 0, 0};
+        for(size_t i = 0; i < pattern.edgeList_.size(); i++){
+          range[0] = std::min(range[0], pattern.edgeList_[i].first);
+          range[1] = std::max(range[1], pattern.edgeList_[i].first);
+          range[2] = std::min(range[2], pattern.edgeList_[i].second);
+          range[3] = std::max(range[3], pattern.edgeList_[i].second);
+        }
+        double pad = 1e-9 * std::max(range[1] - range[0], range[3] - range[2]);
+        box[0] = center[0] + range[0] - pad;
+        box[1] = center[0] + range[1] + pad;
+        box[2] = center[1] + range[2] - pad;
+        box[3] = center[1] + range[3] + pad;
+        return true;
+      }
+      default: return false;
+    }
+    halfwidth[0] = std::abs(halfwidth[0]) * (1 + 1e-9);
+    halfwidth[1] = std::abs(halfwidth[1]) * (1 + 1e-9);
+    box[0] = center[0] - halfwidth[0];
+    box[1] = center[0] + halfwidth[0];
+    box[2] = center[1] - halfwidth[1];
+    box[3] = center[1] + halfwidth[1];
+    return true;
+  }
+  /*==============================================*/
+  // function generating the containment relation between patterns. The
+  // parent of a pattern is the smallest larger pattern containing its
+  // center. The candidates are looked up from a uniform grid of the
+  // bounding boxes, so the cost is close to linear in the number of patterns
   /*==============================================*/
   void Layer::getGeometryContainmentRelation(){
     std::vector< std::pair<int, double> > areaVec;
@@ -578,22 +863,162 @@ namespace SYSTEM{
       [](const std::pair<int, double>& lhs, const std::pair<int, double>& rhs) {
              return lhs.second < rhs.second; }
     );
-    // for(size_t i = 0; i < areaVec.size(); i++){
-    //   std::cout << areaVec[i].first << "\t" << areaVec[i].second << std::endl;
-    // }
-    for(size_t i = 0; i < areaVec.size(); i++){
-      patternVec_[areaVec[i].first].parent = -1;
-      for(size_t j = i + 1; j < areaVec.size(); j++){
-        Pattern pattern2 = patternVec_[areaVec[i].first]; // pattern with smaller area
-        Pattern pattern1 = patternVec_[areaVec[j].first]; // pattern with larger area
-        if(isContainedInGeometry(pattern1, pattern2)){
-          patternVec_[areaVec[i].first].parent = areaVec[j].first;
+    int numOfPattern = areaVec.size();
+    // the bounding boxes of the patterns, in the sorted order
+    std::vector< std::array<double, 4> > boxes(numOfPattern);
+    std::vector<bool> isParent(numOfPattern);
+    double extent[4] = {INF, -INF, INF, -INF};
+    for(int i = 0; i < numOfPattern; i++){
+      isParent[i] = getContainmentBox(patternVec_[areaVec[i].first], boxes[i].data());
+      if(!isParent[i]) continue;
+      extent[0] = std::min(extent[0], boxes[i][0]);
+      extent[1] = std::max(extent[1], boxes[i][1]);
+      extent[2] = std::min(extent[2], boxes[i][2]);
+      extent[3] = std::max(extent[3], boxes[i][3]);
+    }
+    // bin the boxes on a grid with about one cell per pattern, boxes
+    // spanning too many cells are always checked instead
+    int numOfCell = std::max(1, static_cast<int>(std::sqrt(numOfPattern)));
+    double cellSize[2];
+    for(int k = 0; k < 2; k++){
+      cellSize[k] = (extent[2*k+1] - extent[2*k]) / numOfCell;
+      if(!(cellSize[k] > 0)) cellSize[k] = 1;
+    }
+    auto getCell = [&](const double val, const int k) {
+      int idx = static_cast<int>(std::floor((val - extent[2*k]) / cellSize[k]));
+      return std::min(std::max(idx, 0), numOfCell - 1);
+    };
+    std::vector< std::vector<int> > grid(numOfCell * numOfCell);
+    std::vector<int> largeBoxes;
+    for(int i = 0; i < numOfPattern; i++){
+      if(!isParent[i]) continue;
+      int range[4] = {getCell(boxes[i][0], 0), getCell(boxes[i][1], 0), getCell(boxes[i][2], 1), getCell(boxes[i][3], 1)};
+      if((range[1] - range[0] + 1) * (range[3] - range[2] + 1) > 16){
+        largeBoxes.push_back(i);
+        continue;
+      }
+      for(int ix = range[0]; ix <= range[1]; ix++){
+        for(int iy = range[2]; iy <= range[3]; iy++){
+          grid[ix + numOfCell * iy].push_back(i);
+        }
+      }
+    }
+
+    std::vector<int> candidates;
+    for(int i = 0; i < numOfPattern; i++){
+      Pattern& child = patternVec_[areaVec[i].first];
+      child.parent = -1;
+      double center[2];
+      getPatternCenter(child, center);
+      if(center[0] < extent[0] || center[0] > extent[1] || center[1] < extent[2] || center[1] > extent[3]) continue;
+      const std::vector<int>& cell = grid[getCell(center[0], 0) + numOfCell * getCell(center[1], 1)];
+      // only the patterns with larger area, whose box contains the center
+      candidates.clear();
+      const std::vector<int>* lists[2] = {&cell, &largeBoxes};
+      for(int k = 0; k < 2; k++){
+        for(size_t j = 0; j < lists[k]->size(); j++){
+          int idx = (*lists[k])[j];
+          if(idx > i && center[0] >= boxes[idx][0] && center[0] <= boxes[idx][1]
+            && center[1] >= boxes[idx][2] && center[1] <= boxes[idx][3]){
+            candidates.push_back(idx);
+          }
+        }
+      }
+      // check in the sorted order, the first one containing it is the parent
+      std::sort(candidates.begin(), candidates.end());
+      for(size_t j = 0; j < candidates.size(); j++){
+        if(isContainedInGeometry(patternVec_[areaVec[candidates[j]].first], child)){
+          child.parent = areaVec[candidates[j]].first;
           break;
         }
       }
     }
   }
 
+  /*==============================================*/
+  // function returns the number of patterns in the layer
+  /*==============================================*/
+  int Layer::getNumOfPattern(){
+    return patternVec_.size();
+  }
+  /*==============================================*/
+  // helper function returning the field of a pattern behind a parameter name
+  // @args:
+  // pattern: the pattern
+  // parameter: one of CenterX, CenterY, Width (grating), WidthX, WidthY
+  // (rectangle), HalfwidthX, HalfwidthY (ellipse), Radius (circle), Angle
+  // @return:
+  // the address of the field, nullptr if the pattern has no such parameter
+  /*==============================================*/
+  static double* getPatternField(Pattern& pattern, const std::string& parameter){
+    PATTERN type = pattern.type_;
+    if(type == RASTER_ || type == CIRCLES_ || type == RECTANGLES_) return nullptr;
+    if(parameter == "CenterX") return &pattern.arg1_.first;
+    if(parameter == "CenterY" && type == CIRCLE_) return &pattern.arg2_.first;
+    if(parameter == "CenterY" && type != GRATING_) return &pattern.arg1_.second;
+    if(parameter == "Width" && type == GRATING_) return &pattern.arg1_.second;
+    if(parameter == "WidthX" && type == RECTANGLE_) return &pattern.arg2_.first;
+    if(parameter == "WidthY" && type == RECTANGLE_) return &pattern.arg2_.second;
+    if(parameter == "HalfwidthX" && type == ELLIPSE_) return &pattern.arg2_.first;
+    if(parameter == "HalfwidthY" && type == ELLIPSE_) return &pattern.arg2_.second;
+    if(parameter == "Radius" && type == CIRCLE_) return &pattern.arg1_.second;
+    if(parameter == "Angle" && (type == RECTANGLE_ || type == ELLIPSE_ || type == POLYGON_)) return &pattern.angle_;
+    return nullptr;
+  }
+  /*==============================================*/
+  // function returns a geometric parameter of a pattern
+  // @args:
+  // index: the index of the pattern, in the order they are added
+  // parameter: the name of the parameter, see getPatternField
+  /*==============================================*/
+  double Layer::getPatternParameter(const int index, const std::string& parameter){
+    if(index < 0 || index >= (int)patternVec_.size()){
+      std::cerr << std::to_string(index) + ": pattern index out of range!" << std::endl;
+      throw UTILITY::RangeException(std::to_string(index) + ": pattern index out of range!");
+    }
+    double* field = getPatternField(patternVec_[index], parameter);
+    if(field == nullptr){
+      std::cerr << parameter + ": not a parameter of the pattern!" << std::endl;
+      throw UTILITY::ValueException(parameter + ": not a parameter of the pattern!");
+    }
+    return *field;
+  }
+  /*==============================================*/
+  // function changes a geometric parameter of a pattern, and updates its
+  // area and the containment relation of the layer
+  // @args:
+  // index: the index of the pattern, in the order they are added
+  // parameter: the name of the parameter, see getPatternField
+  // value: the new value
+  /*==============================================*/
+  void Layer::setPatternParameter(const int index, const std::string& parameter, const double value){
+    this->getPatternParameter(index, parameter);
+    Pattern& pattern = patternVec_[index];
+    *getPatternField(pattern, parameter) = value;
+    switch(pattern.type_){
+      case GRATING_:{
+        pattern.area = getGratingArea(pattern.arg1_.second);
+        break;
+      }
+      case RECTANGLE_:{
+        pattern.area = getRectangleArea(pattern.arg2_.first, pattern.arg2_.second);
+        break;
+      }
+      case CIRCLE_:{
+        // the radius is stored with both centers
+        pattern.arg2_.second = pattern.arg1_.second;
+        pattern.area = getCircleArea(pattern.arg1_.second);
+        break;
+      }
+      case ELLIPSE_:{
+        pattern.area = getEllipseArea(pattern.arg2_.first, pattern.arg2_.second);
+        break;
+      }
+      default: break;
+    }
+    this->getGeometryContainmentRelation();
+  }
+
   /*==============================================*/
   // Implementaion of the structure class
   /*==============================================*/
@@ -25,6 +25,7 @@
 #include <fstream>
 #include <cstdlib>
 #include <algorithm>
+#include <memory>
 
 namespace SYSTEM{
   /*======================================================
@@ -38,19 +39,31 @@ namespace SYSTEM{
       const EPSILON& epsilonList,
       const int numOfOmega
     );
+    static Ptr<Material> instanceNew(
+      const std::string name,
+      const DispersionModel& model
+    );
+    static Ptr<Material> instanceNew(
+      const std::string name,
+      const Ptr<Material>& ordinary,
+      const Ptr<Material>& extraordinary
+    );
 
     Material(const Material& material) = delete;
     ~Material();
 
     std::string getName();
     EPSTYPE getType();
+    DISPERSION getDispersion();
     //dcomplex* getEpsilonList();
     EpsilonVal getEpsilonAtIndex(const int index);
+    EpsilonVal getEpsilonAtOmega(const double omega);
     int getNumOfOmega();
     double* getOmegaList();
 
     void setOmega(const double* &omegaList, const int numOfOmega);
     void setEpsilon(const EPSILON& epsilonList, const int numOfOmega);
+    void resample(const double* omegaList, const int numOfOmega);
 
   protected:
     Material(
@@ -59,10 +72,26 @@ namespace SYSTEM{
       const EPSILON& epsilonList,
       const int numOfOmega
     );
+    Material(
+      const std::string name,
+      const DispersionModel& model
+    );
+    Material(
+      const std::string name,
+      const Ptr<Material>& ordinary,
+      const Ptr<Material>& extraordinary
+    );
 
     EPSILON epsilonList_;
     double* omegaList_;
     int numOfOmega_;
+    DISPERSION dispersion_ = TABULATED_;
+    DispersionModel model_;
+    Ptr<Material> ordinary_;
+    Ptr<Material> extraordinary_;
+    // the tabulated values as given by the user, kept for resampling
+    std::vector<double> tableOmega_;
+    std::vector<EpsilonVal> tableEpsilon_;
   };
 
   typedef std::vector< Ptr<Material> > MaterialVec;
@@ -72,11 +101,28 @@ namespace SYSTEM{
   /*======================================================
   Implementaion of the Layer class
   =======================================================*/
+  // the shapes of an array pattern in structure-of-arrays layout
+  // width1, width2: the radii of circles, or the widths of rectangles
+  typedef struct PATTERNARRAY{
+    std::vector<double> centerx;
+    std::vector<double> centery;
+    std::vector<double> angle;
+    std::vector<double> width1;
+    std::vector<double> width2;
+  } PatternArray;
+
   typedef struct PATTERNWRAPPER{
     LayerPattern arg1_;
     LayerPattern arg2_;
     // private only for polygon
     EdgeList edgeList_;
+    // private only for raster, the material indices of the pixels with the
+    // first lattice direction fastest, and the index this pattern covers
+    std::shared_ptr< const std::vector<int> > raster_;
+    int rasterSize_[2] = {0, 0};
+    int rasterValue_ = 0;
+    // private only for circle and rectangle arrays
+    std::shared_ptr< const PatternArray > array_;
     PATTERN type_;
     double area;
     int parent = -1;
@@ -129,8 +175,13 @@ namespace SYSTEM{
     void addEllipsePattern(const Ptr<Material>& material, const double args1[2], const double angle, const double args2[2]);
     void addPolygonPattern(const Ptr<Material>& material, const double args1[2], const double angle, double**& edgePoints, const int numOfPoint);
     void addGratingPattern(const Ptr<Material>& material, const double center, const double width);
+    void addRasterPattern(const Ptr<Material>& material, const std::shared_ptr< const std::vector<int> >& raster, const int size[2], const int value);
+    void addArrayPattern(const Ptr<Material>& material, const PATTERN type, const std::shared_ptr< const PatternArray >& array);
 
     void getGeometryContainmentRelation();
+    int getNumOfPattern();
+    double getPatternParameter(const int index, const std::string& parameter);
+    void setPatternParameter(const int index, const std::string& parameter, const double value);
   private:
     enum SOURCE {ISSOURCE_, ISNOTSOURCE_};
 
@@ -199,6 +199,102 @@ int MESH_SetMaterial(lua_State* L){
   return 1;
 }
 
+// this function reads a table of Lorentz oscillators {{strength, omega0, gamma}, ...}
+// at the given index of the stack
+static std::vector<Oscillator> readOscillators(lua_State* L, int index){
+  std::vector<Oscillator> oscillators;
+  int numOfOscillator = lua_rawlen(L, index);
+  for(int i = 0; i < numOfOscillator; i++){
+    lua_pushinteger(L, i+1);
+    lua_gettable(L, index);
+    double vals[3];
+    for(int j = 0; j < 3; j++){
+      lua_pushinteger(L, j + 1);
+      lua_gettable(L, -2);
+      vals[j] = luaU_check<double>(L, -1);
+      lua_pop(L, 1);
+    }
+    Oscillator oscillator;
+    oscillator.strength = vals[0];
+    oscillator.omega0 = vals[1];
+    oscillator.gamma = vals[2];
+    oscillators.push_back(oscillator);
+    lua_pop(L, 1);
+  }
+  return oscillators;
+}
+
+// this function wraps addMaterial(const std::string name, const DispersionModel& model) for a Drude model
+// @how to use:
+// AddMaterialDrude(material name, eps_inf, omega_p, gamma)
+int MESH_AddMaterialDrude(lua_State* L){
+  Simulation* s = luaW_check<Simulation>(L, 1);
+  std::string name = luaU_check<std::string>(L, 2);
+  DispersionModel model;
+  model.epsInf = luaU_check<double>(L, 3);
+  model.omegaP = luaU_check<double>(L, 4);
+  model.gammaP = luaU_check<double>(L, 5);
+  s->addMaterial(name, model);
+  return 1;
+}
+
+// this function wraps addMaterial(const std::string name, const DispersionModel& model) for a Lorentz model
+// @how to use:
+// AddMaterialLorentz(material name, eps_inf, {{strength, omega0, gamma}, ...})
+int MESH_AddMaterialLorentz(lua_State* L){
+  Simulation* s = luaW_check<Simulation>(L, 1);
+  std::string name = luaU_check<std::string>(L, 2);
+  DispersionModel model;
+  model.epsInf = luaU_check<double>(L, 3);
+  model.oscillators = readOscillators(L, 4);
+  s->addMaterial(name, model);
+  return 1;
+}
+
+// this function wraps addMaterial(const std::string name, const DispersionModel& model) for a Drude-Lorentz model
+// @how to use:
+// AddMaterialDrudeLorentz(material name, eps_inf, omega_p, gamma, {{strength, omega0, gamma}, ...})
+int MESH_AddMaterialDrudeLorentz(lua_State* L){
+  Simulation* s = luaW_check<Simulation>(L, 1);
+  std::string name = luaU_check<std::string>(L, 2);
+  DispersionModel model;
+  model.epsInf = luaU_check<double>(L, 3);
+  model.omegaP = luaU_check<double>(L, 4);
+  model.gammaP = luaU_check<double>(L, 5);
+  model.oscillators = readOscillators(L, 6);
+  s->addMaterial(name, model);
+  return 1;
+}
+
+// this function wraps addMaterialUniaxial(const std::string name, const std::string ordinary, const std::string extraordinary)
+// @how to use:
+// AddMaterialUniaxial(material name, ordinary material name, extraordinary material name)
+int MESH_AddMaterialUniaxial(lua_State* L){
+  Simulation* s = luaW_check<Simulation>(L, 1);
+  std::string name = luaU_check<std::string>(L, 2);
+  std::string ordinary = luaU_check<std::string>(L, 3);
+  std::string extraordinary = luaU_check<std::string>(L, 4);
+  s->addMaterialUniaxial(name, ordinary, extraordinary);
+  return 1;
+}
+
+// this function wraps setOmega(const std::vector<double>& omega)
+// @how to use:
+// SetOmega(omega)
+int MESH_SetOmega(lua_State* L){
+  Simulation* s = luaW_check<Simulation>(L, 1);
+  std::vector<double> omegaList;
+  int numOfOmega = lua_rawlen(L, 2);
+  for(int i = 0; i < numOfOmega; i++){
+    lua_pushinteger(L, i+1);
+    lua_gettable(L, 2);
+    omegaList.push_back(luaU_check<double>(L, -1));
+    lua_pop(L, 1);
+  }
+  s->setOmega(omegaList);
+  return 1;
+}
+
 // this function wraps addLayer(const std::string name, const double thick, const std::string materialName)
 // @how to use:
 // AddLayer(layer name, thickness, material name)
@@ -245,6 +341,24 @@ int MESH_AddLayerCopy(lua_State *L){
   return 1;
 }
 
+// this function wraps addLayerRepeat(const std::vector<std::string>& names, const int count)
+// @how to use
+// AddLayerRepeat({layer names of one period}, number of periods)
+int MESH_AddLayerRepeat(lua_State *L){
+  Simulation *s = luaW_check<Simulation>(L, 1);
+  std::vector<std::string> names;
+  int numOfName = lua_rawlen(L, 2);
+  for(int i = 0; i < numOfName; i++){
+    lua_pushinteger(L, i + 1);
+    lua_gettable(L, 2);
+    names.push_back(luaU_check<std::string>(L, -1));
+    lua_pop(L, 1);
+  }
+  int count = luaU_check<int>(L, 3);
+  s->addLayerRepeat(names, count);
+  return 1;
+}
+
 // this function wraps deleteLayer(const std::string name)
 // @how to use
 // DeleteLayer(layer name)
@@ -297,14 +411,39 @@ int MESH_SetProbeLayerZCoordinate(lua_State* L){
   return 1;
 }
 
+// this function wraps addProbeLayer(const std::string name, const double z)
+// @how to use
+// AddProbeLayer(layer name) or
+// AddProbeLayer(layer name, z)
+int MESH_AddProbeLayer(lua_State* L){
+  int n = lua_gettop(L);
+  Simulation* s = luaW_check<Simulation>(L, 1);
+  std::string name = luaU_check<std::string>(L, 2);
+  if(n == 2){
+    s->addProbeLayer(name);
+  }
+  else{
+    double z = luaU_check<double>(L, 3);
+    s->addProbeLayer(name, z);
+  }
+  return 1;
+}
+
 
 // this function wraps setThread(const int numThread)
 // @how to use
-// SetThread(number of thread)
+// SetThread(number of thread, policy)
 int MESH_SetThread(lua_State *L){
+  int n = lua_gettop(L);
   Simulation *s = luaW_check<Simulation>(L, 1);
   int thread = luaU_check<int>(L, 2);
-  s->setThread(thread);
+  if(n == 2){
+    s->setThread(thread);
+  }
+  else{
+    std::string policy = luaU_check<std::string>(L, 3);
+    s->setThread(thread, policy);
+  }
   return 1;
 }
 
@@ -333,6 +472,89 @@ int MESH_GetPhi(lua_State *L){
   return 1;
 }
 
+// this function wraps getPhiAtProbes()
+// @how to use
+// GetPhiAtProbes()
+int MESH_GetPhiAtProbes(lua_State *L){
+  Simulation* s = luaW_check<Simulation>(L, 1);
+  double* phi = s->getPhiAtProbes();
+  int numOfOmega = s->getNumOfOmega();
+  int numOfProbe = s->getNumOfProbe();
+  lua_createtable(L, numOfProbe, 0);
+  for(int p = 0; p < numOfProbe; p++){
+    lua_pushinteger(L, p+1);
+    lua_createtable(L, numOfOmega, 0);
+    for(int i = 0; i < numOfOmega; i++){
+      lua_pushinteger(L, i+1);
+      lua_pushnumber(L, phi[p * numOfOmega + i]);
+      lua_settable(L, -3);
+    }
+    lua_settable(L, -3);
+  }
+  return 1;
+}
+
+// this function wraps getPhiOnKGrid()
+// @how to use
+// GetPhiOnKGrid(omega index, probe index), probe index is optional
+int MESH_GetPhiOnKGrid(lua_State *L){
+  int n = lua_gettop(L);
+  Simulation* s = luaW_check<Simulation>(L, 1);
+  int omegaIdx = luaU_check<int>(L, 2) - 1;
+  int probeIdx = 0;
+  if(n >= 3){
+    probeIdx = luaU_check<int>(L, 3) - 1;
+  }
+  double* phi = s->getPhiOnKGrid();
+  int numOfKx = s->getNumOfKx();
+  int numOfKy = s->getNumOfKy();
+  int numOfProbe = s->getNumOfProbe();
+  if(omegaIdx < 0 || omegaIdx >= s->getNumOfOmega() || probeIdx < 0 || probeIdx >= numOfProbe){
+    return luaL_error(L, "index out of range");
+  }
+  lua_createtable(L, numOfKx, 0);
+  for(int i = 0; i < numOfKx; i++){
+    lua_pushinteger(L, i+1);
+    lua_createtable(L, numOfKy, 0);
+    for(int j = 0; j < numOfKy; j++){
+      lua_pushinteger(L, j+1);
+      lua_pushnumber(L, phi[((static_cast<size_t>(omegaIdx) * numOfKx + i) * numOfKy + j) * numOfProbe + probeIdx]);
+      lua_settable(L, -3);
+    }
+    lua_settable(L, -3);
+  }
+  return 1;
+}
+
+// this function wraps getPhiBySource(const std::string name, const POLARIZATION polar)
+// @how to use
+// GetPhiBySource()
+int MESH_GetPhiBySource(lua_State *L){
+  Simulation* s = luaW_check<Simulation>(L, 1);
+  int numOfOmega = s->getNumOfOmega();
+  std::vector<std::string> names = s->getSourceLayerNames();
+  const POLARIZATION polars[3] = {BOTH_, TE_, TM_};
+  const char* keys[3] = {"total", "TE", "TM"};
+  lua_createtable(L, 0, names.size());
+  for(size_t l = 0; l < names.size(); l++){
+    lua_pushstring(L, names[l].c_str());
+    lua_createtable(L, 0, 3);
+    for(int k = 0; k < 3; k++){
+      double* phi = s->getPhiBySource(names[l], polars[k]);
+      lua_pushstring(L, keys[k]);
+      lua_createtable(L, numOfOmega, 0);
+      for(int i = 0; i < numOfOmega; i++){
+        lua_pushinteger(L, i+1);
+        lua_pushnumber(L, phi[i]);
+        lua_settable(L, -3);
+      }
+      lua_settable(L, -3);
+    }
+    lua_settable(L, -3);
+  }
+  return 1;
+}
+
 // this function wraps getOmega()
 // @how to use
 // GetOmega()
@@ -447,17 +669,22 @@ int MESH_OutputSysInfo(lua_State *L){
 
 // this function wraps optPrintIntermediate()
 // @how to use
-// OptPrintIntermediate()
+// OptPrintIntermediate(), OptPrintIntermediate(output flag) or OptPrintIntermediate(output flag, format)
 int MESH_OptPrintIntermediate(lua_State *L){
   int n = lua_gettop(L);
   Simulation* s = luaW_check<Simulation>(L, 1);
   if(n == 1){
     s->optPrintIntermediate();
   }
-  else{
+  else if(n == 2){
     std::string output_flag = luaU_check<std::string>(L, 2);
     s->optPrintIntermediate(output_flag);
   }
+  else{
+    std::string output_flag = luaU_check<std::string>(L, 2);
+    std::string format = luaU_check<std::string>(L, 3);
+    s->optPrintIntermediate(output_flag, format);
+  }
   return 1;
 }
 
@@ -479,6 +706,59 @@ int MESH_OptOnlyComputeTM(lua_State *L){
   return 1;
 }
 
+// this function wraps optUseEigenContinuation()
+// @how to use
+// OptUseEigenContinuation()
+int MESH_OptUseEigenContinuation(lua_State *L){
+  Simulation* s = luaW_check<Simulation>(L, 1);
+  s->optUseEigenContinuation();
+  return 1;
+}
+
+// this function wraps optRetainKGrid()
+// @how to use
+// OptRetainKGrid()
+int MESH_OptRetainKGrid(lua_State *L){
+  Simulation* s = luaW_check<Simulation>(L, 1);
+  s->optRetainKGrid();
+  return 1;
+}
+
+// this function wraps optCheckpoint(const std::string& fileName, const double interval)
+// @how to use
+// OptCheckpoint(file name) or OptCheckpoint(file name, interval)
+int MESH_OptCheckpoint(lua_State *L){
+  int n = lua_gettop(L);
+  Simulation* s = luaW_check<Simulation>(L, 1);
+  std::string fileName = luaU_check<std::string>(L, 2);
+  if(n == 2){
+    s->optCheckpoint(fileName);
+  }
+  else{
+    double interval = luaU_check<double>(L, 3);
+    s->optCheckpoint(fileName, interval);
+  }
+  return 1;
+}
+
+// this function wraps optProfile(const std::string& fileName, const std::string& format)
+// @how to use
+// OptProfile(), OptProfile(file name) or OptProfile(file name, format)
+int MESH_OptProfile(lua_State *L){
+  int n = lua_gettop(L);
+  Simulation* s = luaW_check<Simulation>(L, 1);
+  std::string fileName = "";
+  std::string format = "JSON";
+  if(n >= 2){
+    fileName = luaU_check<std::string>(L, 2);
+  }
+  if(n >= 3){
+    format = luaU_check<std::string>(L, 3);
+  }
+  s->optProfile(fileName, format);
+  return 1;
+}
+
 // this function wraps optSetLatticeTruncation(const std::string& truncation)
 int MESH_OptSetLatticeTruncation(lua_State *L){
   Simulation* s = luaW_check<Simulation>(L, 1);
@@ -591,6 +871,93 @@ int MESH_IntegrateKxKyMPI(lua_State* L){
   return 1;
 }
 
+// this function wraps addSweepParameter(const std::string layerName, const std::string parameter, const int patternIndex)
+// @how to use
+// AddSweepParameter(layer name, parameter, pattern index), pattern index is optional
+int MESH_AddSweepParameter(lua_State* L){
+  int n = lua_gettop(L);
+  Simulation* s = luaW_check<Simulation>(L, 1);
+  std::string layerName = luaU_check<std::string>(L, 2);
+  std::string parameter = luaU_check<std::string>(L, 3);
+  int patternIdx = 0;
+  if(n >= 4){
+    patternIdx = luaU_check<int>(L, 4) - 1;
+  }
+  s->addSweepParameter(layerName, parameter, patternIdx);
+  return 1;
+}
+
+// this function wraps addSweepVariant(const std::vector<double>& values)
+// @how to use
+// AddSweepVariant({value 1, value 2, ...})
+int MESH_AddSweepVariant(lua_State* L){
+  Simulation* s = luaW_check<Simulation>(L, 1);
+  std::vector<double> values;
+  int numOfValue = lua_rawlen(L, 2);
+  for(int i = 0; i < numOfValue; i++){
+    lua_pushinteger(L, i+1);
+    lua_gettable(L, 2);
+    values.push_back(luaU_check<double>(L, -1));
+    lua_pop(L, 1);
+  }
+  s->addSweepVariant(values);
+  return 1;
+}
+
+// this function wraps runSweep()
+// @how to use
+// RunSweep()
+int MESH_RunSweep(lua_State* L){
+  Simulation* s = luaW_check<Simulation>(L, 1);
+  s->runSweep();
+  return 1;
+}
+
+// this function wraps runSweepMPI(const int rank, const int size)
+// @how to use
+// RunSweepMPI(rank, size)
+int MESH_RunSweepMPI(lua_State* L){
+  Simulation* s = luaW_check<Simulation>(L, 1);
+  int rank = luaU_check<int>(L, 2);
+  int size = luaU_check<int>(L, 3);
+  s->runSweepMPI(rank, size);
+  return 1;
+}
+
+// this function wraps getNumOfSweepVariant()
+// @how to use
+// GetNumOfSweepVariant()
+int MESH_GetNumOfSweepVariant(lua_State* L){
+  Simulation* s = luaW_check<Simulation>(L, 1);
+  lua_pushinteger(L, s->getNumOfSweepVariant());
+  return 1;
+}
+
+// this function wraps getSweepPhi(const int variantIndex, const int probeIndex)
+// @how to use
+// GetSweepPhi(variant index, probe index), probe index is optional
+int MESH_GetSweepPhi(lua_State* L){
+  int n = lua_gettop(L);
+  Simulation* s = luaW_check<Simulation>(L, 1);
+  int variantIdx = luaU_check<int>(L, 2) - 1;
+  int probeIdx = 0;
+  if(n >= 3){
+    probeIdx = luaU_check<int>(L, 3) - 1;
+  }
+  if(variantIdx < 0 || variantIdx >= s->getNumOfSweepVariant() || probeIdx < 0 || probeIdx >= s->getNumOfProbe()){
+    return luaL_error(L, "index out of range");
+  }
+  double* phi = s->getSweepPhi(variantIdx, probeIdx);
+  int numOfOmega = s->getNumOfOmega();
+  lua_createtable(L, numOfOmega, 0);
+  for(int i = 0; i < numOfOmega; i++){
+    lua_pushinteger(L, i+1);
+    lua_pushnumber(L, phi[i]);
+    lua_settable(L, -3);
+  }
+  return 1;
+}
+
 /*======================================================*/
 // constructor for the planar
 /*=======================================================*/
@@ -804,6 +1171,98 @@ int MESH_SetLayerPatternPolygon(lua_State *L){
   delete [] edgePoints;
   return 1;
 }
+// helper function reading a table of pairs {{x1, y1}, ..., {xn, yn}} at
+// index into two vectors
+static void readPairs(lua_State *L, const int index, std::vector<double>& x, std::vector<double>& y){
+  int num = lua_rawlen(L, index);
+  for(int i = 0; i < num; i++){
+    lua_pushinteger(L, i + 1);
+    lua_gettable(L, index);
+    for(int j = 0; j < 2; j++){
+      lua_pushinteger(L, j + 1);
+      lua_gettable(L, -2);
+      if(j == 0) x.push_back(luaU_check<double>(L, -1));
+      else y.push_back(luaU_check<double>(L, -1));
+      lua_pop(L, 1);
+    }
+    lua_pop(L, 1);
+  }
+}
+// helper function reading a table of numbers at index into a vector
+static void readValues(lua_State *L, const int index, std::vector<double>& values){
+  int num = lua_rawlen(L, index);
+  for(int i = 0; i < num; i++){
+    lua_pushinteger(L, i + 1);
+    lua_gettable(L, index);
+    values.push_back(luaU_check<double>(L, -1));
+    lua_pop(L, 1);
+  }
+}
+// this function wraps setLayerPatternCircles(layerName, materialName, centerx, centery, radius)
+// @how to use
+// SetLayerPatternCircles(layer name, material name, {{centerx, centery}, ...}, {radius, ...})
+int MESH_SetLayerPatternCircles(lua_State *L){
+  SimulationPattern *s = luaW_check<SimulationPattern>(L, 1);
+  std::string layerName = luaU_check<std::string>(L, 2);
+  std::string materialName = luaU_check<std::string>(L, 3);
+  std::vector<double> centerx, centery, radius;
+  readPairs(L, 4, centerx, centery);
+  readValues(L, 5, radius);
+  s->setLayerPatternCircles(layerName, materialName, centerx, centery, radius);
+  return 1;
+}
+// this function wraps setLayerPatternRectangles(layerName, materialName, centerx, centery, angle, widthx, widthy)
+// @how to use
+// SetLayerPatternRectangles(layer name, material name, {{centerx, centery}, ...}, {angle, ...}, {{widthx, widthy}, ...})
+int MESH_SetLayerPatternRectangles(lua_State *L){
+  SimulationPattern *s = luaW_check<SimulationPattern>(L, 1);
+  std::string layerName = luaU_check<std::string>(L, 2);
+  std::string materialName = luaU_check<std::string>(L, 3);
+  std::vector<double> centerx, centery, angle, widthx, widthy;
+  readPairs(L, 4, centerx, centery);
+  readValues(L, 5, angle);
+  readPairs(L, 6, widthx, widthy);
+  s->setLayerPatternRectangles(layerName, materialName, centerx, centery, angle, widthx, widthy);
+  return 1;
+}
+// this function wraps setLayerPatternRaster(layerName, materialNames, grid, nx, ny)
+// @how to use
+// SetLayerPatternRaster(layer name, {material names}, {{index, ...}, ...})
+// the raster is a table of rows along the second lattice vector, each row
+// holds the (1-based) material indices of the pixels along the first one
+int MESH_SetLayerPatternRaster(lua_State *L){
+  SimulationPattern *s = luaW_check<SimulationPattern>(L, 1);
+  std::string layerName = luaU_check<std::string>(L, 2);
+  std::vector<std::string> materialNames;
+  int numOfMaterial = lua_rawlen(L, 3);
+  for(int i = 0; i < numOfMaterial; i++){
+    lua_pushinteger(L, i + 1);
+    lua_gettable(L, 3);
+    materialNames.push_back(luaU_check<std::string>(L, -1));
+    lua_pop(L, 1);
+  }
+  int ny = lua_rawlen(L, 4), nx = 0;
+  std::vector<int> grid;
+  for(int j = 0; j < ny; j++){
+    lua_pushinteger(L, j + 1);
+    lua_gettable(L, 4);
+    int len = lua_rawlen(L, -1);
+    if(j > 0 && len != nx){
+      std::cerr << "The rows of the raster should have the same length!" << std::endl;
+      throw UTILITY::RangeException("The rows of the raster should have the same length!");
+    }
+    nx = len;
+    for(int i = 0; i < nx; i++){
+      lua_pushinteger(L, i + 1);
+      lua_gettable(L, -2);
+      grid.push_back(luaU_check<int>(L, -1) - 1);
+      lua_pop(L, 1);
+    }
+    lua_pop(L, 1);
+  }
+  s->setLayerPatternRaster(layerName, materialNames, grid, nx, ny);
+  return 1;
+}
 // this function wraps setLattice(const double xLen, const double yLen, const double angle)
 int MESH_SetLatticePattern(lua_State *L){
   SimulationPattern *s = luaW_check<SimulationPattern>(L, 1);
@@ -850,16 +1309,26 @@ static luaL_Reg character_metatable_Interpolator[] = {
 static luaL_Reg character_metatable_Simulation[] = {
 	{ "AddMaterial", MESH_AddMaterial },
   { "SetMaterial", MESH_SetMaterial, },
+  { "AddMaterialDrude", MESH_AddMaterialDrude },
+  { "AddMaterialLorentz", MESH_AddMaterialLorentz },
+  { "AddMaterialDrudeLorentz", MESH_AddMaterialDrudeLorentz },
+  { "AddMaterialUniaxial", MESH_AddMaterialUniaxial },
+  { "SetOmega", MESH_SetOmega },
   { "SetLayer", MESH_SetLayer, },
 	{ "AddLayer", MESH_AddLayer },
   { "SetLayerThickness", MESH_SetLayerThickness, },
   { "AddLayerCopy", MESH_AddLayerCopy, },
+  { "AddLayerRepeat", MESH_AddLayerRepeat, },
   { "DeleteLayer", MESH_DeleteLayer, },
   { "SetSourceLayer", MESH_SetSourceLayer },
   { "SetProbeLayer", MESH_SetProbeLayer },
   { "SetProbeLayerZCoordinate", MESH_SetProbeLayerZCoordinate},
+  { "AddProbeLayer", MESH_AddProbeLayer },
   { "SetNumOfG", MESH_SetNumOfG },
   { "GetPhi", MESH_GetPhi },
+  { "GetPhiAtProbes", MESH_GetPhiAtProbes },
+  { "GetPhiOnKGrid", MESH_GetPhiOnKGrid },
+  { "GetPhiBySource", MESH_GetPhiBySource },
   { "GetOmega", MESH_GetOmega },
   { "GetEpsilon", MESH_GetEpsilon },
   { "GetNumOfOmega", MESH_GetNumOfOmega },
@@ -871,6 +1340,10 @@ static luaL_Reg character_metatable_Simulation[] = {
   { "OptOnlyComputeTE", MESH_OptOnlyComputeTE },
   { "OptOnlyComputeTM", MESH_OptOnlyComputeTM },
   { "OptSetLatticeTruncation", MESH_OptSetLatticeTruncation },
+  { "OptUseEigenContinuation", MESH_OptUseEigenContinuation },
+  { "OptRetainKGrid", MESH_OptRetainKGrid },
+  { "OptCheckpoint", MESH_OptCheckpoint },
+  { "OptProfile", MESH_OptProfile },
   { "InitSimulation", MESH_InitSimulation },
   { "SetThread", MESH_SetThread },
   { "SetKxIntegral", MESH_SetKxIntegral },
@@ -879,6 +1352,12 @@ static luaL_Reg character_metatable_Simulation[] = {
   { "SetKyIntegralSym", MESH_SetKyIntegralSym },
   { "IntegrateKxKy", MESH_IntegrateKxKy },
   { "IntegrateKxKyMPI", MESH_IntegrateKxKyMPI },
+  { "AddSweepParameter", MESH_AddSweepParameter },
+  { "AddSweepVariant", MESH_AddSweepVariant },
+  { "RunSweep", MESH_RunSweep },
+  { "RunSweepMPI", MESH_RunSweepMPI },
+  { "GetNumOfSweepVariant", MESH_GetNumOfSweepVariant },
+  { "GetSweepPhi", MESH_GetSweepPhi },
 	{NULL, NULL}
 };
 
@@ -903,6 +1382,9 @@ static luaL_Reg character_metatable_SimulationPattern[] = {
   { "SetLayerPatternCircle", MESH_SetLayerPatternCircle },
   { "SetLayerPatternEllipse", MESH_SetLayerPatternEllipse },
   { "SetLayerPatternPolygon", MESH_SetLayerPatternPolygon },
+  { "SetLayerPatternCircles", MESH_SetLayerPatternCircles },
+  { "SetLayerPatternRectangles", MESH_SetLayerPatternRectangles },
+  { "SetLayerPatternRaster", MESH_SetLayerPatternRaster },
   { "SetLattice", MESH_SetLatticePattern },
   { "GetReciprocalLattice", MESH_GetReciprocalLattice },
   { NULL, NULL}
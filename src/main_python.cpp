@@ -25,6 +25,9 @@
  ********************/
 #include "setup.h"
 #include <Python.h>
+#include <thread>
+#include <atomic>
+#include <functional>
 
 #ifdef __cplusplus
 extern "C" {
@@ -174,6 +177,79 @@ int interpolator_converter(PyObject* obj, struct interpolator_converter_data *da
 }
 
 
+struct oscillator_converter_data{
+  std::vector<Oscillator> oscillators;
+};
+
+int oscillator_converter(PyObject *obj, struct oscillator_converter_data *data){
+  if(!PyTuple_Check(obj)){
+    PyErr_SetString(PyExc_TypeError, "Oscillators must be a tuple of (strength, omega0, gamma)");
+    return 0;
+  }
+  for(int i = 0; i < PyTuple_Size(obj); i++){
+    PyObject* pi = PyTuple_GetItem(obj, i);
+    if(!PyTuple_Check(pi) || PyTuple_Size(pi) != 3){
+      PyErr_SetString(PyExc_TypeError, "Oscillators must be a tuple of (strength, omega0, gamma)");
+      return 0;
+    }
+    double vals[3];
+    for(int j = 0; j < 3; j++){
+      PyObject* pj = PyTuple_GetItem(pi, j);
+      if(!CheckPyNumber(pj)){
+        PyErr_SetString(PyExc_TypeError, "Oscillators must be a tuple of (strength, omega0, gamma)");
+        return 0;
+      }
+      vals[j] = AsNumberPyNumber(pj);
+    }
+    Oscillator oscillator;
+    oscillator.strength = vals[0];
+    oscillator.omega0 = vals[1];
+    oscillator.gamma = vals[2];
+    data->oscillators.push_back(oscillator);
+  }
+  return 1;
+}
+
+struct omega_converter_data{
+  std::vector<double> omega;
+};
+
+int omega_converter(PyObject *obj, struct omega_converter_data *data){
+  if(!PyTuple_Check(obj)){
+    PyErr_SetString(PyExc_TypeError, "Omega must be a tuple of numbers");
+    return 0;
+  }
+  for(int i = 0; i < PyTuple_Size(obj); i++){
+    PyObject* pi = PyTuple_GetItem(obj, i);
+    if(!CheckPyNumber(pi)){
+      PyErr_SetString(PyExc_TypeError, "Omega must be a tuple of numbers");
+      return 0;
+    }
+    data->omega.push_back(AsNumberPyNumber(pi));
+  }
+  return 1;
+}
+
+struct values_converter_data{
+  std::vector<double> values;
+};
+
+int values_converter(PyObject *obj, struct values_converter_data *data){
+  if(!PyTuple_Check(obj)){
+    PyErr_SetString(PyExc_TypeError, "Values must be a tuple of numbers");
+    return 0;
+  }
+  for(int i = 0; i < PyTuple_Size(obj); i++){
+    PyObject* pi = PyTuple_GetItem(obj, i);
+    if(!CheckPyNumber(pi)){
+      PyErr_SetString(PyExc_TypeError, "Values must be a tuple of numbers");
+      return 0;
+    }
+    data->values.push_back(AsNumberPyNumber(pi));
+  }
+  return 1;
+}
+
 struct polygon_converter_data{
 	int nvert;
 	std::vector<double> vert;
@@ -227,6 +303,57 @@ int coordinate_converter(PyObject *obj, struct coordinate_converter_data *data){
   return 1;
 }
 
+struct names_converter_data{
+  std::vector<std::string> names;
+};
+
+int names_converter(PyObject *obj, struct names_converter_data *data){
+  if(!PyTuple_Check(obj)){
+    PyErr_SetString(PyExc_TypeError, "Names must be a tuple of strings");
+    return 0;
+  }
+  for(int i = 0; i < PyTuple_Size(obj); i++){
+    PyObject* pi = PyTuple_GetItem(obj, i);
+    if(!PyUnicode_Check(pi)){
+      PyErr_SetString(PyExc_TypeError, "Names must be a tuple of strings");
+      return 0;
+    }
+    data->names.push_back(std::string(PyUnicode_AsUTF8(pi)));
+  }
+  return 1;
+}
+
+struct raster_converter_data{
+  int nx = 0;
+  int ny = 0;
+  std::vector<int> grid;
+};
+
+int raster_converter(PyObject *obj, struct raster_converter_data *data){
+  if(!PyTuple_Check(obj)){
+    PyErr_SetString(PyExc_TypeError, "Raster must be a tuple of rows of material indices");
+    return 0;
+  }
+  data->ny = PyTuple_Size(obj);
+  for(int j = 0; j < data->ny; j++){
+    PyObject* pj = PyTuple_GetItem(obj, j);
+    if(!PyTuple_Check(pj) || (j > 0 && PyTuple_Size(pj) != data->nx)){
+      PyErr_SetString(PyExc_TypeError, "Raster must be a tuple of rows of the same length");
+      return 0;
+    }
+    data->nx = PyTuple_Size(pj);
+    for(int i = 0; i < data->nx; i++){
+      PyObject* pi = PyTuple_GetItem(pj, i);
+      if(!PyLong_Check(pi)){
+        PyErr_SetString(PyExc_TypeError, "Raster must be a tuple of rows of material indices");
+        return 0;
+      }
+      data->grid.push_back(PyLong_AsLong(pi));
+    }
+  }
+  return 1;
+}
+
 /*======================================================*/
 // wrapper for Interpolator
 /*=======================================================*/
@@ -320,6 +447,192 @@ static PyTypeObject MESH_Interpolator_Type = {
   MESH_Interpolator_new, /* tp_new */
 };
 
+/*======================================================*/
+// wrapper for the handle of an asynchronous integration
+/*=======================================================*/
+// the integration runs on its own thread without the GIL
+struct IntegrationTask{
+  std::thread worker;
+  std::atomic<bool> done{false};
+  std::string error;
+};
+
+typedef struct {
+  PyObject_HEAD;
+  PyObject* owner;
+  Simulation* s;
+  IntegrationTask* task;
+} MESH_IntegrationHandle;
+
+/* DEALLOC */
+static void MESH_IntegrationHandle_dealloc(MESH_IntegrationHandle* self){
+  if(self->task != NULL){
+    if(self->task->worker.joinable()){
+      Py_BEGIN_ALLOW_THREADS
+      self->task->worker.join();
+      Py_END_ALLOW_THREADS
+    }
+    delete self->task;
+  }
+  Py_XDECREF(self->owner);
+  Py_TYPE(self)->tp_free((PyObject*)self);
+}
+
+static PyObject* MESH_IntegrationHandle_Done(MESH_IntegrationHandle *self, PyObject *args){
+  return PyBool_FromLong(self->task->done.load());
+}
+
+static PyObject* MESH_IntegrationHandle_Progress(MESH_IntegrationHandle *self, PyObject *args){
+  if(self->task->done.load()){
+    return PyFloat_FromDouble(1.0);
+  }
+  return PyFloat_FromDouble(self->s->getProgress());
+}
+
+static PyObject* MESH_IntegrationHandle_Wait(MESH_IntegrationHandle *self, PyObject *args){
+  if(self->task->worker.joinable()){
+    Py_BEGIN_ALLOW_THREADS
+    self->task->worker.join();
+    Py_END_ALLOW_THREADS
+  }
+  if(self->task->error != ""){
+    PyErr_SetString(PyExc_RuntimeError, self->task->error.c_str());
+    return NULL;
+  }
+  Py_RETURN_NONE;
+}
+
+/* METHOD TABLE */
+static PyMethodDef MESH_IntegrationHandle_methods[] = {
+  {"done",     (PyCFunction) MESH_IntegrationHandle_Done,     METH_NOARGS, "Whether the integration has finished"},
+  {"progress", (PyCFunction) MESH_IntegrationHandle_Progress, METH_NOARGS, "Fraction of the k points done"},
+  {"wait",     (PyCFunction) MESH_IntegrationHandle_Wait,     METH_NOARGS, "Waiting for the integration to finish"},
+  {NULL}  /* Sentinel */
+};
+
+/* TYPE ... whatever */
+static PyTypeObject MESH_IntegrationHandle_Type = {
+  PyVarObject_HEAD_INIT(NULL, 0)
+  "MESH_IntegrationHandle",          /* tp_name */
+  sizeof(MESH_IntegrationHandle),    /* tp_basicsize */
+  0,                         /* tp_itemsize */
+  (destructor)MESH_IntegrationHandle_dealloc, /* tp_dealloc */
+  0,                         /* tp_print */
+  0,                         /* tp_getattr */
+  0,                         /* tp_setattr */
+  0,                         /* tp_reserved */
+  0,                         /* tp_repr */
+  0,                         /* tp_as_number */
+  0,                         /* tp_as_sequence */
+  0,                         /* tp_as_mapping */
+  0,                         /* tp_hash  */
+  0,                         /* tp_call */
+  0,                         /* tp_str */
+  0,                         /* tp_getattro */
+  0,                         /* tp_setattro */
+  0,                         /* tp_as_buffer */
+  Py_TPFLAGS_DEFAULT,        /* tp_flags */ 
+  "MESH_IntegrationHandle",  /* tp_doc */
+  0,                         /* tp_traverse */
+  0,                         /* tp_clear */
+  0,                         /* tp_richcompare */
+  0,                         /* tp_weaklistoffset */
+  0,                         /* tp_iter */
+  0,                         /* tp_iternext */
+  MESH_IntegrationHandle_methods, /* tp_methods */
+  0,                         /* tp_members */
+  0,                         /* tp_getset */
+  0,                          /* tp_base */ 
+  0,                         /* tp_dict */
+  0,                         /* tp_descr_get */
+  0,                         /* tp_descr_set */
+  0,                         /* tp_dictoffset */
+  0,                         /* tp_init */
+  0,                         /* tp_alloc */
+  0,                         /* tp_new */
+};
+
+// starts integrateKxKy() of a simulation on a new thread, the handle keeps
+// the simulation alive until the integration is done. The simulation is
+// busy until then, and refuses every other call
+static PyObject* MESH_StartIntegrateKxKy(PyObject* owner, Simulation* s, std::atomic<bool>* busy){
+  if(busy->exchange(true)){
+    PyErr_SetString(PyExc_RuntimeError, "The simulation is already integrating!");
+    return NULL;
+  }
+  MESH_IntegrationHandle* handle = PyObject_New(MESH_IntegrationHandle, &MESH_IntegrationHandle_Type);
+  if(handle == NULL){
+    *busy = false;
+    return NULL;
+  }
+  Py_INCREF(owner);
+  handle->owner = owner;
+  handle->s = s;
+  IntegrationTask* task = new IntegrationTask();
+  handle->task = task;
+  task->worker = std::thread([s, task, busy](){
+    try{
+      s->integrateKxKy();
+    }
+    catch(const UTILITY::Exception& e){
+      task->error = e.what();
+    }
+    catch(const std::exception& e){
+      task->error = e.what();
+    }
+    catch(...){
+      task->error = "Unknown error in the integration!";
+    }
+    task->done = true;
+    *busy = false;
+  });
+  return (PyObject*) handle;
+}
+
+// looks up an attribute of a simulation, every method is refused while
+// an integration started by StartIntegrateKxKy runs
+static PyObject* MESH_Simulation_GetAttr(PyObject* self, PyObject* name, const std::atomic<bool>* busy){
+  if(busy->load()){
+    const char* attr = PyUnicode_AsUTF8(name);
+    if(attr != NULL && std::strncmp(attr, "__", 2) != 0){
+      PyErr_Format(PyExc_RuntimeError, "%s: the simulation is integrating, wait for it first!", attr);
+      return NULL;
+    }
+  }
+  return PyObject_GenericGetAttr(self, name);
+}
+
+// runs a computation of a simulation without the GIL. The simulation is
+// busy meanwhile, so other threads can not change it or start another
+// computation on it. Returns false with a RuntimeError set on failure
+static bool MESH_CallWithoutGIL(std::atomic<bool>* busy, const std::function<void()>& call){
+  if(busy->exchange(true)){
+    PyErr_SetString(PyExc_RuntimeError, "The simulation is busy!");
+    return false;
+  }
+  std::string error;
+  Py_BEGIN_ALLOW_THREADS
+  try{
+    call();
+  }
+  catch(const UTILITY::Exception& e){
+    error = e.what();
+  }
+  catch(const std::exception& e){
+    error = e.what();
+  }
+  catch(...){
+    error = "Unknown error in the computation!";
+  }
+  Py_END_ALLOW_THREADS
+  *busy = false;
+  if(error != ""){
+    PyErr_SetString(PyExc_RuntimeError, error.c_str());
+    return false;
+  }
+  return true;
+}
+
 /*======================================================*/
 // wrapper for planar
 /*=======================================================*/
@@ -327,6 +640,8 @@ static PyTypeObject MESH_Interpolator_Type = {
 typedef struct {
     PyObject_HEAD; // <----- PUTTING THIS FIRST INHERITS THE BASE PYTHON CLASS!!!
     SimulationPlanar* s;
+    // set while StartIntegrateKxKy runs
+    std::atomic<bool>* busy;
 } MESH_SimulationPlanar;
 
 
@@ -335,6 +650,7 @@ static void MESH_SimulationPlanar_dealloc(MESH_SimulationPlanar* self){
   // Nothing to deallocate. Use this in case the base
   // struct contains a pointer or so.
   delete self->s;
+  delete self->busy;
   Py_TYPE(self)->tp_free((PyObject*)self);
 }
 
@@ -345,6 +661,7 @@ static PyObject *MESH_SimulationPlanar_new(PyTypeObject *type, PyObject *args, P
    // Init vars if any ...
    if (self != NULL){
       self->s = new SimulationPlanar();
+      self->busy = new std::atomic<bool>(false);
    }
    return (PyObject*) self;
 }
@@ -371,6 +688,67 @@ static PyObject* MESH_SimulationPlanar_AddMaterial(MESH_SimulationPlanar *self,
 }
 
 
+static PyObject* MESH_SimulationPlanar_AddMaterialDrude(MESH_SimulationPlanar *self, PyObject *args, PyObject *kwds){
+  static char *kwlist[] = { (char*)"material_name", (char*)"eps_inf", (char*)"omega_p", (char*)"gamma", NULL };
+  const char *materialName;
+  DispersionModel model;
+  if(!PyArg_ParseTupleAndKeywords(args, kwds, "sddd:AddMaterialDrude", kwlist, &materialName, &model.epsInf, &model.omegaP, &model.gammaP)){
+    return NULL;
+  }
+  std::string material_name(materialName);
+  self->s->addMaterial(material_name, model);
+  Py_RETURN_NONE;
+}
+
+static PyObject* MESH_SimulationPlanar_AddMaterialLorentz(MESH_SimulationPlanar *self, PyObject *args, PyObject *kwds){
+  static char *kwlist[] = { (char*)"material_name", (char*)"eps_inf", (char*)"oscillators", NULL };
+  const char *materialName;
+  DispersionModel model;
+  struct oscillator_converter_data oscillator_data;
+  if(!PyArg_ParseTupleAndKeywords(args, kwds, "sdO&:AddMaterialLorentz", kwlist, &materialName, &model.epsInf, &oscillator_converter, &oscillator_data)){
+    return NULL;
+  }
+  model.oscillators = oscillator_data.oscillators;
+  std::string material_name(materialName);
+  self->s->addMaterial(material_name, model);
+  Py_RETURN_NONE;
+}
+
+static PyObject* MESH_SimulationPlanar_AddMaterialDrudeLorentz(MESH_SimulationPlanar *self, PyObject *args, PyObject *kwds){
+  static char *kwlist[] = { (char*)"material_name", (char*)"eps_inf", (char*)"omega_p", (char*)"gamma", (char*)"oscillators", NULL };
+  const char *materialName;
+  DispersionModel model;
+  struct oscillator_converter_data oscillator_data;
+  if(!PyArg_ParseTupleAndKeywords(args, kwds, "sdddO&:AddMaterialDrudeLorentz", kwlist, &materialName, &model.epsInf, &model.omegaP, &model.gammaP, &oscillator_converter, &oscillator_data)){
+    return NULL;
+  }
+  model.oscillators = oscillator_data.oscillators;
+  std::string material_name(materialName);
+  self->s->addMaterial(material_name, model);
+  Py_RETURN_NONE;
+}
+
+static PyObject* MESH_SimulationPlanar_AddMaterialUniaxial(MESH_SimulationPlanar *self, PyObject *args, PyObject *kwds){
+  static char *kwlist[] = { (char*)"material_name", (char*)"ordinary", (char*)"extraordinary", NULL };
+  const char *materialName, *ordinary, *extraordinary;
+  if(!PyArg_ParseTupleAndKeywords(args, kwds, "sss:AddMaterialUniaxial", kwlist, &materialName, &ordinary, &extraordinary)){
+    return NULL;
+  }
+  std::string material_name(materialName), ordinary_name(ordinary), extraordinary_name(extraordinary);
+  self->s->addMaterialUniaxial(material_name, ordinary_name, extraordinary_name);
+  Py_RETURN_NONE;
+}
+
+static PyObject* MESH_SimulationPlanar_SetOmega(MESH_SimulationPlanar *self, PyObject *args, PyObject *kwds){
+  static char *kwlist[] = { (char*)"omega", NULL };
+  struct omega_converter_data omega_data;
+  if(!PyArg_ParseTupleAndKeywords(args, kwds, "O&:SetOmega", kwlist, &omega_converter, &omega_data)){
+    return NULL;
+  }
+  self->s->setOmega(omega_data.omega);
+  Py_RETURN_NONE;
+}
+
 static PyObject* MESH_SimulationPlanar_SetMaterial(MESH_SimulationPlanar *self, PyObject *args, PyObject *kwds){
   static char *kwlist[] = { (char*)"material_name", (char*)"epsilon", NULL };
 	const char *materialName;
@@ -463,6 +841,17 @@ static PyObject* MESH_SimulationPlanar_AddLayerCopy(MESH_SimulationPlanar *self,
   Py_RETURN_NONE;
 }
 
+static PyObject* MESH_SimulationPlanar_AddLayerRepeat(MESH_SimulationPlanar *self, PyObject *args, PyObject *kwds){
+  static char *kwlist[] = { (char*)"layer_names", (char*)"count", NULL };
+  struct names_converter_data names_data;
+  int count;
+  if(!PyArg_ParseTupleAndKeywords(args, kwds, "O&i:AddLayerRepeat", kwlist, &names_converter, &names_data, &count)){
+    return NULL;
+  }
+  self->s->addLayerRepeat(names_data.names, count);
+  Py_RETURN_NONE;
+}
+
 static PyObject* MESH_SimulationPlanar_DeleteLayer(MESH_SimulationPlanar *self, PyObject *args, PyObject *kwds){
   static char *kwlist[] = { (char*)"layer_name", NULL };
 	const char *layerName;
@@ -506,18 +895,34 @@ static PyObject* MESH_SimulationPlanar_SetProbeLayerZCoordinate(MESH_SimulationP
   Py_RETURN_NONE;
 }
 
+static PyObject* MESH_SimulationPlanar_AddProbeLayer(MESH_SimulationPlanar *self, PyObject *args, PyObject *kwds){
+  static char *kwlist[] = { (char*)"layer_name", (char*)"z", NULL };
+  const char *layerName;
+  double z = -1;
+  if(!PyArg_ParseTupleAndKeywords(args, kwds, "s|d:AddProbeLayer", kwlist, &layerName, &z)){
+    return NULL;
+  }
+  std::string layer_name(layerName);
+  self->s->addProbeLayer(layer_name, z);
+  Py_RETURN_NONE;
+}
+
 static PyObject* MESH_SimulationPlanar_SetThread(MESH_SimulationPlanar *self, PyObject *args, PyObject *kwds){
-  static char *kwlist[] = { (char*)"num_thread", NULL };
+  static char *kwlist[] = { (char*)"num_thread", (char*)"policy", NULL };
 	int thread;
-	if(!PyArg_ParseTupleAndKeywords(args, kwds, "i:SetThread", kwlist, &thread)){ 
+  char* threadPolicy = (char*)"Auto";
+	if(!PyArg_ParseTupleAndKeywords(args, kwds, "i|s:SetThread", kwlist, &thread, &threadPolicy)){ 
       return NULL; 
   }
-  self->s->setThread(thread);
+  std::string policy(threadPolicy);
+  self->s->setThread(thread, policy);
   Py_RETURN_NONE;
 }
 
 static PyObject* MESH_SimulationPlanar_InitSimulation(MESH_SimulationPlanar *self, PyObject *args){
-  self->s->initSimulation();
+  if(!MESH_CallWithoutGIL(self->busy, [&](){ self->s->initSimulation(); })){
+    return NULL;
+  }
   Py_RETURN_NONE;
 }
 
@@ -531,6 +936,98 @@ static PyObject* MESH_SimulationPlanar_GetPhi(MESH_SimulationPlanar *self, PyObj
   return phi_value;
 }
 
+static PyObject* MESH_SimulationPlanar_GetPhiAtProbes(MESH_SimulationPlanar *self, PyObject *args){
+  double* phi = self->s->getPhiAtProbes();
+  int num_omega = self->s->getNumOfOmega();
+  int num_probe = self->s->getNumOfProbe();
+  PyObject* phi_value = PyTuple_New(num_probe);
+  for(int p = 0; p < num_probe; p++){
+    PyObject* phi_probe = PyTuple_New(num_omega);
+    for(int i = 0; i < num_omega; i++){
+      PyTuple_SetItem(phi_probe, i, PyFloat_FromDouble(phi[p * num_omega + i]));
+    }
+    PyTuple_SetItem(phi_value, p, phi_probe);
+  }
+  return phi_value;
+}
+
+static PyObject* MESH_SimulationPlanar_GetPhiOnKGrid(MESH_SimulationPlanar *self, PyObject *args, PyObject *kwds){
+  static char* kwlist[] = {(char*)"omega_index", (char*)"probe_index", NULL};
+  int omega_index, probe_index = 0;
+  if(!PyArg_ParseTupleAndKeywords(args, kwds, "i|i:GetPhiOnKGrid", kwlist, &omega_index, &probe_index)){
+    return NULL;
+  }
+  double* phi = self->s->getPhiOnKGrid();
+  int num_kx = self->s->getNumOfKx();
+  int num_ky = self->s->getNumOfKy();
+  int num_probe = self->s->getNumOfProbe();
+  if(omega_index < 0 || omega_index >= self->s->getNumOfOmega() || probe_index < 0 || probe_index >= num_probe){
+    PyErr_SetString(PyExc_IndexError, "index out of range");
+    return NULL;
+  }
+  PyObject* phi_value = PyTuple_New(num_kx);
+  for(int i = 0; i < num_kx; i++){
+    PyObject* phi_kx = PyTuple_New(num_ky);
+    for(int j = 0; j < num_ky; j++){
+      PyTuple_SetItem(phi_kx, j, PyFloat_FromDouble(phi[((static_cast<size_t>(omega_index) * num_kx + i) * num_ky + j) * num_probe + probe_index]));
+    }
+    PyTuple_SetItem(phi_value, i, phi_kx);
+  }
+  return phi_value;
+}
+
+static PyObject* MESH_SimulationPlanar_OptRetainKGrid(MESH_SimulationPlanar *self, PyObject *args){
+  self->s->optRetainKGrid();
+  Py_RETURN_NONE;
+}
+
+static PyObject* MESH_SimulationPlanar_OptCheckpoint(MESH_SimulationPlanar *self, PyObject *args, PyObject *kwds){
+  static char* kwlist[] = {(char*)"file_name", (char*)"interval", NULL};
+  const char* fileName;
+  double interval = 600;
+  if(!PyArg_ParseTupleAndKeywords(args, kwds, "s|d:OptCheckpoint", kwlist, &fileName, &interval)){
+    return NULL;
+  }
+  std::string file_name(fileName);
+  self->s->optCheckpoint(file_name, interval);
+  Py_RETURN_NONE;
+}
+
+static PyObject* MESH_SimulationPlanar_OptProfile(MESH_SimulationPlanar *self, PyObject *args, PyObject *kwds){
+  static char* kwlist[] = {(char*)"file_name", (char*)"format", NULL};
+  const char* fileName = "";
+  const char* format = "JSON";
+  if(!PyArg_ParseTupleAndKeywords(args, kwds, "|ss:OptProfile", kwlist, &fileName, &format)){
+    return NULL;
+  }
+  std::string file_name(fileName), format_name(format);
+  self->s->optProfile(file_name, format_name);
+  Py_RETURN_NONE;
+}
+
+static PyObject* MESH_SimulationPlanar_GetPhiBySource(MESH_SimulationPlanar *self, PyObject *args){
+  int num_omega = self->s->getNumOfOmega();
+  std::vector<std::string> names = self->s->getSourceLayerNames();
+  const POLARIZATION polars[3] = {BOTH_, TE_, TM_};
+  const char* keys[3] = {"total", "TE", "TM"};
+  PyObject* phi_value = PyDict_New();
+  for(size_t l = 0; l < names.size(); l++){
+    PyObject* phi_layer = PyDict_New();
+    for(int k = 0; k < 3; k++){
+      double* phi = self->s->getPhiBySource(names[l], polars[k]);
+      PyObject* phi_polar = PyTuple_New(num_omega);
+      for(int i = 0; i < num_omega; i++){
+        PyTuple_SetItem(phi_polar, i, PyFloat_FromDouble(phi[i]));
+      }
+      PyDict_SetItemString(phi_layer, keys[k], phi_polar);
+      Py_DECREF(phi_polar);
+    }
+    PyDict_SetItemString(phi_value, names[l].c_str(), phi_layer);
+    Py_DECREF(phi_layer);
+  }
+  return phi_value;
+}
+
 static PyObject* MESH_SimulationPlanar_GetOmega(MESH_SimulationPlanar *self, PyObject *args){
   double* omega = self->s->getOmega();
   int num_omega = self->s->getNumOfOmega();
@@ -588,7 +1085,10 @@ static PyObject* MESH_SimulationPlanar_GetPhiAtKxKy(MESH_SimulationPlanar *self,
   if(!PyArg_ParseTupleAndKeywords(args, kwds, "id|d:GetPhiAtKxKy", kwlist, &omega_index, &kx, &ky)){ 
     return NULL; 
   }
-  double value = self->s->getPhiAtKxKy(omega_index, kx, ky);
+  double value;
+  if(!MESH_CallWithoutGIL(self->busy, [&](){ value = self->s->getPhiAtKxKy(omega_index, kx, ky); })){
+    return NULL;
+  }
   return PyFloat_FromDouble(value);
 }
 
@@ -598,18 +1098,14 @@ static PyObject* MESH_SimulationPlanar_OutputSysInfo(MESH_SimulationPlanar *self
 }
 
 static PyObject* MESH_SimulationPlanar_OptPrintIntermediate(MESH_SimulationPlanar *self, PyObject *args, PyObject *kwds){
-  static char* kwlist[] = {(char*)"output_flag", NULL };
+  static char* kwlist[] = {(char*)"output_flag", (char*)"format", NULL };
   char* outputFlag = (char*)"";
-  if(!PyArg_ParseTupleAndKeywords(args, kwds, "|s:OptPrintIntermediate", kwlist, &outputFlag)){ 
+  char* outputFormat = (char*)"Text";
+  if(!PyArg_ParseTupleAndKeywords(args, kwds, "|ss:OptPrintIntermediate", kwlist, &outputFlag, &outputFormat)){ 
     return NULL; 
   }
-  std::string output_flag(outputFlag);
-  if(output_flag == ""){
-    self->s->optPrintIntermediate();
-  }
-  else{
-    self->s->optPrintIntermediate(output_flag);
-  }
+  std::string output_flag(outputFlag), format(outputFormat);
+  self->s->optPrintIntermediate(output_flag, format);
   Py_RETURN_NONE;
 }
 
@@ -623,6 +1119,11 @@ static PyObject* MESH_SimulationPlanar_OptOnlyComputeTM(MESH_SimulationPlanar *s
   Py_RETURN_NONE;
 }
 
+static PyObject* MESH_SimulationPlanar_OptUseEigenContinuation(MESH_SimulationPlanar *self, PyObject *args){
+  self->s->optUseEigenContinuation();
+  Py_RETURN_NONE;
+}
+
 static PyObject* MESH_SimulationPlanar_SetKxIntegral(MESH_SimulationPlanar *self, PyObject *args, PyObject *kwds){
   static char* kwlist[] = {(char*)"num_points", (char*)"integral_end", NULL};
   int num_points;
@@ -688,10 +1189,16 @@ static PyObject* MESH_SimulationPlanar_SetKyIntegralSym(MESH_SimulationPlanar *s
 }
 
 static PyObject* MESH_SimulationPlanar_IntegrateKxKy(MESH_SimulationPlanar *self, PyObject *args){
-  self->s->integrateKxKy();
+  if(!MESH_CallWithoutGIL(self->busy, [&](){ self->s->integrateKxKy(); })){
+    return NULL;
+  }
   Py_RETURN_NONE;
 }
 
+static PyObject* MESH_SimulationPlanar_StartIntegrateKxKy(MESH_SimulationPlanar *self, PyObject *args){
+  return MESH_StartIntegrateKxKy((PyObject*)self, self->s, self->busy);
+}
+
 
 static PyObject* MESH_SimulationPlanar_IntegrateKxKyMPI(MESH_SimulationPlanar *self, PyObject *args, PyObject *kwds){
   static char* kwlist[] = {(char*)"rank", (char*)"size", NULL};
@@ -699,10 +1206,76 @@ static PyObject* MESH_SimulationPlanar_IntegrateKxKyMPI(MESH_SimulationPlanar *s
   if(!PyArg_ParseTupleAndKeywords(args, kwds, "ii:IntegrateKxKyMPI", kwlist, &rank, &size)){ 
     return NULL; 
   }
-  self->s->integrateKxKyMPI(rank, size);
+  if(!MESH_CallWithoutGIL(self->busy, [&](){ self->s->integrateKxKyMPI(rank, size); })){
+    return NULL;
+  }
   Py_RETURN_NONE;
 }
 
+static PyObject* MESH_SimulationPlanar_AddSweepParameter(MESH_SimulationPlanar *self, PyObject *args, PyObject *kwds){
+  static char* kwlist[] = {(char*)"layer_name", (char*)"parameter", (char*)"pattern_index", NULL};
+  const char *layerName, *parameter;
+  int pattern_index = 0;
+  if(!PyArg_ParseTupleAndKeywords(args, kwds, "ss|i:AddSweepParameter", kwlist, &layerName, &parameter, &pattern_index)){
+    return NULL;
+  }
+  std::string layer_name(layerName), parameter_name(parameter);
+  self->s->addSweepParameter(layer_name, parameter_name, pattern_index);
+  Py_RETURN_NONE;
+}
+
+static PyObject* MESH_SimulationPlanar_AddSweepVariant(MESH_SimulationPlanar *self, PyObject *args, PyObject *kwds){
+  static char* kwlist[] = {(char*)"values", NULL};
+  struct values_converter_data values_data;
+  if(!PyArg_ParseTupleAndKeywords(args, kwds, "O&:AddSweepVariant", kwlist, &values_converter, &values_data)){
+    return NULL;
+  }
+  self->s->addSweepVariant(values_data.values);
+  Py_RETURN_NONE;
+}
+
+static PyObject* MESH_SimulationPlanar_RunSweep(MESH_SimulationPlanar *self, PyObject *args){
+  if(!MESH_CallWithoutGIL(self->busy, [&](){ self->s->runSweep(); })){
+    return NULL;
+  }
+  Py_RETURN_NONE;
+}
+
+static PyObject* MESH_SimulationPlanar_RunSweepMPI(MESH_SimulationPlanar *self, PyObject *args, PyObject *kwds){
+  static char* kwlist[] = {(char*)"rank", (char*)"size", NULL};
+  int rank, size;
+  if(!PyArg_ParseTupleAndKeywords(args, kwds, "ii:RunSweepMPI", kwlist, &rank, &size)){
+    return NULL;
+  }
+  if(!MESH_CallWithoutGIL(self->busy, [&](){ self->s->runSweepMPI(rank, size); })){
+    return NULL;
+  }
+  Py_RETURN_NONE;
+}
+
+static PyObject* MESH_SimulationPlanar_GetNumOfSweepVariant(MESH_SimulationPlanar *self, PyObject *args){
+  return PyLong_FromLong(self->s->getNumOfSweepVariant());
+}
+
+static PyObject* MESH_SimulationPlanar_GetSweepPhi(MESH_SimulationPlanar *self, PyObject *args, PyObject *kwds){
+  static char* kwlist[] = {(char*)"variant_index", (char*)"probe_index", NULL};
+  int variant_index, probe_index = 0;
+  if(!PyArg_ParseTupleAndKeywords(args, kwds, "i|i:GetSweepPhi", kwlist, &variant_index, &probe_index)){
+    return NULL;
+  }
+  if(variant_index < 0 || variant_index >= self->s->getNumOfSweepVariant() || probe_index < 0 || probe_index >= self->s->getNumOfProbe()){
+    PyErr_SetString(PyExc_IndexError, "index out of range");
+    return NULL;
+  }
+  double* phi = self->s->getSweepPhi(variant_index, probe_index);
+  int num_omega = self->s->getNumOfOmega();
+  PyObject* phi_value = PyTuple_New(num_omega);
+  for(int i = 0; i < num_omega; i++){
+    PyTuple_SetItem(phi_value, i, PyFloat_FromDouble(phi[i]));
+  }
+  return phi_value;
+}
+
 static PyObject* MESH_SimulationPlanar_OptUseQuadgk(MESH_SimulationPlanar *self, PyObject *args){
   self->s->optUseQuadgk();
   Py_RETURN_NONE;
@@ -731,30 +1304,52 @@ static PyObject* MESH_SimulationPlanar_GetPhiAtKParallel(MESH_SimulationPlanar *
   if(!PyArg_ParseTupleAndKeywords(args, kwds, "id:GetPhiAtKParallel", kwlist, &omega_index, &k_parallel)){ 
     return NULL; 
   }
-  return PyFloat_FromDouble(self->s->getPhiAtKParallel(omega_index, k_parallel));
+  double value;
+  if(!MESH_CallWithoutGIL(self->busy, [&](){ value = self->s->getPhiAtKParallel(omega_index, k_parallel); })){
+    return NULL;
+  }
+  return PyFloat_FromDouble(value);
 }
 
 static PyObject* MESH_SimulationPlanar_IntegrateKParallel(MESH_SimulationPlanar *self, PyObject *args){
-  self->s->integrateKParallel();
+  if(!MESH_CallWithoutGIL(self->busy, [&](){ self->s->integrateKParallel(); })){
+    return NULL;
+  }
   Py_RETURN_NONE;
 }
 
 
+static PyObject* MESH_SimulationPlanar_GetAttr(MESH_SimulationPlanar *self, PyObject *name){
+  return MESH_Simulation_GetAttr((PyObject*)self, name, self->busy);
+}
 /* METHOD TABLE */
 static PyMethodDef MESH_SimulationPlanar_methods[] = {
   {"AddMaterial",                   (PyCFunction) MESH_SimulationPlanar_AddMaterial,                   METH_VARARGS | METH_KEYWORDS, "Adding new material to the simulation"},
   {"SetMaterial",                   (PyCFunction) MESH_SimulationPlanar_SetMaterial,                   METH_VARARGS | METH_KEYWORDS, "Setting material property"},
+  {"AddMaterialDrude",              (PyCFunction) MESH_SimulationPlanar_AddMaterialDrude,              METH_VARARGS | METH_KEYWORDS, "Adding a Drude material to the simulation"},
+  {"AddMaterialLorentz",            (PyCFunction) MESH_SimulationPlanar_AddMaterialLorentz,            METH_VARARGS | METH_KEYWORDS, "Adding a Lorentz material to the simulation"},
+  {"AddMaterialDrudeLorentz",       (PyCFunction) MESH_SimulationPlanar_AddMaterialDrudeLorentz,       METH_VARARGS | METH_KEYWORDS, "Adding a Drude-Lorentz material to the simulation"},
+  {"AddMaterialUniaxial",           (PyCFunction) MESH_SimulationPlanar_AddMaterialUniaxial,           METH_VARARGS | METH_KEYWORDS, "Adding a uniaxial material to the simulation"},
+  {"SetOmega",                      (PyCFunction) MESH_SimulationPlanar_SetOmega,                      METH_VARARGS | METH_KEYWORDS, "Setting the omega grid of the simulation"},
   {"AddLayer",                      (PyCFunction) MESH_SimulationPlanar_AddLayer,                      METH_VARARGS | METH_KEYWORDS, "Adding new layer to the simulation"},
   {"SetLayer",                      (PyCFunction) MESH_SimulationPlanar_SetLayer,                      METH_VARARGS | METH_KEYWORDS, "Setting layer property"},
   {"SetLayerThickness",             (PyCFunction) MESH_SimulationPlanar_SetLayerThickness,             METH_VARARGS | METH_KEYWORDS, "Setting layer thickness"},
   {"AddLayerCopy",                  (PyCFunction) MESH_SimulationPlanar_AddLayerCopy,                  METH_VARARGS | METH_KEYWORDS, "Making a copy of existing layer"},
+  {"AddLayerRepeat",                (PyCFunction) MESH_SimulationPlanar_AddLayerRepeat,                METH_VARARGS | METH_KEYWORDS, "Repeating existing layers periodically"},
   {"DeleteLayer",                   (PyCFunction) MESH_SimulationPlanar_DeleteLayer,                   METH_VARARGS | METH_KEYWORDS, "Deleting an existing layer"},
   {"SetSourceLayer",                (PyCFunction) MESH_SimulationPlanar_SetSourceLayer,                METH_VARARGS | METH_KEYWORDS, "Setting a source layer"},
   {"SetProbeLayer",                 (PyCFunction) MESH_SimulationPlanar_SetProbeLayer,                 METH_VARARGS | METH_KEYWORDS, "Setting the probe layer"},
   {"SetProbeLayerZCoordinate",      (PyCFunction) MESH_SimulationPlanar_SetProbeLayerZCoordinate,      METH_VARARGS | METH_KEYWORDS, "Setting the z-coordinate in the probe layer"},
+  {"AddProbeLayer",                 (PyCFunction) MESH_SimulationPlanar_AddProbeLayer,                 METH_VARARGS | METH_KEYWORDS, "Adding an additional probe layer"},
   {"SetThread",                     (PyCFunction) MESH_SimulationPlanar_SetThread,                     METH_VARARGS | METH_KEYWORDS, "Setting the number of thread"},
   {"InitSimulation",                (PyCFunction) MESH_SimulationPlanar_InitSimulation,                METH_VARARGS | METH_KEYWORDS, "Initializing simulation"},
   {"GetPhi",                        (PyCFunction) MESH_SimulationPlanar_GetPhi,                        METH_VARARGS | METH_KEYWORDS, "Getting the value of Phi"},
+  {"GetPhiAtProbes",                (PyCFunction) MESH_SimulationPlanar_GetPhiAtProbes,                METH_VARARGS | METH_KEYWORDS, "Getting the value of Phi at all probes"},
+  {"GetPhiBySource",                (PyCFunction) MESH_SimulationPlanar_GetPhiBySource,                METH_VARARGS | METH_KEYWORDS, "Getting the value of Phi from each source layer"},
+  {"GetPhiOnKGrid",                 (PyCFunction) MESH_SimulationPlanar_GetPhiOnKGrid,                 METH_VARARGS | METH_KEYWORDS, "Getting the integrand on the full k grid"},
+  {"OptRetainKGrid",                (PyCFunction) MESH_SimulationPlanar_OptRetainKGrid,                METH_VARARGS | METH_KEYWORDS, "Keeping the integrand on the full k grid"},
+  {"OptCheckpoint",                 (PyCFunction) MESH_SimulationPlanar_OptCheckpoint,                 METH_VARARGS | METH_KEYWORDS, "Checkpointing the k space integration"},
+  {"OptProfile",                    (PyCFunction) MESH_SimulationPlanar_OptProfile,                    METH_VARARGS | METH_KEYWORDS, "Timing the phases of the simulation"},
   {"GetOmega",                      (PyCFunction) MESH_SimulationPlanar_GetOmega,                      METH_VARARGS | METH_KEYWORDS, "Getting all the omega values"},
   {"GetEpsilon",                    (PyCFunction) MESH_SimulationPlanar_GetEpsilon,                    METH_VARARGS | METH_KEYWORDS, "Getting epsilon at one frequency"},
   {"OutputLayerPatternRealization", (PyCFunction) MESH_SimulationPlanar_OutputLayerPatternRealization, METH_VARARGS | METH_KEYWORDS, "Outputting dielectric reconstruction"},
@@ -764,12 +1359,20 @@ static PyMethodDef MESH_SimulationPlanar_methods[] = {
   {"OptPrintIntermediate",          (PyCFunction) MESH_SimulationPlanar_OptPrintIntermediate,          METH_VARARGS | METH_KEYWORDS, "Option to output intermediate results"},
   {"OptOnlyComputeTE",              (PyCFunction) MESH_SimulationPlanar_OptOnlyComputeTE,              METH_VARARGS | METH_KEYWORDS, "Option to only compute TE mode"},
   {"OptOnlyComputeTM",              (PyCFunction) MESH_SimulationPlanar_OptOnlyComputeTM,              METH_VARARGS | METH_KEYWORDS, "Option to only compute TM mode"},
+  {"OptUseEigenContinuation",       (PyCFunction) MESH_SimulationPlanar_OptUseEigenContinuation,       METH_VARARGS | METH_KEYWORDS, "Option to continue eigen solutions along ky"},
   {"SetKxIntegral",                 (PyCFunction) MESH_SimulationPlanar_SetKxIntegral,                 METH_VARARGS | METH_KEYWORDS, "Setting kx integration range"},
   {"SetKyIntegral",                 (PyCFunction) MESH_SimulationPlanar_SetKyIntegral,                 METH_VARARGS | METH_KEYWORDS, "Setting kx integration range"},
   {"SetKxIntegralSym",              (PyCFunction) MESH_SimulationPlanar_SetKxIntegralSym,              METH_VARARGS | METH_KEYWORDS, "Setting kx integration range in symmetric case"},
   {"SetKyIntegralSym",              (PyCFunction) MESH_SimulationPlanar_SetKyIntegralSym,              METH_VARARGS | METH_KEYWORDS, "Setting ky integration range in symmetric case"},
   {"IntegrateKxKy",                 (PyCFunction) MESH_SimulationPlanar_IntegrateKxKy,                 METH_VARARGS | METH_KEYWORDS, "Action to integrate kx and ky"},
+  {"StartIntegrateKxKy",            (PyCFunction) MESH_SimulationPlanar_StartIntegrateKxKy,            METH_NOARGS, "Action to integrate kx and ky in the background"},
   {"IntegrateKxKyMPI",              (PyCFunction) MESH_SimulationPlanar_IntegrateKxKyMPI,              METH_VARARGS | METH_KEYWORDS, "Action to integrate kx and ky using MPI"},
+  {"AddSweepParameter",             (PyCFunction) MESH_SimulationPlanar_AddSweepParameter,             METH_VARARGS | METH_KEYWORDS, "Adding a parameter to the structure sweep"},
+  {"AddSweepVariant",               (PyCFunction) MESH_SimulationPlanar_AddSweepVariant,               METH_VARARGS | METH_KEYWORDS, "Adding a variant to the structure sweep"},
+  {"RunSweep",                      (PyCFunction) MESH_SimulationPlanar_RunSweep,                      METH_NOARGS, "Action to run the structure sweep"},
+  {"RunSweepMPI",                   (PyCFunction) MESH_SimulationPlanar_RunSweepMPI,                   METH_VARARGS | METH_KEYWORDS, "Action to run the structure sweep using MPI"},
+  {"GetNumOfSweepVariant",          (PyCFunction) MESH_SimulationPlanar_GetNumOfSweepVariant,          METH_NOARGS, "Getting the number of sweep variants"},
+  {"GetSweepPhi",                   (PyCFunction) MESH_SimulationPlanar_GetSweepPhi,                   METH_VARARGS | METH_KEYWORDS, "Getting the value of Phi of a sweep variant"},
   {"OptUseQuadgk",                  (PyCFunction) MESH_SimulationPlanar_OptUseQuadgk,                  METH_VARARGS | METH_KEYWORDS, "Option to use Quadgk"},
   {"OptUseQuadgl",                  (PyCFunction) MESH_SimulationPlanar_OptUseQuadgl,                  METH_VARARGS | METH_KEYWORDS, "Option to use Quadgk"},
   {"SetKParallelIntegral",          (PyCFunction) MESH_SimulationPlanar_SetKParallel,                  METH_VARARGS | METH_KEYWORDS, "Setting kParallel integration range"},
@@ -796,7 +1399,7 @@ static PyTypeObject MESH_SimulationPlanar_Type = {
   0,                         /* tp_hash  */
   0,                         /* tp_call */
   0,                         /* tp_str */
-  0,                         /* tp_getattro */
+  (getattrofunc)MESH_SimulationPlanar_GetAttr, /* tp_getattro */
   0,                         /* tp_setattro */
   0,                         /* tp_as_buffer */
   Py_TPFLAGS_DEFAULT,        /* tp_flags */ 
@@ -828,6 +1431,8 @@ static PyTypeObject MESH_SimulationPlanar_Type = {
 typedef struct {
     PyObject_HEAD; // <----- PUTTING THIS FIRST INHERITS THE BASE PYTHON CLASS!!!
     SimulationGrating* s;
+    // set while StartIntegrateKxKy runs
+    std::atomic<bool>* busy;
 } MESH_SimulationGrating;
 
 
@@ -836,6 +1441,7 @@ static void MESH_SimulationGrating_dealloc(MESH_SimulationGrating* self){
   // Nothing to deallocate. Use this in case the base
   // struct contains a pointer or so.
   delete self->s;
+  delete self->busy;
   Py_TYPE(self)->tp_free((PyObject*)self);
 }
 
@@ -847,6 +1453,7 @@ static PyObject *MESH_SimulationGrating_new(PyTypeObject *type, PyObject *args,
    // Init vars if any ...
    if (self != NULL){
       self->s = new SimulationGrating();
+      self->busy = new std::atomic<bool>(false);
    }
    return (PyObject*) self;
 }
@@ -873,6 +1480,67 @@ static PyObject* MESH_SimulationGrating_AddMaterial(MESH_SimulationGrating *self
 
 }
 
+static PyObject* MESH_SimulationGrating_AddMaterialDrude(MESH_SimulationGrating *self, PyObject *args, PyObject *kwds){
+  static char *kwlist[] = { (char*)"material_name", (char*)"eps_inf", (char*)"omega_p", (char*)"gamma", NULL };
+  const char *materialName;
+  DispersionModel model;
+  if(!PyArg_ParseTupleAndKeywords(args, kwds, "sddd:AddMaterialDrude", kwlist, &materialName, &model.epsInf, &model.omegaP, &model.gammaP)){
+    return NULL;
+  }
+  std::string material_name(materialName);
+  self->s->addMaterial(material_name, model);
+  Py_RETURN_NONE;
+}
+
+static PyObject* MESH_SimulationGrating_AddMaterialLorentz(MESH_SimulationGrating *self, PyObject *args, PyObject *kwds){
+  static char *kwlist[] = { (char*)"material_name", (char*)"eps_inf", (char*)"oscillators", NULL };
+  const char *materialName;
+  DispersionModel model;
+  struct oscillator_converter_data oscillator_data;
+  if(!PyArg_ParseTupleAndKeywords(args, kwds, "sdO&:AddMaterialLorentz", kwlist, &materialName, &model.epsInf, &oscillator_converter, &oscillator_data)){
+    return NULL;
+  }
+  model.oscillators = oscillator_data.oscillators;
+  std::string material_name(materialName);
+  self->s->addMaterial(material_name, model);
+  Py_RETURN_NONE;
+}
+
+static PyObject* MESH_SimulationGrating_AddMaterialDrudeLorentz(MESH_SimulationGrating *self, PyObject *args, PyObject *kwds){
+  static char *kwlist[] = { (char*)"material_name", (char*)"eps_inf", (char*)"omega_p", (char*)"gamma", (char*)"oscillators", NULL };
+  const char *materialName;
+  DispersionModel model;
+  struct oscillator_converter_data oscillator_data;
+  if(!PyArg_ParseTupleAndKeywords(args, kwds, "sdddO&:AddMaterialDrudeLorentz", kwlist, &materialName, &model.epsInf, &model.omegaP, &model.gammaP, &oscillator_converter, &oscillator_data)){
+    return NULL;
+  }
+  model.oscillators = oscillator_data.oscillators;
+  std::string material_name(materialName);
+  self->s->addMaterial(material_name, model);
+  Py_RETURN_NONE;
+}
+
+static PyObject* MESH_SimulationGrating_AddMaterialUniaxial(MESH_SimulationGrating *self, PyObject *args, PyObject *kwds){
+  static char *kwlist[] = { (char*)"material_name", (char*)"ordinary", (char*)"extraordinary", NULL };
+  const char *materialName, *ordinary, *extraordinary;
+  if(!PyArg_ParseTupleAndKeywords(args, kwds, "sss:AddMaterialUniaxial", kwlist, &materialName, &ordinary, &extraordinary)){
+    return NULL;
+  }
+  std::string material_name(materialName), ordinary_name(ordinary), extraordinary_name(extraordinary);
+  self->s->addMaterialUniaxial(material_name, ordinary_name, extraordinary_name);
+  Py_RETURN_NONE;
+}
+
+static PyObject* MESH_SimulationGrating_SetOmega(MESH_SimulationGrating *self, PyObject *args, PyObject *kwds){
+  static char *kwlist[] = { (char*)"omega", NULL };
+  struct omega_converter_data omega_data;
+  if(!PyArg_ParseTupleAndKeywords(args, kwds, "O&:SetOmega", kwlist, &omega_converter, &omega_data)){
+    return NULL;
+  }
+  self->s->setOmega(omega_data.omega);
+  Py_RETURN_NONE;
+}
+
 static PyObject* MESH_SimulationGrating_SetMaterial(MESH_SimulationGrating *self, PyObject *args, PyObject *kwds){
   static char *kwlist[] = { (char*)"material_name", (char*)"epsilon", NULL };
 	const char *materialName;
@@ -965,6 +1633,17 @@ static PyObject* MESH_SimulationGrating_AddLayerCopy(MESH_SimulationGrating *sel
   Py_RETURN_NONE;
 }
 
+static PyObject* MESH_SimulationGrating_AddLayerRepeat(MESH_SimulationGrating *self, PyObject *args, PyObject *kwds){
+  static char *kwlist[] = { (char*)"layer_names", (char*)"count", NULL };
+  struct names_converter_data names_data;
+  int count;
+  if(!PyArg_ParseTupleAndKeywords(args, kwds, "O&i:AddLayerRepeat", kwlist, &names_converter, &names_data, &count)){
+    return NULL;
+  }
+  self->s->addLayerRepeat(names_data.names, count);
+  Py_RETURN_NONE;
+}
+
 static PyObject* MESH_SimulationGrating_DeleteLayer(MESH_SimulationGrating *self, PyObject *args, PyObject *kwds){
   static char *kwlist[] = { (char*)"layer_name", NULL };
 	const char *layerName;
@@ -1004,22 +1683,38 @@ static PyObject* MESH_SimulationGrating_SetProbeLayerZCoordinate(MESH_Simulation
 	if(!PyArg_ParseTupleAndKeywords(args, kwds, "d:SetProbeLayerZCoordinate", kwlist, &z)){ 
       return NULL; 
   }
-  self->s->setProbeLayerZCoordinate(z);
+  self->s->setProbeLayerZCoordinate(z);
+  Py_RETURN_NONE;
+}
+
+static PyObject* MESH_SimulationGrating_AddProbeLayer(MESH_SimulationGrating *self, PyObject *args, PyObject *kwds){
+  static char *kwlist[] = { (char*)"layer_name", (char*)"z", NULL };
+  const char *layerName;
+  double z = -1;
+  if(!PyArg_ParseTupleAndKeywords(args, kwds, "s|d:AddProbeLayer", kwlist, &layerName, &z)){
+    return NULL;
+  }
+  std::string layer_name(layerName);
+  self->s->addProbeLayer(layer_name, z);
   Py_RETURN_NONE;
 }
 
 static PyObject* MESH_SimulationGrating_SetThread(MESH_SimulationGrating *self, PyObject *args, PyObject *kwds){
-  static char *kwlist[] = { (char*)"num_thread", NULL };
+  static char *kwlist[] = { (char*)"num_thread", (char*)"policy", NULL };
 	int thread;
-	if(!PyArg_ParseTupleAndKeywords(args, kwds, "i:SetThread", kwlist, &thread)){ 
+  char* threadPolicy = (char*)"Auto";
+	if(!PyArg_ParseTupleAndKeywords(args, kwds, "i|s:SetThread", kwlist, &thread, &threadPolicy)){ 
       return NULL; 
   }
-  self->s->setThread(thread);
+  std::string policy(threadPolicy);
+  self->s->setThread(thread, policy);
   Py_RETURN_NONE;
 }
 
 static PyObject* MESH_SimulationGrating_InitSimulation(MESH_SimulationGrating *self, PyObject *args){
-  self->s->initSimulation();
+  if(!MESH_CallWithoutGIL(self->busy, [&](){ self->s->initSimulation(); })){
+    return NULL;
+  }
   Py_RETURN_NONE;
 }
 
@@ -1033,6 +1728,98 @@ static PyObject* MESH_SimulationGrating_GetPhi(MESH_SimulationGrating *self, PyO
   return phi_value;
 }
 
+static PyObject* MESH_SimulationGrating_GetPhiAtProbes(MESH_SimulationGrating *self, PyObject *args){
+  double* phi = self->s->getPhiAtProbes();
+  int num_omega = self->s->getNumOfOmega();
+  int num_probe = self->s->getNumOfProbe();
+  PyObject* phi_value = PyTuple_New(num_probe);
+  for(int p = 0; p < num_probe; p++){
+    PyObject* phi_probe = PyTuple_New(num_omega);
+    for(int i = 0; i < num_omega; i++){
+      PyTuple_SetItem(phi_probe, i, PyFloat_FromDouble(phi[p * num_omega + i]));
+    }
+    PyTuple_SetItem(phi_value, p, phi_probe);
+  }
+  return phi_value;
+}
+
+static PyObject* MESH_SimulationGrating_GetPhiOnKGrid(MESH_SimulationGrating *self, PyObject *args, PyObject *kwds){
+  static char* kwlist[] = {(char*)"omega_index", (char*)"probe_index", NULL};
+  int omega_index, probe_index = 0;
+  if(!PyArg_ParseTupleAndKeywords(args, kwds, "i|i:GetPhiOnKGrid", kwlist, &omega_index, &probe_index)){
+    return NULL;
+  }
+  double* phi = self->s->getPhiOnKGrid();
+  int num_kx = self->s->getNumOfKx();
+  int num_ky = self->s->getNumOfKy();
+  int num_probe = self->s->getNumOfProbe();
+  if(omega_index < 0 || omega_index >= self->s->getNumOfOmega() || probe_index < 0 || probe_index >= num_probe){
+    PyErr_SetString(PyExc_IndexError, "index out of range");
+    return NULL;
+  }
+  PyObject* phi_value = PyTuple_New(num_kx);
+  for(int i = 0; i < num_kx; i++){
+    PyObject* phi_kx = PyTuple_New(num_ky);
+    for(int j = 0; j < num_ky; j++){
+      PyTuple_SetItem(phi_kx, j, PyFloat_FromDouble(phi[((static_cast<size_t>(omega_index) * num_kx + i) * num_ky + j) * num_probe + probe_index]));
+    }
+    PyTuple_SetItem(phi_value, i, phi_kx);
+  }
+  return phi_value;
+}
+
+static PyObject* MESH_SimulationGrating_OptRetainKGrid(MESH_SimulationGrating *self, PyObject *args){
+  self->s->optRetainKGrid();
+  Py_RETURN_NONE;
+}
+
+static PyObject* MESH_SimulationGrating_OptCheckpoint(MESH_SimulationGrating *self, PyObject *args, PyObject *kwds){
+  static char* kwlist[] = {(char*)"file_name", (char*)"interval", NULL};
+  const char* fileName;
+  double interval = 600;
+  if(!PyArg_ParseTupleAndKeywords(args, kwds, "s|d:OptCheckpoint", kwlist, &fileName, &interval)){
+    return NULL;
+  }
+  std::string file_name(fileName);
+  self->s->optCheckpoint(file_name, interval);
+  Py_RETURN_NONE;
+}
+
+static PyObject* MESH_SimulationGrating_OptProfile(MESH_SimulationGrating *self, PyObject *args, PyObject *kwds){
+  static char* kwlist[] = {(char*)"file_name", (char*)"format", NULL};
+  const char* fileName = "";
+  const char* format = "JSON";
+  if(!PyArg_ParseTupleAndKeywords(args, kwds, "|ss:OptProfile", kwlist, &fileName, &format)){
+    return NULL;
+  }
+  std::string file_name(fileName), format_name(format);
+  self->s->optProfile(file_name, format_name);
+  Py_RETURN_NONE;
+}
+
+static PyObject* MESH_SimulationGrating_GetPhiBySource(MESH_SimulationGrating *self, PyObject *args){
+  int num_omega = self->s->getNumOfOmega();
+  std::vector<std::string> names = self->s->getSourceLayerNames();
+  const POLARIZATION polars[3] = {BOTH_, TE_, TM_};
+  const char* keys[3] = {"total", "TE", "TM"};
+  PyObject* phi_value = PyDict_New();
+  for(size_t l = 0; l < names.size(); l++){
+    PyObject* phi_layer = PyDict_New();
+    for(int k = 0; k < 3; k++){
+      double* phi = self->s->getPhiBySource(names[l], polars[k]);
+      PyObject* phi_polar = PyTuple_New(num_omega);
+      for(int i = 0; i < num_omega; i++){
+        PyTuple_SetItem(phi_polar, i, PyFloat_FromDouble(phi[i]));
+      }
+      PyDict_SetItemString(phi_layer, keys[k], phi_polar);
+      Py_DECREF(phi_polar);
+    }
+    PyDict_SetItemString(phi_value, names[l].c_str(), phi_layer);
+    Py_DECREF(phi_layer);
+  }
+  return phi_value;
+}
+
 static PyObject* MESH_SimulationGrating_GetOmega(MESH_SimulationGrating *self, PyObject *args){
   double* omega = self->s->getOmega();
   int num_omega = self->s->getNumOfOmega();
@@ -1090,7 +1877,10 @@ static PyObject* MESH_SimulationGrating_GetPhiAtKxKy(MESH_SimulationGrating *sel
   if(!PyArg_ParseTupleAndKeywords(args, kwds, "id|d:GetPhiAtKxKy", kwlist, &omega_index, &kx, &ky)){ 
     return NULL; 
   }
-  double value = self->s->getPhiAtKxKy(omega_index, kx, ky);
+  double value;
+  if(!MESH_CallWithoutGIL(self->busy, [&](){ value = self->s->getPhiAtKxKy(omega_index, kx, ky); })){
+    return NULL;
+  }
   return PyFloat_FromDouble(value);
 }
 
@@ -1100,18 +1890,14 @@ static PyObject* MESH_SimulationGrating_OutputSysInfo(MESH_SimulationGrating *se
 }
 
 static PyObject* MESH_SimulationGrating_OptPrintIntermediate(MESH_SimulationGrating *self, PyObject *args, PyObject *kwds){
-  static char* kwlist[] = {(char*)"output_flag", NULL };
+  static char* kwlist[] = {(char*)"output_flag", (char*)"format", NULL };
   char* outputFlag = (char*)"";
-  if(!PyArg_ParseTupleAndKeywords(args, kwds, "|s:OptPrintIntermediate", kwlist, &outputFlag)){ 
+  char* outputFormat = (char*)"Text";
+  if(!PyArg_ParseTupleAndKeywords(args, kwds, "|ss:OptPrintIntermediate", kwlist, &outputFlag, &outputFormat)){ 
     return NULL; 
   }
-  std::string output_flag(outputFlag);
-  if(output_flag == ""){
-    self->s->optPrintIntermediate();
-  }
-  else{
-    self->s->optPrintIntermediate(output_flag);
-  }
+  std::string output_flag(outputFlag), format(outputFormat);
+  self->s->optPrintIntermediate(output_flag, format);
   Py_RETURN_NONE;
 }
 
@@ -1125,6 +1911,11 @@ static PyObject* MESH_SimulationGrating_OptOnlyComputeTM(MESH_SimulationGrating
   Py_RETURN_NONE;
 }
 
+static PyObject* MESH_SimulationGrating_OptUseEigenContinuation(MESH_SimulationGrating *self, PyObject *args){
+  self->s->optUseEigenContinuation();
+  Py_RETURN_NONE;
+}
+
 static PyObject* MESH_SimulationGrating_SetKxIntegral(MESH_SimulationGrating *self, PyObject *args, PyObject *kwds){
   static char* kwlist[] = {(char*)"num_points", (char*)"integral_end", NULL};
   int num_points;
@@ -1190,10 +1981,16 @@ static PyObject* MESH_SimulationGrating_SetKyIntegralSym(MESH_SimulationGrating
 }
 
 static PyObject* MESH_SimulationGrating_IntegrateKxKy(MESH_SimulationGrating *self, PyObject *args){
-  self->s->integrateKxKy();
+  if(!MESH_CallWithoutGIL(self->busy, [&](){ self->s->integrateKxKy(); })){
+    return NULL;
+  }
   Py_RETURN_NONE;
 }
 
+static PyObject* MESH_SimulationGrating_StartIntegrateKxKy(MESH_SimulationGrating *self, PyObject *args){
+  return MESH_StartIntegrateKxKy((PyObject*)self, self->s, self->busy);
+}
+
 
 static PyObject* MESH_SimulationGrating_IntegrateKxKyMPI(MESH_SimulationGrating *self, PyObject *args, PyObject *kwds){
   static char* kwlist[] = {(char*)"rank", (char*)"size", NULL};
@@ -1201,10 +1998,76 @@ static PyObject* MESH_SimulationGrating_IntegrateKxKyMPI(MESH_SimulationGrating
   if(!PyArg_ParseTupleAndKeywords(args, kwds, "ii:IntegrateKxKyMPI", kwlist, &rank, &size)){ 
     return NULL; 
   }
-  self->s->integrateKxKyMPI(rank, size);
+  if(!MESH_CallWithoutGIL(self->busy, [&](){ self->s->integrateKxKyMPI(rank, size); })){
+    return NULL;
+  }
+  Py_RETURN_NONE;
+}
+
+static PyObject* MESH_SimulationGrating_AddSweepParameter(MESH_SimulationGrating *self, PyObject *args, PyObject *kwds){
+  static char* kwlist[] = {(char*)"layer_name", (char*)"parameter", (char*)"pattern_index", NULL};
+  const char *layerName, *parameter;
+  int pattern_index = 0;
+  if(!PyArg_ParseTupleAndKeywords(args, kwds, "ss|i:AddSweepParameter", kwlist, &layerName, &parameter, &pattern_index)){
+    return NULL;
+  }
+  std::string layer_name(layerName), parameter_name(parameter);
+  self->s->addSweepParameter(layer_name, parameter_name, pattern_index);
+  Py_RETURN_NONE;
+}
+
+static PyObject* MESH_SimulationGrating_AddSweepVariant(MESH_SimulationGrating *self, PyObject *args, PyObject *kwds){
+  static char* kwlist[] = {(char*)"values", NULL};
+  struct values_converter_data values_data;
+  if(!PyArg_ParseTupleAndKeywords(args, kwds, "O&:AddSweepVariant", kwlist, &values_converter, &values_data)){
+    return NULL;
+  }
+  self->s->addSweepVariant(values_data.values);
+  Py_RETURN_NONE;
+}
+
+static PyObject* MESH_SimulationGrating_RunSweep(MESH_SimulationGrating *self, PyObject *args){
+  if(!MESH_CallWithoutGIL(self->busy, [&](){ self->s->runSweep(); })){
+    return NULL;
+  }
+  Py_RETURN_NONE;
+}
+
+static PyObject* MESH_SimulationGrating_RunSweepMPI(MESH_SimulationGrating *self, PyObject *args, PyObject *kwds){
+  static char* kwlist[] = {(char*)"rank", (char*)"size", NULL};
+  int rank, size;
+  if(!PyArg_ParseTupleAndKeywords(args, kwds, "ii:RunSweepMPI", kwlist, &rank, &size)){
+    return NULL;
+  }
+  if(!MESH_CallWithoutGIL(self->busy, [&](){ self->s->runSweepMPI(rank, size); })){
+    return NULL;
+  }
   Py_RETURN_NONE;
 }
 
+static PyObject* MESH_SimulationGrating_GetNumOfSweepVariant(MESH_SimulationGrating *self, PyObject *args){
+  return PyLong_FromLong(self->s->getNumOfSweepVariant());
+}
+
+static PyObject* MESH_SimulationGrating_GetSweepPhi(MESH_SimulationGrating *self, PyObject *args, PyObject *kwds){
+  static char* kwlist[] = {(char*)"variant_index", (char*)"probe_index", NULL};
+  int variant_index, probe_index = 0;
+  if(!PyArg_ParseTupleAndKeywords(args, kwds, "i|i:GetSweepPhi", kwlist, &variant_index, &probe_index)){
+    return NULL;
+  }
+  if(variant_index < 0 || variant_index >= self->s->getNumOfSweepVariant() || probe_index < 0 || probe_index >= self->s->getNumOfProbe()){
+    PyErr_SetString(PyExc_IndexError, "index out of range");
+    return NULL;
+  }
+  double* phi = self->s->getSweepPhi(variant_index, probe_index);
+  int num_omega = self->s->getNumOfOmega();
+  PyObject* phi_value = PyTuple_New(num_omega);
+  for(int i = 0; i < num_omega; i++){
+    PyTuple_SetItem(phi_value, i, PyFloat_FromDouble(phi[i]));
+  }
+  return phi_value;
+}
+
 
 static PyObject* MESH_SimulationGrating_SetNumOfG(MESH_SimulationGrating *self, PyObject *args, PyObject *kwds){
   static char* kwlist[] = {(char*)"num_G",  NULL};
@@ -1244,21 +2107,37 @@ static PyObject* MESH_SimulationGrating_SetLayerPatternGrating(MESH_SimulationGr
 }
 
 
+static PyObject* MESH_SimulationGrating_GetAttr(MESH_SimulationGrating *self, PyObject *name){
+  return MESH_Simulation_GetAttr((PyObject*)self, name, self->busy);
+}
 /* METHOD TABLE */
 static PyMethodDef MESH_SimulationGrating_methods[] = {
   {"AddMaterial",                   (PyCFunction) MESH_SimulationGrating_AddMaterial,                   METH_VARARGS | METH_KEYWORDS, "Adding new material to the simulation"},
   {"SetMaterial",                   (PyCFunction) MESH_SimulationGrating_SetMaterial,                   METH_VARARGS | METH_KEYWORDS, "Setting material property"},
+  {"AddMaterialDrude",              (PyCFunction) MESH_SimulationGrating_AddMaterialDrude,              METH_VARARGS | METH_KEYWORDS, "Adding a Drude material to the simulation"},
+  {"AddMaterialLorentz",            (PyCFunction) MESH_SimulationGrating_AddMaterialLorentz,            METH_VARARGS | METH_KEYWORDS, "Adding a Lorentz material to the simulation"},
+  {"AddMaterialDrudeLorentz",       (PyCFunction) MESH_SimulationGrating_AddMaterialDrudeLorentz,       METH_VARARGS | METH_KEYWORDS, "Adding a Drude-Lorentz material to the simulation"},
+  {"AddMaterialUniaxial",           (PyCFunction) MESH_SimulationGrating_AddMaterialUniaxial,           METH_VARARGS | METH_KEYWORDS, "Adding a uniaxial material to the simulation"},
+  {"SetOmega",                      (PyCFunction) MESH_SimulationGrating_SetOmega,                      METH_VARARGS | METH_KEYWORDS, "Setting the omega grid of the simulation"},
   {"AddLayer",                      (PyCFunction) MESH_SimulationGrating_AddLayer,                      METH_VARARGS | METH_KEYWORDS, "Adding new layer to the simulation"},
   {"SetLayer",                      (PyCFunction) MESH_SimulationGrating_SetLayer,                      METH_VARARGS | METH_KEYWORDS, "Setting layer property"},
   {"SetLayerThickness",             (PyCFunction) MESH_SimulationGrating_SetLayerThickness,             METH_VARARGS | METH_KEYWORDS, "Setting layer thickness"},
   {"AddLayerCopy",                  (PyCFunction) MESH_SimulationGrating_AddLayerCopy,                  METH_VARARGS | METH_KEYWORDS, "Making a copy of existing layer"},
+  {"AddLayerRepeat",                (PyCFunction) MESH_SimulationGrating_AddLayerRepeat,                METH_VARARGS | METH_KEYWORDS, "Repeating existing layers periodically"},
   {"DeleteLayer",                   (PyCFunction) MESH_SimulationGrating_DeleteLayer,                   METH_VARARGS | METH_KEYWORDS, "Deleting an existing layer"},
   {"SetSourceLayer",                (PyCFunction) MESH_SimulationGrating_SetSourceLayer,                METH_VARARGS | METH_KEYWORDS, "Setting a source layer"},
   {"SetProbeLayer",                 (PyCFunction) MESH_SimulationGrating_SetProbeLayer,                 METH_VARARGS | METH_KEYWORDS, "Setting the probe layer"},
   {"SetProbeLayerZCoordinate",      (PyCFunction) MESH_SimulationGrating_SetProbeLayerZCoordinate,      METH_VARARGS | METH_KEYWORDS, "Setting the z-coordinate in the probe layer"},
+  {"AddProbeLayer",                 (PyCFunction) MESH_SimulationGrating_AddProbeLayer,                 METH_VARARGS | METH_KEYWORDS, "Adding an additional probe layer"},
   {"SetThread",                     (PyCFunction) MESH_SimulationGrating_SetThread,                     METH_VARARGS | METH_KEYWORDS, "Setting the number of thread"},
   {"InitSimulation",                (PyCFunction) MESH_SimulationGrating_InitSimulation,                METH_VARARGS | METH_KEYWORDS, "Initializing simulation"},
   {"GetPhi",                        (PyCFunction) MESH_SimulationGrating_GetPhi,                        METH_VARARGS | METH_KEYWORDS, "Getting the value of Phi"},
+  {"GetPhiAtProbes",                (PyCFunction) MESH_SimulationGrating_GetPhiAtProbes,                METH_VARARGS | METH_KEYWORDS, "Getting the value of Phi at all probes"},
+  {"GetPhiBySource",                (PyCFunction) MESH_SimulationGrating_GetPhiBySource,                METH_VARARGS | METH_KEYWORDS, "Getting the value of Phi from each source layer"},
+  {"GetPhiOnKGrid",                 (PyCFunction) MESH_SimulationGrating_GetPhiOnKGrid,                 METH_VARARGS | METH_KEYWORDS, "Getting the integrand on the full k grid"},
+  {"OptRetainKGrid",                (PyCFunction) MESH_SimulationGrating_OptRetainKGrid,                METH_VARARGS | METH_KEYWORDS, "Keeping the integrand on the full k grid"},
+  {"OptCheckpoint",                 (PyCFunction) MESH_SimulationGrating_OptCheckpoint,                 METH_VARARGS | METH_KEYWORDS, "Checkpointing the k space integration"},
+  {"OptProfile",                    (PyCFunction) MESH_SimulationGrating_OptProfile,                    METH_VARARGS | METH_KEYWORDS, "Timing the phases of the simulation"},
   {"GetOmega",                      (PyCFunction) MESH_SimulationGrating_GetOmega,                      METH_VARARGS | METH_KEYWORDS, "Getting all the omega values"},
   {"GetEpsilon",                    (PyCFunction) MESH_SimulationGrating_GetEpsilon,                    METH_VARARGS | METH_KEYWORDS, "Getting epsilon at one frequency"},
   {"OutputLayerPatternRealization", (PyCFunction) MESH_SimulationGrating_OutputLayerPatternRealization, METH_VARARGS | METH_KEYWORDS, "Outputting dielectric reconstruction"},
@@ -1268,12 +2147,20 @@ static PyMethodDef MESH_SimulationGrating_methods[] = {
   {"OptPrintIntermediate",          (PyCFunction) MESH_SimulationGrating_OptPrintIntermediate,          METH_VARARGS | METH_KEYWORDS, "Option to output intermediate results"},
   {"OptOnlyComputeTE",              (PyCFunction) MESH_SimulationGrating_OptOnlyComputeTE,              METH_VARARGS | METH_KEYWORDS, "Option to only compute TE mode"},
   {"OptOnlyComputeTM",              (PyCFunction) MESH_SimulationGrating_OptOnlyComputeTM,              METH_VARARGS | METH_KEYWORDS, "Option to only compute TM mode"},
+  {"OptUseEigenContinuation",       (PyCFunction) MESH_SimulationGrating_OptUseEigenContinuation,       METH_VARARGS | METH_KEYWORDS, "Option to continue eigen solutions along ky"},
   {"SetKxIntegral",                 (PyCFunction) MESH_SimulationGrating_SetKxIntegral,                 METH_VARARGS | METH_KEYWORDS, "Setting kx integration range"},
   {"SetKyIntegral",                 (PyCFunction) MESH_SimulationGrating_SetKyIntegral,                 METH_VARARGS | METH_KEYWORDS, "Setting kx integration range"},
   {"SetKxIntegralSym",              (PyCFunction) MESH_SimulationGrating_SetKxIntegralSym,              METH_VARARGS | METH_KEYWORDS, "Setting kx integration range in symmetric case"},
   {"SetKyIntegralSym",              (PyCFunction) MESH_SimulationGrating_SetKyIntegralSym,              METH_VARARGS | METH_KEYWORDS, "Setting ky integration range in symmetric case"},
   {"IntegrateKxKy",                 (PyCFunction) MESH_SimulationGrating_IntegrateKxKy,                 METH_VARARGS | METH_KEYWORDS, "Action to integrate kx and ky"},
+  {"StartIntegrateKxKy",            (PyCFunction) MESH_SimulationGrating_StartIntegrateKxKy,            METH_NOARGS, "Action to integrate kx and ky in the background"},
   {"IntegrateKxKyMPI",              (PyCFunction) MESH_SimulationGrating_IntegrateKxKyMPI,              METH_VARARGS | METH_KEYWORDS, "Action to integrate kx and ky using MPI"},
+  {"AddSweepParameter",             (PyCFunction) MESH_SimulationGrating_AddSweepParameter,             METH_VARARGS | METH_KEYWORDS, "Adding a parameter to the structure sweep"},
+  {"AddSweepVariant",               (PyCFunction) MESH_SimulationGrating_AddSweepVariant,               METH_VARARGS | METH_KEYWORDS, "Adding a variant to the structure sweep"},
+  {"RunSweep",                      (PyCFunction) MESH_SimulationGrating_RunSweep,                      METH_NOARGS, "Action to run the structure sweep"},
+  {"RunSweepMPI",                   (PyCFunction) MESH_SimulationGrating_RunSweepMPI,                   METH_VARARGS | METH_KEYWORDS, "Action to run the structure sweep using MPI"},
+  {"GetNumOfSweepVariant",          (PyCFunction) MESH_SimulationGrating_GetNumOfSweepVariant,          METH_NOARGS, "Getting the number of sweep variants"},
+  {"GetSweepPhi",                   (PyCFunction) MESH_SimulationGrating_GetSweepPhi,                   METH_VARARGS | METH_KEYWORDS, "Getting the value of Phi of a sweep variant"},
   {"SetLattice",                    (PyCFunction) MESH_SimulationGrating_SetLatticeGrating,             METH_VARARGS | METH_KEYWORDS, "Setting lattice constant"},
   {"SetLayerPatternGrating",        (PyCFunction) MESH_SimulationGrating_SetLayerPatternGrating,        METH_VARARGS | METH_KEYWORDS, "Setting grating pattern"},
   {"SetNumOfG",                     (PyCFunction) MESH_SimulationGrating_SetNumOfG,                     METH_VARARGS | METH_KEYWORDS, "Setting number of G"},
@@ -1299,7 +2186,7 @@ static PyTypeObject MESH_SimulationGrating_Type = {
   0,                         /* tp_hash  */
   0,                         /* tp_call */
   0,                         /* tp_str */
-  0,                         /* tp_getattro */
+  (getattrofunc)MESH_SimulationGrating_GetAttr, /* tp_getattro */
   0,                         /* tp_setattro */
   0,                         /* tp_as_buffer */
   Py_TPFLAGS_DEFAULT,        /* tp_flags */ 
@@ -1333,6 +2220,8 @@ typedef struct {
     // Own c-variables:
     // e.g int x = 0;
     SimulationPattern *s;
+    // set while StartIntegrateKxKy runs
+    std::atomic<bool>* busy;
 } MESH_SimulationPattern;
 
 
@@ -1341,6 +2230,7 @@ static void MESH_SimulationPattern_dealloc(MESH_SimulationPattern* self){
   // Nothing to deallocate. Use this in case the base
   // struct contains a pointer or so.
   delete self->s;
+  delete self->busy;
   Py_TYPE(self)->tp_free((PyObject*)self);
 }
 
@@ -1352,6 +2242,7 @@ static PyObject *MESH_SimulationPattern_new(PyTypeObject *type, PyObject *args,
    // Init vars if any ...
    if (self != NULL){
       self->s = new SimulationPattern();
+      self->busy = new std::atomic<bool>(false);
    }
    return (PyObject*) self;
 }
@@ -1378,6 +2269,67 @@ static PyObject* MESH_SimulationPattern_AddMaterial(MESH_SimulationPattern *self
 
 }
 
+static PyObject* MESH_SimulationPattern_AddMaterialDrude(MESH_SimulationPattern *self, PyObject *args, PyObject *kwds){
+  static char *kwlist[] = { (char*)"material_name", (char*)"eps_inf", (char*)"omega_p", (char*)"gamma", NULL };
+  const char *materialName;
+  DispersionModel model;
+  if(!PyArg_ParseTupleAndKeywords(args, kwds, "sddd:AddMaterialDrude", kwlist, &materialName, &model.epsInf, &model.omegaP, &model.gammaP)){
+    return NULL;
+  }
+  std::string material_name(materialName);
+  self->s->addMaterial(material_name, model);
+  Py_RETURN_NONE;
+}
+
+static PyObject* MESH_SimulationPattern_AddMaterialLorentz(MESH_SimulationPattern *self, PyObject *args, PyObject *kwds){
+  static char *kwlist[] = { (char*)"material_name", (char*)"eps_inf", (char*)"oscillators", NULL };
+  const char *materialName;
+  DispersionModel model;
+  struct oscillator_converter_data oscillator_data;
+  if(!PyArg_ParseTupleAndKeywords(args, kwds, "sdO&:AddMaterialLorentz", kwlist, &materialName, &model.epsInf, &oscillator_converter, &oscillator_data)){
+    return NULL;
+  }
+  model.oscillators = oscillator_data.oscillators;
+  std::string material_name(materialName);
+  self->s->addMaterial(material_name, model);
+  Py_RETURN_NONE;
+}
+
+static PyObject* MESH_SimulationPattern_AddMaterialDrudeLorentz(MESH_SimulationPattern *self, PyObject *args, PyObject *kwds){
+  static char *kwlist[] = { (char*)"material_name", (char*)"eps_inf", (char*)"omega_p", (char*)"gamma", (char*)"oscillators", NULL };
+  const char *materialName;
+  DispersionModel model;
+  struct oscillator_converter_data oscillator_data;
+  if(!PyArg_ParseTupleAndKeywords(args, kwds, "sdddO&:AddMaterialDrudeLorentz", kwlist, &materialName, &model.epsInf, &model.omegaP, &model.gammaP, &oscillator_converter, &oscillator_data)){
+    return NULL;
+  }
+  model.oscillators = oscillator_data.oscillators;
+  std::string material_name(materialName);
+  self->s->addMaterial(material_name, model);
+  Py_RETURN_NONE;
+}
+
+static PyObject* MESH_SimulationPattern_AddMaterialUniaxial(MESH_SimulationPattern *self, PyObject *args, PyObject *kwds){
+  static char *kwlist[] = { (char*)"material_name", (char*)"ordinary", (char*)"extraordinary", NULL };
+  const char *materialName, *ordinary, *extraordinary;
+  if(!PyArg_ParseTupleAndKeywords(args, kwds, "sss:AddMaterialUniaxial", kwlist, &materialName, &ordinary, &extraordinary)){
+    return NULL;
+  }
+  std::string material_name(materialName), ordinary_name(ordinary), extraordinary_name(extraordinary);
+  self->s->addMaterialUniaxial(material_name, ordinary_name, extraordinary_name);
+  Py_RETURN_NONE;
+}
+
+static PyObject* MESH_SimulationPattern_SetOmega(MESH_SimulationPattern *self, PyObject *args, PyObject *kwds){
+  static char *kwlist[] = { (char*)"omega", NULL };
+  struct omega_converter_data omega_data;
+  if(!PyArg_ParseTupleAndKeywords(args, kwds, "O&:SetOmega", kwlist, &omega_converter, &omega_data)){
+    return NULL;
+  }
+  self->s->setOmega(omega_data.omega);
+  Py_RETURN_NONE;
+}
+
 static PyObject* MESH_SimulationPattern_SetMaterial(MESH_SimulationPattern *self, PyObject *args, PyObject *kwds){
   static char *kwlist[] = { (char*)"material_name", (char*)"epsilon", NULL };
 	const char *materialName;
@@ -1470,6 +2422,17 @@ static PyObject* MESH_SimulationPattern_AddLayerCopy(MESH_SimulationPattern *sel
   Py_RETURN_NONE;
 }
 
+static PyObject* MESH_SimulationPattern_AddLayerRepeat(MESH_SimulationPattern *self, PyObject *args, PyObject *kwds){
+  static char *kwlist[] = { (char*)"layer_names", (char*)"count", NULL };
+  struct names_converter_data names_data;
+  int count;
+  if(!PyArg_ParseTupleAndKeywords(args, kwds, "O&i:AddLayerRepeat", kwlist, &names_converter, &names_data, &count)){
+    return NULL;
+  }
+  self->s->addLayerRepeat(names_data.names, count);
+  Py_RETURN_NONE;
+}
+
 static PyObject* MESH_SimulationPattern_DeleteLayer(MESH_SimulationPattern *self, PyObject *args, PyObject *kwds){
   static char *kwlist[] = { (char*)"layer_name", NULL };
 	const char *layerName;
@@ -1513,18 +2476,34 @@ static PyObject* MESH_SimulationPattern_SetProbeLayerZCoordinate(MESH_Simulation
   Py_RETURN_NONE;
 }
 
+static PyObject* MESH_SimulationPattern_AddProbeLayer(MESH_SimulationPattern *self, PyObject *args, PyObject *kwds){
+  static char *kwlist[] = { (char*)"layer_name", (char*)"z", NULL };
+  const char *layerName;
+  double z = -1;
+  if(!PyArg_ParseTupleAndKeywords(args, kwds, "s|d:AddProbeLayer", kwlist, &layerName, &z)){
+    return NULL;
+  }
+  std::string layer_name(layerName);
+  self->s->addProbeLayer(layer_name, z);
+  Py_RETURN_NONE;
+}
+
 static PyObject* MESH_SimulationPattern_SetThread(MESH_SimulationPattern *self, PyObject *args, PyObject *kwds){
-  static char *kwlist[] = { (char*)"num_thread", NULL };
+  static char *kwlist[] = { (char*)"num_thread", (char*)"policy", NULL };
 	int thread;
-	if(!PyArg_ParseTupleAndKeywords(args, kwds, "i:SetThread", kwlist, &thread)){ 
+  char* threadPolicy = (char*)"Auto";
+	if(!PyArg_ParseTupleAndKeywords(args, kwds, "i|s:SetThread", kwlist, &thread, &threadPolicy)){ 
       return NULL; 
   }
-  self->s->setThread(thread);
+  std::string policy(threadPolicy);
+  self->s->setThread(thread, policy);
   Py_RETURN_NONE;
 }
 
 static PyObject* MESH_SimulationPattern_InitSimulation(MESH_SimulationPattern *self, PyObject *args){
-  self->s->initSimulation();
+  if(!MESH_CallWithoutGIL(self->busy, [&](){ self->s->initSimulation(); })){
+    return NULL;
+  }
   Py_RETURN_NONE;
 }
 
@@ -1538,6 +2517,98 @@ static PyObject* MESH_SimulationPattern_GetPhi(MESH_SimulationPattern *self, PyO
   return phi_value;
 }
 
+static PyObject* MESH_SimulationPattern_GetPhiAtProbes(MESH_SimulationPattern *self, PyObject *args){
+  double* phi = self->s->getPhiAtProbes();
+  int num_omega = self->s->getNumOfOmega();
+  int num_probe = self->s->getNumOfProbe();
+  PyObject* phi_value = PyTuple_New(num_probe);
+  for(int p = 0; p < num_probe; p++){
+    PyObject* phi_probe = PyTuple_New(num_omega);
+    for(int i = 0; i < num_omega; i++){
+      PyTuple_SetItem(phi_probe, i, PyFloat_FromDouble(phi[p * num_omega + i]));
+    }
+    PyTuple_SetItem(phi_value, p, phi_probe);
+  }
+  return phi_value;
+}
+
+static PyObject* MESH_SimulationPattern_GetPhiOnKGrid(MESH_SimulationPattern *self, PyObject *args, PyObject *kwds){
+  static char* kwlist[] = {(char*)"omega_index", (char*)"probe_index", NULL};
+  int omega_index, probe_index = 0;
+  if(!PyArg_ParseTupleAndKeywords(args, kwds, "i|i:GetPhiOnKGrid", kwlist, &omega_index, &probe_index)){
+    return NULL;
+  }
+  double* phi = self->s->getPhiOnKGrid();
+  int num_kx = self->s->getNumOfKx();
+  int num_ky = self->s->getNumOfKy();
+  int num_probe = self->s->getNumOfProbe();
+  if(omega_index < 0 || omega_index >= self->s->getNumOfOmega() || probe_index < 0 || probe_index >= num_probe){
+    PyErr_SetString(PyExc_IndexError, "index out of range");
+    return NULL;
+  }
+  PyObject* phi_value = PyTuple_New(num_kx);
+  for(int i = 0; i < num_kx; i++){
+    PyObject* phi_kx = PyTuple_New(num_ky);
+    for(int j = 0; j < num_ky; j++){
+      PyTuple_SetItem(phi_kx, j, PyFloat_FromDouble(phi[((static_cast<size_t>(omega_index) * num_kx + i) * num_ky + j) * num_probe + probe_index]));
+    }
+    PyTuple_SetItem(phi_value, i, phi_kx);
+  }
+  return phi_value;
+}
+
+static PyObject* MESH_SimulationPattern_OptRetainKGrid(MESH_SimulationPattern *self, PyObject *args){
+  self->s->optRetainKGrid();
+  Py_RETURN_NONE;
+}
+
+static PyObject* MESH_SimulationPattern_OptCheckpoint(MESH_SimulationPattern *self, PyObject *args, PyObject *kwds){
+  static char* kwlist[] = {(char*)"file_name", (char*)"interval", NULL};
+  const char* fileName;
+  double interval = 600;
+  if(!PyArg_ParseTupleAndKeywords(args, kwds, "s|d:OptCheckpoint", kwlist, &fileName, &interval)){
+    return NULL;
+  }
+  std::string file_name(fileName);
+  self->s->optCheckpoint(file_name, interval);
+  Py_RETURN_NONE;
+}
+
+static PyObject* MESH_SimulationPattern_OptProfile(MESH_SimulationPattern *self, PyObject *args, PyObject *kwds){
+  static char* kwlist[] = {(char*)"file_name", (char*)"format", NULL};
+  const char* fileName = "";
+  const char* format = "JSON";
+  if(!PyArg_ParseTupleAndKeywords(args, kwds, "|ss:OptProfile", kwlist, &fileName, &format)){
+    return NULL;
+  }
+  std::string file_name(fileName), format_name(format);
+  self->s->optProfile(file_name, format_name);
+  Py_RETURN_NONE;
+}
+
+static PyObject* MESH_SimulationPattern_GetPhiBySource(MESH_SimulationPattern *self, PyObject *args){
+  int num_omega = self->s->getNumOfOmega();
+  std::vector<std::string> names = self->s->getSourceLayerNames();
+  const POLARIZATION polars[3] = {BOTH_, TE_, TM_};
+  const char* keys[3] = {"total", "TE", "TM"};
+  PyObject* phi_value = PyDict_New();
+  for(size_t l = 0; l < names.size(); l++){
+    PyObject* phi_layer = PyDict_New();
+    for(int k = 0; k < 3; k++){
+      double* phi = self->s->getPhiBySource(names[l], polars[k]);
+      PyObject* phi_polar = PyTuple_New(num_omega);
+      for(int i = 0; i < num_omega; i++){
+        PyTuple_SetItem(phi_polar, i, PyFloat_FromDouble(phi[i]));
+      }
+      PyDict_SetItemString(phi_layer, keys[k], phi_polar);
+      Py_DECREF(phi_polar);
+    }
+    PyDict_SetItemString(phi_value, names[l].c_str(), phi_layer);
+    Py_DECREF(phi_layer);
+  }
+  return phi_value;
+}
+
 static PyObject* MESH_SimulationPattern_GetOmega(MESH_SimulationPattern *self, PyObject *args){
   double* omega = self->s->getOmega();
   int num_omega = self->s->getNumOfOmega();
@@ -1595,7 +2666,10 @@ static PyObject* MESH_SimulationPattern_GetPhiAtKxKy(MESH_SimulationPattern *sel
   if(!PyArg_ParseTupleAndKeywords(args, kwds, "id|d:GetPhiAtKxKy", kwlist, &omega_index, &kx, &ky)){ 
     return NULL; 
   }
-  double value = self->s->getPhiAtKxKy(omega_index, kx, ky);
+  double value;
+  if(!MESH_CallWithoutGIL(self->busy, [&](){ value = self->s->getPhiAtKxKy(omega_index, kx, ky); })){
+    return NULL;
+  }
   return PyFloat_FromDouble(value);
 }
 
@@ -1605,18 +2679,14 @@ static PyObject* MESH_SimulationPattern_OutputSysInfo(MESH_SimulationPattern *se
 }
 
 static PyObject* MESH_SimulationPattern_OptPrintIntermediate(MESH_SimulationPattern *self, PyObject *args, PyObject *kwds){
-  static char* kwlist[] = {(char*)"output_flag", NULL };
+  static char* kwlist[] = {(char*)"output_flag", (char*)"format", NULL };
   char* outputFlag = (char*)"";
-  if(!PyArg_ParseTupleAndKeywords(args, kwds, "|s:OptPrintIntermediate", kwlist, &outputFlag)){ 
+  char* outputFormat = (char*)"Text";
+  if(!PyArg_ParseTupleAndKeywords(args, kwds, "|ss:OptPrintIntermediate", kwlist, &outputFlag, &outputFormat)){ 
     return NULL; 
   }
-  std::string output_flag(outputFlag);
-  if(output_flag == ""){
-    self->s->optPrintIntermediate();
-  }
-  else{
-    self->s->optPrintIntermediate(output_flag);
-  }
+  std::string output_flag(outputFlag), format(outputFormat);
+  self->s->optPrintIntermediate(output_flag, format);
   Py_RETURN_NONE;
 }
 
@@ -1630,6 +2700,11 @@ static PyObject* MESH_SimulationPattern_OptOnlyComputeTM(MESH_SimulationPattern
   Py_RETURN_NONE;
 }
 
+static PyObject* MESH_SimulationPattern_OptUseEigenContinuation(MESH_SimulationPattern *self, PyObject *args){
+  self->s->optUseEigenContinuation();
+  Py_RETURN_NONE;
+}
+
 static PyObject* MESH_SimulationPattern_SetKxIntegral(MESH_SimulationPattern *self, PyObject *args, PyObject *kwds){
   static char* kwlist[] = {(char*)"num_points", (char*)"integral_end", NULL};
   int num_points;
@@ -1695,10 +2770,16 @@ static PyObject* MESH_SimulationPattern_SetKyIntegralSym(MESH_SimulationPattern
 }
 
 static PyObject* MESH_SimulationPattern_IntegrateKxKy(MESH_SimulationPattern *self, PyObject *args){
-  self->s->integrateKxKy();
+  if(!MESH_CallWithoutGIL(self->busy, [&](){ self->s->integrateKxKy(); })){
+    return NULL;
+  }
   Py_RETURN_NONE;
 }
 
+static PyObject* MESH_SimulationPattern_StartIntegrateKxKy(MESH_SimulationPattern *self, PyObject *args){
+  return MESH_StartIntegrateKxKy((PyObject*)self, self->s, self->busy);
+}
+
 
 static PyObject* MESH_SimulationPattern_IntegrateKxKyMPI(MESH_SimulationPattern *self, PyObject *args, PyObject *kwds){
   static char* kwlist[] = {(char*)"rank", (char*)"size", NULL};
@@ -1706,10 +2787,76 @@ static PyObject* MESH_SimulationPattern_IntegrateKxKyMPI(MESH_SimulationPattern
   if(!PyArg_ParseTupleAndKeywords(args, kwds, "ii:IntegrateKxKyMPI", kwlist, &rank, &size)){ 
     return NULL; 
   }
-  self->s->integrateKxKyMPI(rank, size);
+  if(!MESH_CallWithoutGIL(self->busy, [&](){ self->s->integrateKxKyMPI(rank, size); })){
+    return NULL;
+  }
+  Py_RETURN_NONE;
+}
+
+static PyObject* MESH_SimulationPattern_AddSweepParameter(MESH_SimulationPattern *self, PyObject *args, PyObject *kwds){
+  static char* kwlist[] = {(char*)"layer_name", (char*)"parameter", (char*)"pattern_index", NULL};
+  const char *layerName, *parameter;
+  int pattern_index = 0;
+  if(!PyArg_ParseTupleAndKeywords(args, kwds, "ss|i:AddSweepParameter", kwlist, &layerName, &parameter, &pattern_index)){
+    return NULL;
+  }
+  std::string layer_name(layerName), parameter_name(parameter);
+  self->s->addSweepParameter(layer_name, parameter_name, pattern_index);
+  Py_RETURN_NONE;
+}
+
+static PyObject* MESH_SimulationPattern_AddSweepVariant(MESH_SimulationPattern *self, PyObject *args, PyObject *kwds){
+  static char* kwlist[] = {(char*)"values", NULL};
+  struct values_converter_data values_data;
+  if(!PyArg_ParseTupleAndKeywords(args, kwds, "O&:AddSweepVariant", kwlist, &values_converter, &values_data)){
+    return NULL;
+  }
+  self->s->addSweepVariant(values_data.values);
+  Py_RETURN_NONE;
+}
+
+static PyObject* MESH_SimulationPattern_RunSweep(MESH_SimulationPattern *self, PyObject *args){
+  if(!MESH_CallWithoutGIL(self->busy, [&](){ self->s->runSweep(); })){
+    return NULL;
+  }
+  Py_RETURN_NONE;
+}
+
+static PyObject* MESH_SimulationPattern_RunSweepMPI(MESH_SimulationPattern *self, PyObject *args, PyObject *kwds){
+  static char* kwlist[] = {(char*)"rank", (char*)"size", NULL};
+  int rank, size;
+  if(!PyArg_ParseTupleAndKeywords(args, kwds, "ii:RunSweepMPI", kwlist, &rank, &size)){
+    return NULL;
+  }
+  if(!MESH_CallWithoutGIL(self->busy, [&](){ self->s->runSweepMPI(rank, size); })){
+    return NULL;
+  }
   Py_RETURN_NONE;
 }
 
+static PyObject* MESH_SimulationPattern_GetNumOfSweepVariant(MESH_SimulationPattern *self, PyObject *args){
+  return PyLong_FromLong(self->s->getNumOfSweepVariant());
+}
+
+static PyObject* MESH_SimulationPattern_GetSweepPhi(MESH_SimulationPattern *self, PyObject *args, PyObject *kwds){
+  static char* kwlist[] = {(char*)"variant_index", (char*)"probe_index", NULL};
+  int variant_index, probe_index = 0;
+  if(!PyArg_ParseTupleAndKeywords(args, kwds, "i|i:GetSweepPhi", kwlist, &variant_index, &probe_index)){
+    return NULL;
+  }
+  if(variant_index < 0 || variant_index >= self->s->getNumOfSweepVariant() || probe_index < 0 || probe_index >= self->s->getNumOfProbe()){
+    PyErr_SetString(PyExc_IndexError, "index out of range");
+    return NULL;
+  }
+  double* phi = self->s->getSweepPhi(variant_index, probe_index);
+  int num_omega = self->s->getNumOfOmega();
+  PyObject* phi_value = PyTuple_New(num_omega);
+  for(int i = 0; i < num_omega; i++){
+    PyTuple_SetItem(phi_value, i, PyFloat_FromDouble(phi[i]));
+  }
+  return phi_value;
+}
+
 static PyObject* MESH_SimulationPattern_SetNumOfG(MESH_SimulationPattern *self, PyObject *args, PyObject *kwds){
   static char* kwlist[] = {(char*)"num_G",  NULL};
   int numG;
@@ -1822,21 +2969,89 @@ static PyObject* MESH_SimulationPattern_SetLayerPatternPolygon(MESH_SimulationPa
   delete [] edgePoints;
   Py_RETURN_NONE;
 }
+static PyObject* MESH_SimulationPattern_SetLayerPatternCircles(MESH_SimulationPattern *self, PyObject *args, PyObject *kwds){
+  static char* kwlist[] = {(char*)"layer_name", (char*)"material_name", (char*)"centers", (char*)"radii", NULL};
+  char* materialName, *layerName;
+  struct polygon_converter_data centers_data;
+  struct values_converter_data radii_data;
+  if(!PyArg_ParseTupleAndKeywords(args, kwds, "ssO&O&:SetLayerPatternCircles", kwlist, &layerName, &materialName, &polygon_converter, &centers_data, &values_converter, &radii_data)){
+    return NULL;
+  }
+  std::string layer_name(layerName), material_name(materialName);
+  std::vector<double> centerx, centery;
+  for(int i = 0; i < centers_data.nvert; i++){
+    centerx.push_back(centers_data.vert[2*i]);
+    centery.push_back(centers_data.vert[2*i+1]);
+  }
+  self->s->setLayerPatternCircles(layer_name, material_name, centerx, centery, radii_data.values);
+  Py_RETURN_NONE;
+}
+
+static PyObject* MESH_SimulationPattern_SetLayerPatternRectangles(MESH_SimulationPattern *self, PyObject *args, PyObject *kwds){
+  static char* kwlist[] = {(char*)"layer_name", (char*)"material_name", (char*)"centers", (char*)"angles", (char*)"widths", NULL};
+  char* materialName, *layerName;
+  struct polygon_converter_data centers_data, widths_data;
+  struct values_converter_data angles_data;
+  if(!PyArg_ParseTupleAndKeywords(args, kwds, "ssO&O&O&:SetLayerPatternRectangles", kwlist, &layerName, &materialName, &polygon_converter, &centers_data, &values_converter, &angles_data, &polygon_converter, &widths_data)){
+    return NULL;
+  }
+  std::string layer_name(layerName), material_name(materialName);
+  std::vector<double> centerx, centery, widthx, widthy;
+  for(int i = 0; i < centers_data.nvert; i++){
+    centerx.push_back(centers_data.vert[2*i]);
+    centery.push_back(centers_data.vert[2*i+1]);
+  }
+  for(int i = 0; i < widths_data.nvert; i++){
+    widthx.push_back(widths_data.vert[2*i]);
+    widthy.push_back(widths_data.vert[2*i+1]);
+  }
+  self->s->setLayerPatternRectangles(layer_name, material_name, centerx, centery, angles_data.values, widthx, widthy);
+  Py_RETURN_NONE;
+}
+
+static PyObject* MESH_SimulationPattern_SetLayerPatternRaster(MESH_SimulationPattern *self, PyObject *args, PyObject *kwds){
+  static char* kwlist[] = {(char*)"layer_name", (char*)"material_names", (char*)"raster", NULL};
+  char* layerName;
+  struct names_converter_data names_data;
+  struct raster_converter_data raster_data;
+  if(!PyArg_ParseTupleAndKeywords(args, kwds, "sO&O&:SetLayerPatternRaster", kwlist, &layerName, &names_converter, &names_data, &raster_converter, &raster_data)){
+    return NULL;
+  }
+  std::string layer_name(layerName);
+  self->s->setLayerPatternRaster(layer_name, names_data.names, raster_data.grid, raster_data.nx, raster_data.ny);
+  Py_RETURN_NONE;
+}
+static PyObject* MESH_SimulationPattern_GetAttr(MESH_SimulationPattern *self, PyObject *name){
+  return MESH_Simulation_GetAttr((PyObject*)self, name, self->busy);
+}
 /* METHOD TABLE */
 static PyMethodDef MESH_SimulationPattern_methods[] = {
   {"AddMaterial",                   (PyCFunction) MESH_SimulationPattern_AddMaterial,                   METH_VARARGS | METH_KEYWORDS, "Adding new material to the simulation"},
   {"SetMaterial",                   (PyCFunction) MESH_SimulationPattern_SetMaterial,                   METH_VARARGS | METH_KEYWORDS, "Setting material property"},
+  {"AddMaterialDrude",              (PyCFunction) MESH_SimulationPattern_AddMaterialDrude,              METH_VARARGS | METH_KEYWORDS, "Adding a Drude material to the simulation"},
+  {"AddMaterialLorentz",            (PyCFunction) MESH_SimulationPattern_AddMaterialLorentz,            METH_VARARGS | METH_KEYWORDS, "Adding a Lorentz material to the simulation"},
+  {"AddMaterialDrudeLorentz",       (PyCFunction) MESH_SimulationPattern_AddMaterialDrudeLorentz,       METH_VARARGS | METH_KEYWORDS, "Adding a Drude-Lorentz material to the simulation"},
+  {"AddMaterialUniaxial",           (PyCFunction) MESH_SimulationPattern_AddMaterialUniaxial,           METH_VARARGS | METH_KEYWORDS, "Adding a uniaxial material to the simulation"},
+  {"SetOmega",                      (PyCFunction) MESH_SimulationPattern_SetOmega,                      METH_VARARGS | METH_KEYWORDS, "Setting the omega grid of the simulation"},
   {"AddLayer",                      (PyCFunction) MESH_SimulationPattern_AddLayer,                      METH_VARARGS | METH_KEYWORDS, "Adding new layer to the simulation"},
   {"SetLayer",                      (PyCFunction) MESH_SimulationPattern_SetLayer,                      METH_VARARGS | METH_KEYWORDS, "Setting layer property"},
   {"SetLayerThickness",             (PyCFunction) MESH_SimulationPattern_SetLayerThickness,             METH_VARARGS | METH_KEYWORDS, "Setting layer thickness"},
   {"AddLayerCopy",                  (PyCFunction) MESH_SimulationPattern_AddLayerCopy,                  METH_VARARGS | METH_KEYWORDS, "Making a copy of existing layer"},
+  {"AddLayerRepeat",                (PyCFunction) MESH_SimulationPattern_AddLayerRepeat,                METH_VARARGS | METH_KEYWORDS, "Repeating existing layers periodically"},
   {"DeleteLayer",                   (PyCFunction) MESH_SimulationPattern_DeleteLayer,                   METH_VARARGS | METH_KEYWORDS, "Deleting an existing layer"},
   {"SetSourceLayer",                (PyCFunction) MESH_SimulationPattern_SetSourceLayer,                METH_VARARGS | METH_KEYWORDS, "Setting a source layer"},
   {"SetProbeLayer",                 (PyCFunction) MESH_SimulationPattern_SetProbeLayer,                 METH_VARARGS | METH_KEYWORDS, "Setting the probe layer"},
   {"SetProbeLayerZCoordinate",      (PyCFunction) MESH_SimulationPattern_SetProbeLayerZCoordinate,      METH_VARARGS | METH_KEYWORDS, "Setting the z-coordinate in the probe layer"},
+  {"AddProbeLayer",                 (PyCFunction) MESH_SimulationPattern_AddProbeLayer,                 METH_VARARGS | METH_KEYWORDS, "Adding an additional probe layer"},
   {"SetThread",                     (PyCFunction) MESH_SimulationPattern_SetThread,                     METH_VARARGS | METH_KEYWORDS, "Setting the number of thread"},
   {"InitSimulation",                (PyCFunction) MESH_SimulationPattern_InitSimulation,                METH_VARARGS | METH_KEYWORDS, "Initializing simulation"},
   {"GetPhi",                        (PyCFunction) MESH_SimulationPattern_GetPhi,                        METH_VARARGS | METH_KEYWORDS, "Getting the value of Phi"},
+  {"GetPhiAtProbes",                (PyCFunction) MESH_SimulationPattern_GetPhiAtProbes,                METH_VARARGS | METH_KEYWORDS, "Getting the value of Phi at all probes"},
+  {"GetPhiBySource",                (PyCFunction) MESH_SimulationPattern_GetPhiBySource,                METH_VARARGS | METH_KEYWORDS, "Getting the value of Phi from each source layer"},
+  {"GetPhiOnKGrid",                 (PyCFunction) MESH_SimulationPattern_GetPhiOnKGrid,                 METH_VARARGS | METH_KEYWORDS, "Getting the integrand on the full k grid"},
+  {"OptRetainKGrid",                (PyCFunction) MESH_SimulationPattern_OptRetainKGrid,                METH_VARARGS | METH_KEYWORDS, "Keeping the integrand on the full k grid"},
+  {"OptCheckpoint",                 (PyCFunction) MESH_SimulationPattern_OptCheckpoint,                 METH_VARARGS | METH_KEYWORDS, "Checkpointing the k space integration"},
+  {"OptProfile",                    (PyCFunction) MESH_SimulationPattern_OptProfile,                    METH_VARARGS | METH_KEYWORDS, "Timing the phases of the simulation"},
   {"GetOmega",                      (PyCFunction) MESH_SimulationPattern_GetOmega,                      METH_VARARGS | METH_KEYWORDS, "Getting all the omega values"},
   {"GetEpsilon",                    (PyCFunction) MESH_SimulationPattern_GetEpsilon,                    METH_VARARGS | METH_KEYWORDS, "Getting epsilon at one frequency"},
   {"OutputLayerPatternRealization", (PyCFunction) MESH_SimulationPattern_OutputLayerPatternRealization, METH_VARARGS | METH_KEYWORDS, "Outputting dielectric reconstruction"},
@@ -1846,18 +3061,29 @@ static PyMethodDef MESH_SimulationPattern_methods[] = {
   {"OptPrintIntermediate",          (PyCFunction) MESH_SimulationPattern_OptPrintIntermediate,          METH_VARARGS | METH_KEYWORDS, "Option to output intermediate results"},
   {"OptOnlyComputeTE",              (PyCFunction) MESH_SimulationPattern_OptOnlyComputeTE,              METH_VARARGS | METH_KEYWORDS, "Option to only compute TE mode"},
   {"OptOnlyComputeTM",              (PyCFunction) MESH_SimulationPattern_OptOnlyComputeTM,              METH_VARARGS | METH_KEYWORDS, "Option to only compute TM mode"},
+  {"OptUseEigenContinuation",       (PyCFunction) MESH_SimulationPattern_OptUseEigenContinuation,       METH_VARARGS | METH_KEYWORDS, "Option to continue eigen solutions along ky"},
   {"SetKxIntegral",                 (PyCFunction) MESH_SimulationPattern_SetKxIntegral,                 METH_VARARGS | METH_KEYWORDS, "Setting kx integration range"},
   {"SetKyIntegral",                 (PyCFunction) MESH_SimulationPattern_SetKyIntegral,                 METH_VARARGS | METH_KEYWORDS, "Setting kx integration range"},
   {"SetKxIntegralSym",              (PyCFunction) MESH_SimulationPattern_SetKxIntegralSym,              METH_VARARGS | METH_KEYWORDS, "Setting kx integration range in symmetric case"},
   {"SetKyIntegralSym",              (PyCFunction) MESH_SimulationPattern_SetKyIntegralSym,              METH_VARARGS | METH_KEYWORDS, "Setting ky integration range in symmetric case"},
   {"IntegrateKxKy",                 (PyCFunction) MESH_SimulationPattern_IntegrateKxKy,                 METH_VARARGS | METH_KEYWORDS, "Action to integrate kx and ky"},
+  {"StartIntegrateKxKy",            (PyCFunction) MESH_SimulationPattern_StartIntegrateKxKy,            METH_NOARGS, "Action to integrate kx and ky in the background"},
   {"IntegrateKxKyMPI",              (PyCFunction) MESH_SimulationPattern_IntegrateKxKyMPI,              METH_VARARGS | METH_KEYWORDS, "Action to integrate kx and ky using MPI"},
+  {"AddSweepParameter",             (PyCFunction) MESH_SimulationPattern_AddSweepParameter,             METH_VARARGS | METH_KEYWORDS, "Adding a parameter to the structure sweep"},
+  {"AddSweepVariant",               (PyCFunction) MESH_SimulationPattern_AddSweepVariant,               METH_VARARGS | METH_KEYWORDS, "Adding a variant to the structure sweep"},
+  {"RunSweep",                      (PyCFunction) MESH_SimulationPattern_RunSweep,                      METH_NOARGS, "Action to run the structure sweep"},
+  {"RunSweepMPI",                   (PyCFunction) MESH_SimulationPattern_RunSweepMPI,                   METH_VARARGS | METH_KEYWORDS, "Action to run the structure sweep using MPI"},
+  {"GetNumOfSweepVariant",          (PyCFunction) MESH_SimulationPattern_GetNumOfSweepVariant,          METH_NOARGS, "Getting the number of sweep variants"},
+  {"GetSweepPhi",                   (PyCFunction) MESH_SimulationPattern_GetSweepPhi,                   METH_VARARGS | METH_KEYWORDS, "Getting the value of Phi of a sweep variant"},
   {"SetLattice",                    (PyCFunction) MESH_SimulationPattern_SetLatticePattern,             METH_VARARGS | METH_KEYWORDS, "Setting lattice constants"},
   {"GetReciprocalLattice",          (PyCFunction) MESH_SimulationPattern_GetReciprocalLattice,          METH_VARARGS | METH_KEYWORDS, "Getting reciprocal lattice"},
   {"SetLayerPatternRectangle",      (PyCFunction) MESH_SimulationPattern_SetLayerPatternRectangle,      METH_VARARGS | METH_KEYWORDS, "Setting rectangle layer pattern"},
   {"SetLayerPatternEllipse",        (PyCFunction) MESH_SimulationPattern_SetLayerPatternEllipse,        METH_VARARGS | METH_KEYWORDS, "Setting ellipse layer pattern"},
   {"SetLayerPatternCircle",         (PyCFunction) MESH_SimulationPattern_SetLayerPatternCircle,         METH_VARARGS | METH_KEYWORDS, "Setting circle layer pattern"},
   {"SetLayerPatternPolygon",        (PyCFunction) MESH_SimulationPattern_SetLayerPatternPolygon,        METH_VARARGS | METH_KEYWORDS, "Setting polygon layer pattern"},
+  {"SetLayerPatternCircles",        (PyCFunction) MESH_SimulationPattern_SetLayerPatternCircles,        METH_VARARGS | METH_KEYWORDS, "Setting an array of circle layer patterns"},
+  {"SetLayerPatternRectangles",     (PyCFunction) MESH_SimulationPattern_SetLayerPatternRectangles,     METH_VARARGS | METH_KEYWORDS, "Setting an array of rectangle layer patterns"},
+  {"SetLayerPatternRaster",         (PyCFunction) MESH_SimulationPattern_SetLayerPatternRaster,         METH_VARARGS | METH_KEYWORDS, "Setting raster layer pattern"},
   {"SetNumOfG",                     (PyCFunction) MESH_SimulationPattern_SetNumOfG,                     METH_VARARGS | METH_KEYWORDS, "Setting number of G"},
   {"GetNumOfG",                     (PyCFunction) MESH_SimulationPattern_GetNumOfG,                     METH_VARARGS | METH_KEYWORDS, "Getting number of G"},
   {"OptSetLatticeTruncation",       (PyCFunction) MESH_SimulationPattern_OptSetLatticeTruncation,       METH_VARARGS | METH_KEYWORDS, "Setting G selection method"},
@@ -1882,7 +3108,7 @@ static PyTypeObject MESH_SimulationPattern_Type = {
   0,                         /* tp_hash  */
   0,                         /* tp_call */
   0,                         /* tp_str */
-  0,                         /* tp_getattro */
+  (getattrofunc)MESH_SimulationPattern_GetAttr, /* tp_getattro */
   0,                         /* tp_setattro */
   0,                         /* tp_as_buffer */
   Py_TPFLAGS_DEFAULT,         /* tp_flags */  
@@ -1942,11 +3168,56 @@ static PyObject* MESH_Version(PyObject *self, PyObject *args){
   return FromStringPyDefString(output.c_str());
 }
 
+/*======================================================*/
+// reader of the binary intermediate files
+/*=======================================================*/
+static PyObject* FromVectorPyTuple(const std::vector<double>& vals){
+  PyObject* tuple = PyTuple_New(vals.size());
+  for(size_t i = 0; i < vals.size(); i++){
+    PyTuple_SetItem(tuple, i, PyFloat_FromDouble(vals[i]));
+  }
+  return tuple;
+}
+static PyObject* MESH_ReadIntermediate(PyObject *self, PyObject *args, PyObject *kwds){
+  static char *kwlist[] = { (char*)"file_name", NULL };
+  const char *fileName;
+  if(!PyArg_ParseTupleAndKeywords(args, kwds, "s:ReadIntermediate", kwlist, &fileName)){
+    return NULL;
+  }
+  std::vector<double> omega, kx, ky;
+  std::vector< std::vector<double> > phi;
+  try{
+    IntermediateWriter::read(std::string(fileName), omega, kx, ky, phi);
+  }
+  catch(UTILITY::Exception& e){
+    PyErr_SetString(PyExc_IOError, e.what().c_str());
+    return NULL;
+  }
+  PyObject* result = PyDict_New();
+  PyObject* item = FromVectorPyTuple(omega);
+  PyDict_SetItemString(result, "omega", item);
+  Py_DECREF(item);
+  item = FromVectorPyTuple(kx);
+  PyDict_SetItemString(result, "kx", item);
+  Py_DECREF(item);
+  item = FromVectorPyTuple(ky);
+  PyDict_SetItemString(result, "ky", item);
+  Py_DECREF(item);
+  item = PyTuple_New(phi.size());
+  for(size_t p = 0; p < phi.size(); p++){
+    PyTuple_SetItem(item, p, FromVectorPyTuple(phi[p]));
+  }
+  PyDict_SetItemString(result, "phi", item);
+  Py_DECREF(item);
+  return result;
+}
+
 /* MODULE codie function table */
 static PyMethodDef MESH_module_methods[] = {
   {"Constants", MESH_Constants, METH_VARARGS | METH_KEYWORDS,"Physical Constants" },
   {"Usage"    , MESH_Usage    , METH_VARARGS | METH_KEYWORDS,"Instructions"       },
   {"Version"  , MESH_Version  , METH_VARARGS | METH_KEYWORDS,"Version information"},
+  {"ReadIntermediate", (PyCFunction) MESH_ReadIntermediate, METH_VARARGS | METH_KEYWORDS, "Reading a binary intermediate file"},
   {NULL, NULL, 0, NULL}        /* Sentinel */
 };
 
@@ -1980,6 +3251,8 @@ PyDoc_STRVAR(module_doc, "MESH: Multilayer Electromagnetic Solver for Heat trans
   // Create the class types
   if (PyType_Ready(&MESH_Interpolator_Type) < 0)
     INITERROR;
+  if (PyType_Ready(&MESH_IntegrationHandle_Type) < 0)
+    INITERROR;
   if (PyType_Ready(&MESH_SimulationPlanar_Type) < 0)
     INITERROR;
   if (PyType_Ready(&MESH_SimulationGrating_Type) < 0)
@@ -2006,6 +3279,9 @@ PyDoc_STRVAR(module_doc, "MESH: Multilayer Electromagnetic Solver for Heat trans
   Py_INCREF(&MESH_Interpolator_Type);
   PyModule_AddObject(module, "Interpolator", (PyObject *)&MESH_Interpolator_Type);
 
+  Py_INCREF(&MESH_IntegrationHandle_Type);
+  PyModule_AddObject(module, "IntegrationHandle", (PyObject *)&MESH_IntegrationHandle_Type);
+
   Py_INCREF(&MESH_SimulationPlanar_Type);
   PyModule_AddObject(module, "SimulationPlanar", (PyObject *)&MESH_SimulationPlanar_Type);
 